@@ -101,79 +101,55 @@ const char *accelerateKernels =
   STRINGIFY(
     typedef enum
     {
-      UndefinedCompositeOp,
-      AlphaCompositeOp,
+      UndefinedCompositeOp = 0,
+      OverCompositeOp,
+      InCompositeOp,
+      OutCompositeOp,
       AtopCompositeOp,
-      BlendCompositeOp,
-      BlurCompositeOp,
+      XorCompositeOp,
+      PlusCompositeOp,
+      MinusCompositeOp,
+      AddCompositeOp,
+      SubtractCompositeOp,
+      DifferenceCompositeOp,
+      MultiplyCompositeOp,
       BumpmapCompositeOp,
-      ChangeMaskCompositeOp,
+      CopyCompositeOp,
+      CopyRedCompositeOp,
+      CopyGreenCompositeOp,
+      CopyBlueCompositeOp,
+      CopyOpacityCompositeOp,
       ClearCompositeOp,
-      ColorBurnCompositeOp,
-      ColorDodgeCompositeOp,
+      DissolveCompositeOp,
+      DisplaceCompositeOp,
+      ModulateCompositeOp,
+      ThresholdCompositeOp,
+      NoCompositeOp,
+      DarkenCompositeOp,
+      LightenCompositeOp,
+      HueCompositeOp,
+      SaturateCompositeOp,
       ColorizeCompositeOp,
-      CopyBlackCompositeOp,
-      CopyBlueCompositeOp,
-      CopyCompositeOp,
+      LuminizeCompositeOp,
+      ScreenCompositeOp,
+      OverlayCompositeOp,
       CopyCyanCompositeOp,
-      CopyGreenCompositeOp,
       CopyMagentaCompositeOp,
-      CopyAlphaCompositeOp,
-      CopyRedCompositeOp,
       CopyYellowCompositeOp,
-      DarkenCompositeOp,
-      DarkenIntensityCompositeOp,
-      DifferenceCompositeOp,
-      DisplaceCompositeOp,
-      DissolveCompositeOp,
-      DistortCompositeOp,
-      DivideDstCompositeOp,
-      DivideSrcCompositeOp,
-      DstAtopCompositeOp,
-      DstCompositeOp,
-      DstInCompositeOp,
-      DstOutCompositeOp,
-      DstOverCompositeOp,
-      ExclusionCompositeOp,
+      CopyBlackCompositeOp,
+      DivideCompositeOp,
       HardLightCompositeOp,
-      HardMixCompositeOp,
-      HueCompositeOp,
-      InCompositeOp,
-      IntensityCompositeOp,
-      LightenCompositeOp,
-      LightenIntensityCompositeOp,
+      ExclusionCompositeOp,
+      ColorDodgeCompositeOp,
+      ColorBurnCompositeOp,
+      SoftLightCompositeOp,
       LinearBurnCompositeOp,
       LinearDodgeCompositeOp,
       LinearLightCompositeOp,
-      LuminizeCompositeOp,
-      MathematicsCompositeOp,
-      MinusDstCompositeOp,
-      MinusSrcCompositeOp,
-      ModulateCompositeOp,
-      ModulusAddCompositeOp,
-      ModulusSubtractCompositeOp,
-      MultiplyCompositeOp,
-      NoCompositeOp,
-      OutCompositeOp,
-      OverCompositeOp,
-      OverlayCompositeOp,
-      PegtopLightCompositeOp,
-      PinLightCompositeOp,
-      PlusCompositeOp,
-      ReplaceCompositeOp,
-      SaturateCompositeOp,
-      ScreenCompositeOp,
-      SoftLightCompositeOp,
-      SrcAtopCompositeOp,
-      SrcCompositeOp,
-      SrcInCompositeOp,
-      SrcOutCompositeOp,
-      SrcOverCompositeOp,
-      ThresholdCompositeOp,
       VividLightCompositeOp,
-      XorCompositeOp,
-      StereoCompositeOp
-    } CompositeOperator;
+      PinLightCompositeOp,
+      HardMixCompositeOp
+    } CompositeOperator;  /* must correspond to magick/image.h */
   )
 
   STRINGIFY(
@@ -323,7 +299,7 @@ OPENCL_ELIF((MAGICKCORE_QUANTUM_DEPTH == 32))
   STRINGIFY(
     static inline CLQuantum ScaleCharToQuantum(const unsigned char value)
     {
-      return((CLQuantum) (16843009.0*value));
+      return((CLQuantum) (16843009.0f*value));
     }
   )
 
@@ -338,6 +314,18 @@ OPENCL_IF((MAGICKCORE_HDRI_SUPPORT == 1))
       }
   )
 
+OPENCL_ELIF((MAGICKCORE_QUANTUM_DEPTH == 32))
+
+  STRINGIFY(
+    static inline CLQuantum ClampToQuantum(const float value)
+      {
+        /* QuantumRange rounds up to 2^32 as a float */
+        if (value >= QuantumRange)
+          return ((CLQuantum) 0xffffffffU);
+        return (CLQuantum) (clamp(value, 0.0f, QuantumRange) + 0.5f);
+      }
+  )
+
 OPENCL_ELSE()
 
   STRINGIFY(
@@ -356,6 +344,23 @@ OPENCL_ENDIF()
       }
   )
 
+OPENCL_IF((MAGICKCORE_QUANTUM_DEPTH == 32))
+
+  STRINGIFY(
+    static inline uint ScaleQuantumToMap(CLQuantum value)
+      {
+        /* the map of a 32 bit quantum has 16 bits */
+        return ((uint) (value/65537U));
+      }
+
+    static inline CLQuantum ScaleMapToQuantum(const uint value)
+      {
+        return ((CLQuantum) (65537U*value));
+      }
+  )
+
+OPENCL_ELSE()
+
   STRINGIFY(
     static inline uint ScaleQuantumToMap(CLQuantum value)
       {
@@ -364,8 +369,15 @@ OPENCL_ENDIF()
         else 
           return ((uint)value);
       }
+
+    static inline CLQuantum ScaleMapToQuantum(const uint value)
+      {
+        return ((CLQuantum) value);
+      }
   )
 
+OPENCL_ENDIF()
+
   STRINGIFY(
     static inline float PerceptibleReciprocal(const float x)
     {
@@ -916,12 +928,16 @@ OPENCL_ENDIF()
 
   STRINGIFY(
   /*
-  Reduce image noise and reduce detail levels by row
+  Reduce image noise and reduce detail levels by row.  When normalizeEdges
+  is set the taps which fall outside of the image are left out and the
+  remaining weights are scaled back to one (like BlurImage() does on the
+  CPU), otherwise the edge pixels are repeated.
   */
   __kernel void BlurRow(const __global CLQuantum *image,
     const unsigned int number_channels,const ChannelType channel,
     __constant float *filter,const unsigned int width,
     const unsigned int imageColumns,const unsigned int imageRows,
+    const unsigned int normalizeEdges,
     __local float4 *temp,__global float4 *tempImage)
   {
     const int x = get_global_id(0);
@@ -954,15 +970,35 @@ OPENCL_ENDIF()
 
       int i = 0;
 
-      for ( ; i+7 < width; )
+      if ((normalizeEdges != 0) &&
+          ((x < (int) radius) || (x+(int) radius >= columns)))
       {
-        for (int j=0; j < 8; j++)
-          result+=filter[i+j]*temp[i+j+get_local_id(0)];
-        i+=8;
+        float scale = 0.0f;
+
+        for ( ; i < width; i++)
+        {
+          const int cx = x+i-(int) radius;
+
+          if ((cx >= 0) && (cx < columns))
+          {
+            result+=filter[i]*temp[i+get_local_id(0)];
+            scale+=filter[i];
+          }
+        }
+        result/=scale;
       }
+      else
+      {
+        for ( ; i+7 < width; )
+        {
+          for (int j=0; j < 8; j++)
+            result+=filter[i+j]*temp[i+j+get_local_id(0)];
+          i+=8;
+        }
 
-      for ( ; i < width; i++)
-        result+=filter[i]*temp[i+get_local_id(0)];
+        for ( ; i < width; i++)
+          result+=filter[i]*temp[i+get_local_id(0)];
+      }
 
       // write back to global
       tempImage[y*columns+x] = result;
@@ -972,12 +1008,14 @@ OPENCL_ENDIF()
 
   STRINGIFY(
   /*
-  Reduce image noise and reduce detail levels by line
+  Reduce image noise and reduce detail levels by line, the edges are
+  handled like by BlurRow
   */
   __kernel void BlurColumn(const __global float4 *blurRowData,
     const unsigned int number_channels,const ChannelType channel,
     __constant float *filter,const unsigned int width,
     const unsigned int imageColumns,const unsigned int imageRows,
+    const unsigned int normalizeEdges,
     __local float4 *temp,__global CLQuantum *filteredImage)
   {
     const int x = get_global_id(0);
@@ -1011,15 +1049,35 @@ OPENCL_ENDIF()
 
       int i = 0;
 
-      for ( ; i+7 < width; )
+      if ((normalizeEdges != 0) &&
+          ((y < (int) radius) || (y+(int) radius >= rows)))
       {
-        for (int j=0; j < 8; j++)
-          result+=filter[i+j]*temp[i+j+get_local_id(1)];
-        i+=8;
+        float scale = 0.0f;
+
+        for ( ; i < width; i++)
+        {
+          const int cy = y+i-(int) radius;
+
+          if ((cy >= 0) && (cy < rows))
+          {
+            result+=filter[i]*temp[i+get_local_id(1)];
+            scale+=filter[i];
+          }
+        }
+        result/=scale;
       }
+      else
+      {
+        for ( ; i+7 < width; )
+        {
+          for (int j=0; j < 8; j++)
+            result+=filter[i+j]*temp[i+j+get_local_id(1)];
+          i+=8;
+        }
 
-      for ( ; i < width; i++)
-        result+=filter[i]*temp[i+get_local_id(1)];
+        for ( ; i < width; i++)
+          result+=filter[i]*temp[i+get_local_id(1)];
+      }
 
       // write back to global
       WriteFloat4(filteredImage, number_channels, columns, x, y, channel, result);
@@ -1027,6 +1085,558 @@ OPENCL_ENDIF()
   }
   )
 
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%    C o m p o s i t e                                                        %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+  OPENCL_DEFINE(OpaqueOpacity, ((CLQuantum) 0U))
+  OPENCL_DEFINE(TransparentOpacity, ((CLQuantum) ~0U))
+
+OPENCL_IF((MAGICKCORE_QUANTUM_DEPTH == 32))
+
+  STRINGIFY(
+    static inline float CompositeIntensity(const CLPixelType pixel)
+    {
+      /* like PixelIntensityRec601() */
+      return(floor((306.0f*getRed(pixel)+601.0f*getGreen(pixel)+
+        117.0f*getBlue(pixel))/1024.0f));
+    }
+  )
+
+OPENCL_ELSE()
+
+  STRINGIFY(
+    static inline float CompositeIntensity(const CLPixelType pixel)
+    {
+      /* like PixelIntensityRec601() */
+      return((float) ((306U*(uint) getRed(pixel)+601U*(uint) getGreen(pixel)+
+        117U*(uint) getBlue(pixel)) >> 10));
+    }
+  )
+
+OPENCL_ENDIF()
+
+  STRINGIFY(
+    /*
+      The blend functions of the separable operators of composite.c, these
+      all share the same opacity handling (see BlendCompositePixel()).
+    */
+    static inline float BlendCompositeChannel(const CompositeOperator compose,
+      const float source,const float destination)
+    {
+      float
+        ramp;
+
+      switch (compose)
+      {
+        case DifferenceCompositeOp:
+          return(fabs(source-destination));
+        case MultiplyCompositeOp:
+          return(source*destination/QuantumRange);
+        case DarkenCompositeOp:
+          return(MagickMin(source,destination));
+        case LightenCompositeOp:
+          return(MagickMax(source,destination));
+        case ScreenCompositeOp:
+          return(source+destination-source*destination/QuantumRange);
+        case OverlayCompositeOp:
+          if (destination < (0.5f*QuantumRange))
+            return(2.0f*source*destination/QuantumRange);
+          return(QuantumRange*(1.0f-2.0f*(1.0f-source/QuantumRange)*
+            (1.0f-destination/QuantumRange)));
+        case HardLightCompositeOp:
+          if (source <= (0.5f*QuantumRange))
+            return(2.0f*source*destination/QuantumRange);
+          return(QuantumRange*(1.0f-2.0f*(1.0f-source/QuantumRange)*
+            (1.0f-destination/QuantumRange)));
+        case ExclusionCompositeOp:
+          return(source+destination-2.0f*source*destination/QuantumRange);
+        case ColorDodgeCompositeOp:
+          if (source == QuantumRange)
+            return(QuantumRange);
+          return(MagickMin(QuantumRange,destination/
+            (1.0f-source/QuantumRange)));
+        case ColorBurnCompositeOp:
+          if (source == 0.0f)
+            return(0.0f);
+          return(QuantumRange-MagickMin(QuantumRange,
+            (QuantumRange-destination)/(source/QuantumRange)));
+        case SoftLightCompositeOp:
+          if (source <= (0.5f*QuantumRange))
+            return(destination*(1.0f-(1.0f-destination/QuantumRange)*
+              (1.0f-2.0f*source/QuantumRange)));
+          if (destination <= (0.25f*QuantumRange))
+            ramp=((16.0f*(destination/QuantumRange)-12.0f)*
+              (destination/QuantumRange)+4.0f)*destination/QuantumRange;
+          else
+            ramp=sqrt(destination/QuantumRange);
+          return(destination+(2.0f*source-QuantumRange)*
+            (ramp-destination/QuantumRange));
+        case LinearBurnCompositeOp:
+          return(MagickMax(0.0f,source+destination-QuantumRange));
+        case LinearDodgeCompositeOp:
+          return(MagickMin(QuantumRange,source+destination));
+        case LinearLightCompositeOp:
+          return(clamp(2.0f*source+destination-QuantumRange,0.0f,
+            QuantumRange));
+        case VividLightCompositeOp:
+          if (source == QuantumRange)
+            return(QuantumRange);
+          if (source == 0.0f)
+            return(0.0f);
+          if (source >= (0.5f*QuantumRange))
+            return(MagickMin(QuantumRange,destination/
+              (2.0f-2.0f*source/QuantumRange)));
+          return(MagickMax(0.0f,(destination+2.0f*source-QuantumRange)/
+            (2.0f*source/QuantumRange)));
+        case PinLightCompositeOp:
+          if (source >= (0.5f*QuantumRange))
+            return(MagickMax(destination,2.0f*(source-0.5f*QuantumRange)));
+          return(MagickMin(destination,2.0f*source));
+        case HardMixCompositeOp:
+          return((source+destination) < QuantumRange ? 0.0f : QuantumRange);
+        default:
+          break;
+      }
+      return(destination);
+    }
+
+    static inline CLQuantum BlendCompositeQuantum(
+      const CompositeOperator compose,const float source,
+      const float destination,const float source_alpha,
+      const float dest_alpha,const float gamma)
+    {
+      return(ClampToQuantum((BlendCompositeChannel(compose,source,destination)*
+        (1.0f-source_alpha)*(1.0f-dest_alpha)+
+        source*(1.0f-source_alpha)*dest_alpha+
+        destination*(1.0f-dest_alpha)*source_alpha)*gamma));
+    }
+
+    static inline CLPixelType BlendCompositePixel(
+      const CompositeOperator compose,const CLPixelType source,
+      const CLPixelType destination)
+    {
+      CLPixelType
+        composite;
+
+      float
+        dest_alpha,
+        gamma,
+        source_alpha;
+
+      source_alpha=QuantumScale*getAlpha(source);
+      dest_alpha=QuantumScale*getAlpha(destination);
+      gamma=(1.0f-source_alpha)+(1.0f-dest_alpha)-
+        (1.0f-source_alpha)*(1.0f-dest_alpha);
+      gamma=clamp(gamma,0.0f,1.0f);
+      setAlpha(&composite,ClampToQuantum(QuantumRange*(1.0f-gamma)));
+      gamma=1.0f/(fabs(gamma) < MagickEpsilon ? MagickEpsilon : gamma);
+      setRed(&composite,BlendCompositeQuantum(compose,getRed(source),
+        getRed(destination),source_alpha,dest_alpha,gamma));
+      setGreen(&composite,BlendCompositeQuantum(compose,getGreen(source),
+        getGreen(destination),source_alpha,dest_alpha,gamma));
+      setBlue(&composite,BlendCompositeQuantum(compose,getBlue(source),
+        getBlue(destination),source_alpha,dest_alpha,gamma));
+      return(composite);
+    }
+  )
+
+  STRINGIFY(
+    static inline CLPixelType OverCompositePixel(const CLPixelType source,
+      const CLPixelType destination)
+    {
+      CLPixelType
+        composite;
+
+      float
+        delta,
+        dest_alpha,
+        source_alpha;
+
+      /* like AlphaCompositePixel() */
+      if (getAlpha(source) == TransparentOpacity)
+        return(destination);
+      source_alpha=QuantumScale*getAlpha(source);
+      dest_alpha=QuantumScale*getAlpha(destination);
+      delta=1.0f-source_alpha*dest_alpha;
+      setAlpha(&composite,ClampToQuantum(QuantumRange*(1.0f-delta)));
+      delta=1.0f/(delta <= MagickEpsilon ? 1.0f : delta);
+      setRed(&composite,ClampToQuantum(delta*((1.0f-source_alpha)*
+        getRed(source)+(1.0f-dest_alpha)*getRed(destination)*source_alpha)));
+      setGreen(&composite,ClampToQuantum(delta*((1.0f-source_alpha)*
+        getGreen(source)+(1.0f-dest_alpha)*getGreen(destination)*
+        source_alpha)));
+      setBlue(&composite,ClampToQuantum(delta*((1.0f-source_alpha)*
+        getBlue(source)+(1.0f-dest_alpha)*getBlue(destination)*
+        source_alpha)));
+      return(composite);
+    }
+
+    static inline CLPixelType InCompositePixel(const CLPixelType source,
+      const CLPixelType destination)
+    {
+      CLPixelType
+        composite;
+
+      float
+        opacity;
+
+      if (getAlpha(source) == TransparentOpacity)
+        return(source);
+      if (getAlpha(destination) == TransparentOpacity)
+        return(destination);
+      /* the color terms of InCompositePixels() reduce to the source color */
+      opacity=(QuantumRange-getAlpha(source))*
+        (QuantumRange-getAlpha(destination))/QuantumRange;
+      composite=source;
+      setAlpha(&composite,ClampToQuantum(QuantumRange-opacity));
+      return(composite);
+    }
+
+    static inline CLPixelType OutCompositePixel(const CLPixelType source,
+      const CLPixelType destination)
+    {
+      CLPixelType
+        composite;
+
+      float
+        opacity;
+
+      if (getAlpha(source) == TransparentOpacity)
+        return(source);
+      composite=destination;
+      if (getAlpha(destination) == OpaqueOpacity)
+        {
+          setAlpha(&composite,TransparentOpacity);
+          return(composite);
+        }
+      /* the color terms of OutCompositePixels() reduce to the source color */
+      opacity=(QuantumRange-getAlpha(source))*getAlpha(destination)/
+        QuantumRange;
+      composite=source;
+      setAlpha(&composite,ClampToQuantum(QuantumRange-opacity));
+      return(composite);
+    }
+
+    static inline CLPixelType AtopCompositePixel(const CLPixelType source,
+      const CLPixelType destination)
+    {
+      CLPixelType
+        composite;
+
+      float
+        source_alpha;
+
+      /*
+        AtopCompositePixel() divides by the canvas coverage that it also
+        multiplies with, so only the source opacity remains.  Over a fully
+        transparent canvas that quotient is undefined and the CPU yields
+        black.
+      */
+      if (getAlpha(destination) == TransparentOpacity)
+        {
+          setRed(&composite,0);
+          setGreen(&composite,0);
+          setBlue(&composite,0);
+          setAlpha(&composite,TransparentOpacity);
+          return(composite);
+        }
+      source_alpha=QuantumScale*getAlpha(source);
+      setRed(&composite,ClampToQuantum((1.0f-source_alpha)*getRed(source)+
+        source_alpha*getRed(destination)));
+      setGreen(&composite,ClampToQuantum((1.0f-source_alpha)*
+        getGreen(source)+source_alpha*getGreen(destination)));
+      setBlue(&composite,ClampToQuantum((1.0f-source_alpha)*getBlue(source)+
+        source_alpha*getBlue(destination)));
+      setAlpha(&composite,getAlpha(destination));
+      return(composite);
+    }
+
+    static inline CLPixelType XorCompositePixel(const CLPixelType source,
+      const CLPixelType destination)
+    {
+      CLPixelType
+        composite;
+
+      float
+        dest_alpha,
+        gamma,
+        source_alpha;
+
+      source_alpha=QuantumScale*getAlpha(source);
+      dest_alpha=QuantumScale*getAlpha(destination);
+      gamma=(1.0f-source_alpha)+(1.0f-dest_alpha)-
+        2.0f*(1.0f-source_alpha)*(1.0f-dest_alpha);
+      setAlpha(&composite,ClampToQuantum(QuantumRange*(1.0f-gamma)));
+      gamma=1.0f/(gamma <= MagickEpsilon ? 1.0f : gamma);
+      setRed(&composite,ClampToQuantum(((1.0f-source_alpha)*getRed(source)*
+        dest_alpha+(1.0f-dest_alpha)*getRed(destination)*source_alpha)*
+        gamma));
+      setGreen(&composite,ClampToQuantum(((1.0f-source_alpha)*
+        getGreen(source)*dest_alpha+(1.0f-dest_alpha)*getGreen(destination)*
+        source_alpha)*gamma));
+      setBlue(&composite,ClampToQuantum(((1.0f-source_alpha)*getBlue(source)*
+        dest_alpha+(1.0f-dest_alpha)*getBlue(destination)*source_alpha)*
+        gamma));
+      return(composite);
+    }
+  )
+
+  STRINGIFY(
+    static inline CLQuantum AddCompositeQuantum(const float source,
+      const float destination)
+    {
+      float
+        value;
+
+      value=source+destination;
+      if (value > QuantumRange)
+        value-=QuantumRange+1.0f;
+      return(ClampToQuantum(value));
+    }
+
+    static inline CLQuantum SubtractCompositeQuantum(const float source,
+      const float destination)
+    {
+      float
+        value;
+
+      value=source-destination;
+      if (value < 0.0f)
+        value+=QuantumRange+1.0f;
+      return(ClampToQuantum(value));
+    }
+
+    static inline CLQuantum ThresholdCompositeQuantum(const float source,
+      const float destination,const float amount,const float threshold)
+    {
+      float
+        value;
+
+      value=destination-source;
+      if (fabs(2.0f*value) < threshold)
+        value=destination;
+      else
+        value=destination+(value*amount);
+      return(ClampToQuantum(value));
+    }
+
+    static inline CLQuantum DivideCompositeQuantum(const float source,
+      const float destination)
+    {
+      /* avoid division by zero, use a value near zero instead */
+      return(ClampToQuantum(source*QuantumRange/(destination != 0.0f ?
+        destination : 1.0f/QuantumRange)));
+    }
+
+    static inline CLPixelType ArithmeticCompositePixel(
+      const CompositeOperator compose,const CLPixelType source,
+      const CLPixelType destination,const float amount,const float threshold)
+    {
+      CLPixelType
+        composite;
+
+      float
+        dest_coverage,
+        intensity,
+        source_coverage;
+
+      source_coverage=QuantumRange-getAlpha(source);
+      dest_coverage=QuantumRange-getAlpha(destination);
+      composite=destination;
+      switch (compose)
+      {
+        case PlusCompositeOp:
+          setRed(&composite,ClampToQuantum((source_coverage*getRed(source)+
+            dest_coverage*getRed(destination))/QuantumRange));
+          setGreen(&composite,ClampToQuantum((source_coverage*
+            getGreen(source)+dest_coverage*getGreen(destination))/
+            QuantumRange));
+          setBlue(&composite,ClampToQuantum((source_coverage*getBlue(source)+
+            dest_coverage*getBlue(destination))/QuantumRange));
+          setAlpha(&composite,TransparentOpacity-ClampToQuantum(
+            (source_coverage+dest_coverage)/QuantumRange));
+          break;
+        case MinusCompositeOp:
+          setRed(&composite,ClampToQuantum((dest_coverage*getRed(destination)-
+            source_coverage*getRed(source))/QuantumRange));
+          setGreen(&composite,ClampToQuantum((dest_coverage*
+            getGreen(destination)-source_coverage*getGreen(source))/
+            QuantumRange));
+          setBlue(&composite,ClampToQuantum((dest_coverage*
+            getBlue(destination)-source_coverage*getBlue(source))/
+            QuantumRange));
+          setAlpha(&composite,TransparentOpacity-ClampToQuantum(
+            (dest_coverage-source_coverage)/QuantumRange));
+          break;
+        case AddCompositeOp:
+          setRed(&composite,AddCompositeQuantum(getRed(source),
+            getRed(destination)));
+          setGreen(&composite,AddCompositeQuantum(getGreen(source),
+            getGreen(destination)));
+          setBlue(&composite,AddCompositeQuantum(getBlue(source),
+            getBlue(destination)));
+          setAlpha(&composite,OpaqueOpacity);
+          break;
+        case SubtractCompositeOp:
+          setRed(&composite,SubtractCompositeQuantum(getRed(source),
+            getRed(destination)));
+          setGreen(&composite,SubtractCompositeQuantum(getGreen(source),
+            getGreen(destination)));
+          setBlue(&composite,SubtractCompositeQuantum(getBlue(source),
+            getBlue(destination)));
+          setAlpha(&composite,OpaqueOpacity);
+          break;
+        case DissolveCompositeOp:
+          setRed(&composite,ClampToQuantum((getAlpha(source)*getRed(source)+
+            source_coverage*getRed(destination))/QuantumRange));
+          setGreen(&composite,ClampToQuantum((getAlpha(source)*
+            getGreen(source)+source_coverage*getGreen(destination))/
+            QuantumRange));
+          setBlue(&composite,ClampToQuantum((getAlpha(source)*
+            getBlue(source)+source_coverage*getBlue(destination))/
+            QuantumRange));
+          setAlpha(&composite,OpaqueOpacity);
+          break;
+        case BumpmapCompositeOp:
+          intensity=CompositeIntensity(source)/QuantumRange;
+          setRed(&composite,ClampToQuantum(intensity*getRed(destination)));
+          setGreen(&composite,ClampToQuantum(intensity*getGreen(destination)));
+          setBlue(&composite,ClampToQuantum(intensity*getBlue(destination)));
+          setAlpha(&composite,ClampToQuantum(intensity*getAlpha(destination)));
+          break;
+        case ThresholdCompositeOp:
+          setRed(&composite,ThresholdCompositeQuantum(getRed(source),
+            getRed(destination),amount,threshold));
+          setGreen(&composite,ThresholdCompositeQuantum(getGreen(source),
+            getGreen(destination),amount,threshold));
+          setBlue(&composite,ThresholdCompositeQuantum(getBlue(source),
+            getBlue(destination),amount,threshold));
+          setAlpha(&composite,ThresholdCompositeQuantum(getAlpha(source),
+            getAlpha(destination),amount,threshold));
+          break;
+        case DivideCompositeOp:
+          setRed(&composite,DivideCompositeQuantum(getRed(source),
+            getRed(destination)));
+          setGreen(&composite,DivideCompositeQuantum(getGreen(source),
+            getGreen(destination)));
+          setBlue(&composite,DivideCompositeQuantum(getBlue(source),
+            getBlue(destination)));
+          setAlpha(&composite,DivideCompositeQuantum(getAlpha(source),
+            getAlpha(destination)));
+          break;
+        default:
+          break;
+      }
+      return(composite);
+    }
+  )
+
+  STRINGIFY(
+    /*
+      Composites the source region on the canvas region of the same size,
+      the work item (x,y) handles the pixel at that offset within both
+      regions.  The canvas is updated in place.
+    */
+    __kernel void Composite(__global CLPixelType *canvas,
+      const unsigned int canvasColumns,const unsigned int canvasX,
+      const unsigned int canvasY,const unsigned int canvasMatte,
+      const __global CLPixelType *source,const unsigned int sourceColumns,
+      const unsigned int sourceX,const unsigned int sourceY,
+      const unsigned int sourceMatte,const unsigned int compose,
+      const float amount,const float threshold)
+    {
+      const unsigned int x=get_global_id(0);
+      const unsigned int y=get_global_id(1);
+      const size_t c=(size_t) (canvasY+y)*canvasColumns+canvasX+x;
+
+      CLPixelType
+        destination,
+        pixel;
+
+      pixel=source[(size_t) (sourceY+y)*sourceColumns+sourceX+x];
+      destination=canvas[c];
+
+      /* the channel copies use the stored pixels */
+      switch (compose)
+      {
+        case CopyCompositeOp:
+          canvas[c]=pixel;
+          return;
+        case CopyRedCompositeOp:
+          setRed(&destination,getRed(pixel));
+          canvas[c]=destination;
+          return;
+        case CopyGreenCompositeOp:
+          setGreen(&destination,getGreen(pixel));
+          canvas[c]=destination;
+          return;
+        case CopyBlueCompositeOp:
+          setBlue(&destination,getBlue(pixel));
+          canvas[c]=destination;
+          return;
+        case CopyOpacityCompositeOp:
+          setAlpha(&destination,sourceMatte != 0 ? getAlpha(pixel) :
+            ClampToQuantum(QuantumRange-CompositeIntensity(pixel)));
+          canvas[c]=destination;
+          return;
+        case ClearCompositeOp:
+          setAlpha(&destination,TransparentOpacity);
+          canvas[c]=destination;
+          return;
+        default:
+          break;
+      }
+
+      /* like PrepareSourcePacket() and PrepareDestinationPacket() */
+      if (sourceMatte == 0)
+        setAlpha(&pixel,OpaqueOpacity);
+      if (canvasMatte == 0)
+        setAlpha(&destination,OpaqueOpacity);
+      switch (compose)
+      {
+        case OverCompositeOp:
+          destination=OverCompositePixel(pixel,destination);
+          break;
+        case InCompositeOp:
+          destination=InCompositePixel(pixel,destination);
+          break;
+        case OutCompositeOp:
+          destination=OutCompositePixel(pixel,destination);
+          break;
+        case AtopCompositeOp:
+          destination=AtopCompositePixel(pixel,destination);
+          break;
+        case XorCompositeOp:
+          destination=XorCompositePixel(pixel,destination);
+          break;
+        case PlusCompositeOp:
+        case MinusCompositeOp:
+        case AddCompositeOp:
+        case SubtractCompositeOp:
+        case DissolveCompositeOp:
+        case BumpmapCompositeOp:
+        case ThresholdCompositeOp:
+        case DivideCompositeOp:
+          destination=ArithmeticCompositePixel(compose,pixel,destination,
+            amount,threshold);
+          break;
+        default:
+          destination=BlendCompositePixel(compose,pixel,destination);
+          break;
+      }
+      canvas[c]=destination;
+    }
+  )
+
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %                                                                             %
@@ -1041,6 +1651,129 @@ OPENCL_ENDIF()
 
   STRINGIFY(
 
+  static inline void ConvertRGBToHSL(const CLQuantum red,const CLQuantum green, const CLQuantum blue,
+    float *hue, float *saturation, float *lightness)
+  {
+  float
+    c,
+    tmax,
+    tmin;
+
+  /*
+     Convert RGB to HSL colorspace.
+     */
+  tmax=MagickMax(QuantumScale*red,MagickMax(QuantumScale*green, QuantumScale*blue));
+  tmin=MagickMin(QuantumScale*red,MagickMin(QuantumScale*green, QuantumScale*blue));
+
+  c=tmax-tmin;
+
+  *lightness=(tmax+tmin)/2.0;
+  if (c <= 0.0)
+  {
+    *hue=0.0;
+    *saturation=0.0;
+    return;
+  }
+
+  if (tmax == (QuantumScale*red))
+  {
+    *hue=(QuantumScale*green-QuantumScale*blue)/c;
+    if ((QuantumScale*green) < (QuantumScale*blue))
+      *hue+=6.0;
+  }
+  else
+    if (tmax == (QuantumScale*green))
+      *hue=2.0+(QuantumScale*blue-QuantumScale*red)/c;
+    else
+      *hue=4.0+(QuantumScale*red-QuantumScale*green)/c;
+
+  *hue*=60.0/360.0;
+  if (*lightness <= 0.5)
+    *saturation=c/(2.0*(*lightness));
+  else
+    *saturation=c/(2.0-2.0*(*lightness));
+  }
+
+  static inline void ConvertHSLToRGB(const float hue,const float saturation, const float lightness,
+      CLQuantum *red,CLQuantum *green,CLQuantum *blue)
+  {
+    float
+      b,
+      c,
+      g,
+      h,
+      tmin,
+      r,
+      x;
+
+    /*
+       Convert HSL to RGB colorspace.
+       */
+    h=hue*360.0;
+    if (lightness <= 0.5)
+      c=2.0*lightness*saturation;
+    else
+      c=(2.0-2.0*lightness)*saturation;
+    tmin=lightness-0.5*c;
+    h-=360.0*floor(h/360.0);
+    h/=60.0;
+    x=c*(1.0-fabs(h-2.0*floor(h/2.0)-1.0));
+    switch ((int) floor(h) % 6)
+    {
+      case 0:
+        {
+          r=tmin+c;
+          g=tmin+x;
+          b=tmin;
+          break;
+        }
+      case 1:
+        {
+          r=tmin+x;
+          g=tmin+c;
+          b=tmin;
+          break;
+        }
+      case 2:
+        {
+          r=tmin;
+          g=tmin+c;
+          b=tmin+x;
+          break;
+        }
+      case 3:
+        {
+          r=tmin;
+          g=tmin+x;
+          b=tmin+c;
+          break;
+        }
+      case 4:
+        {
+          r=tmin+x;
+          g=tmin;
+          b=tmin+c;
+          break;
+        }
+      case 5:
+        {
+          r=tmin+c;
+          g=tmin;
+          b=tmin+x;
+          break;
+        }
+      default:
+        {
+          r=0.0;
+          g=0.0;
+          b=0.0;
+        }
+    }
+    *red=ClampToQuantum(QuantumRange*r);
+    *green=ClampToQuantum(QuantumRange*g);
+    *blue=ClampToQuantum(QuantumRange*b);
+  }
+
   static inline float4 ConvertRGBToHSB(const float4 pixel)
   {
     float4 result=0.0f;
@@ -1126,25 +1859,41 @@ OPENCL_ENDIF()
     return(result);
   }
 
-  __kernel void Contrast(__global CLQuantum *image,
-    const unsigned int number_channels,const int sign)
+  __kernel void Contrast(__global CLPixelType *im,const int sign)
   {
     const int x=get_global_id(0);
     const int y=get_global_id(1);
-    const unsigned int columns=get_global_size(0);
+    const int columns=get_global_size(0);
+    const int c=x+y*columns;
 
-    float4 pixel=ReadAllChannels(image,number_channels,columns,x,y);
-    if (number_channels < 3)
-      pixel.y=pixel.z=pixel.x;
+    /* GM adjusts the lightness of HSL, see ContrastImage() */
+    const float alpha=0.5f+MagickEpsilon;
 
-    pixel=ConvertRGBToHSB(pixel);
-    float brightness=pixel.z;
-    brightness+=0.5f*sign*(0.5f*(sinpi(brightness-0.5f)+1.0f)-brightness);
-    brightness=clamp(brightness,0.0f,1.0f);
-    pixel.z=brightness;
-    pixel=ConvertHSBToRGB(pixel);
+    CLPixelType pixel=im[c];
+
+    CLQuantum
+      blue,
+      green,
+      red;
+
+    float
+      hue,
+      lightness,
+      saturation;
+
+    red=getRed(pixel);
+    green=getGreen(pixel);
+    blue=getBlue(pixel);
 
-    WriteAllChannels(image,number_channels,columns,x,y,pixel);
+    ConvertRGBToHSL(red,green,blue,&hue,&saturation,&lightness);
+    lightness+=alpha*sign*(alpha*(sinpi(lightness-alpha)+1.0f)-lightness);
+    lightness=clamp(lightness,0.0f,1.0f);
+    ConvertHSLToRGB(hue,saturation,lightness,&red,&green,&blue);
+
+    setRed(&pixel,red);
+    setGreen(&pixel,green);
+    setBlue(&pixel,blue);
+    im[c]=pixel;
   }
   )
 
@@ -1163,31 +1912,26 @@ OPENCL_ENDIF()
     STRINGIFY(
     /*
     */
-    __kernel void Histogram(__global CLPixelType * restrict im,
-      const ChannelType channel, 
-      const unsigned int colorspace,
-      const unsigned int method,
+    __kernel void Histogram(const __global CLPixelType * restrict im,
+      const unsigned int matte,
       __global uint4 * restrict histogram)
       {
         const int x = get_global_id(0);  
         const int y = get_global_id(1);  
         const int columns = get_global_size(0);  
         const int c = x + y * columns;
-        if ((channel & SyncChannels) != 0)
-        {
-          float red=(float)getRed(im[c]);
-          float green=(float)getGreen(im[c]);
-          float blue=(float)getBlue(im[c]);
 
-          float intensity = GetPixelIntensity(colorspace, method, red, green, blue);
-          uint pos = ScaleQuantumToMap(ClampToQuantum(intensity));
-          atomic_inc((__global uint *)(&(histogram[pos]))+2); //red position
-        }
-        else
-        {
-          // for equalizing, we always need all channels?
-          // otherwise something more
-        }
+        /*
+          One histogram per channel like BuildChannelHistograms(), the
+          counters are laid out like a CLPixelType.
+        */
+        const CLPixelType p = im[c];
+
+        atomic_inc((__global uint *)(&(histogram[ScaleQuantumToMap(getBlue(p))]))); //blue position
+        atomic_inc((__global uint *)(&(histogram[ScaleQuantumToMap(getGreen(p))]))+1); //green position
+        atomic_inc((__global uint *)(&(histogram[ScaleQuantumToMap(getRed(p))]))+2); //red position
+        if (matte != 0)
+          atomic_inc((__global uint *)(&(histogram[ScaleQuantumToMap(getAlpha(p))]))+3); //alpha position
       }
     )
 
@@ -1211,6 +1955,12 @@ OPENCL_ENDIF()
         //read from global
         oValue=im[c];
 
+        //channels that are not stretched keep their value
+        red=getRed(oValue);
+        green=getGreen(oValue);
+        blue=getBlue(oValue);
+        alpha=getAlpha(oValue);
+
         if ((channel & RedChannel) != 0)
         {
           if (getRedF4(white) != getRedF4(black))
@@ -1270,11 +2020,16 @@ OPENCL_ENDIF()
 */
 
   STRINGIFY(
+    /*
+      The filter is normalized by the host and applied to the opacity only
+      when the image has a matte channel, like ConvolveImage().  Each work
+      group caches its pixels and the filter in local memory.
+    */
     __kernel 
     void ConvolveOptimized(const __global CLPixelType *input, __global CLPixelType *output,
     const unsigned int imageWidth, const unsigned int imageHeight,
-    __constant float *filter, const unsigned int filterWidth, const unsigned int filterHeight,
-    const uint matte, const ChannelType channel, __local CLPixelType *pixelLocalCache, __local float* filterCache) {
+    const __global float *filter, const unsigned int filterWidth, const unsigned int filterHeight,
+    const uint matte, __local CLPixelType *pixelLocalCache, __local float* filterCache) {
 
       int2 blockID;
       blockID.x = get_global_id(0) / get_local_size(0);
@@ -1310,7 +2065,6 @@ OPENCL_ENDIF()
         imagePixelIndex = cachedAreaOrg + cachedAreaIndex;
 
         // only support EdgeVirtualPixelMethod through ClampToCanvas
-        // TODO: implement other virtual pixel method
         imagePixelIndex.x = ClampToCanvas(imagePixelIndex.x, imageWidth);
         imagePixelIndex.y = ClampToCanvas(imagePixelIndex.y, imageHeight);
 
@@ -1336,57 +2090,28 @@ OPENCL_ENDIF()
 
       int filterIndex = 0;
       float4 sum = (float4)0.0f;
-      float gamma = 0.0f;
-      if (((channel & AlphaChannel) == 0) || (matte == 0)) {
-        int cacheIndexY = get_local_id(1);
-        for (int j = 0; j < filterHeight; j++) {
-          int cacheIndexX = get_local_id(0);
-          for (int i = 0; i < filterWidth; i++) {
-            CLPixelType p = pixelLocalCache[cacheIndexY*cachedAreaDimen.x + cacheIndexX];
-            float f = filterCache[filterIndex];
-
-            sum.x += f * p.x;
-            sum.y += f * p.y;
-            sum.z += f * p.z; 
-            sum.w += f * p.w;
-
-            gamma += f;
-            filterIndex++;
-            cacheIndexX++;
-          }
-          cacheIndexY++;
-        }
-      }
-      else {
-        int cacheIndexY = get_local_id(1);
-        for (int j = 0; j < filterHeight; j++) {
-          int cacheIndexX = get_local_id(0);
-          for (int i = 0; i < filterWidth; i++) {
-
-            CLPixelType p = pixelLocalCache[cacheIndexY*cachedAreaDimen.x + cacheIndexX];
-            float alpha = QuantumScale*p.w;
-            float f = filterCache[filterIndex];
-            float g = alpha * f;
-
-            sum.x += g*p.x;
-            sum.y += g*p.y;
-            sum.z += g*p.z;
-            sum.w += f*p.w;
-
-            gamma += g;
-            filterIndex++;
-            cacheIndexX++;
-          }
-          cacheIndexY++;
+      int cacheIndexY = get_local_id(1);
+      for (int j = 0; j < filterHeight; j++) {
+        int cacheIndexX = get_local_id(0);
+        for (int i = 0; i < filterWidth; i++) {
+          CLPixelType p = pixelLocalCache[cacheIndexY*cachedAreaDimen.x + cacheIndexX];
+          float f = filterCache[filterIndex];
+
+          sum.x += f * p.x;
+          sum.y += f * p.y;
+          sum.z += f * p.z; 
+          sum.w += f * p.w;
+
+          filterIndex++;
+          cacheIndexX++;
         }
-        gamma = PerceptibleReciprocal(gamma);
-        sum.xyz = gamma*sum.xyz;
+        cacheIndexY++;
       }
       CLPixelType outputPixel;
       outputPixel.x = ClampToQuantum(sum.x);
       outputPixel.y = ClampToQuantum(sum.y);
       outputPixel.z = ClampToQuantum(sum.z);
-      outputPixel.w = ((channel & AlphaChannel)!=0)?ClampToQuantum(sum.w):input[imageIndex.y * imageWidth + imageIndex.x].w;
+      outputPixel.w = (matte != 0) ? ClampToQuantum(sum.w) : 0;
 
       output[imageIndex.y * imageWidth + imageIndex.x] = outputPixel;
     }
@@ -1396,17 +2121,13 @@ OPENCL_ENDIF()
     __kernel 
     void Convolve(const __global CLPixelType *input, __global CLPixelType *output,
                   const uint imageWidth, const uint imageHeight,
-                  __constant float *filter, const unsigned int filterWidth, const unsigned int filterHeight,
-                  const uint matte, const ChannelType channel) {
+                  const __global float *filter, const unsigned int filterWidth, const unsigned int filterHeight,
+                  const uint matte) {
 
       int2 imageIndex;
       imageIndex.x = get_global_id(0);
       imageIndex.y = get_global_id(1);
 
-      /*
-      unsigned int imageWidth = get_global_size(0);
-      unsigned int imageHeight = get_global_size(1);
-      */
       if (imageIndex.x >= imageWidth
           || imageIndex.y >= imageHeight)
           return;
@@ -1417,65 +2138,31 @@ OPENCL_ENDIF()
 
       int filterIndex = 0;
       float4 sum = (float4)0.0f;
-      float gamma = 0.0f;
-      if (((channel & AlphaChannel) == 0) || (matte == 0)) {
-        for (int j = 0; j < filterHeight; j++) {
-          int2 inputPixelIndex;
-          inputPixelIndex.y = imageIndex.y - midFilterDimen.y + j;
-          inputPixelIndex.y = ClampToCanvas(inputPixelIndex.y, imageHeight);
-          for (int i = 0; i < filterWidth; i++) {
-            inputPixelIndex.x = imageIndex.x - midFilterDimen.x + i;
-            inputPixelIndex.x = ClampToCanvas(inputPixelIndex.x, imageWidth);
-        
-            CLPixelType p = input[inputPixelIndex.y * imageWidth + inputPixelIndex.x];
-            float f = filter[filterIndex];
-
-            sum.x += f * p.x;
-            sum.y += f * p.y;
-            sum.z += f * p.z; 
-            sum.w += f * p.w;
-
-            gamma += f;
-
-            filterIndex++;
-          }
-        }
-      }
-      else {
-
-        for (int j = 0; j < filterHeight; j++) {
-          int2 inputPixelIndex;
-          inputPixelIndex.y = imageIndex.y - midFilterDimen.y + j;
-          inputPixelIndex.y = ClampToCanvas(inputPixelIndex.y, imageHeight);
-          for (int i = 0; i < filterWidth; i++) {
-            inputPixelIndex.x = imageIndex.x - midFilterDimen.x + i;
-            inputPixelIndex.x = ClampToCanvas(inputPixelIndex.x, imageWidth);
-        
-            CLPixelType p = input[inputPixelIndex.y * imageWidth + inputPixelIndex.x];
-            float alpha = QuantumScale*p.w;
-            float f = filter[filterIndex];
-            float g = alpha * f;
-
-            sum.x += g*p.x;
-            sum.y += g*p.y;
-            sum.z += g*p.z;
-            sum.w += f*p.w;
-
-            gamma += g;
-
-
-            filterIndex++;
-          }
+      for (int j = 0; j < filterHeight; j++) {
+        int2 inputPixelIndex;
+        inputPixelIndex.y = imageIndex.y - midFilterDimen.y + j;
+        inputPixelIndex.y = ClampToCanvas(inputPixelIndex.y, imageHeight);
+        for (int i = 0; i < filterWidth; i++) {
+          inputPixelIndex.x = imageIndex.x - midFilterDimen.x + i;
+          inputPixelIndex.x = ClampToCanvas(inputPixelIndex.x, imageWidth);
+
+          CLPixelType p = input[inputPixelIndex.y * imageWidth + inputPixelIndex.x];
+          float f = filter[filterIndex];
+
+          sum.x += f * p.x;
+          sum.y += f * p.y;
+          sum.z += f * p.z; 
+          sum.w += f * p.w;
+
+          filterIndex++;
         }
-        gamma = PerceptibleReciprocal(gamma);
-        sum.xyz = gamma*sum.xyz;
       }
 
       CLPixelType outputPixel;
       outputPixel.x = ClampToQuantum(sum.x);
       outputPixel.y = ClampToQuantum(sum.y);
       outputPixel.z = ClampToQuantum(sum.z);
-      outputPixel.w = ((channel & AlphaChannel)!=0)?ClampToQuantum(sum.w):input[imageIndex.y * imageWidth + imageIndex.x].w;
+      outputPixel.w = (matte != 0) ? ClampToQuantum(sum.w) : 0;
 
       output[imageIndex.y * imageWidth + imageIndex.x] = outputPixel;
     }
@@ -1516,17 +2203,18 @@ OPENCL_ENDIF()
                      && clampedNeighbor.y == neighbor.y)?inputImage[clampedNeighbor.y*imageWidth+clampedNeighbor.x]
     :(CLPixelType)0;
 
-    int sv[4];
-    sv[0] = (int)v.x;
-    sv[1] = (int)v.y;
-    sv[2] = (int)v.z;
-    sv[3] = (int)v.w;
+    /* like Hull(), signed and wide enough for a 32 bit quantum */
+    long sv[4];
+    sv[0] = (long)v.x;
+    sv[1] = (long)v.y;
+    sv[2] = (long)v.z;
+    sv[3] = (long)v.w;
 
-    int sr[4];
-    sr[0] = (int)r.x;
-    sr[1] = (int)r.y;
-    sr[2] = (int)r.z;
-    sr[3] = (int)r.w;
+    long sr[4];
+    sr[0] = (long)r.x;
+    sr[1] = (long)r.y;
+    sr[2] = (long)r.z;
+    sr[3] = (long)r.w;
 
     if (polarity > 0) {
       \n #pragma unroll 4\n
@@ -1589,23 +2277,23 @@ OPENCL_ENDIF()
     :(CLPixelType)0;
 
 
-    int sv[4];
-    sv[0] = (int)v.x;
-    sv[1] = (int)v.y;
-    sv[2] = (int)v.z;
-    sv[3] = (int)v.w;
+    long sv[4];
+    sv[0] = (long)v.x;
+    sv[1] = (long)v.y;
+    sv[2] = (long)v.z;
+    sv[3] = (long)v.w;
 
-    int sr[4];
-    sr[0] = (int)r.x;
-    sr[1] = (int)r.y;
-    sr[2] = (int)r.z;
-    sr[3] = (int)r.w;
+    long sr[4];
+    sr[0] = (long)r.x;
+    sr[1] = (long)r.y;
+    sr[2] = (long)r.z;
+    sr[3] = (long)r.w;
 
-    int ss[4];
-    ss[0] = (int)s.x;
-    ss[1] = (int)s.y;
-    ss[2] = (int)s.z;
-    ss[3] = (int)s.w;
+    long ss[4];
+    ss[0] = (long)s.x;
+    ss[1] = (long)s.y;
+    ss[2] = (long)s.z;
+    ss[3] = (long)s.w;
 
     if (polarity > 0) {
       \n #pragma unroll 4\n
@@ -1631,72 +2319,352 @@ OPENCL_ENDIF()
     v.y = (CLQuantum)sv[1];
     v.z = (CLQuantum)sv[2];
 
-    if (matte!=0)
-      v.w = (CLQuantum)sv[3];
+    if (matte!=0)
+      v.w = (CLQuantum)sv[3];
+
+    outputImage[y*imageWidth+x] = v;
+
+    }
+  )
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     D r a w A f f i n e                                                     %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+  STRINGIFY(
+    typedef enum
+    {
+      UndefinedVirtualPixelMethod,
+      ConstantVirtualPixelMethod,
+      EdgeVirtualPixelMethod,
+      MirrorVirtualPixelMethod,
+      TileVirtualPixelMethod
+    } VirtualPixelMethod;  /* must correspond to magick/pixel_cache.h */
+  )
+
+  STRINGIFY(
+    static inline int TileOffset(const int offset,const int range)
+    {
+      return(((offset % range)+range) % range);
+    }
+
+    static inline CLPixelType GetVirtualPixel(
+      const __global CLPixelType *image,const int columns,const int rows,
+      const int x,const int y,const unsigned int method,
+      const CLPixelType virtual_pixel)
+    {
+      int
+        u,
+        v;
+
+      if ((x >= 0) && (x < columns) && (y >= 0) && (y < rows))
+        return(image[y*columns+x]);
+      switch (method)
+      {
+        case ConstantVirtualPixelMethod:
+          return(virtual_pixel);
+        case MirrorVirtualPixelMethod:
+        {
+          u=((x >= 0) && (x < columns)) ? x : columns-TileOffset(x,columns)-1;
+          v=((y >= 0) && (y < rows)) ? y : rows-TileOffset(y,rows)-1;
+          break;
+        }
+        case TileVirtualPixelMethod:
+        {
+          u=TileOffset(x,columns);
+          v=TileOffset(y,rows);
+          break;
+        }
+        case EdgeVirtualPixelMethod:
+        default:
+        {
+          u=ClampToCanvas(x,columns);
+          v=ClampToCanvas(y,rows);
+          break;
+        }
+      }
+      return(image[v*columns+u]);
+    }
+
+    /*
+      Like InterpolateViewColor(), fully transparent neighbours do not
+      contribute to the color of a matte image.  Returns 0 when no
+      neighbour contributes at all.
+    */
+    static inline int InterpolatePixel(const __global CLPixelType *image,
+      const int columns,const int rows,const unsigned int matte,
+      const unsigned int method,const CLPixelType virtual_pixel,const int x,
+      const int y,const float x_offset,const float y_offset,
+      CLPixelType *color)
+    {
+      CLPixelType
+        p0,
+        p1,
+        p2,
+        p3;
+
+      float
+        alpha,
+        beta,
+        p0_area,
+        p1_area,
+        p2_area,
+        p3_area,
+        p_area;
+
+      p0=GetVirtualPixel(image,columns,rows,x,y,method,virtual_pixel);
+      p1=GetVirtualPixel(image,columns,rows,x+1,y,method,virtual_pixel);
+      p2=GetVirtualPixel(image,columns,rows,x,y+1,method,virtual_pixel);
+      p3=GetVirtualPixel(image,columns,rows,x+1,y+1,method,virtual_pixel);
+      alpha=x_offset-floor(x_offset);
+      beta=y_offset-floor(y_offset);
+      p0_area=((matte == 0) || (getAlpha(p0) != TransparentOpacity)) ?
+        (1.0f-beta)*(1.0f-alpha) : 0.0f;
+      p1_area=((matte == 0) || (getAlpha(p1) != TransparentOpacity)) ?
+        (1.0f-beta)*alpha : 0.0f;
+      p2_area=((matte == 0) || (getAlpha(p2) != TransparentOpacity)) ?
+        beta*(1.0f-alpha) : 0.0f;
+      p3_area=((matte == 0) || (getAlpha(p3) != TransparentOpacity)) ?
+        beta*alpha : 0.0f;
+      p_area=p0_area+p1_area+p2_area+p3_area;
+      if (p_area <= (0.5f/QuantumRange))
+        return(0);
+      setRed(color,ClampToQuantum((p0_area*getRed(p0)+p1_area*getRed(p1)+
+        p2_area*getRed(p2)+p3_area*getRed(p3))/p_area));
+      setGreen(color,ClampToQuantum((p0_area*getGreen(p0)+p1_area*
+        getGreen(p1)+p2_area*getGreen(p2)+p3_area*getGreen(p3))/p_area));
+      setBlue(color,ClampToQuantum((p0_area*getBlue(p0)+p1_area*getBlue(p1)+
+        p2_area*getBlue(p2)+p3_area*getBlue(p3))/p_area));
+      if (matte == 0)
+        setAlpha(color,OpaqueOpacity);
+      else
+        setAlpha(color,ClampToQuantum((1.0f-beta)*((1.0f-alpha)*
+          getAlpha(p0)+alpha*getAlpha(p1))+beta*((1.0f-alpha)*getAlpha(p2)+
+          alpha*getAlpha(p3))));
+      return(1);
+    }
+  )
+
+  STRINGIFY(
+    /*
+      Each row of the image is only written between the columns in spans,
+      which the host computes like DrawAffineImage().  The inverse affine
+      (sx, rx, ry, sy, tx, ty in s0 to s5) maps an image pixel to the
+      composite image.  With blend set the pixels are sampled and blended
+      over the image exactly like DrawAffineImage(), otherwise the
+      neighbourhood starts at the floor of the offset and replaces the
+      image pixel.
+    */
+    __kernel void DrawAffine(const __global CLPixelType *composite,
+      const unsigned int compositeColumns,const unsigned int compositeRows,
+      const unsigned int compositeMatte,const unsigned int method,
+      const float4 virtualPixel,__global CLPixelType *image,
+      const unsigned int imageColumns,const int yMin,
+      const __global int2 *spans,const float8 inverse,
+      const unsigned int blend)
+    {
+      CLPixelType
+        pixel,
+        virtual_pixel;
+
+      float
+        x_offset,
+        y_offset;
+
+      int
+        x,
+        y;
+
+      int2
+        span;
+
+      size_t
+        i;
+
+      x=get_global_id(0);
+      span=spans[get_global_id(1)];
+      if ((x < span.x) || (x > span.y) || (x >= (int) imageColumns))
+        return;
+      y=yMin+get_global_id(1);
+
+      virtual_pixel.x=ClampToQuantum(virtualPixel.x);
+      virtual_pixel.y=ClampToQuantum(virtualPixel.y);
+      virtual_pixel.z=ClampToQuantum(virtualPixel.z);
+      virtual_pixel.w=ClampToQuantum(virtualPixel.w);
+      x_offset=x*inverse.s0+y*inverse.s2+inverse.s4;
+      y_offset=x*inverse.s1+y*inverse.s3+inverse.s5;
+      i=(size_t) y*imageColumns+x;
+      if (blend == 0)
+        {
+          /* outside of the composite image only the virtual pixels remain */
+          if (InterpolatePixel(composite,compositeColumns,compositeRows,
+                compositeMatte,method,virtual_pixel,(int) floor(x_offset),
+                (int) floor(y_offset),x_offset,y_offset,&pixel) == 0)
+            pixel=virtual_pixel;
+          image[i]=pixel;
+          return;
+        }
+      /* the CPU truncates the offset toward zero */
+      if (InterpolatePixel(composite,compositeColumns,compositeRows,
+            compositeMatte,method,virtual_pixel,(int) x_offset,(int) y_offset,
+            x_offset,y_offset,&pixel) == 0)
+        {
+          setRed(&pixel,0);
+          setGreen(&pixel,0);
+          setBlue(&pixel,0);
+          setAlpha(&pixel,TransparentOpacity);
+        }
+      image[i]=OverCompositePixel(pixel,image[i]);
+    }
+  )
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     E q u a l i z e                                                         %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+OPENCL_IF((MAGICKCORE_QUANTUM_DEPTH == 32))
+
+  STRINGIFY(
+    static inline CLQuantum ScaleMapRatioToQuantum(const ulong numerator,
+      const ulong denominator)
+      {
+        /* the map of a 32 bit quantum has 16 bits */
+        const ulong quotient=numerator/denominator;
+        const ulong remainder=numerator%denominator;
+        return((CLQuantum) (65537UL*quotient+(65537UL*remainder)/denominator));
+      }
+  )
+
+OPENCL_ELSE()
+
+  STRINGIFY(
+    static inline CLQuantum ScaleMapRatioToQuantum(const ulong numerator,
+      const ulong denominator)
+      {
+        return((CLQuantum) (numerator/denominator));
+      }
+  )
+
+OPENCL_ENDIF()
+
+    STRINGIFY(
+    static inline CLQuantum EqualizeQuantum(const uint intensity,
+      const uint low,const uint high)
+      {
+        if (high == low)
+          return((CLQuantum) 0);
+        return(ScaleMapRatioToQuantum((ulong) MaxMap*(intensity-low),
+          (ulong) (high-low)));
+      }
+
+    /*
+      Integrates the channel histograms into the equalization map like
+      EqualizeImage().  A single work-group runs it, each work-item owns a
+      contiguous slice of the bins.  bounds receives the first and the last
+      value of the integral, a channel is only equalized when they differ.
+    */
+    __kernel __attribute__((reqd_work_group_size(256, 1, 1)))
+    void EqualizeMap(const __global uint4 * restrict histogram,
+      __global CLPixelType * restrict equalize_map,
+      __global uint4 * restrict bounds,
+      __local uint4 * restrict sums)
+      {
+        const uint t = get_local_id(0);
+        const uint slices = get_local_size(0);
+        const uint bins = (MaxMap+1)/slices;
+        const uint first = t*bins;
+
+        uint4 intensity = (uint4)(0);
+        for (uint i = first; i < first+bins; i++)
+          intensity+=histogram[i];
+        sums[t]=intensity;
+        barrier(CLK_LOCAL_MEM_FENCE);
 
-    outputImage[y*imageWidth+x] = v;
+        // exclusive prefix sum of the slices, the total goes last
+        if (t == 0)
+        {
+          uint4 total = (uint4)(0);
+          for (uint j = 0; j < slices; j++)
+          {
+            const uint4 sum = sums[j];
+            sums[j]=total;
+            total+=sum;
+          }
+          sums[slices]=total;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
 
-    }
-  )
+        const uint4 low = histogram[0];
+        const uint4 high = sums[slices];
+        if (t == 0)
+        {
+          bounds[0]=low;
+          bounds[1]=high;
+        }
 
-/*
-%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-%                                                                             %
-%                                                                             %
-%                                                                             %
-%     E q u a l i z e                                                         %
-%                                                                             %
-%                                                                             %
-%                                                                             %
-%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-*/
+        intensity=sums[t];
+        for (uint i = first; i < first+bins; i++)
+        {
+          CLPixelType value;
+
+          intensity+=histogram[i];
+          value.x=EqualizeQuantum(intensity.x,low.x,high.x);
+          value.y=EqualizeQuantum(intensity.y,low.y,high.y);
+          value.z=EqualizeQuantum(intensity.z,low.z,high.z);
+          value.w=EqualizeQuantum(intensity.w,low.w,high.w);
+          equalize_map[i]=value;
+        }
+      }
+    )
 
     STRINGIFY(
     /*
     */
     __kernel void Equalize(__global CLPixelType * restrict im,
-      const ChannelType channel,  
-      __global CLPixelType * restrict equalize_map,
-      const float4 white, const float4 black)
+      const __global CLPixelType * restrict equalize_map,
+      const __global uint4 * restrict bounds)
       {
         const int x = get_global_id(0);  
         const int y = get_global_id(1);  
         const int columns = get_global_size(0);  
         const int c = x + y * columns;
 
-        uint ePos;
+        const uint4 low = bounds[0];
+        const uint4 high = bounds[1];
+
         CLPixelType oValue, eValue;
-        CLQuantum red, green, blue, alpha;
 
         //read from global
         oValue=im[c];
+        eValue=oValue;
 
-        if ((channel & SyncChannels) != 0)
-        {
-          if (getRedF4(white) != getRedF4(black))
-          {
-            ePos = ScaleQuantumToMap(getRed(oValue)); 
-            eValue = equalize_map[ePos];
-            red = getRed(eValue);
-            ePos = ScaleQuantumToMap(getGreen(oValue)); 
-            eValue = equalize_map[ePos];
-            green = getRed(eValue);
-            ePos = ScaleQuantumToMap(getBlue(oValue)); 
-            eValue = equalize_map[ePos];
-            blue = getRed(eValue);
-            ePos = ScaleQuantumToMap(getAlpha(oValue)); 
-            eValue = equalize_map[ePos];
-            alpha = getRed(eValue);
- 
-            //write back
-            im[c]=(CLPixelType)(blue, green, red, alpha);
-          }
-
-        }
-
-        // for equalizing, we always need all channels?
-        // otherwise something more
+        if (low.z != high.z)
+          setRed(&eValue,getRed(equalize_map[ScaleQuantumToMap(getRed(oValue))]));
+        if (low.y != high.y)
+          setGreen(&eValue,getGreen(equalize_map[ScaleQuantumToMap(getGreen(oValue))]));
+        if (low.x != high.x)
+          setBlue(&eValue,getBlue(equalize_map[ScaleQuantumToMap(getBlue(oValue))]));
+        if (low.w != high.w)
+          setAlpha(&eValue,getAlpha(equalize_map[ScaleQuantumToMap(getAlpha(oValue))]));
 
+        //write back
+        im[c]=eValue;
      }
     )
 
@@ -1831,28 +2799,32 @@ OPENCL_ENDIF()
 */
 
   STRINGIFY(
-  __kernel void Grayscale(__global CLQuantum *image,const int number_channels,
-    const unsigned int colorspace,const unsigned int method)
+  /*
+    GM converts to gray through the map like XYZTransformPackets(), the
+    weights select Rec. 601 or Rec. 709 luma.
+  */
+  __kernel void Grayscale(__global CLPixelType *im,const float red_weight,
+    const float green_weight,const float blue_weight)
   {
-    const unsigned int x = get_global_id(0);
-    const unsigned int y = get_global_id(1);
-    const unsigned int columns = get_global_size(0);
-    __global CLQuantum *p = image + getPixelIndex(number_channels, columns, x, y);
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    const int columns = get_global_size(0);
+    const int c = x + y * columns;
 
-    float
-      blue,
-      green,
-      red;
+    CLPixelType pixel = im[c];
 
-    red=getPixelRed(p);
-    green=getPixelGreen(p);
-    blue=getPixelBlue(p);
+    float intensity=red_weight*(float) ScaleQuantumToMap(getRed(pixel))+
+      green_weight*(float) ScaleQuantumToMap(getGreen(pixel))+
+      blue_weight*(float) ScaleQuantumToMap(getBlue(pixel));
+    intensity=intensity < 0.0f ? 0.0f : intensity > (float) MaxMap ?
+      (float) MaxMap : (intensity + 0.5f);
 
-    CLQuantum intensity=ClampToQuantum(GetPixelIntensity(colorspace, method, red, green, blue));
+    CLQuantum gray=ScaleMapToQuantum((uint) intensity);
 
-    setPixelRed(p,intensity);
-    setPixelGreen(p,intensity);
-    setPixelBlue(p,intensity);
+    setRed(&pixel,gray);
+    setGreen(&pixel,gray);
+    setBlue(&pixel,gray);
+    im[c] = pixel;
   }
   )
 
@@ -1991,129 +2963,6 @@ OPENCL_ENDIF()
 
   STRINGIFY(
 
-  static inline void ConvertRGBToHSL(const CLQuantum red,const CLQuantum green, const CLQuantum blue,
-    float *hue, float *saturation, float *lightness)
-  {
-  float
-    c,
-    tmax,
-    tmin;
-
-  /*
-     Convert RGB to HSL colorspace.
-     */
-  tmax=MagickMax(QuantumScale*red,MagickMax(QuantumScale*green, QuantumScale*blue));
-  tmin=MagickMin(QuantumScale*red,MagickMin(QuantumScale*green, QuantumScale*blue));
-
-  c=tmax-tmin;
-
-  *lightness=(tmax+tmin)/2.0;
-  if (c <= 0.0)
-  {
-    *hue=0.0;
-    *saturation=0.0;
-    return;
-  }
-
-  if (tmax == (QuantumScale*red))
-  {
-    *hue=(QuantumScale*green-QuantumScale*blue)/c;
-    if ((QuantumScale*green) < (QuantumScale*blue))
-      *hue+=6.0;
-  }
-  else
-    if (tmax == (QuantumScale*green))
-      *hue=2.0+(QuantumScale*blue-QuantumScale*red)/c;
-    else
-      *hue=4.0+(QuantumScale*red-QuantumScale*green)/c;
-
-  *hue*=60.0/360.0;
-  if (*lightness <= 0.5)
-    *saturation=c/(2.0*(*lightness));
-  else
-    *saturation=c/(2.0-2.0*(*lightness));
-  }
-
-  static inline void ConvertHSLToRGB(const float hue,const float saturation, const float lightness,
-      CLQuantum *red,CLQuantum *green,CLQuantum *blue)
-  {
-    float
-      b,
-      c,
-      g,
-      h,
-      tmin,
-      r,
-      x;
-
-    /*
-       Convert HSL to RGB colorspace.
-       */
-    h=hue*360.0;
-    if (lightness <= 0.5)
-      c=2.0*lightness*saturation;
-    else
-      c=(2.0-2.0*lightness)*saturation;
-    tmin=lightness-0.5*c;
-    h-=360.0*floor(h/360.0);
-    h/=60.0;
-    x=c*(1.0-fabs(h-2.0*floor(h/2.0)-1.0));
-    switch ((int) floor(h) % 6)
-    {
-      case 0:
-        {
-          r=tmin+c;
-          g=tmin+x;
-          b=tmin;
-          break;
-        }
-      case 1:
-        {
-          r=tmin+x;
-          g=tmin+c;
-          b=tmin;
-          break;
-        }
-      case 2:
-        {
-          r=tmin;
-          g=tmin+c;
-          b=tmin+x;
-          break;
-        }
-      case 3:
-        {
-          r=tmin;
-          g=tmin+x;
-          b=tmin+c;
-          break;
-        }
-      case 4:
-        {
-          r=tmin+x;
-          g=tmin;
-          b=tmin+c;
-          break;
-        }
-      case 5:
-        {
-          r=tmin+c;
-          g=tmin;
-          b=tmin+x;
-          break;
-        }
-      default:
-        {
-          r=0.0;
-          g=0.0;
-          b=0.0;
-        }
-    }
-    *red=ClampToQuantum(QuantumRange*r);
-    *green=ClampToQuantum(QuantumRange*g);
-    *blue=ClampToQuantum(QuantumRange*b);
-  }
-
   static inline void ModulateHSL(const float percent_hue, const float percent_saturation,const float percent_lightness, 
     CLQuantum *red,CLQuantum *green,CLQuantum *blue)
   {
@@ -2123,24 +2972,28 @@ OPENCL_ENDIF()
       saturation;
 
     /*
-    Increase or decrease color lightness, saturation, or hue.
+    Increase or decrease color lightness, saturation, or hue like
+    ModulateImagePixels().
     */
     ConvertRGBToHSL(*red,*green,*blue,&hue,&saturation,&lightness);
-    hue+=0.5*(0.01*percent_hue-1.0);
-    while (hue < 0.0)
-      hue+=1.0;
-    while (hue >= 1.0)
-      hue-=1.0;
-    saturation*=0.01*percent_saturation;
-    lightness*=0.01*percent_lightness;
+    lightness*=(0.01f+MagickEpsilon)*percent_lightness;
+    if (lightness > 1.0f)
+      lightness=1.0f;
+    saturation*=(0.01f+MagickEpsilon)*percent_saturation;
+    if (saturation > 1.0f)
+      saturation=1.0f;
+    hue+=percent_hue/200.0f-0.5f;
+    while (hue < 0.0f)
+      hue+=1.0f;
+    while (hue > 1.0f)
+      hue-=1.0f;
     ConvertHSLToRGB(hue,saturation,lightness,red,green,blue);
   }
 
   __kernel void Modulate(__global CLPixelType *im, 
     const float percent_brightness, 
     const float percent_hue, 
-    const float percent_saturation, 
-    const int colorspace)
+    const float percent_saturation)
   {
 
     const int x = get_global_id(0);  
@@ -2159,16 +3012,8 @@ OPENCL_ENDIF()
     green=getGreen(pixel);
     blue=getBlue(pixel);
 
-    switch (colorspace)
-    {
-      case HSLColorspace:
-      default:
-        {
-          ModulateHSL(percent_hue, percent_saturation, percent_brightness, 
-              &red, &green, &blue);
-        }
-
-    }
+    ModulateHSL(percent_hue, percent_saturation, percent_brightness, 
+        &red, &green, &blue);
 
     CLPixelType filteredPixel;
    
@@ -2194,12 +3039,23 @@ OPENCL_ENDIF()
 */
 
   STRINGIFY(
+    static inline CLQuantum TruncateToQuantum(const float value)
+      {
+        /* QuantumRange rounds up to 2^32 as a float */
+        if (value >= QuantumRange)
+          return ((CLQuantum) ~0U);
+        return ((CLQuantum) clamp(value, 0.0f, QuantumRange));
+      }
+
+    /*
+      Like MotionBlurImage() the weighted sums are truncated and the opacity
+      is only blurred for matte images.
+    */
     __kernel 
     void MotionBlur(const __global CLPixelType *input, __global CLPixelType *output,
                     const unsigned int imageWidth, const unsigned int imageHeight,
                     const __global float *filter, const unsigned int width, const __global int2* offset,
-                    const float4 bias,
-                    const ChannelType channel, const unsigned int matte) {
+                    const unsigned int matte) {
 
       int2 currentPixel;
       currentPixel.x = get_global_id(0);
@@ -2209,67 +3065,28 @@ OPENCL_ENDIF()
           || currentPixel.y >= imageHeight)
           return;
 
-      float4 pixel;
-      pixel.x = (float)bias.x;
-      pixel.y = (float)bias.y;
-      pixel.z = (float)bias.z;
-      pixel.w = (float)bias.w;
-
-      if (((channel & AlphaChannel) == 0) || (matte == 0)) {
-        
-        for (int i = 0; i < width; i++) {
-          // only support EdgeVirtualPixelMethod through ClampToCanvas
-          // TODO: implement other virtual pixel method
-          int2 samplePixel = currentPixel + offset[i];
-          samplePixel.x = ClampToCanvas(samplePixel.x, imageWidth);
-          samplePixel.y = ClampToCanvas(samplePixel.y, imageHeight);
-          CLPixelType samplePixelValue = input[ samplePixel.y * imageWidth + samplePixel.x];
-
-          pixel.x += (filter[i] * (float)samplePixelValue.x);
-          pixel.y += (filter[i] * (float)samplePixelValue.y);
-          pixel.z += (filter[i] * (float)samplePixelValue.z);
-          pixel.w += (filter[i] * (float)samplePixelValue.w);
-        }
+      float4 pixel = (float4) 0.0f;
 
-        CLPixelType outputPixel;
-        outputPixel.x = ClampToQuantum(pixel.x);
-        outputPixel.y = ClampToQuantum(pixel.y);
-        outputPixel.z = ClampToQuantum(pixel.z);
-        outputPixel.w = ClampToQuantum(pixel.w);
-        output[currentPixel.y * imageWidth + currentPixel.x] = outputPixel;
+      for (int i = 0; i < width; i++) {
+        // only support EdgeVirtualPixelMethod through ClampToCanvas
+        int2 samplePixel = currentPixel + offset[i];
+        samplePixel.x = ClampToCanvas(samplePixel.x, imageWidth);
+        samplePixel.y = ClampToCanvas(samplePixel.y, imageHeight);
+        CLPixelType samplePixelValue = input[ samplePixel.y * imageWidth + samplePixel.x];
+
+        pixel.x += (filter[i] * (float)samplePixelValue.x);
+        pixel.y += (filter[i] * (float)samplePixelValue.y);
+        pixel.z += (filter[i] * (float)samplePixelValue.z);
+        pixel.w += (filter[i] * (float)samplePixelValue.w);
       }
-      else {
-
-        float gamma = 0.0f;
-        for (int i = 0; i < width; i++) {
-          // only support EdgeVirtualPixelMethod through ClampToCanvas
-          // TODO: implement other virtual pixel method
-          int2 samplePixel = currentPixel + offset[i];
-          samplePixel.x = ClampToCanvas(samplePixel.x, imageWidth);
-          samplePixel.y = ClampToCanvas(samplePixel.y, imageHeight);
 
-          CLPixelType samplePixelValue = input[ samplePixel.y * imageWidth + samplePixel.x];
-
-          float alpha = QuantumScale*samplePixelValue.w;
-          float k = filter[i];
-          pixel.x = pixel.x + k * alpha * samplePixelValue.x;
-          pixel.y = pixel.y + k * alpha * samplePixelValue.y;
-          pixel.z = pixel.z + k * alpha * samplePixelValue.z;
-
-          pixel.w += k * alpha * samplePixelValue.w;
-
-          gamma+=k*alpha;
-        }
-        gamma = PerceptibleReciprocal(gamma);
-        pixel.xyz = gamma*pixel.xyz;
-
-        CLPixelType outputPixel;
-        outputPixel.x = ClampToQuantum(pixel.x);
-        outputPixel.y = ClampToQuantum(pixel.y);
-        outputPixel.z = ClampToQuantum(pixel.z);
-        outputPixel.w = ClampToQuantum(pixel.w);
-        output[currentPixel.y * imageWidth + currentPixel.x] = outputPixel;
-      }
+      CLPixelType outputPixel;
+      outputPixel.x = TruncateToQuantum(pixel.x);
+      outputPixel.y = TruncateToQuantum(pixel.y);
+      outputPixel.z = TruncateToQuantum(pixel.z);
+      outputPixel.w = (matte != 0) ? TruncateToQuantum(pixel.w) :
+        input[currentPixel.y * imageWidth + currentPixel.x].w;
+      output[currentPixel.y * imageWidth + currentPixel.x] = outputPixel;
     }
   )
 
@@ -2936,9 +3753,7 @@ OPENCL_ENDIF()
             {
               cp.w = (float) *(p + 3);
 
-              // float alpha = weight * QuantumScale * cp.w;
-              // error: use of type 'double' requires cl_khr_fp64 support
-              float alpha = weight * (1 - (float) cp.w / 255);
+              float alpha = weight * (1.0f - QuantumScale * cp.w);
 
               filteredPixel.x += alpha * cp.x;
               filteredPixel.y += alpha * cp.y;
@@ -3017,9 +3832,12 @@ OPENCL_ENDIF()
       const float resizeFilterScale, const float resizeFilterSupport,
       const float resizeFilterBlur, __local CLQuantum *inputImageCache, const int numCachedPixels,
       const unsigned int pixelPerWorkgroup, const unsigned int pixelChunkSize,
-      __local float4 *outputPixelCache, __local float *densityCache, __local float *gammaCache)
+      __local float4 *outputPixelCache, __local float *densityCache, __local float *gammaCache,
+      const unsigned int inputOffsetY, const unsigned int filteredOffsetY)
   {
-    // calculate the range of resized image pixels computed by this workgroup
+    // calculate the range of resized image pixels computed by this workgroup,
+    // the input and filtered buffers may hold a band of rows starting at
+    // inputOffsetY and filteredOffsetY of the whole images
     const unsigned int startY = get_group_id(1)*pixelPerWorkgroup;
     const unsigned int stopY = MagickMin(startY + pixelPerWorkgroup,filteredRows);
     const unsigned int actualNumPixelToCompute = stopY - startY;
@@ -3028,12 +3846,12 @@ OPENCL_ENDIF()
     float scale = resizeFilterScale;
     const float support = resizeFilterSupport;
 
-    const int cacheRangeStartY = MagickMax((int)((startY+0.5f)/yFactor+MagickEpsilon-support+0.5f),(int)(0));
-    const int cacheRangeEndY = MagickMin((int)(cacheRangeStartY + numCachedPixels), (int)inputRows);
+    const int cacheRangeStartY = MagickMax((int)((startY+filteredOffsetY+0.5f)/yFactor+MagickEpsilon-support+0.5f),(int)(inputOffsetY));
+    const int cacheRangeEndY = MagickMin((int)(cacheRangeStartY + numCachedPixels), (int)(inputOffsetY+inputRows));
 
     // cache the input pixels into local memory
     const unsigned int x = get_global_id(0);
-    unsigned int pos = getPixelIndex(4, inputColumns, x, cacheRangeStartY);
+    unsigned int pos = getPixelIndex(4, inputColumns, x, cacheRangeStartY-inputOffsetY);
     unsigned int rangeLength = cacheRangeEndY-cacheRangeStartY;
     unsigned int stride = inputColumns * 4;
     for (unsigned int i = 0; i < 4; i++)
@@ -3062,12 +3880,12 @@ OPENCL_ENDIF()
       if (pixelIndex != -1)
       {
         // x coordinated of the resized pixel computed by this workitem
-        const int y = chunkStartY + pixelIndex;
+        const int y = chunkStartY + pixelIndex + filteredOffsetY;
 
         // calculate how many steps required for this pixel
         const float bisect = (y+0.5)/yFactor+MagickEpsilon;
-        const unsigned int start = (unsigned int)MagickMax(bisect-support+0.5f,0.0f);
-        const unsigned int stop  = (unsigned int)MagickMin(bisect+support+0.5f,(float)inputRows);
+        const unsigned int start = (unsigned int)MagickMax(bisect-support+0.5f,(float)inputOffsetY);
+        const unsigned int stop  = (unsigned int)MagickMin(bisect+support+0.5f,(float)(inputOffsetY+inputRows));
         const unsigned int n = stop - start;
 
         // calculate how many steps this workitem will contribute
@@ -3102,9 +3920,7 @@ OPENCL_ENDIF()
             {
               cp.w = (float) *(p + (rangeLength * 3));
 
-              // float alpha = weight * QuantumScale * cp.w;
-              // error: use of type 'double' requires cl_khr_fp64 support
-              float alpha = weight * (1 - (float) cp.w / 255);
+              float alpha = weight * (1.0f - QuantumScale * cp.w);
 
               filteredPixel.x += alpha * cp.x;
               filteredPixel.y += alpha * cp.y;
@@ -3270,6 +4086,11 @@ OPENCL_ENDIF()
 */
 
   STRINGIFY(
+  /*
+  Blur the rows produced by BlurRow and sharpen the image with the result.
+  Like BlurImage() on the CPU, the taps outside of the image are left out
+  and the remaining weights are scaled back to one.
+  */
   __kernel void UnsharpMaskBlurColumn(const __global CLQuantum* image,
     const __global float4 *blurRowData,const unsigned int number_channels,
     const ChannelType channel,const unsigned int columns,
@@ -3311,14 +4132,34 @@ OPENCL_ENDIF()
 
       int i = 0;
 
-      for ( ; i+7 < width; )
+      if ((cy < (int) radius) || (cy+(int) radius >= rows))
       {
-        for (int j=0; j < 8; j++, i++)
-          blurredPixel+=cachedFilter[i+j]*cachedData[i+j+get_local_id(1)];
+        float scale = 0.0f;
+
+        for ( ; i < width; i++)
+        {
+          const int sy = cy+i-(int) radius;
+
+          if ((sy >= 0) && (sy < rows))
+          {
+            blurredPixel+=cachedFilter[i]*cachedData[i+get_local_id(1)];
+            scale+=cachedFilter[i];
+          }
+        }
+        blurredPixel/=scale;
       }
+      else
+      {
+        for ( ; i+7 < width; )
+        {
+          for (int j=0; j < 8; j++)
+            blurredPixel+=cachedFilter[i+j]*cachedData[i+j+get_local_id(1)];
+          i+=8;
+        }
 
-      for ( ; i < width; i++)
-        blurredPixel+=cachedFilter[i]*cachedData[i+get_local_id(1)];
+        for ( ; i < width; i++)
+          blurredPixel+=cachedFilter[i]*cachedData[i+get_local_id(1)];
+      }
 
       float4 inputImagePixel = ReadFloat4(image,number_channels,columns,groupX,cy,channel);
       float4 outputPixel = inputImagePixel - blurredPixel;
@@ -3335,6 +4176,10 @@ OPENCL_ENDIF()
   )
 
   STRINGIFY(
+  /*
+  Single pass unsharp mask for the narrow kernels, the edges are handled
+  like by UnsharpMaskBlurColumn.
+  */
   __kernel void UnsharpMask(const __global CLQuantum *image,const unsigned int number_channels,
     const ChannelType channel,__constant float *filter,const unsigned int width,
     const unsigned int columns,const unsigned int rows,__local float4 *pixels,
@@ -3350,31 +4195,39 @@ OPENCL_ENDIF()
     int endRow = (get_group_id(1) + 1) * get_local_size(1) + radius;
 
     while (row < endRow) {
-      int srcy = (row < 0) ? -row : row; // mirror pad
-      srcy = (srcy >= rows) ? (2 * rows - srcy - 1) : srcy;
-
       float4 value = 0.0f;
 
       int ix = x - radius;
       int i = 0;
 
-      while (i + 7 < width) {
-        for (int j = 0; j < 8; ++j) { // unrolled
-          int srcx = ix + j;
-          srcx = (srcx < 0) ? -srcx : srcx;
-          srcx = (srcx >= columns) ? (2 * columns - srcx - 1) : srcx;
-          value += filter[i + j] * ReadFloat4(image, number_channels, columns, srcx, srcy, channel);
+      if ((row < 0) || (row >= rows)) {
+        // left out by the column pass
+      } else if ((ix < 0) || (ix + width > columns)) {
+        float scale = 0.0f;
+
+        while (i < width) {
+          if ((ix >= 0) && (ix < columns)) {
+            value += filter[i] * ReadFloat4(image, number_channels, columns, ix, row, channel);
+            scale += filter[i];
+          }
+          ++i;
+          ++ix;
+        }
+        if (scale != 0.0f)
+          value /= scale;
+      } else {
+        while (i + 7 < width) {
+          for (int j = 0; j < 8; ++j) // unrolled
+            value += filter[i + j] * ReadFloat4(image, number_channels, columns, ix + j, row, channel);
+          ix += 8;
+          i += 8;
         }
-        ix += 8;
-        i += 8;
-      }
 
-      while (i < width) {
-        int srcx = (ix < 0) ? -ix : ix; // mirror pad
-        srcx = (srcx >= columns) ? (2 * columns - srcx - 1) : srcx;
-        value += filter[i] * ReadFloat4(image, number_channels, columns, srcx, srcy, channel);
-        ++i;
-        ++ix;
+        while (i < width) {
+          value += filter[i] * ReadFloat4(image, number_channels, columns, ix, row, channel);
+          ++i;
+          ++ix;
+        }
       }
       pixels[(row - baseRow) * get_local_size(0) + get_local_id(0)] = value;
       row += get_local_size(1);
@@ -3388,14 +4241,30 @@ OPENCL_ENDIF()
     float4 value = (float4)(0.0f);
 
     int i = 0;
-    while (i + 7 < width) {
-      for (int j = 0; j < 8; ++j) // unrolled
-        value += (float4)(filter[i]) * pixels[px + (py + i + j) * prp];
-      i += 8;
-    }
-    while (i < width) {
-      value += (float4)(filter[i]) * pixels[px + (py + i) * prp];
-      ++i;
+    if ((y < radius) || (y + radius >= rows)) {
+      float scale = 0.0f;
+
+      while (i < width) {
+        const int srcy = (int) (y + i) - (int) radius;
+
+        if ((srcy >= 0) && (srcy < rows)) {
+          value += (float4)(filter[i]) * pixels[px + (py + i) * prp];
+          scale += filter[i];
+        }
+        ++i;
+      }
+      if (scale != 0.0f)
+        value /= scale;
+    } else {
+      while (i + 7 < width) {
+        for (int j = 0; j < 8; ++j) // unrolled
+          value += (float4)(filter[i + j]) * pixels[px + (py + i + j) * prp];
+        i += 8;
+      }
+      while (i < width) {
+        value += (float4)(filter[i]) * pixels[px + (py + i) * prp];
+        ++i;
+      }
     }
 
     if ((x < columns) && (y < rows)) {
@@ -3521,7 +4390,8 @@ OPENCL_ENDIF()
       const unsigned int filteredColumns, const unsigned int filteredRows,
       __local CLQuantum *inputImageCache, const int numCachedPixels,
       const unsigned int pixelPerWorkgroup, const unsigned int pixelChunkSize,
-      __local float4 *outputPixelCache)
+      __local float4 *outputPixelCache, const float yFactor,
+      const unsigned int inputOffsetY, const unsigned int filteredOffsetY)
   {
     // calculate the range of resized image pixels computed by this workgroup
     const unsigned int startX = get_group_id(0) * pixelPerWorkgroup;
@@ -3535,8 +4405,12 @@ OPENCL_ENDIF()
     const int cacheRangeEndX = MagickMin((int)(cacheRangeStartX + numCachedPixels), (int)inputColumns);
 
     // cache the input pixels into local memory
+    // the input and filtered buffers may hold a band of rows starting at
+    // inputOffsetY and filteredOffsetY of the whole images
     const unsigned int y = get_global_id(1);
-    const unsigned int pos = getPixelIndex(4, inputColumns, cacheRangeStartX, y / xFactor);
+    const int sourceY = clamp((int)((y + filteredOffsetY) / yFactor), (int)inputOffsetY,
+      (int)(inputOffsetY + inputRows - 1)) - (int)inputOffsetY;
+    const unsigned int pos = getPixelIndex(4, inputColumns, cacheRangeStartX, sourceY);
     const unsigned int num_elements = (cacheRangeEndX - cacheRangeStartX) * 4;
     event_t e = async_work_group_copy(inputImageCache, inputImage + pos, num_elements, 0);
     wait_group_events(1, &e);
@@ -3612,14 +4486,14 @@ OPENCL_ENDIF()
                 filteredPixel = 0.0;
                 local_idx++;
               }
-              if (cp.w < 255.0) {
+              if (cp.w < QuantumRange) {
                 x_volume += x_span;
               }
               filteredPixel += x_span * cp;
-              filteredPixel.x = filteredPixel.x > 255.0 ? 255.0 : filteredPixel.x;
-              filteredPixel.y = filteredPixel.y > 255.0 ? 255.0 : filteredPixel.y;
-              filteredPixel.z = filteredPixel.z > 255.0 ? 255.0 : filteredPixel.z;
-              filteredPixel.w = filteredPixel.w > 255.0 ? 255.0 : filteredPixel.w;
+              filteredPixel.x = filteredPixel.x > QuantumRange ? QuantumRange : filteredPixel.x;
+              filteredPixel.y = filteredPixel.y > QuantumRange ? QuantumRange : filteredPixel.y;
+              filteredPixel.z = filteredPixel.z > QuantumRange ? QuantumRange : filteredPixel.z;
+              filteredPixel.w = filteredPixel.w > QuantumRange ? QuantumRange : filteredPixel.w;
               x_scale -= x_span;
               x_span = 1.0;
               next_column = 1;
@@ -3638,22 +4512,22 @@ OPENCL_ENDIF()
                 next_column = 0;
                 local_idx++;
               }
-              if (cp.w < 255.0)
+              if (cp.w < QuantumRange)
                 x_volume += x_scale;
               filteredPixel += x_scale * cp;
               x_span -= x_scale;
             }
 
             if (x_span > 0.0) {
-              if (cp.w < 255.0)
+              if (cp.w < QuantumRange)
                 x_volume += x_span;
               filteredPixel += x_span * cp;
             }
 
-            filteredPixel.x = filteredPixel.x > 255.0 ? 255.0 : filteredPixel.x;
-            filteredPixel.y = filteredPixel.y > 255.0 ? 255.0 : filteredPixel.y;
-            filteredPixel.z = filteredPixel.z > 255.0 ? 255.0 : filteredPixel.z;
-            filteredPixel.w = filteredPixel.w > 255.0 ? 255.0 : filteredPixel.w;
+            filteredPixel.x = filteredPixel.x > QuantumRange ? QuantumRange : filteredPixel.x;
+            filteredPixel.y = filteredPixel.y > QuantumRange ? QuantumRange : filteredPixel.y;
+            filteredPixel.z = filteredPixel.z > QuantumRange ? QuantumRange : filteredPixel.z;
+            filteredPixel.w = filteredPixel.w > QuantumRange ? QuantumRange : filteredPixel.w;
           }
         }
       }
@@ -29,6 +29,8 @@
 #include "MagickCore/statistic.h"
 #include "MagickCore/visual-effects.h" */
 
+#include "magick/composite.h"
+
 #if defined(__cplusplus) || defined(c_plusplus)
 extern "C" {
 #endif
@@ -65,10 +67,33 @@ extern MagickPrivate MagickBooleanType
     const ColorspaceType, ExceptionInfo*); */
 
 extern Image
+  *AccelerateBlurImage(const Image *,const double *,const unsigned long,
+    const MagickBool,ExceptionInfo *),
+  *AccelerateConvolveImage(const Image *,const double *,const unsigned long,
+    ExceptionInfo *),
+  *AccelerateDespeckleImage(const Image *,ExceptionInfo *),
+  *AccelerateMotionBlurImage(const Image *,const double *,const unsigned long,
+    const int *,ExceptionInfo *),
   *AccelerateResizeImage(const Image *,const size_t,const size_t,const size_t,
     const FilterInfo *,const double,ExceptionInfo *),
+  *AccelerateRotateImage(const Image *,const double,ExceptionInfo *),
   *AccelerateScaleImage(const Image *,const size_t,const size_t,
-    ExceptionInfo *);
+    ExceptionInfo *),
+  *AccelerateUnsharpMaskImage(const Image *,const double *,
+    const unsigned long,const double,const double,ExceptionInfo *);
+
+extern MagickBooleanType
+  AccelerateCompositeImage(const CompositeOperator,const CompositeOptions_t *,
+    const unsigned long,const unsigned long,const Image *,const long,
+    const long,Image *,const long,const long,ExceptionInfo *),
+  AccelerateContrastImage(Image *,const unsigned int,ExceptionInfo *),
+  AccelerateDrawAffineImage(Image *,const Image *,const AffineMatrix *,
+    const long,const unsigned long,const long *,ExceptionInfo *),
+  AccelerateEqualizeImage(Image *,ExceptionInfo *),
+  AccelerateGrayscaleImage(Image *,const ColorspaceType,ExceptionInfo *),
+  AccelerateModulateImage(Image *,const double,const double,const double,
+    ExceptionInfo *),
+  AccelerateNormalizeImage(Image *,const double,ExceptionInfo *);
 
 #endif /* HAVE_OPENCL */
 
@@ -84,15 +84,38 @@ Include declarations.
 #include "MagickCore/token.h" */
 
 #include "magick/studio.h"
+#include "magick/composite.h"
 #include "magick/opencl-private.h"
 #include "magick/opencl.h"
 #include "magick/pixel_cache.h"
+#include "magick/render.h"
 
 #define MAGICK_MAX(x,y) (((x) >= (y))?(x):(y))
 #define MAGICK_MIN(x,y) (((x) <= (y))?(x):(y))
 
+/*
+  Images streamed through the device in bands keep CLTileSlots bands in
+  flight, so the upload of a band overlaps the kernels of the previous band
+  and the readback of the one before.  CLTileBufferSize bounds the largest
+  buffer of a band, which is also staged in host memory.
+*/
+#define CLTileSlots 3
+#define CLTileBufferSize ((MagickSizeType) 32*1024*1024)
+
 #if defined(HAVE_OPENCL)
 
+/*
+  Channel mask understood by the ChannelType of the OpenCL kernels, GM always
+  stores four quanta per pixel so all of them are filtered.
+*/
+#define CLCompositeChannels 0x001F
+
+/*
+  The kernels which filter opacity like the color channels use this mask for
+  images without a matte channel, the CPU code leaves opacity alone for them.
+*/
+#define CLColorChannels 0x0007
+
 // /*
 //   Define declarations.
 // */
@@ -227,172 +250,80 @@ static MagickCLEnv getOpenCLEnvironment(ExceptionInfo* exception)
   return(clEnv);
 }
 
+static cl_mem createKernelInfo(MagickCLDevice device,const double *kernel,
+  const unsigned long width,ExceptionInfo *exception)
+{
+  cl_mem
+    imageKernelBuffer;
+
+  float
+    *kernelBufferPtr;
+
+  size_t
+    i;
+
+  kernelBufferPtr=MagickAllocateArray(float *,width,sizeof(float));
+  if (kernelBufferPtr == (float *) NULL)
+    return((cl_mem) NULL);
+  for (i = 0; i < width; i++)
+    kernelBufferPtr[i]=(float) kernel[i];
+  imageKernelBuffer=CreateOpenCLBuffer(device,CL_MEM_COPY_HOST_PTR |
+    CL_MEM_READ_ONLY,width*sizeof(float),kernelBufferPtr);
+  MagickFreeMemory(kernelBufferPtr);
+  if (imageKernelBuffer == (cl_mem) NULL)
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+  return(imageKernelBuffer);
+}
+
 /*
-%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-%                                                                             %
-%                                                                             %
-%                                                                             %
-%     A c c e l e r a t e R e s i z e I m a g e                               %
-%                                                                             %
-%                                                                             %
-%                                                                             %
-%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+  Builds the channel histograms of an image that lives on the device.  The
+  counters of a bin are laid out like a CLPixelType: blue, green, red and
+  opacity.  They are cleared from the host memory of histogram, which must
+  not change until the events of histogramInfo have completed.
 */
-
-static MagickBooleanType resizeHorizontalFilter(MagickCLDevice device,
-  cl_command_queue queue,const Image *image,Image *filteredImage,
-  cl_mem imageBuffer,cl_uint matte_or_cmyk,cl_uint columns,cl_uint rows,
-  cl_mem resizedImageBuffer,cl_uint resizedColumns,cl_uint resizedRows,
-  cl_uint filter_type,const FilterInfo *resizeFilter,const double blur,
-  cl_mem resizeFilterCubicCoefficients,
-  const float xFactor,ExceptionInfo *exception)
+static MagickBooleanType computeHistogram(MagickCLDevice device,
+  cl_command_queue queue,const Image *image,cl_mem imageBuffer,
+  MagickCLCacheInfo histogramInfo,cl_uint4 *histogram,
+  ExceptionInfo *exception)
 {
-  cl_kernel
-    horizontalKernel;
-
   cl_int
     status;
 
-  const unsigned int
-    workgroupSize = 256;
-
-  float
-    resizeFilterScale,
-    resizeFilterSupport,
-    resizeFilterBlur,
-    scale,
-    support;
+  cl_kernel
+    histogramKernel;
 
-  int
-    numCachedPixels,
-    resizeFilterType;
+  cl_uint
+    matte;
 
   MagickBooleanType
     outputReady;
 
   size_t
-    gammaAccumulatorLocalMemorySize,
     gsize[2],
     i,
-    imageCacheLocalMemorySize,
-    pixelAccumulatorLocalMemorySize,
-    lsize[2],
-    totalLocalMemorySize,
-    weightAccumulatorLocalMemorySize;
-
-  unsigned int
-    chunkSize,
-    pixelPerWorkgroup;
+    length;
 
-  horizontalKernel=NULL;
   outputReady=MagickFalse;
+  length=(MaxMap+1)*sizeof(cl_uint4);
 
-  /*
-  Apply filter to resize vertically from image to resize image.
-  */
-  scale=blur*MAGICK_MAX(1.0/xFactor,1.0);
-  support=scale*resizeFilter->support;
-  if (support < 0.5)
-  {
-    /*
-    Support too small even for nearest neighbour: Reduce to point
-    sampling.
-    */
-    support=0.5+MagickEpsilon;
-    scale=1.0;
-  }
-  scale=1.0/scale;
-
-  if (resizedColumns < workgroupSize)
-  {
-    chunkSize=32;
-    pixelPerWorkgroup=32;
-  }
-  else
-  {
-    chunkSize=workgroupSize;
-    pixelPerWorkgroup=workgroupSize;
-  }
-
-DisableMSCWarning(4127)
-  while(1)
-RestoreMSCWarning
-  {
-    /* calculate the local memory size needed per workgroup */
-    numCachedPixels=(int) ceil((pixelPerWorkgroup-1)/xFactor+2*support);
-    imageCacheLocalMemorySize=numCachedPixels*sizeof(CLQuantum)*4;
-    totalLocalMemorySize=imageCacheLocalMemorySize;
-
-    /* local size for the pixel accumulator */
-    pixelAccumulatorLocalMemorySize=chunkSize*sizeof(cl_float4);
-    totalLocalMemorySize+=pixelAccumulatorLocalMemorySize;
-
-    /* local memory size for the weight accumulator */
-    weightAccumulatorLocalMemorySize=chunkSize*sizeof(float);
-    totalLocalMemorySize+=weightAccumulatorLocalMemorySize;
-
-    /* local memory size for the gamma accumulator */
-    gammaAccumulatorLocalMemorySize=chunkSize*sizeof(float);
-    totalLocalMemorySize+=gammaAccumulatorLocalMemorySize;
-
-    if (totalLocalMemorySize <= device->local_memory_size)
-      break;
-    else
-    {
-      pixelPerWorkgroup=pixelPerWorkgroup/2;
-      chunkSize=chunkSize/2;
-      if ((pixelPerWorkgroup == 0) || (chunkSize == 0))
-      {
-        /* quit, fallback to CPU */
-        goto cleanup;
-      }
-    }
-  }
-
-  // resizeFilterType=(int)GetResizeFilterWeightingType(resizeFilter);
-  // resizeWindowType=(int)GetResizeFilterWindowWeightingType(resizeFilter);
-  resizeFilterType=filter_type;
+  /* the counters have 32 bits */
+  if (((MagickSizeType) image->columns*image->rows) > 0xffffffffUL)
+    return(MagickFalse);
 
-  horizontalKernel=AcquireOpenCLKernel(device,"ResizeHorizontalFilter");
-  if (horizontalKernel == (cl_kernel) NULL)
+  histogramKernel=AcquireOpenCLKernel(device,"Histogram");
+  if (histogramKernel == (cl_kernel) NULL)
   {
     (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
-      ResourceLimitWarning,"AcquireOpenCLKernel failed.", ".");
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
     goto cleanup;
   }
 
-  // resizeFilterScale=(float) GetResizeFilterScale(resizeFilter);
-  // resizeFilterSupport=(float) GetResizeFilterSupport(resizeFilter);
-  // resizeFilterWindowSupport=(float) GetResizeFilterWindowSupport(resizeFilter);
-  // resizeFilterBlur=(float) GetResizeFilterBlur(resizeFilter);
-  resizeFilterScale=scale;
-  resizeFilterSupport=support;
-  resizeFilterBlur=blur;
-
+  matte=image->matte ? 1 : 0;
   i=0;
-  status =SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_mem),(void*)&imageBuffer);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&matte_or_cmyk);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&columns);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&rows);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_mem),(void*)&resizedImageBuffer);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&resizedColumns);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&resizedRows);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&xFactor);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(int),(void*)&resizeFilterType);
-  // status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(int),(void*)&resizeWindowType);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_mem),(void*)&resizeFilterCubicCoefficients);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&resizeFilterScale);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&resizeFilterSupport);
-  // status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&resizeFilterWindowSupport);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&resizeFilterBlur);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,imageCacheLocalMemorySize,NULL);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(int),&numCachedPixels);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(unsigned int),&pixelPerWorkgroup);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(unsigned int),&chunkSize);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,pixelAccumulatorLocalMemorySize,NULL);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,weightAccumulatorLocalMemorySize,NULL);
-  status|=SetOpenCLKernelArg(horizontalKernel,i++,gammaAccumulatorLocalMemorySize,NULL);
-
+  status =SetOpenCLKernelArg(histogramKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(histogramKernel,i++,sizeof(cl_uint),&matte);
+  status|=SetOpenCLKernelArg(histogramKernel,i++,sizeof(cl_mem),(void *)&histogramInfo->buffer);
   if (status != CL_SUCCESS)
   {
     (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
@@ -400,88 +331,3325 @@ RestoreMSCWarning
     goto cleanup;
   }
 
-  gsize[0]=(resizedColumns+pixelPerWorkgroup-1)/pixelPerWorkgroup*
-    workgroupSize;
-  gsize[1]=resizedRows;
-  lsize[0]=workgroupSize;
-  lsize[1]=1;
-  outputReady=EnqueueOpenCLKernel(queue,horizontalKernel,2,
-    (const size_t *) NULL,gsize,lsize,image,filteredImage,MagickFalse,
+  /* the counters start from the zeroed host copy */
+  (void) memset(histogram,0,length);
+  outputReady=WriteOpenCLBuffer(queue,histogramInfo,length,histogram,
     exception);
+  if (outputReady == MagickFalse)
+    goto cleanup;
+
+  gsize[0]=image->columns;
+  gsize[1]=image->rows;
+  outputReady=EnqueueOpenCLTileKernel(queue,histogramKernel,2,gsize,
+    (const size_t *) NULL,GetCacheInfoOpenCL((CacheInfo *) image->cache),
+    histogramInfo,(MagickSizeType) image->columns*image->rows,exception);
 
 cleanup:
 
-  if (horizontalKernel != (cl_kernel) NULL)
-    ReleaseOpenCLKernel(horizontalKernel);
+  if (histogramKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(histogramKernel);
 
   return(outputReady);
 }
 
-static MagickBooleanType resizeVerticalFilter(MagickCLDevice device,
-  cl_command_queue queue,const Image *image,Image * filteredImage,
-  cl_mem imageBuffer,cl_uint matte_or_cmyk,cl_uint columns,cl_uint rows,
-  cl_mem resizedImageBuffer,cl_uint resizedColumns,cl_uint resizedRows,
-  cl_uint filter_type,const FilterInfo *resizeFilter,const double blur,
-  cl_mem resizeFilterCubicCoefficients,
-  const float yFactor,ExceptionInfo *exception)
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e B l u r I m a g e                                   %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static Image *ComputeBlurImage(const Image* image,MagickCLEnv clEnv,
+  const double *kernel,const unsigned long width,
+  const MagickBool normalize_edges,ExceptionInfo *exception)
 {
-  cl_kernel
-    verticalKernel;
+  cl_command_queue
+    queue;
 
   cl_int
     status;
 
-  const unsigned int
-    workgroupSize = 256;
+  cl_kernel
+    blurColumnKernel,
+    blurRowKernel;
 
-  float
-    resizeFilterScale,
-    resizeFilterSupport,
-    resizeFilterBlur,
-    scale,
-    support;
+  cl_mem
+    filteredImageBuffer,
+    imageBuffer,
+    imageKernelBuffer,
+    tempImageBuffer;
 
-  int
-    numCachedPixels,
-    resizeFilterType;
+  cl_uint
+    channel_mask,
+    imageColumns,
+    imageRows,
+    kernelWidth,
+    normalizeEdges,
+    number_channels;
+
+  Image
+    *filteredImage;
 
   MagickBooleanType
     outputReady;
 
+  MagickCLDevice
+    device;
+
+  MagickSizeType
+    length;
+
   size_t
-    gammaAccumulatorLocalMemorySize,
+    chunkSize,
     gsize[2],
     i,
-    imageCacheLocalMemorySize,
-    pixelAccumulatorLocalMemorySize,
-    lsize[2],
-    totalLocalMemorySize,
-    weightAccumulatorLocalMemorySize;
-
-  unsigned int
-    chunkSize,
-    pixelPerWorkgroup;
+    lsize[2];
 
-  verticalKernel=NULL;
+  filteredImage=NULL;
+  imageBuffer=NULL;
+  filteredImageBuffer=NULL;
+  imageKernelBuffer=NULL;
+  tempImageBuffer=NULL;
+  blurRowKernel=NULL;
+  blurColumnKernel=NULL;
   outputReady=MagickFalse;
 
-  /*
-  Apply filter to resize vertically from image to resize image.
-  */
-  scale=blur*MAGICK_MAX(1.0/yFactor,1.0);
-  support=scale*resizeFilter->support;
-  if (support < 0.5)
-  {
-    /*
-    Support too small even for nearest neighbour: Reduce to point
-    sampling.
-    */
-    support=0.5+MagickEpsilon;
+  chunkSize=256;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+
+  /* both passes cache a row (or column) segment in local memory */
+  if ((chunkSize+width)*sizeof(cl_float4) > device->local_memory_size)
+    goto cleanup;
+
+  filteredImage=CloneImage(image,image->columns,image->rows,MagickTrue,
+    exception);
+  if (filteredImage == (Image *) NULL)
+    goto cleanup;
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+  filteredImageBuffer=GetAuthenticOpenCLBuffer(filteredImage,device,exception);
+  if (filteredImageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  imageKernelBuffer=createKernelInfo(device,kernel,width,exception);
+  if (imageKernelBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  length=image->columns*image->rows;
+  tempImageBuffer=CreateOpenCLBuffer(device,CL_MEM_READ_WRITE,length*
+    sizeof(cl_float4),(void *) NULL);
+  if (tempImageBuffer == (cl_mem) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+    goto cleanup;
+  }
+
+  blurRowKernel=AcquireOpenCLKernel(device,"BlurRow");
+  if (blurRowKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+  blurColumnKernel=AcquireOpenCLKernel(device,"BlurColumn");
+  if (blurColumnKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  number_channels=4;
+  channel_mask=image->matte ? CLCompositeChannels : CLColorChannels;
+  kernelWidth=(cl_uint) width;
+  imageColumns=(cl_uint) image->columns;
+  imageRows=(cl_uint) image->rows;
+  normalizeEdges=normalize_edges ? 1 : 0;
+
+  i=0;
+  status =SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&number_channels);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&channel_mask);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_mem),(void *)&imageKernelBuffer);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&kernelWidth);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&imageColumns);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&imageRows);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&normalizeEdges);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_float4)*(chunkSize+width),(void *) NULL);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_mem),(void *)&tempImageBuffer);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=chunkSize*((imageColumns+chunkSize-1)/chunkSize);
+  gsize[1]=imageRows;
+  lsize[0]=chunkSize;
+  lsize[1]=1;
+  outputReady=EnqueueOpenCLKernel(queue,blurRowKernel,2,(const size_t *) NULL,
+    gsize,lsize,image,filteredImage,MagickFalse,exception);
+  if (outputReady == MagickFalse)
+    goto cleanup;
+
+  i=0;
+  status =SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_mem),(void *)&tempImageBuffer);
+  status|=SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_uint),&number_channels);
+  status|=SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_uint),&channel_mask);
+  status|=SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_mem),(void *)&imageKernelBuffer);
+  status|=SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_uint),&kernelWidth);
+  status|=SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_uint),&imageColumns);
+  status|=SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_uint),&imageRows);
+  status|=SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_uint),&normalizeEdges);
+  status|=SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_float4)*(chunkSize+width),(void *) NULL);
+  status|=SetOpenCLKernelArg(blurColumnKernel,i++,sizeof(cl_mem),(void *)&filteredImageBuffer);
+  if (status != CL_SUCCESS)
+  {
+    outputReady=MagickFalse;
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=imageColumns;
+  gsize[1]=chunkSize*((imageRows+chunkSize-1)/chunkSize);
+  lsize[0]=1;
+  lsize[1]=chunkSize;
+  outputReady=EnqueueOpenCLKernel(queue,blurColumnKernel,2,
+    (const size_t *) NULL,gsize,lsize,image,filteredImage,MagickFalse,
+    exception);
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (filteredImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(filteredImageBuffer);
+  if (tempImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(tempImageBuffer);
+  if (imageKernelBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageKernelBuffer);
+  if (blurRowKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(blurRowKernel);
+  if (blurColumnKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(blurColumnKernel);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+  if ((outputReady == MagickFalse) && (filteredImage != (Image *) NULL))
+  {
+    DestroyImage(filteredImage);
+    filteredImage=(Image *) NULL;
+  }
+
+  return(filteredImage);
+}
+
+MagickPrivate Image *AccelerateBlurImage(const Image *image,
+  const double *kernel,const unsigned long width,
+  const MagickBool normalize_edges,ExceptionInfo *exception)
+{
+  Image
+    *filteredImage;
+
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(kernel != (const double *) NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return((Image *) NULL);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return((Image *) NULL);
+  if (CheckOpenCLOperationCost(clEnv,BlurCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return((Image *) NULL);
+
+  filteredImage=ComputeBlurImage(image,clEnv,kernel,width,normalize_edges,
+    exception);
+  return(filteredImage);
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e C o m p o s i t e I m a g e                         %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static MagickBool checkCompositeOperator(const CompositeOperator compose)
+{
+  switch (compose)
+  {
+    case OverCompositeOp:
+    case InCompositeOp:
+    case OutCompositeOp:
+    case AtopCompositeOp:
+    case XorCompositeOp:
+    case PlusCompositeOp:
+    case MinusCompositeOp:
+    case AddCompositeOp:
+    case SubtractCompositeOp:
+    case DifferenceCompositeOp:
+    case MultiplyCompositeOp:
+    case BumpmapCompositeOp:
+    case CopyCompositeOp:
+    case CopyRedCompositeOp:
+    case CopyGreenCompositeOp:
+    case CopyBlueCompositeOp:
+    case CopyOpacityCompositeOp:
+    case ClearCompositeOp:
+    case DissolveCompositeOp:
+    case ThresholdCompositeOp:
+    case DarkenCompositeOp:
+    case LightenCompositeOp:
+    case ScreenCompositeOp:
+    case OverlayCompositeOp:
+    case DivideCompositeOp:
+    case HardLightCompositeOp:
+    case ExclusionCompositeOp:
+    case ColorDodgeCompositeOp:
+    case ColorBurnCompositeOp:
+    case SoftLightCompositeOp:
+    case LinearBurnCompositeOp:
+    case LinearDodgeCompositeOp:
+    case LinearLightCompositeOp:
+    case VividLightCompositeOp:
+    case PinLightCompositeOp:
+    case HardMixCompositeOp:
+      return(MagickTrue);
+    default:
+      break;
+  }
+  /* the HSL operators, displace, modulate and the CMYK copies stay on the CPU */
+  return(MagickFalse);
+}
+
+static MagickBooleanType ComputeCompositeImage(Image *canvas_image,
+  MagickCLEnv clEnv,const CompositeOperator compose,
+  const CompositeOptions_t *options,const unsigned long columns,
+  const unsigned long rows,const Image *source_image,const long source_x,
+  const long source_y,const long canvas_x,const long canvas_y,
+  ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_float
+    amount,
+    threshold;
+
+  cl_int
+    status;
+
+  cl_kernel
+    compositeKernel;
+
+  cl_mem
+    canvasBuffer,
+    sourceBuffer;
+
+  cl_uint
+    canvasColumns,
+    canvasMatte,
+    canvasX,
+    canvasY,
+    op,
+    sourceColumns,
+    sourceMatte,
+    sourceX,
+    sourceY;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLDevice
+    device;
+
+  size_t
+    gsize[2],
+    i;
+
+  compositeKernel=NULL;
+  canvasBuffer=NULL;
+  sourceBuffer=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+  canvasBuffer=GetAuthenticOpenCLBuffer(canvas_image,device,exception);
+  if (canvasBuffer == (cl_mem) NULL)
+    goto cleanup;
+  sourceBuffer=GetAuthenticOpenCLBuffer(source_image,device,exception);
+  if (sourceBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  compositeKernel=AcquireOpenCLKernel(device,"Composite");
+  if (compositeKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  /* without matte channels over and atop simply replace the canvas */
+  op=(cl_uint) compose;
+  if (((compose == OverCompositeOp) || (compose == AtopCompositeOp)) &&
+      !canvas_image->matte && !source_image->matte)
+    op=(cl_uint) CopyCompositeOp;
+  canvasColumns=(cl_uint) canvas_image->columns;
+  canvasX=(cl_uint) canvas_x;
+  canvasY=(cl_uint) canvas_y;
+  canvasMatte=canvas_image->matte ? 1 : 0;
+  sourceColumns=(cl_uint) source_image->columns;
+  sourceX=(cl_uint) source_x;
+  sourceY=(cl_uint) source_y;
+  sourceMatte=source_image->matte ? 1 : 0;
+  amount=0.0f;
+  threshold=0.0f;
+  if (options != (const CompositeOptions_t *) NULL)
+    {
+      amount=(cl_float) options->amount;
+      threshold=(cl_float) options->threshold;
+    }
+
+  i=0;
+  status =SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_mem),(void *)&canvasBuffer);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_uint),&canvasColumns);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_uint),&canvasX);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_uint),&canvasY);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_uint),&canvasMatte);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_mem),(void *)&sourceBuffer);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_uint),&sourceColumns);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_uint),&sourceX);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_uint),&sourceY);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_uint),&sourceMatte);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_uint),&op);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_float),&amount);
+  status|=SetOpenCLKernelArg(compositeKernel,i++,sizeof(cl_float),&threshold);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  /* only the overlapping region is enqueued, it waits for both images */
+  gsize[0]=columns;
+  gsize[1]=rows;
+  outputReady=EnqueueOpenCLTileKernel(queue,compositeKernel,2,gsize,
+    (const size_t *) NULL,GetCacheInfoOpenCL((CacheInfo *) source_image->cache),
+    GetCacheInfoOpenCL((CacheInfo *) canvas_image->cache),
+    (MagickSizeType) columns*rows,exception);
+
+cleanup:
+
+  if (sourceBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(sourceBuffer);
+  if (canvasBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(canvasBuffer);
+  if (compositeKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(compositeKernel);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+
+  return(outputReady);
+}
+
+MagickPrivate MagickBooleanType AccelerateCompositeImage(
+  const CompositeOperator compose,const CompositeOptions_t *options,
+  const unsigned long columns,const unsigned long rows,
+  const Image *source_image,const long source_x,const long source_y,
+  Image *canvas_image,const long canvas_x,const long canvas_y,
+  ExceptionInfo *exception)
+{
+  MagickCLEnv
+    clEnv;
+
+  assert(canvas_image != NULL);
+  assert(source_image != NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkCompositeOperator(compose) == MagickFalse)
+    return(MagickFalse);
+  if ((compose == ThresholdCompositeOp) &&
+      (options == (const CompositeOptions_t *) NULL))
+    return(MagickFalse);
+
+  /* CMYK images keep their opacity in the indexes */
+  if ((canvas_image->storage_class != DirectClass) ||
+      (canvas_image->colorspace == CMYKColorspace) ||
+      (source_image->colorspace == CMYKColorspace))
+    return(MagickFalse);
+
+  /* the kernel updates the canvas in place while it reads the source */
+  if (canvas_image->cache == source_image->cache)
+    return(MagickFalse);
+
+  if ((columns == 0) || (rows == 0) || (source_x < 0) || (source_y < 0) ||
+      (canvas_x < 0) || (canvas_y < 0) ||
+      ((unsigned long) source_x+columns > source_image->columns) ||
+      ((unsigned long) source_y+rows > source_image->rows) ||
+      ((unsigned long) canvas_x+columns > canvas_image->columns) ||
+      ((unsigned long) canvas_y+rows > canvas_image->rows))
+    return(MagickFalse);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return(MagickFalse);
+  if (CheckOpenCLOperationCost(clEnv,CompositeCLOperation,
+        (MagickSizeType) columns*rows,(MagickSizeType) columns*rows) == MagickFalse)
+    return(MagickFalse);
+
+  return(ComputeCompositeImage(canvas_image,clEnv,compose,options,columns,
+    rows,source_image,source_x,source_y,canvas_x,canvas_y,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e C o n t r a s t I m a g e                           %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static MagickBooleanType ComputeContrastImage(Image *image,MagickCLEnv clEnv,
+  const unsigned int sharpen,ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_int
+    sign,
+    status;
+
+  cl_kernel
+    contrastKernel;
+
+  cl_mem
+    imageBuffer;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLDevice
+    device;
+
+  size_t
+    gsize[2],
+    i;
+
+  contrastKernel=NULL;
+  imageBuffer=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  contrastKernel=AcquireOpenCLKernel(device,"Contrast");
+  if (contrastKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  sign=sharpen ? 1 : -1;
+  i=0;
+  status =SetOpenCLKernelArg(contrastKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(contrastKernel,i++,sizeof(cl_int),&sign);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=image->columns;
+  gsize[1]=image->rows;
+  outputReady=EnqueueOpenCLKernel(queue,contrastKernel,2,(const size_t *) NULL,
+    gsize,(const size_t *) NULL,image,(const Image *) NULL,MagickFalse,
+    exception);
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (contrastKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(contrastKernel);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+
+  return(outputReady);
+}
+
+MagickPrivate MagickBooleanType AccelerateContrastImage(Image *image,
+  const unsigned int sharpen,ExceptionInfo *exception)
+{
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return(MagickFalse);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return(MagickFalse);
+  if (CheckOpenCLOperationCost(clEnv,ContrastCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return(MagickFalse);
+
+  return(ComputeContrastImage(image,clEnv,sharpen,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e C o n v o l v e I m a g e                           %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static Image *ComputeConvolveImage(const Image* image,MagickCLEnv clEnv,
+  const double *kernel,const unsigned long width,ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_int
+    status;
+
+  cl_kernel
+    clkernel;
+
+  cl_mem
+    convolutionKernel,
+    filteredImageBuffer,
+    imageBuffer;
+
+  cl_uint
+    filterWidth,
+    imageHeight,
+    imageWidth,
+    matte;
+
+  double
+    normalize,
+    *normal_kernel;
+
+  Image
+    *filteredImage;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLDevice
+    device;
+
+  size_t
+    gsize[2],
+    i,
+    localMemoryRequirement,
+    lsize[2];
+
+  filteredImage=NULL;
+  imageBuffer=NULL;
+  filteredImageBuffer=NULL;
+  convolutionKernel=NULL;
+  clkernel=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+
+  filteredImage=CloneImage(image,image->columns,image->rows,MagickTrue,
+    exception);
+  if (filteredImage == (Image *) NULL)
+    goto cleanup;
+  filteredImage->storage_class=DirectClass;
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+  filteredImageBuffer=GetAuthenticOpenCLBuffer(filteredImage,device,exception);
+  if (filteredImageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  /*
+    Normalize the kernel like ConvolveImage().
+  */
+  normal_kernel=MagickAllocateArray(double *,(size_t) width*width,
+    sizeof(double));
+  if (normal_kernel == (double *) NULL)
+    goto cleanup;
+  normalize=0.0;
+  for (i=0; i < (size_t) width*width; i++)
+    normalize+=kernel[i];
+  if (AbsoluteValue(normalize) <= MagickEpsilon)
+    normalize=1.0;
+  normalize=1.0/normalize;
+  for (i=0; i < (size_t) width*width; i++)
+    normal_kernel[i]=normalize*kernel[i];
+  convolutionKernel=createKernelInfo(device,normal_kernel,width*width,
+    exception);
+  MagickFreeMemory(normal_kernel);
+  if (convolutionKernel == (cl_mem) NULL)
+    goto cleanup;
+
+  /*
+    Cache a 16x16 tile with its apron and the filter in local memory when
+    they fit, otherwise every work item reads its neighbourhood from
+    global memory.
+  */
+  lsize[0]=16;
+  lsize[1]=16;
+  localMemoryRequirement=(lsize[0]+width-1)*(lsize[1]+width-1)*
+    sizeof(CLQuantum)*4+width*width*sizeof(float);
+  if (localMemoryRequirement <= device->local_memory_size)
+    clkernel=AcquireOpenCLKernel(device,"ConvolveOptimized");
+  else
+    clkernel=AcquireOpenCLKernel(device,"Convolve");
+  if (clkernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  imageWidth=(cl_uint) image->columns;
+  imageHeight=(cl_uint) image->rows;
+  filterWidth=(cl_uint) width;
+  matte=(image->matte != MagickFalse) ? 1 : 0;
+
+  i=0;
+  status =SetOpenCLKernelArg(clkernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(clkernel,i++,sizeof(cl_mem),(void *)&filteredImageBuffer);
+  status|=SetOpenCLKernelArg(clkernel,i++,sizeof(cl_uint),&imageWidth);
+  status|=SetOpenCLKernelArg(clkernel,i++,sizeof(cl_uint),&imageHeight);
+  status|=SetOpenCLKernelArg(clkernel,i++,sizeof(cl_mem),(void *)&convolutionKernel);
+  status|=SetOpenCLKernelArg(clkernel,i++,sizeof(cl_uint),&filterWidth);
+  status|=SetOpenCLKernelArg(clkernel,i++,sizeof(cl_uint),&filterWidth);
+  status|=SetOpenCLKernelArg(clkernel,i++,sizeof(cl_uint),&matte);
+  if (localMemoryRequirement <= device->local_memory_size)
+    {
+      status|=SetOpenCLKernelArg(clkernel,i++,(lsize[0]+width-1)*
+        (lsize[1]+width-1)*sizeof(CLQuantum)*4,(void *) NULL);
+      status|=SetOpenCLKernelArg(clkernel,i++,width*width*sizeof(float),
+        (void *) NULL);
+    }
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=lsize[0]*((image->columns+lsize[0]-1)/lsize[0]);
+  gsize[1]=lsize[1]*((image->rows+lsize[1]-1)/lsize[1]);
+  outputReady=EnqueueOpenCLKernel(queue,clkernel,2,(const size_t *) NULL,
+    gsize,lsize,image,filteredImage,MagickFalse,exception);
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (filteredImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(filteredImageBuffer);
+  if (convolutionKernel != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(convolutionKernel);
+  if (clkernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(clkernel);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+  if ((outputReady == MagickFalse) && (filteredImage != (Image *) NULL))
+  {
+    DestroyImage(filteredImage);
+    filteredImage=(Image *) NULL;
+  }
+
+  return(filteredImage);
+}
+
+MagickPrivate Image *AccelerateConvolveImage(const Image *image,
+  const double *kernel,const unsigned long width,ExceptionInfo *exception)
+{
+  Image
+    *filteredImage;
+
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(kernel != (const double *) NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return((Image *) NULL);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return((Image *) NULL);
+  if (CheckOpenCLOperationCost(clEnv,ConvolveCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return((Image *) NULL);
+
+  filteredImage=ComputeConvolveImage(image,clEnv,kernel,width,exception);
+  return(filteredImage);
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e D e s p e c k l e I m a g e                         %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static Image *ComputeDespeckleImage(const Image *image,MagickCLEnv clEnv,
+  ExceptionInfo *exception)
+{
+  static const int
+    X[4] = {0, 1, 1,-1},
+    Y[4] = {1, 0, 1, 1};
+
+  cl_command_queue
+    queue;
+
+  cl_int
+    polarity,
+    status;
+
+  cl_int2
+    offset;
+
+  cl_kernel
+    hullPass1,
+    hullPass2;
+
+  cl_mem
+    filteredImageBuffer,
+    imageBuffer,
+    inputBuffer,
+    tempImageBuffer;
+
+  cl_uint
+    imageHeight,
+    imageWidth,
+    matte;
+
+  Image
+    *filteredImage;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLDevice
+    device;
+
+  size_t
+    gsize[2],
+    i,
+    k,
+    pass;
+
+  filteredImage=NULL;
+  imageBuffer=NULL;
+  filteredImageBuffer=NULL;
+  tempImageBuffer=NULL;
+  hullPass1=NULL;
+  hullPass2=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+
+  filteredImage=CloneImage(image,image->columns,image->rows,MagickTrue,
+    exception);
+  if (filteredImage == (Image *) NULL)
+    goto cleanup;
+  filteredImage->storage_class=DirectClass;
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+  filteredImageBuffer=GetAuthenticOpenCLBuffer(filteredImage,device,exception);
+  if (filteredImageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  tempImageBuffer=CreateOpenCLBuffer(device,CL_MEM_READ_WRITE,
+    image->columns*image->rows*sizeof(CLQuantum)*4,(void *) NULL);
+  if (tempImageBuffer == (cl_mem) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+    goto cleanup;
+  }
+
+  hullPass1=AcquireOpenCLKernel(device,"HullPass1");
+  if (hullPass1 == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+  hullPass2=AcquireOpenCLKernel(device,"HullPass2");
+  if (hullPass2 == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  imageWidth=(cl_uint) image->columns;
+  imageHeight=(cl_uint) image->rows;
+  matte=(image->matte != MagickFalse) ? 1 : 0;
+  gsize[0]=image->columns;
+  gsize[1]=image->rows;
+
+  /*
+    Same sequence of hulls as DespeckleImage(), all channels at once.  The
+    first pass reads the source image, afterwards the two passes of every
+    hull ping-pong between the temporary buffer and the filtered image.
+  */
+  inputBuffer=imageBuffer;
+  for (k=0; k < 4; k++)
+  {
+    for (pass=0; pass < 4; pass++)
+    {
+      offset.s[0]=((pass == 0) || (pass == 3)) ? X[k] : -X[k];
+      offset.s[1]=((pass == 0) || (pass == 3)) ? Y[k] : -Y[k];
+      polarity=(pass < 2) ? 1 : -1;
+
+      i=0;
+      status =SetOpenCLKernelArg(hullPass1,i++,sizeof(cl_mem),(void *)&inputBuffer);
+      status|=SetOpenCLKernelArg(hullPass1,i++,sizeof(cl_mem),(void *)&tempImageBuffer);
+      status|=SetOpenCLKernelArg(hullPass1,i++,sizeof(cl_uint),&imageWidth);
+      status|=SetOpenCLKernelArg(hullPass1,i++,sizeof(cl_uint),&imageHeight);
+      status|=SetOpenCLKernelArg(hullPass1,i++,sizeof(cl_int2),&offset);
+      status|=SetOpenCLKernelArg(hullPass1,i++,sizeof(cl_int),&polarity);
+      status|=SetOpenCLKernelArg(hullPass1,i++,sizeof(cl_uint),&matte);
+      if (status != CL_SUCCESS)
+      {
+        (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+          ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+        goto cleanup;
+      }
+      outputReady=EnqueueOpenCLKernel(queue,hullPass1,2,(const size_t *) NULL,
+        gsize,(const size_t *) NULL,image,filteredImage,MagickFalse,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+
+      i=0;
+      status =SetOpenCLKernelArg(hullPass2,i++,sizeof(cl_mem),(void *)&tempImageBuffer);
+      status|=SetOpenCLKernelArg(hullPass2,i++,sizeof(cl_mem),(void *)&filteredImageBuffer);
+      status|=SetOpenCLKernelArg(hullPass2,i++,sizeof(cl_uint),&imageWidth);
+      status|=SetOpenCLKernelArg(hullPass2,i++,sizeof(cl_uint),&imageHeight);
+      status|=SetOpenCLKernelArg(hullPass2,i++,sizeof(cl_int2),&offset);
+      status|=SetOpenCLKernelArg(hullPass2,i++,sizeof(cl_int),&polarity);
+      status|=SetOpenCLKernelArg(hullPass2,i++,sizeof(cl_uint),&matte);
+      if (status != CL_SUCCESS)
+      {
+        outputReady=MagickFalse;
+        (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+          ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+        goto cleanup;
+      }
+      outputReady=EnqueueOpenCLKernel(queue,hullPass2,2,(const size_t *) NULL,
+        gsize,(const size_t *) NULL,image,filteredImage,MagickFalse,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+
+      inputBuffer=filteredImageBuffer;
+    }
+  }
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (filteredImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(filteredImageBuffer);
+  if (tempImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(tempImageBuffer);
+  if (hullPass1 != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(hullPass1);
+  if (hullPass2 != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(hullPass2);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+  if ((outputReady == MagickFalse) && (filteredImage != (Image *) NULL))
+  {
+    DestroyImage(filteredImage);
+    filteredImage=(Image *) NULL;
+  }
+
+  return(filteredImage);
+}
+
+MagickPrivate Image *AccelerateDespeckleImage(const Image *image,
+  ExceptionInfo *exception)
+{
+  Image
+    *filteredImage;
+
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return((Image *) NULL);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return((Image *) NULL);
+  if (CheckOpenCLOperationCost(clEnv,DespeckleCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return((Image *) NULL);
+
+  filteredImage=ComputeDespeckleImage(image,clEnv,exception);
+  return(filteredImage);
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e D r a w A f f i n e I m a g e                       %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static MagickBooleanType ComputeDrawAffineImage(Image *image,
+  MagickCLEnv clEnv,const Image *composite,const AffineMatrix *inverse_affine,
+  const long y_min,const unsigned long rows,const long *spans,
+  const VirtualPixelMethod method,const MagickBool matte,
+  const MagickBool blend,ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_float4
+    virtualPixel;
+
+  cl_float8
+    inverse;
+
+  cl_int
+    status,
+    yMin;
+
+  cl_int2
+    *spanBufferPtr;
+
+  cl_kernel
+    drawAffineKernel;
+
+  cl_mem
+    compositeBuffer,
+    imageBuffer,
+    spanBuffer;
+
+  cl_uint
+    blendPixels,
+    compositeColumns,
+    compositeMatte,
+    compositeRows,
+    imageColumns,
+    virtualPixelMethod;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLDevice
+    device;
+
+  size_t
+    gsize[2],
+    i;
+
+  drawAffineKernel=NULL;
+  compositeBuffer=NULL;
+  imageBuffer=NULL;
+  spanBuffer=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+  compositeBuffer=GetAuthenticOpenCLBuffer(composite,device,exception);
+  if (compositeBuffer == (cl_mem) NULL)
+    goto cleanup;
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  /* without spans every column of every row is drawn */
+  spanBufferPtr=MagickAllocateArray(cl_int2 *,rows,sizeof(cl_int2));
+  if (spanBufferPtr == (cl_int2 *) NULL)
+    goto cleanup;
+  for (i=0; i < rows; i++)
+  {
+    if (spans == (const long *) NULL)
+      {
+        spanBufferPtr[i].s[0]=0;
+        spanBufferPtr[i].s[1]=(cl_int) image->columns-1;
+        continue;
+      }
+    spanBufferPtr[i].s[0]=(cl_int) MAGICK_MAX(spans[2*i],0);
+    spanBufferPtr[i].s[1]=(cl_int) spans[2*i+1];
+  }
+  spanBuffer=CreateOpenCLBuffer(device,CL_MEM_COPY_HOST_PTR |
+    CL_MEM_READ_ONLY,rows*sizeof(cl_int2),spanBufferPtr);
+  MagickFreeMemory(spanBufferPtr);
+  if (spanBuffer == (cl_mem) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+    goto cleanup;
+  }
+
+  drawAffineKernel=AcquireOpenCLKernel(device,"DrawAffine");
+  if (drawAffineKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  compositeColumns=(cl_uint) composite->columns;
+  compositeRows=(cl_uint) composite->rows;
+  compositeMatte=(matte != MagickFalse) ? 1 : 0;
+  virtualPixelMethod=(cl_uint) method;
+  virtualPixel.s[0]=(cl_float) composite->background_color.blue;
+  virtualPixel.s[1]=(cl_float) composite->background_color.green;
+  virtualPixel.s[2]=(cl_float) composite->background_color.red;
+  virtualPixel.s[3]=(cl_float) composite->background_color.opacity;
+  imageColumns=(cl_uint) image->columns;
+  yMin=(cl_int) y_min;
+  (void) memset(&inverse,0,sizeof(inverse));
+  inverse.s[0]=(cl_float) inverse_affine->sx;
+  inverse.s[1]=(cl_float) inverse_affine->rx;
+  inverse.s[2]=(cl_float) inverse_affine->ry;
+  inverse.s[3]=(cl_float) inverse_affine->sy;
+  inverse.s[4]=(cl_float) inverse_affine->tx;
+  inverse.s[5]=(cl_float) inverse_affine->ty;
+  blendPixels=(blend != MagickFalse) ? 1 : 0;
+
+  i=0;
+  status =SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_mem),(void *)&compositeBuffer);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_uint),&compositeColumns);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_uint),&compositeRows);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_uint),&compositeMatte);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_uint),&virtualPixelMethod);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_float4),&virtualPixel);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_uint),&imageColumns);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_int),&yMin);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_mem),(void *)&spanBuffer);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_float8),&inverse);
+  status|=SetOpenCLKernelArg(drawAffineKernel,i++,sizeof(cl_uint),&blendPixels);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=image->columns;
+  gsize[1]=rows;
+  outputReady=EnqueueOpenCLKernel(queue,drawAffineKernel,2,
+    (const size_t *) NULL,gsize,(const size_t *) NULL,composite,image,
+    MagickFalse,exception);
+
+cleanup:
+
+  if (compositeBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(compositeBuffer);
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (spanBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(spanBuffer);
+  if (drawAffineKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(drawAffineKernel);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+
+  return(outputReady);
+}
+
+MagickPrivate MagickBooleanType AccelerateDrawAffineImage(Image *image,
+  const Image *composite,const AffineMatrix *inverse_affine,const long y_min,
+  const unsigned long rows,const long *spans,ExceptionInfo *exception)
+{
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(composite != NULL);
+  assert(inverse_affine != (const AffineMatrix *) NULL);
+  assert(spans != (const long *) NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if ((image->storage_class != DirectClass) ||
+      (image->colorspace == CMYKColorspace) ||
+      (composite->colorspace == CMYKColorspace))
+    return(MagickFalse);
+
+  /* the kernel blends over the image in place while it reads the composite */
+  if (image->cache == composite->cache)
+    return(MagickFalse);
+
+  if ((rows == 0) || (y_min < 0) ||
+      ((unsigned long) y_min+rows > image->rows))
+    return(MagickFalse);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return(MagickFalse);
+  if (CheckOpenCLOperationCost(clEnv,AffineCLOperation,
+        (MagickSizeType) image->columns*rows,
+        (MagickSizeType) image->columns*rows) == MagickFalse)
+    return(MagickFalse);
+
+  /* like InterpolateViewColor() only RGB images interpolate their opacity */
+  return(ComputeDrawAffineImage(image,clEnv,composite,inverse_affine,y_min,
+    rows,spans,GetImageVirtualPixelMethod(composite),composite->matte &&
+    IsRGBColorspace(composite->colorspace),MagickTrue,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e E q u a l i z e I m a g e                           %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static MagickBooleanType ComputeEqualizeImage(Image *image,MagickCLEnv clEnv,
+  ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_int
+    status;
+
+  cl_kernel
+    equalizeKernel,
+    equalizeMapKernel;
+
+  cl_mem
+    boundsBuffer,
+    equalizeMapBuffer,
+    imageBuffer;
+
+  cl_uint4
+    *histogram;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLCacheInfo
+    histogramInfo;
+
+  MagickCLDevice
+    device;
+
+  size_t
+    gsize[2],
+    i,
+    lsize[2];
+
+  boundsBuffer=NULL;
+  equalizeKernel=NULL;
+  equalizeMapBuffer=NULL;
+  equalizeMapKernel=NULL;
+  histogram=(cl_uint4 *) NULL;
+  histogramInfo=(MagickCLCacheInfo) NULL;
+  imageBuffer=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+
+  /* the map is integrated by a single work-group */
+  if ((257*sizeof(cl_uint4)) > device->local_memory_size)
+    goto cleanup;
+
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  histogram=MagickAllocateArray(cl_uint4 *,MaxMap+1,sizeof(cl_uint4));
+  if (histogram == (cl_uint4 *) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"MemoryAllocationFailed.",".");
+    goto cleanup;
+  }
+  histogramInfo=AcquireMagickCLCacheInfo(device,(Quantum *) NULL,
+    (MaxMap+1)*sizeof(cl_uint4));
+  equalizeMapBuffer=CreateOpenCLBuffer(device,CL_MEM_READ_WRITE,
+    (MaxMap+1)*sizeof(PixelPacket),(void *) NULL);
+  boundsBuffer=CreateOpenCLBuffer(device,CL_MEM_READ_WRITE,
+    2*sizeof(cl_uint4),(void *) NULL);
+  if ((histogramInfo == (MagickCLCacheInfo) NULL) ||
+      (equalizeMapBuffer == (cl_mem) NULL) || (boundsBuffer == (cl_mem) NULL))
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+    goto cleanup;
+  }
+
+  equalizeMapKernel=AcquireOpenCLKernel(device,"EqualizeMap");
+  if (equalizeMapKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+  equalizeKernel=AcquireOpenCLKernel(device,"Equalize");
+  if (equalizeKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  if (computeHistogram(device,queue,image,imageBuffer,histogramInfo,histogram,
+        exception) == MagickFalse)
+    goto cleanup;
+
+  i=0;
+  status =SetOpenCLKernelArg(equalizeMapKernel,i++,sizeof(cl_mem),(void *)&histogramInfo->buffer);
+  status|=SetOpenCLKernelArg(equalizeMapKernel,i++,sizeof(cl_mem),(void *)&equalizeMapBuffer);
+  status|=SetOpenCLKernelArg(equalizeMapKernel,i++,sizeof(cl_mem),(void *)&boundsBuffer);
+  status|=SetOpenCLKernelArg(equalizeMapKernel,i++,257*sizeof(cl_uint4),(void *) NULL);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=256;
+  lsize[0]=256;
+  outputReady=EnqueueOpenCLTileKernel(queue,equalizeMapKernel,1,gsize,lsize,
+    histogramInfo,(MagickCLCacheInfo) NULL,(MagickSizeType) MaxMap+1,
+    exception);
+  if (outputReady == MagickFalse)
+    goto cleanup;
+  outputReady=MagickFalse;
+
+  i=0;
+  status =SetOpenCLKernelArg(equalizeKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(equalizeKernel,i++,sizeof(cl_mem),(void *)&equalizeMapBuffer);
+  status|=SetOpenCLKernelArg(equalizeKernel,i++,sizeof(cl_mem),(void *)&boundsBuffer);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  /* the map and the bounds are ordered by the command queue */
+  gsize[0]=image->columns;
+  gsize[1]=image->rows;
+  outputReady=EnqueueOpenCLKernel(queue,equalizeKernel,2,(const size_t *) NULL,
+    gsize,(const size_t *) NULL,image,(const Image *) NULL,MagickFalse,
+    exception);
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (equalizeMapBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(equalizeMapBuffer);
+  if (boundsBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(boundsBuffer);
+  if (equalizeMapKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(equalizeMapKernel);
+  if (equalizeKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(equalizeKernel);
+  /* the upload of the cleared counters may still use the host copy */
+  SyncMagickCLCacheInfo(histogramInfo);
+  histogramInfo=RelinquishMagickCLCacheInfo(histogramInfo,MagickFalse);
+  MagickFreeMemory(histogram);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+
+  return(outputReady);
+}
+
+MagickPrivate MagickBooleanType AccelerateEqualizeImage(Image *image,
+  ExceptionInfo *exception)
+{
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return(MagickFalse);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return(MagickFalse);
+  if (CheckOpenCLOperationCost(clEnv,HistogramCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return(MagickFalse);
+
+  return(ComputeEqualizeImage(image,clEnv,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e G r a y s c a l e I m a g e                         %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static MagickBooleanType ComputeGrayscaleImage(Image *image,MagickCLEnv clEnv,
+  const ColorspaceType colorspace,ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_float
+    blueWeight,
+    greenWeight,
+    redWeight;
+
+  cl_int
+    status;
+
+  cl_kernel
+    grayscaleKernel;
+
+  cl_mem
+    imageBuffer;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLDevice
+    device;
+
+  size_t
+    gsize[2],
+    i;
+
+  grayscaleKernel=NULL;
+  imageBuffer=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  grayscaleKernel=AcquireOpenCLKernel(device,"Grayscale");
+  if (grayscaleKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  /*
+    Same weights as the luma transforms in RGBTransformImage().
+  */
+  if (colorspace == Rec709LumaColorspace)
+    {
+      redWeight=0.2126f;
+      greenWeight=0.7152f;
+      blueWeight=0.0722f;
+    }
+  else
+    {
+      redWeight=0.299f;
+      greenWeight=0.587f;
+      blueWeight=0.114f;
+    }
+
+  i=0;
+  status =SetOpenCLKernelArg(grayscaleKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(grayscaleKernel,i++,sizeof(cl_float),&redWeight);
+  status|=SetOpenCLKernelArg(grayscaleKernel,i++,sizeof(cl_float),&greenWeight);
+  status|=SetOpenCLKernelArg(grayscaleKernel,i++,sizeof(cl_float),&blueWeight);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=image->columns;
+  gsize[1]=image->rows;
+  outputReady=EnqueueOpenCLKernel(queue,grayscaleKernel,2,(const size_t *) NULL,
+    gsize,(const size_t *) NULL,image,(const Image *) NULL,MagickFalse,
+    exception);
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (grayscaleKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(grayscaleKernel);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+
+  return(outputReady);
+}
+
+MagickPrivate MagickBooleanType AccelerateGrayscaleImage(Image *image,
+  const ColorspaceType colorspace,ExceptionInfo *exception)
+{
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if ((colorspace != GRAYColorspace) &&
+      (colorspace != Rec601LumaColorspace) &&
+      (colorspace != Rec709LumaColorspace))
+    return(MagickFalse);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return(MagickFalse);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return(MagickFalse);
+  if (CheckOpenCLOperationCost(clEnv,GrayscaleCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return(MagickFalse);
+
+  return(ComputeGrayscaleImage(image,clEnv,colorspace,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e M o d u l a t e I m a g e                           %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static MagickBooleanType ComputeModulateImage(Image *image,MagickCLEnv clEnv,
+  const double percent_brightness,const double percent_saturation,
+  const double percent_hue,ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_float
+    brightness,
+    hue,
+    saturation;
+
+  cl_int
+    status;
+
+  cl_kernel
+    modulateKernel;
+
+  cl_mem
+    imageBuffer;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLDevice
+    device;
+
+  size_t
+    gsize[2],
+    i;
+
+  modulateKernel=NULL;
+  imageBuffer=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  modulateKernel=AcquireOpenCLKernel(device,"Modulate");
+  if (modulateKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  brightness=(cl_float) percent_brightness;
+  hue=(cl_float) percent_hue;
+  saturation=(cl_float) percent_saturation;
+
+  i=0;
+  status =SetOpenCLKernelArg(modulateKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(modulateKernel,i++,sizeof(cl_float),&brightness);
+  status|=SetOpenCLKernelArg(modulateKernel,i++,sizeof(cl_float),&hue);
+  status|=SetOpenCLKernelArg(modulateKernel,i++,sizeof(cl_float),&saturation);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=image->columns;
+  gsize[1]=image->rows;
+  outputReady=EnqueueOpenCLKernel(queue,modulateKernel,2,(const size_t *) NULL,
+    gsize,(const size_t *) NULL,image,(const Image *) NULL,MagickFalse,
+    exception);
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (modulateKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(modulateKernel);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+
+  return(outputReady);
+}
+
+MagickPrivate MagickBooleanType AccelerateModulateImage(Image *image,
+  const double percent_brightness,const double percent_saturation,
+  const double percent_hue,ExceptionInfo *exception)
+{
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return(MagickFalse);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return(MagickFalse);
+  if (CheckOpenCLOperationCost(clEnv,ModulateCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return(MagickFalse);
+
+  return(ComputeModulateImage(image,clEnv,percent_brightness,
+    percent_saturation,percent_hue,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e M o t i o n B l u r I m a g e                       %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static Image *ComputeMotionBlurImage(const Image *image,MagickCLEnv clEnv,
+  const double *kernel,const unsigned long width,const int *offsets,
+  ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_int
+    status;
+
+  cl_int2
+    *offsetBufferPtr;
+
+  cl_kernel
+    motionBlurKernel;
+
+  cl_mem
+    filteredImageBuffer,
+    imageBuffer,
+    imageKernelBuffer,
+    offsetBuffer;
+
+  cl_uint
+    imageHeight,
+    imageWidth,
+    kernelWidth,
+    matte;
+
+  Image
+    *filteredImage;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLDevice
+    device;
+
+  size_t
+    gsize[2],
+    i,
+    lsize[2];
+
+  filteredImage=NULL;
+  imageBuffer=NULL;
+  filteredImageBuffer=NULL;
+  imageKernelBuffer=NULL;
+  offsetBuffer=NULL;
+  motionBlurKernel=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+
+  filteredImage=CloneImage(image,image->columns,image->rows,MagickTrue,
+    exception);
+  if (filteredImage == (Image *) NULL)
+    goto cleanup;
+  filteredImage->storage_class=DirectClass;
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+  filteredImageBuffer=GetAuthenticOpenCLBuffer(filteredImage,device,exception);
+  if (filteredImageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  imageKernelBuffer=createKernelInfo(device,kernel,width,exception);
+  if (imageKernelBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  offsetBufferPtr=MagickAllocateArray(cl_int2 *,width,sizeof(cl_int2));
+  if (offsetBufferPtr == (cl_int2 *) NULL)
+    goto cleanup;
+  for (i=0; i < width; i++)
+  {
+    offsetBufferPtr[i].s[0]=(cl_int) offsets[2*i];
+    offsetBufferPtr[i].s[1]=(cl_int) offsets[2*i+1];
+  }
+  offsetBuffer=CreateOpenCLBuffer(device,CL_MEM_COPY_HOST_PTR |
+    CL_MEM_READ_ONLY,width*sizeof(cl_int2),offsetBufferPtr);
+  MagickFreeMemory(offsetBufferPtr);
+  if (offsetBuffer == (cl_mem) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+    goto cleanup;
+  }
+
+  motionBlurKernel=AcquireOpenCLKernel(device,"MotionBlur");
+  if (motionBlurKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  imageWidth=(cl_uint) image->columns;
+  imageHeight=(cl_uint) image->rows;
+  kernelWidth=(cl_uint) width;
+  matte=(image->matte != MagickFalse) ? 1 : 0;
+
+  i=0;
+  status =SetOpenCLKernelArg(motionBlurKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(motionBlurKernel,i++,sizeof(cl_mem),(void *)&filteredImageBuffer);
+  status|=SetOpenCLKernelArg(motionBlurKernel,i++,sizeof(cl_uint),&imageWidth);
+  status|=SetOpenCLKernelArg(motionBlurKernel,i++,sizeof(cl_uint),&imageHeight);
+  status|=SetOpenCLKernelArg(motionBlurKernel,i++,sizeof(cl_mem),(void *)&imageKernelBuffer);
+  status|=SetOpenCLKernelArg(motionBlurKernel,i++,sizeof(cl_uint),&kernelWidth);
+  status|=SetOpenCLKernelArg(motionBlurKernel,i++,sizeof(cl_mem),(void *)&offsetBuffer);
+  status|=SetOpenCLKernelArg(motionBlurKernel,i++,sizeof(cl_uint),&matte);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  lsize[0]=16;
+  lsize[1]=16;
+  gsize[0]=lsize[0]*((image->columns+lsize[0]-1)/lsize[0]);
+  gsize[1]=lsize[1]*((image->rows+lsize[1]-1)/lsize[1]);
+  outputReady=EnqueueOpenCLKernel(queue,motionBlurKernel,2,
+    (const size_t *) NULL,gsize,lsize,image,filteredImage,MagickFalse,
+    exception);
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (filteredImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(filteredImageBuffer);
+  if (imageKernelBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageKernelBuffer);
+  if (offsetBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(offsetBuffer);
+  if (motionBlurKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(motionBlurKernel);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+  if ((outputReady == MagickFalse) && (filteredImage != (Image *) NULL))
+  {
+    DestroyImage(filteredImage);
+    filteredImage=(Image *) NULL;
+  }
+
+  return(filteredImage);
+}
+
+MagickPrivate Image *AccelerateMotionBlurImage(const Image *image,
+  const double *kernel,const unsigned long width,const int *offsets,
+  ExceptionInfo *exception)
+{
+  Image
+    *filteredImage;
+
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(kernel != (const double *) NULL);
+  assert(offsets != (const int *) NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return((Image *) NULL);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return((Image *) NULL);
+  if (CheckOpenCLOperationCost(clEnv,MotionBlurCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return((Image *) NULL);
+
+  filteredImage=ComputeMotionBlurImage(image,clEnv,kernel,width,offsets,
+    exception);
+  return(filteredImage);
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e N o r m a l i z e I m a g e                         %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+/*
+  Same as FindHistogramBoundsAlg() in enhance.c.
+*/
+static void findHistogramBounds(const cl_uint4 *histogram,const size_t channel,
+  const double threshold,double *low,double *high)
+{
+  double
+    intensity;
+
+  intensity=0.0;
+  for (*low=0.0; *low < MaxMapDouble; *low+=1.0)
+  {
+    intensity+=histogram[(size_t) *low].s[channel];
+    if (intensity > threshold)
+      break;
+  }
+  intensity=0.0;
+  for (*high=MaxMapDouble; *high >= 1.0; *high-=1.0)
+  {
+    intensity+=histogram[(size_t) *high].s[channel];
+    if (intensity > threshold)
+      break;
+  }
+}
+
+static inline Quantum stretchQuantum(const size_t i,const double low,
+  const double high)
+{
+  if (i < (size_t) low)
+    return(0);
+  if (i > (size_t) high)
+    return(MaxRGB);
+  if (low != high)
+    return(ScaleMapToQuantum((MaxMapDouble*(i-low))/(high-low)));
+  return(0);
+}
+
+static MagickBooleanType ComputeNormalizeImage(Image *image,MagickCLEnv clEnv,
+  const double threshold,ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_float4
+    black,
+    white;
+
+  cl_int
+    status;
+
+  cl_kernel
+    stretchKernel;
+
+  cl_mem
+    imageBuffer,
+    stretchMapBuffer;
+
+  cl_uint
+    channel_mask;
+
+  cl_uint4
+    *histogram;
+
+  DoublePixelPacket
+    high,
+    low;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLCacheInfo
+    histogramInfo;
+
+  MagickCLDevice
+    device;
+
+  PixelPacket
+    *stretchMap;
+
+  size_t
+    gsize[2],
+    i;
+
+  histogram=(cl_uint4 *) NULL;
+  histogramInfo=(MagickCLCacheInfo) NULL;
+  imageBuffer=NULL;
+  stretchKernel=NULL;
+  stretchMap=(PixelPacket *) NULL;
+  stretchMapBuffer=NULL;
+  outputReady=MagickFalse;
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  histogram=MagickAllocateArray(cl_uint4 *,MaxMap+1,sizeof(cl_uint4));
+  stretchMap=MagickAllocateArray(PixelPacket *,MaxMap+1,sizeof(PixelPacket));
+  if ((histogram == (cl_uint4 *) NULL) || (stretchMap == (PixelPacket *) NULL))
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"MemoryAllocationFailed.",".");
+    goto cleanup;
+  }
+  histogramInfo=AcquireMagickCLCacheInfo(device,(Quantum *) NULL,
+    (MaxMap+1)*sizeof(cl_uint4));
+  if (histogramInfo == (MagickCLCacheInfo) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+    goto cleanup;
+  }
+
+  if (computeHistogram(device,queue,image,imageBuffer,histogramInfo,histogram,
+        exception) == MagickFalse)
+    goto cleanup;
+  if (ReadOpenCLBuffer(queue,histogramInfo,(MaxMap+1)*sizeof(cl_uint4),
+        histogram,exception) == MagickFalse)
+    goto cleanup;
+  SyncMagickCLCacheInfo(histogramInfo);
+
+  /*
+    Find the black and white points like NormalizeImage(), the fallback
+    depends on the red bounds for every channel.  The counters of a channel
+    are at its position in a CLPixelType.
+  */
+  findHistogramBounds(histogram,2,threshold,&low.red,&high.red);
+  if (low.red == high.red)
+    findHistogramBounds(histogram,2,0.0,&low.red,&high.red);
+  findHistogramBounds(histogram,1,threshold,&low.green,&high.green);
+  if (low.red == high.red)
+    findHistogramBounds(histogram,1,0.0,&low.green,&high.green);
+  findHistogramBounds(histogram,0,threshold,&low.blue,&high.blue);
+  if (low.red == high.red)
+    findHistogramBounds(histogram,0,0.0,&low.blue,&high.blue);
+  low.opacity=0.0;
+  high.opacity=0.0;
+  if (image->matte)
+    {
+      findHistogramBounds(histogram,3,threshold,&low.opacity,&high.opacity);
+      if (low.red == high.red)
+        findHistogramBounds(histogram,3,0.0,&low.opacity,&high.opacity);
+    }
+  (void) LogMagickEvent(TransformEvent,GetMagickModule(),
+    "Histogram bounds on the device: red %g-%g, green %g-%g, blue %g-%g",
+    low.red,high.red,low.green,high.green,low.blue,high.blue);
+
+  for (i = 0; i <= MaxMap; i++)
+  {
+    stretchMap[i].red=stretchQuantum(i,low.red,high.red);
+    stretchMap[i].green=stretchQuantum(i,low.green,high.green);
+    stretchMap[i].blue=stretchQuantum(i,low.blue,high.blue);
+    stretchMap[i].opacity=stretchQuantum(i,low.opacity,high.opacity);
+  }
+  stretchMapBuffer=CreateOpenCLBuffer(device,CL_MEM_COPY_HOST_PTR |
+    CL_MEM_READ_ONLY,(MaxMap+1)*sizeof(PixelPacket),stretchMap);
+  if (stretchMapBuffer == (cl_mem) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+    goto cleanup;
+  }
+
+  stretchKernel=AcquireOpenCLKernel(device,"ContrastStretch");
+  if (stretchKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  /* channels whose black and white points are equal are left alone */
+  black.s[0]=(cl_float) low.blue;
+  black.s[1]=(cl_float) low.green;
+  black.s[2]=(cl_float) low.red;
+  black.s[3]=(cl_float) low.opacity;
+  white.s[0]=(cl_float) high.blue;
+  white.s[1]=(cl_float) high.green;
+  white.s[2]=(cl_float) high.red;
+  white.s[3]=(cl_float) high.opacity;
+  channel_mask=CLCompositeChannels;
+  i=0;
+  status =SetOpenCLKernelArg(stretchKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(stretchKernel,i++,sizeof(cl_uint),&channel_mask);
+  status|=SetOpenCLKernelArg(stretchKernel,i++,sizeof(cl_mem),(void *)&stretchMapBuffer);
+  status|=SetOpenCLKernelArg(stretchKernel,i++,sizeof(cl_float4),&white);
+  status|=SetOpenCLKernelArg(stretchKernel,i++,sizeof(cl_float4),&black);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=image->columns;
+  gsize[1]=image->rows;
+  outputReady=EnqueueOpenCLKernel(queue,stretchKernel,2,(const size_t *) NULL,
+    gsize,(const size_t *) NULL,image,(const Image *) NULL,MagickFalse,
+    exception);
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (stretchMapBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(stretchMapBuffer);
+  if (stretchKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(stretchKernel);
+  /* a pending transfer may still use the host copy */
+  SyncMagickCLCacheInfo(histogramInfo);
+  histogramInfo=RelinquishMagickCLCacheInfo(histogramInfo,MagickFalse);
+  MagickFreeMemory(histogram);
+  MagickFreeMemory(stretchMap);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+
+  return(outputReady);
+}
+
+MagickPrivate MagickBooleanType AccelerateNormalizeImage(Image *image,
+  const double threshold,ExceptionInfo *exception)
+{
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return(MagickFalse);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return(MagickFalse);
+  if (CheckOpenCLOperationCost(clEnv,HistogramCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return(MagickFalse);
+
+  return(ComputeNormalizeImage(image,clEnv,threshold,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e R e s i z e I m a g e                               %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static MagickBooleanType resizeHorizontalFilter(MagickCLDevice device,
+  cl_command_queue queue,const Image *image,Image *filteredImage,
+  MagickCLCacheInfo imageInfo,MagickCLCacheInfo filteredInfo,
+  cl_mem imageBuffer,cl_uint matte_or_cmyk,cl_uint columns,cl_uint rows,
+  cl_mem resizedImageBuffer,cl_uint resizedColumns,cl_uint resizedRows,
+  cl_uint filter_type,const FilterInfo *resizeFilter,const double blur,
+  cl_mem resizeFilterCubicCoefficients,
+  const float xFactor,ExceptionInfo *exception)
+{
+  cl_kernel
+    horizontalKernel;
+
+  cl_int
+    status;
+
+  const unsigned int
+    workgroupSize = 256;
+
+  float
+    resizeFilterScale,
+    resizeFilterSupport,
+    resizeFilterBlur,
+    scale,
+    support;
+
+  int
+    numCachedPixels,
+    resizeFilterType;
+
+  MagickBooleanType
+    outputReady;
+
+  size_t
+    gammaAccumulatorLocalMemorySize,
+    gsize[2],
+    i,
+    imageCacheLocalMemorySize,
+    pixelAccumulatorLocalMemorySize,
+    lsize[2],
+    totalLocalMemorySize,
+    weightAccumulatorLocalMemorySize;
+
+  unsigned int
+    chunkSize,
+    pixelPerWorkgroup;
+
+  horizontalKernel=NULL;
+  outputReady=MagickFalse;
+
+  /*
+  Apply filter to resize vertically from image to resize image.
+  */
+  scale=blur*MAGICK_MAX(1.0/xFactor,1.0);
+  support=scale*resizeFilter->support;
+  if (support < 0.5)
+  {
+    /*
+    Support too small even for nearest neighbour: Reduce to point
+    sampling.
+    */
+    support=0.5+MagickEpsilon;
+    scale=1.0;
+  }
+  scale=1.0/scale;
+
+  if (resizedColumns < workgroupSize)
+  {
+    chunkSize=32;
+    pixelPerWorkgroup=32;
+  }
+  else
+  {
+    chunkSize=workgroupSize;
+    pixelPerWorkgroup=workgroupSize;
+  }
+
+DisableMSCWarning(4127)
+  while(1)
+RestoreMSCWarning
+  {
+    /* calculate the local memory size needed per workgroup */
+    numCachedPixels=(int) ceil((pixelPerWorkgroup-1)/xFactor+2*support);
+    imageCacheLocalMemorySize=numCachedPixels*sizeof(CLQuantum)*4;
+    totalLocalMemorySize=imageCacheLocalMemorySize;
+
+    /* local size for the pixel accumulator */
+    pixelAccumulatorLocalMemorySize=chunkSize*sizeof(cl_float4);
+    totalLocalMemorySize+=pixelAccumulatorLocalMemorySize;
+
+    /* local memory size for the weight accumulator */
+    weightAccumulatorLocalMemorySize=chunkSize*sizeof(float);
+    totalLocalMemorySize+=weightAccumulatorLocalMemorySize;
+
+    /* local memory size for the gamma accumulator */
+    gammaAccumulatorLocalMemorySize=chunkSize*sizeof(float);
+    totalLocalMemorySize+=gammaAccumulatorLocalMemorySize;
+
+    if (totalLocalMemorySize <= device->local_memory_size)
+      break;
+    else
+    {
+      pixelPerWorkgroup=pixelPerWorkgroup/2;
+      chunkSize=chunkSize/2;
+      if ((pixelPerWorkgroup == 0) || (chunkSize == 0))
+      {
+        /* quit, fallback to CPU */
+        goto cleanup;
+      }
+    }
+  }
+
+  // resizeFilterType=(int)GetResizeFilterWeightingType(resizeFilter);
+  // resizeWindowType=(int)GetResizeFilterWindowWeightingType(resizeFilter);
+  resizeFilterType=filter_type;
+
+  horizontalKernel=AcquireOpenCLKernel(device,"ResizeHorizontalFilter");
+  if (horizontalKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.", ".");
+    goto cleanup;
+  }
+
+  // resizeFilterScale=(float) GetResizeFilterScale(resizeFilter);
+  // resizeFilterSupport=(float) GetResizeFilterSupport(resizeFilter);
+  // resizeFilterWindowSupport=(float) GetResizeFilterWindowSupport(resizeFilter);
+  // resizeFilterBlur=(float) GetResizeFilterBlur(resizeFilter);
+  resizeFilterScale=scale;
+  resizeFilterSupport=support;
+  resizeFilterBlur=blur;
+
+  i=0;
+  status =SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_mem),(void*)&imageBuffer);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&matte_or_cmyk);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&columns);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&rows);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_mem),(void*)&resizedImageBuffer);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&resizedColumns);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_uint),(void*)&resizedRows);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&xFactor);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(int),(void*)&resizeFilterType);
+  // status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(int),(void*)&resizeWindowType);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(cl_mem),(void*)&resizeFilterCubicCoefficients);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&resizeFilterScale);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&resizeFilterSupport);
+  // status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&resizeFilterWindowSupport);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(float),(void*)&resizeFilterBlur);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,imageCacheLocalMemorySize,NULL);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(int),&numCachedPixels);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(unsigned int),&pixelPerWorkgroup);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,sizeof(unsigned int),&chunkSize);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,pixelAccumulatorLocalMemorySize,NULL);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,weightAccumulatorLocalMemorySize,NULL);
+  status|=SetOpenCLKernelArg(horizontalKernel,i++,gammaAccumulatorLocalMemorySize,NULL);
+
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=(resizedColumns+pixelPerWorkgroup-1)/pixelPerWorkgroup*
+    workgroupSize;
+  gsize[1]=resizedRows;
+  lsize[0]=workgroupSize;
+  lsize[1]=1;
+  if (image == (const Image *) NULL)
+    outputReady=EnqueueOpenCLTileKernel(queue,horizontalKernel,2,gsize,lsize,
+      imageInfo,filteredInfo,(MagickSizeType) resizedColumns*resizedRows,exception);
+  else
+    outputReady=EnqueueOpenCLKernel(queue,horizontalKernel,2,
+      (const size_t *) NULL,gsize,lsize,image,filteredImage,MagickFalse,
+      exception);
+
+cleanup:
+
+  if (horizontalKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(horizontalKernel);
+
+  return(outputReady);
+}
+
+static MagickBooleanType resizeVerticalFilter(MagickCLDevice device,
+  cl_command_queue queue,const Image *image,Image * filteredImage,
+  MagickCLCacheInfo imageInfo,MagickCLCacheInfo filteredInfo,
+  cl_mem imageBuffer,cl_uint matte_or_cmyk,cl_uint columns,cl_uint rows,
+  cl_mem resizedImageBuffer,cl_uint resizedColumns,cl_uint resizedRows,
+  cl_uint filter_type,const FilterInfo *resizeFilter,const double blur,
+  cl_mem resizeFilterCubicCoefficients,const float yFactor,
+  const cl_uint inputOffsetY,const cl_uint resizedOffsetY,
+  ExceptionInfo *exception)
+{
+  cl_kernel
+    verticalKernel;
+
+  cl_int
+    status;
+
+  const unsigned int
+    workgroupSize = 256;
+
+  float
+    resizeFilterScale,
+    resizeFilterSupport,
+    resizeFilterBlur,
+    scale,
+    support;
+
+  int
+    numCachedPixels,
+    resizeFilterType;
+
+  MagickBooleanType
+    outputReady;
+
+  size_t
+    gammaAccumulatorLocalMemorySize,
+    gsize[2],
+    i,
+    imageCacheLocalMemorySize,
+    pixelAccumulatorLocalMemorySize,
+    lsize[2],
+    totalLocalMemorySize,
+    weightAccumulatorLocalMemorySize;
+
+  unsigned int
+    chunkSize,
+    pixelPerWorkgroup;
+
+  verticalKernel=NULL;
+  outputReady=MagickFalse;
+
+  /*
+  Apply filter to resize vertically from image to resize image.
+  */
+  scale=blur*MAGICK_MAX(1.0/yFactor,1.0);
+  support=scale*resizeFilter->support;
+  if (support < 0.5)
+  {
+    /*
+    Support too small even for nearest neighbour: Reduce to point
+    sampling.
+    */
+    support=0.5+MagickEpsilon;
     scale=1.0;
   }
-  scale=1.0/scale;
+  scale=1.0/scale;
+
+  if (resizedRows < workgroupSize)
+  {
+    chunkSize=32;
+    pixelPerWorkgroup=32;
+  }
+  else
+  {
+    chunkSize=workgroupSize;
+    pixelPerWorkgroup=workgroupSize;
+  }
+
+DisableMSCWarning(4127)
+  while(1)
+RestoreMSCWarning
+  {
+    /* calculate the local memory size needed per workgroup */
+    numCachedPixels=(int)ceil((pixelPerWorkgroup-1)/yFactor+2*support);
+    imageCacheLocalMemorySize=numCachedPixels*sizeof(CLQuantum)*4;
+    totalLocalMemorySize=imageCacheLocalMemorySize;
+
+    /* local size for the pixel accumulator */
+    pixelAccumulatorLocalMemorySize=chunkSize*sizeof(cl_float4);
+    totalLocalMemorySize+=pixelAccumulatorLocalMemorySize;
+
+    /* local memory size for the weight accumulator */
+    weightAccumulatorLocalMemorySize=chunkSize*sizeof(float);
+    totalLocalMemorySize+=weightAccumulatorLocalMemorySize;
+
+    /* local memory size for the gamma accumulator */
+    gammaAccumulatorLocalMemorySize=chunkSize*sizeof(float);
+    totalLocalMemorySize+=gammaAccumulatorLocalMemorySize;
+
+    if (totalLocalMemorySize <= device->local_memory_size)
+      break;
+    else
+    {
+      pixelPerWorkgroup=pixelPerWorkgroup/2;
+      chunkSize=chunkSize/2;
+      if ((pixelPerWorkgroup == 0) || (chunkSize == 0))
+      {
+        /* quit, fallback to CPU */
+        goto cleanup;
+      }
+    }
+  }
+
+  // resizeFilterType=(int)GetResizeFilterWeightingType(resizeFilter);
+  // resizeWindowType=(int)GetResizeFilterWindowWeightingType(resizeFilter);
+  resizeFilterType=filter_type;
+
+  verticalKernel=AcquireOpenCLKernel(device,"ResizeVerticalFilter");
+  if (verticalKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  // resizeFilterScale=(float) GetResizeFilterScale(resizeFilter);
+  // resizeFilterSupport=(float) GetResizeFilterSupport(resizeFilter);
+  // resizeFilterBlur=(float) GetResizeFilterBlur(resizeFilter);
+  // resizeFilterWindowSupport=(float) GetResizeFilterWindowSupport(resizeFilter);
+  resizeFilterScale=scale;
+  resizeFilterSupport=support;
+  resizeFilterBlur=blur;
+
+  i=0;
+  status =SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_mem),(void*)&imageBuffer);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&matte_or_cmyk);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&columns);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&rows);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_mem),(void*)&resizedImageBuffer);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&resizedColumns);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&resizedRows);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&yFactor);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(int),(void*)&resizeFilterType);
+  // status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(int),(void*)&resizeWindowType);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_mem),(void*)&resizeFilterCubicCoefficients);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&resizeFilterScale);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&resizeFilterSupport);
+  // status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&resizeFilterWindowSupport);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&resizeFilterBlur);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,imageCacheLocalMemorySize, NULL);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(int), &numCachedPixels);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(unsigned int), &pixelPerWorkgroup);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(unsigned int), &chunkSize);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,pixelAccumulatorLocalMemorySize, NULL);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,weightAccumulatorLocalMemorySize, NULL);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,gammaAccumulatorLocalMemorySize, NULL);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&inputOffsetY);
+  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&resizedOffsetY);
+
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=resizedColumns;
+  gsize[1]=(resizedRows+pixelPerWorkgroup-1)/pixelPerWorkgroup*
+    workgroupSize;
+  lsize[0]=1;
+  lsize[1]=workgroupSize;
+  if (image == (const Image *) NULL)
+    outputReady=EnqueueOpenCLTileKernel(queue,verticalKernel,2,gsize,lsize,
+      imageInfo,filteredInfo,(MagickSizeType) resizedColumns*resizedRows,exception);
+  else
+    outputReady=EnqueueOpenCLKernel(queue,verticalKernel,2,
+      (const size_t *) NULL,gsize,lsize,image,filteredImage,MagickFalse,
+      exception);
+
+cleanup:
+
+  if (verticalKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(verticalKernel);
+
+  return(outputReady);
+}
+
+/*
+  Images whose buffers do not fit in a single device allocation are streamed
+  through the resize and scale kernels in bands of rows.  Each band of the
+  source is uploaded together with the rows the filter support reaches into,
+  the kernels are told where the band starts in the whole image and the
+  filtered band is read back into the pixel cache of the destination.
+
+  Uploads, kernels and readbacks run on their own command queues.  The band
+  buffers are cache infos so the commands are ordered by the events that
+  EnqueueOpenCLTileKernel(), WriteOpenCLBuffer() and ReadOpenCLBuffer()
+  register with them.  The filter helpers use the tiles when they are given
+  no image.
+*/
+typedef struct _CLTileInfo
+{
+  MagickCLCacheInfo
+    input,
+    temp,
+    output;
+
+  PixelPacket
+    *input_pixels,
+    *output_pixels;
+
+  size_t
+    rows,
+    y;
+} CLTileInfo;
+
+/*
+  A device streaming a share of the destination rows, from y up to end, in
+  bands.  Every device keeps its own CLTileSlots bands in flight on its own
+  queues.  The bands of several devices are issued round-robin so that the
+  devices work concurrently, see acquireTileSets().
+*/
+typedef struct _CLTileSet
+{
+  MagickCLDevice
+    device;
+
+  cl_command_queue
+    queue,
+    readQueue,
+    writeQueue;
+
+  CLTileInfo
+    tiles[CLTileSlots];
+
+  MagickSizeType
+    limit;
+
+  size_t
+    band,
+    end,
+    maxFilteredRows,
+    maxInputRows,
+    y;
+} CLTileSet;
+
+/*
+  MAGICK_OCL_TILE_LIMIT lowers the limit (in bytes, with an optional K, M or
+  G suffix) so the tests can stream small images in bands.
+*/
+static MagickSizeType getTileBufferLimit(const MagickCLDevice device)
+{
+  const char
+    *option;
+
+  MagickSizeType
+    limit;
+
+  limit=~((MagickSizeType) 0);
+  if (device->max_mem_alloc_size != 0)
+    {
+      /* the whole image path keeps up to three buffers on the device */
+      limit=(MagickSizeType) device->max_mem_alloc_size;
+      if ((device->global_memory_size/4) < limit)
+        limit=(MagickSizeType) device->global_memory_size/4;
+    }
+  option=getenv("MAGICK_OCL_TILE_LIMIT");
+  if (option != (const char *) NULL)
+    {
+      magick_int64_t
+        override;
+
+      override=MagickSizeStrToInt64(option,1024);
+      if ((override > 0) && ((MagickSizeType) override < limit))
+        limit=(MagickSizeType) override;
+    }
+  return(limit);
+}
+
+static void relinquishTileInfos(CLTileInfo *tiles)
+{
+  size_t
+    i;
+
+  for (i = 0; i < CLTileSlots; i++)
+  {
+    /* the pending transfers may still use the host memory */
+    SyncMagickCLCacheInfo(tiles[i].input);
+    SyncMagickCLCacheInfo(tiles[i].temp);
+    SyncMagickCLCacheInfo(tiles[i].output);
+    tiles[i].input=RelinquishMagickCLCacheInfo(tiles[i].input,MagickFalse);
+    tiles[i].temp=RelinquishMagickCLCacheInfo(tiles[i].temp,MagickFalse);
+    tiles[i].output=RelinquishMagickCLCacheInfo(tiles[i].output,MagickFalse);
+    MagickFreeMemory(tiles[i].input_pixels);
+    MagickFreeMemory(tiles[i].output_pixels);
+  }
+}
+
+static MagickBooleanType acquireTileInfos(MagickCLDevice device,
+  CLTileInfo *tiles,const size_t inputLength,const size_t tempLength,
+  const size_t outputLength,ExceptionInfo *exception)
+{
+  size_t
+    i;
+
+  for (i = 0; i < CLTileSlots; i++)
+  {
+    tiles[i].input=AcquireMagickCLCacheInfo(device,(Quantum *) NULL,
+      inputLength);
+    if (tempLength != 0)
+      tiles[i].temp=AcquireMagickCLCacheInfo(device,(Quantum *) NULL,
+        tempLength);
+    tiles[i].output=AcquireMagickCLCacheInfo(device,(Quantum *) NULL,
+      outputLength);
+    if ((tiles[i].input == (MagickCLCacheInfo) NULL) ||
+        ((tempLength != 0) && (tiles[i].temp == (MagickCLCacheInfo) NULL)) ||
+        (tiles[i].output == (MagickCLCacheInfo) NULL))
+    {
+      (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+        ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+      return(MagickFalse);
+    }
+    tiles[i].input_pixels=MagickAllocateMemory(PixelPacket *,inputLength);
+    tiles[i].output_pixels=MagickAllocateMemory(PixelPacket *,outputLength);
+    if ((tiles[i].input_pixels == (PixelPacket *) NULL) ||
+        (tiles[i].output_pixels == (PixelPacket *) NULL))
+    {
+      (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+        ResourceLimitWarning,"MemoryAllocationFailed.",".");
+      return(MagickFalse);
+    }
+  }
+  return(MagickTrue);
+}
+
+static MagickBooleanType flushTileInfo(CLTileInfo *tile,Image *filteredImage,
+  ExceptionInfo *exception)
+{
+  PixelPacket
+    *q;
+
+  SyncMagickCLCacheInfo(tile->input);
+  SyncMagickCLCacheInfo(tile->temp);
+  SyncMagickCLCacheInfo(tile->output);
+  if (tile->rows == 0)
+    return(MagickTrue);
+  q=SetImagePixelsEx(filteredImage,0,(long) tile->y,filteredImage->columns,
+    tile->rows,exception);
+  if (q == (PixelPacket *) NULL)
+    return(MagickFalse);
+  (void) memcpy(q,tile->output_pixels,filteredImage->columns*tile->rows*
+    sizeof(PixelPacket));
+  tile->rows=0;
+  return(SyncImagePixelsEx(filteredImage,exception));
+}
+
+static MagickBooleanType acquireTileSetQueues(CLTileSet *set)
+{
+  set->queue=AcquireOpenCLCommandQueue(set->device);
+  set->writeQueue=AcquireOpenCLCommandQueue(set->device);
+  set->readQueue=AcquireOpenCLCommandQueue(set->device);
+  if ((set->queue == (cl_command_queue) NULL) ||
+      (set->writeQueue == (cl_command_queue) NULL) ||
+      (set->readQueue == (cl_command_queue) NULL))
+    return(MagickFalse);
+  return(MagickTrue);
+}
+
+/* releases the bands and the queues of a set but not its device */
+static void releaseTileSet(CLTileSet *set)
+{
+  relinquishTileInfos(set->tiles);
+  if (set->queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(set->device,set->queue);
+  if (set->writeQueue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(set->device,set->writeQueue);
+  if (set->readQueue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(set->device,set->readQueue);
+  set->queue=(cl_command_queue) NULL;
+  set->writeQueue=(cl_command_queue) NULL;
+  set->readQueue=(cl_command_queue) NULL;
+}
+
+/*
+  Returns the enabled devices.  MAGICK_OCL_TILE_SETS asks for at least that
+  many, repeating the devices, so the tests can share the rows of an image
+  between the sets of a single device.
+*/
+static MagickCLDevice *requestTileDevices(MagickCLEnv clEnv,
+  size_t *number_devices)
+{
+  const char
+    *option;
+
+  MagickCLDevice
+    *all,
+    *devices,
+    *more;
+
+  size_t
+    number_more,
+    wanted;
+
+  devices=RequestOpenCLDevices(clEnv,number_devices);
+  option=getenv("MAGICK_OCL_TILE_SETS");
+  if ((option == (const char *) NULL) || (*number_devices == 0))
+    return(devices);
+  wanted=(size_t) MagickAtoL(option);
+  while (*number_devices < wanted)
+  {
+    more=RequestOpenCLDevices(clEnv,&number_more);
+    if (more == (MagickCLDevice *) NULL)
+      break;
+    all=(MagickCLDevice *) AcquireQuantumMemory(*number_devices+number_more,
+      sizeof(*all));
+    if (all == (MagickCLDevice *) NULL)
+      {
+        more=ReleaseOpenCLDevices(more,number_more);
+        break;
+      }
+    (void) memcpy(all,devices,*number_devices*sizeof(*all));
+    (void) memcpy(all+*number_devices,more,number_more*sizeof(*all));
+    *number_devices+=number_more;
+    devices=(MagickCLDevice *) RelinquishMagickMemory(devices);
+    more=(MagickCLDevice *) RelinquishMagickMemory(more);
+    devices=all;
+  }
+  return(devices);
+}
+
+/*
+  Shares the rows of the destination between all the enabled devices in
+  proportion to their speed, a lower benchmark score being a faster device.
+  NULL is returned, and the caller uses a single device, when there are
+  not at least two devices with enough pixels to be worth their transfers.
+*/
+static CLTileSet *acquireTileSets(MagickCLEnv clEnv,const size_t columns,
+  const size_t rows,size_t *number_sets)
+{
+  CLTileSet
+    *sets;
+
+  double
+    total,
+    *weights;
+
+  MagickCLDevice
+    *devices;
+
+  size_t
+    i,
+    number_devices,
+    requested_devices,
+    y;
+
+  *number_sets=0;
+  devices=requestTileDevices(clEnv,&requested_devices);
+  number_devices=MAGICK_MIN(requested_devices,rows);
+  if ((MagickSizeType) columns*rows < (MagickSizeType) number_devices*
+        MAGICKCORE_OPENCL_MINIMUM_PIXELS)
+    number_devices=(size_t) ((MagickSizeType) columns*rows/
+      MAGICKCORE_OPENCL_MINIMUM_PIXELS);
+  if (number_devices < 2)
+    {
+      devices=ReleaseOpenCLDevices(devices,requested_devices);
+      return((CLTileSet *) NULL);
+    }
+  sets=MagickAllocateArray(CLTileSet *,number_devices,sizeof(*sets));
+  weights=MagickAllocateArray(double *,number_devices,sizeof(*weights));
+  if ((sets == (CLTileSet *) NULL) || (weights == (double *) NULL))
+    {
+      MagickFreeMemory(sets);
+      MagickFreeMemory(weights);
+      devices=ReleaseOpenCLDevices(devices,requested_devices);
+      return((CLTileSet *) NULL);
+    }
+  (void) memset(sets,0,number_devices*sizeof(*sets));
+
+  /* the devices are equal when one of them was not benchmarked */
+  total=0.0;
+  for (i = 0; i < number_devices; i++)
+  {
+    if (devices[i]->score <= 0.0)
+      break;
+    weights[i]=1.0/devices[i]->score;
+    total+=weights[i];
+  }
+  if (i < number_devices)
+    {
+      for (i = 0; i < number_devices; i++)
+        weights[i]=1.0;
+      total=(double) number_devices;
+    }
+
+  for (i = 0, y = 0; i < number_devices; i++)
+  {
+    sets[i].device=devices[i];
+    sets[i].limit=getTileBufferLimit(devices[i]);
+    sets[i].y=y;
+    y+=(size_t) (rows*weights[i]/total+0.5);
+    if ((i == (number_devices-1)) || (y > rows))
+      y=rows;
+    sets[i].end=y;
+    (void) LogMagickEvent(AccelerateEvent,GetMagickModule(),
+      "%s filters rows %.20g to %.20g",devices[i]->name,(double) sets[i].y,
+      (double) sets[i].end);
+  }
+  /* the sets hold the devices they use, the others are returned */
+  for (i = number_devices; i < requested_devices; i++)
+    ReleaseOpenCLDevice(devices[i]);
+  devices=(MagickCLDevice *) RelinquishMagickMemory(devices);
+  MagickFreeMemory(weights);
+  *number_sets=number_devices;
+  return(sets);
+}
+
+static CLTileSet *relinquishTileSets(CLTileSet *sets,const size_t number_sets)
+{
+  size_t
+    i;
+
+  for (i = 0; i < number_sets; i++)
+    ReleaseOpenCLDevice(sets[i].device);
+  MagickFreeMemory(sets);
+  return((CLTileSet *) NULL);
+}
+
+static MagickBooleanType resizeImageTiles(CLTileSet *sets,
+  const size_t number_sets,const Image *image,Image *filteredImage,
+  const size_t filter_type,const FilterInfo *filter_info,const double blur,
+  ExceptionInfo *exception)
+{
+  cl_uint
+    matte_or_cmyk;
+
+  CLTileInfo
+    *tile;
+
+  CLTileSet
+    *set;
+
+  const PixelPacket
+    *p;
+
+  double
+    support;
+
+  float
+    xFactor,
+    yFactor;
+
+  long
+    start;
+
+  MagickBooleanType
+    outputReady,
+    pending;
+
+  MagickSizeType
+    tileLimit;
+
+  size_t
+    filteredTileRows,
+    filteredY,
+    i,
+    inputEnd,
+    inputTileRows,
+    inputY,
+    j;
+
+  outputReady=MagickFalse;
+
+  matte_or_cmyk=(image->matte || image->colorspace == CMYKColorspace)?1:0;
+  xFactor=(float) filteredImage->columns/(float) image->columns;
+  yFactor=(float) filteredImage->rows/(float) image->rows;
+  support=blur*MAGICK_MAX(1.0/yFactor,1.0)*filter_info->support;
+  if (support < 0.5)
+    support=0.5+MagickEpsilon;
+
+  for (i = 0; i < number_sets; i++)
+  {
+    /*
+      The horizontal pass keeps the source rows of a band, the vertical pass
+      needs the rows the support reaches into above and below the band.
+    */
+    set=sets+i;
+    if (set->y >= set->end)
+      continue;
+    tileLimit=MAGICK_MIN(set->limit/CLTileSlots,CLTileBufferSize);
+    set->maxInputRows=(size_t) (tileLimit/(MAGICK_MAX(image->columns,
+      filteredImage->columns)*sizeof(PixelPacket)));
+    if (set->maxInputRows >= image->rows)
+      {
+        set->maxInputRows=image->rows;
+        set->maxFilteredRows=filteredImage->rows;
+      }
+    else
+      {
+        if ((double) set->maxInputRows <= (2.0*support+4.0))
+          goto cleanup;
+        set->maxFilteredRows=(size_t) ((set->maxInputRows-2.0*support-4.0)*
+          yFactor);
+      }
+    set->maxFilteredRows=MAGICK_MIN(set->maxFilteredRows,(size_t) (tileLimit/
+      (filteredImage->columns*sizeof(PixelPacket))));
+    set->maxFilteredRows=MAGICK_MIN(set->maxFilteredRows,set->end-set->y);
+    if (set->maxFilteredRows == 0)
+      goto cleanup;
+
+    if (acquireTileInfos(set->device,set->tiles,image->columns*
+          set->maxInputRows*sizeof(PixelPacket),filteredImage->columns*
+          set->maxInputRows*sizeof(PixelPacket),filteredImage->columns*
+          set->maxFilteredRows*sizeof(PixelPacket),exception) == MagickFalse)
+      goto cleanup;
+    if (acquireTileSetQueues(set) == MagickFalse)
+      goto cleanup;
+  }
+
+  do
+  {
+    pending=MagickFalse;
+    for (i = 0; i < number_sets; i++)
+    {
+      set=sets+i;
+      if (set->y >= set->end)
+        continue;
+      pending=MagickTrue;
+
+      /* the band that used this slot before has to leave it first */
+      tile=set->tiles+(set->band % CLTileSlots);
+      outputReady=flushTileInfo(tile,filteredImage,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+      outputReady=MagickFalse;
+
+      filteredY=set->y;
+      filteredTileRows=MAGICK_MIN(set->maxFilteredRows,set->end-filteredY);
+      start=(long) ((filteredY+0.5)/yFactor+MagickEpsilon-support+0.5)-1;
+      inputY=start > 0 ? (size_t) start : 0;
+      inputEnd=(size_t) ((filteredY+filteredTileRows-0.5)/yFactor+
+        MagickEpsilon+support+0.5)+2;
+      inputEnd=MAGICK_MIN(inputEnd,image->rows);
+      inputTileRows=inputEnd-inputY;
+      if (inputTileRows > set->maxInputRows)
+        goto cleanup;
+
+      p=AcquireImagePixels(image,0,(long) inputY,image->columns,inputTileRows,
+        exception);
+      if (p == (const PixelPacket *) NULL)
+        goto cleanup;
+      (void) memcpy(tile->input_pixels,p,image->columns*inputTileRows*
+        sizeof(PixelPacket));
+      outputReady=WriteOpenCLBuffer(set->writeQueue,tile->input,
+        image->columns*inputTileRows*sizeof(PixelPacket),tile->input_pixels,
+        exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+
+      outputReady=resizeHorizontalFilter(set->device,set->queue,
+        (const Image *) NULL,(Image *) NULL,tile->input,tile->temp,
+        tile->input->buffer,matte_or_cmyk,(cl_uint) image->columns,
+        (cl_uint) inputTileRows,tile->temp->buffer,
+        (cl_uint) filteredImage->columns,(cl_uint) inputTileRows,filter_type,
+        filter_info,blur,(cl_mem) NULL,xFactor,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+
+      outputReady=resizeVerticalFilter(set->device,set->queue,
+        (const Image *) NULL,(Image *) NULL,tile->temp,tile->output,
+        tile->temp->buffer,matte_or_cmyk,(cl_uint) filteredImage->columns,
+        (cl_uint) inputTileRows,tile->output->buffer,
+        (cl_uint) filteredImage->columns,(cl_uint) filteredTileRows,
+        filter_type,filter_info,blur,(cl_mem) NULL,yFactor,(cl_uint) inputY,
+        (cl_uint) filteredY,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+
+      outputReady=ReadOpenCLBuffer(set->readQueue,tile->output,
+        filteredImage->columns*filteredTileRows*sizeof(PixelPacket),
+        tile->output_pixels,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+      tile->y=filteredY;
+      tile->rows=filteredTileRows;
+      set->y+=filteredTileRows;
+      set->band++;
+    }
+  } while (pending != MagickFalse);
+
+  /* store the bands that are still in flight, oldest first */
+  for (i = 0; i < number_sets; i++)
+    for (j = 0; j < CLTileSlots; j++)
+    {
+      outputReady=flushTileInfo(sets[i].tiles+((sets[i].band+j) %
+        CLTileSlots),filteredImage,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+    }
+
+cleanup:
+
+  for (i = 0; i < number_sets; i++)
+    releaseTileSet(sets+i);
+
+  return(outputReady);
+}
+
+static Image *ComputeResizeImage(const Image* image,MagickCLEnv clEnv,
+  const size_t resizedColumns,const size_t resizedRows,const size_t filter_type,
+  const FilterInfo *filter_info,const double blur,ExceptionInfo *exception)
+{
+  cl_command_queue
+    queue;
+
+  cl_mem
+    cubicCoefficientsBuffer,
+    filteredImageBuffer,
+    imageBuffer,
+    tempImageBuffer;
+
+  cl_uint
+    matte_or_cmyk;
+
+  CLTileSet
+    *sets,
+    tileSet;
+
+  const double
+    *resizeFilterCoefficient;
+
+  float
+    coefficientBuffer[7],
+    xFactor,
+    yFactor;
+
+  MagickBooleanType
+    outputReady;
+
+  MagickCLDevice
+    device;
+
+  MagickSizeType
+    length,
+    limit;
+
+  Image
+    *filteredImage;
+
+  size_t
+    i,
+    number_sets;
+
+  filteredImage=NULL;
+  imageBuffer=NULL;
+  filteredImageBuffer=NULL;
+  tempImageBuffer=NULL;
+  cubicCoefficientsBuffer=NULL;
+  device=NULL;
+  queue=NULL;
+  outputReady=MagickFalse;
+
+  /* share the rows between the devices when there are several */
+  sets=acquireTileSets(clEnv,resizedColumns,resizedRows,&number_sets);
+  if (sets != (CLTileSet *) NULL)
+  {
+    filteredImage=CloneImage(image,resizedColumns,resizedRows,MagickTrue,
+      exception);
+    if (filteredImage == (Image *) NULL)
+      goto cleanup;
+    outputReady=resizeImageTiles(sets,number_sets,image,filteredImage,
+      filter_type,filter_info,blur,exception);
+    goto cleanup;
+  }
+
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+  filteredImage=CloneImage(image,resizedColumns,resizedRows,MagickTrue,
+    exception);
+  if (filteredImage == (Image *) NULL)
+    goto cleanup;
+  limit=getTileBufferLimit(device);
+  length=MAGICK_MAX(MAGICK_MAX(image->columns*image->rows,
+    resizedColumns*resizedRows),MAGICK_MAX(resizedColumns*image->rows,
+    image->columns*resizedRows));
+  if (length*sizeof(PixelPacket) > limit)
+  {
+    (void) memset(&tileSet,0,sizeof(tileSet));
+    tileSet.device=device;
+    tileSet.limit=limit;
+    tileSet.end=resizedRows;
+    outputReady=resizeImageTiles(&tileSet,1,image,filteredImage,filter_type,
+      filter_info,blur,exception);
+    goto cleanup;
+  }
+  // if (filteredImage->number_channels != image->number_channels)
+  //   goto cleanup;
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+  filteredImageBuffer=GetAuthenticOpenCLBuffer(filteredImage,device,exception);
+  if (filteredImageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  /* resizeFilterCoefficient=GetResizeFilterCoefficient(resizeFilter);
+  for (i = 0; i < 7; i++)
+    coefficientBuffer[i]=(float) resizeFilterCoefficient[i];
+  cubicCoefficientsBuffer=CreateOpenCLBuffer(device,CL_MEM_COPY_HOST_PTR |
+    CL_MEM_READ_ONLY,sizeof(coefficientBuffer),&coefficientBuffer);
+  if (cubicCoefficientsBuffer == (cl_mem) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+    goto cleanup;
+  } */
+
+  // No number_channels in struct _Image in GM
+  // number_channels=(cl_uint) image->number_channels;
+  matte_or_cmyk=(image->matte || image->colorspace == CMYKColorspace)?1:0;
+  xFactor=(float) resizedColumns/(float) image->columns;
+  yFactor=(float) resizedRows/(float) image->rows;
+  if (xFactor > yFactor)
+  {
+    length=resizedColumns*image->rows*4;
+    tempImageBuffer=CreateOpenCLBuffer(device,CL_MEM_READ_WRITE,length*
+      sizeof(CLQuantum),(void *) NULL);
+    if (tempImageBuffer == (cl_mem) NULL)
+    {
+      (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+        ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+      goto cleanup;
+    }
+
+    outputReady=resizeHorizontalFilter(device,queue,image,filteredImage,
+      (MagickCLCacheInfo) NULL,(MagickCLCacheInfo) NULL,
+      imageBuffer,matte_or_cmyk,(cl_uint) image->columns,
+      (cl_uint) image->rows,tempImageBuffer,(cl_uint) resizedColumns,
+      (cl_uint) image->rows,filter_type,filter_info,blur,
+      cubicCoefficientsBuffer,xFactor,exception);
+    if (outputReady == MagickFalse)
+      goto cleanup;
+
+    outputReady=resizeVerticalFilter(device,queue,image,filteredImage,
+      (MagickCLCacheInfo) NULL,(MagickCLCacheInfo) NULL,
+      tempImageBuffer,matte_or_cmyk,(cl_uint) resizedColumns,
+      (cl_uint) image->rows,filteredImageBuffer,(cl_uint) resizedColumns,
+      (cl_uint) resizedRows,filter_type,filter_info,blur,
+      cubicCoefficientsBuffer,yFactor,0,0,exception);
+    if (outputReady == MagickFalse)
+      goto cleanup;
+  }
+  else
+  {
+    length=image->columns*resizedRows*4;
+    tempImageBuffer=CreateOpenCLBuffer(device,CL_MEM_READ_WRITE,length*
+      sizeof(CLQuantum),(void *) NULL);
+    if (tempImageBuffer == (cl_mem) NULL)
+    {
+      (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+        ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+      goto cleanup;
+    }
 
-  if (resizedRows < workgroupSize)
+    outputReady=resizeVerticalFilter(device,queue,image,filteredImage,
+      (MagickCLCacheInfo) NULL,(MagickCLCacheInfo) NULL,
+      imageBuffer,matte_or_cmyk,(cl_uint) image->columns,
+      (cl_int) image->rows,tempImageBuffer,(cl_uint) image->columns,
+      (cl_uint) resizedRows,filter_type,filter_info,blur,
+      cubicCoefficientsBuffer,yFactor,0,0,exception);
+    if (outputReady == MagickFalse)
+      goto cleanup;
+
+    outputReady=resizeHorizontalFilter(device,queue,image,filteredImage,
+      (MagickCLCacheInfo) NULL,(MagickCLCacheInfo) NULL,
+      tempImageBuffer,matte_or_cmyk,(cl_uint) image->columns,
+      (cl_uint) resizedRows,filteredImageBuffer,(cl_uint) resizedColumns,
+      (cl_uint) resizedRows,filter_type,filter_info,blur,
+      cubicCoefficientsBuffer,xFactor,exception);
+    if (outputReady == MagickFalse)
+      goto cleanup;
+  }
+
+cleanup:
+
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (filteredImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(filteredImageBuffer);
+  if (tempImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(tempImageBuffer);
+  if (cubicCoefficientsBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(cubicCoefficientsBuffer);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+  if (sets != (CLTileSet *) NULL)
+    sets=relinquishTileSets(sets,number_sets);
+  if ((outputReady == MagickFalse) && (filteredImage != (Image *) NULL))
+  {
+    DestroyImage(filteredImage);
+    filteredImage=(Image *) NULL;
+  }
+
+  return(filteredImage);
+}
+
+MagickPrivate Image *AccelerateResizeImage(const Image *image,
+  const size_t resizedColumns,const size_t resizedRows,const size_t filter_type,
+  const FilterInfo *filter_info,const double blur,ExceptionInfo *exception)
+{
+  Image
+    *filteredImage;
+
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return((Image *) NULL);
+
+  // if ((gpuSupportedResizeWeighting(GetResizeFilterWeightingType(
+  //        resizeFilter)) == MagickFalse) ||
+  //     (gpuSupportedResizeWeighting(GetResizeFilterWindowWeightingType(
+  //        resizeFilter)) == MagickFalse))
+  //   return((Image *) NULL);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return((Image *) NULL);
+  if (CheckOpenCLOperationCost(clEnv,ResizeCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) resizedColumns*resizedRows) == MagickFalse)
+    return((Image *) NULL);
+
+  filteredImage=ComputeResizeImage(image,clEnv,resizedColumns,resizedRows,
+    filter_type,filter_info,blur,exception);
+  return(filteredImage);
+}
+
+static MagickBooleanType scaleFilter(MagickCLDevice device,
+  cl_command_queue queue,const Image *image,Image *filteredImage,
+  MagickCLCacheInfo imageInfo,MagickCLCacheInfo filteredInfo,
+  cl_mem imageBuffer,cl_uint matte_or_cmyk,cl_uint columns,cl_uint rows,
+  cl_mem scaledImageBuffer,cl_uint scaledColumns,cl_uint scaledRows,
+  const float yFactor,const cl_uint inputOffsetY,const cl_uint scaledOffsetY,
+  ExceptionInfo *exception)
+{
+  cl_kernel
+    scaleKernel;
+
+  cl_int
+    status;
+
+  const unsigned int
+    workgroupSize = 256;
+
+  float
+    xFactor;
+
+  int
+    numCachedPixels;
+
+  MagickBooleanType
+    outputReady;
+
+  size_t
+    gsize[2],
+    i,
+    imageCacheLocalMemorySize,
+    pixelAccumulatorLocalMemorySize,
+    lsize[2],
+    totalLocalMemorySize;
+
+  unsigned int
+    chunkSize,
+    pixelPerWorkgroup;
+
+  scaleKernel=NULL;
+  outputReady=MagickFalse;
+
+  xFactor=(float) scaledColumns/columns;
+
+  if (scaledColumns < workgroupSize)
   {
     chunkSize=32;
     pixelPerWorkgroup=32;
@@ -492,131 +3660,257 @@ static MagickBooleanType resizeVerticalFilter(MagickCLDevice device,
     pixelPerWorkgroup=workgroupSize;
   }
 
-DisableMSCWarning(4127)
-  while(1)
-RestoreMSCWarning
-  {
-    /* calculate the local memory size needed per workgroup */
-    numCachedPixels=(int)ceil((pixelPerWorkgroup-1)/yFactor+2*support);
-    imageCacheLocalMemorySize=numCachedPixels*sizeof(CLQuantum)*4;
-    totalLocalMemorySize=imageCacheLocalMemorySize;
+DisableMSCWarning(4127)
+  while(1)
+RestoreMSCWarning
+  {
+    /* calculate the local memory size needed per workgroup */
+    numCachedPixels=(int) ceil((pixelPerWorkgroup-1)/xFactor+2*(0.5+MagickEpsilon));
+    imageCacheLocalMemorySize=numCachedPixels*sizeof(CLQuantum)*4;
+    totalLocalMemorySize=imageCacheLocalMemorySize;
+
+    /* local size for the pixel accumulator */
+    pixelAccumulatorLocalMemorySize=chunkSize*sizeof(cl_float4);
+    totalLocalMemorySize+=pixelAccumulatorLocalMemorySize;
+
+    if (totalLocalMemorySize <= device->local_memory_size)
+      break;
+    else
+    {
+      pixelPerWorkgroup=pixelPerWorkgroup/2;
+      chunkSize=chunkSize/2;
+      if ((pixelPerWorkgroup == 0) || (chunkSize == 0))
+      {
+        /* quit, fallback to CPU */
+        goto cleanup;
+      }
+    }
+  }
+
+  scaleKernel=AcquireOpenCLKernel(device,"ScaleFilter");
+  if (scaleKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.", ".");
+    goto cleanup;
+  }
+
+  i=0;
+  status =SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_mem),(void*)&imageBuffer);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&matte_or_cmyk);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&columns);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&rows);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_mem),(void*)&scaledImageBuffer);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&scaledColumns);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&scaledRows);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,imageCacheLocalMemorySize,NULL);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(int),&numCachedPixels);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(unsigned int),&pixelPerWorkgroup);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(unsigned int),&chunkSize);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,pixelAccumulatorLocalMemorySize,NULL);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(float),(void*)&yFactor);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&inputOffsetY);
+  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&scaledOffsetY);
+
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
+    goto cleanup;
+  }
+
+  gsize[0]=(scaledColumns+pixelPerWorkgroup-1)/pixelPerWorkgroup*
+    workgroupSize;
+  gsize[1]=scaledRows;
+  lsize[0]=workgroupSize;
+  lsize[1]=1;
+  if (image == (const Image *) NULL)
+    outputReady=EnqueueOpenCLTileKernel(queue,scaleKernel,2,gsize,lsize,
+      imageInfo,filteredInfo,(MagickSizeType) scaledColumns*scaledRows,exception);
+  else
+    outputReady=EnqueueOpenCLKernel(queue,scaleKernel,2,
+      (const size_t *) NULL,gsize,lsize,image,filteredImage,MagickFalse,
+      exception);
+
+cleanup:
+
+  if (scaleKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(scaleKernel);
+
+  return(outputReady);
+}
+
+static MagickBooleanType scaleImageTiles(CLTileSet *sets,
+  const size_t number_sets,const Image *image,Image *filteredImage,
+  ExceptionInfo *exception)
+{
+  cl_uint
+    matte_or_cmyk;
+
+  CLTileInfo
+    *tile;
+
+  CLTileSet
+    *set;
+
+  const PixelPacket
+    *p;
+
+  float
+    yFactor;
 
-    /* local size for the pixel accumulator */
-    pixelAccumulatorLocalMemorySize=chunkSize*sizeof(cl_float4);
-    totalLocalMemorySize+=pixelAccumulatorLocalMemorySize;
+  long
+    start;
 
-    /* local memory size for the weight accumulator */
-    weightAccumulatorLocalMemorySize=chunkSize*sizeof(float);
-    totalLocalMemorySize+=weightAccumulatorLocalMemorySize;
+  MagickBooleanType
+    outputReady,
+    pending;
 
-    /* local memory size for the gamma accumulator */
-    gammaAccumulatorLocalMemorySize=chunkSize*sizeof(float);
-    totalLocalMemorySize+=gammaAccumulatorLocalMemorySize;
+  MagickSizeType
+    tileLimit;
 
-    if (totalLocalMemorySize <= device->local_memory_size)
-      break;
+  size_t
+    filteredTileRows,
+    filteredY,
+    i,
+    inputEnd,
+    inputTileRows,
+    inputY,
+    j;
+
+  outputReady=MagickFalse;
+
+  matte_or_cmyk=(image->matte || image->colorspace == CMYKColorspace)?1:0;
+  yFactor=(float) filteredImage->rows/(float) image->rows;
+
+  for (i = 0; i < number_sets; i++)
+  {
+    /* each scaled row samples a single source row */
+    set=sets+i;
+    if (set->y >= set->end)
+      continue;
+    tileLimit=MAGICK_MIN(set->limit/CLTileSlots,CLTileBufferSize);
+    set->maxInputRows=(size_t) (tileLimit/(image->columns*
+      sizeof(PixelPacket)));
+    if (set->maxInputRows >= image->rows)
+      {
+        set->maxInputRows=image->rows;
+        set->maxFilteredRows=filteredImage->rows;
+      }
     else
-    {
-      pixelPerWorkgroup=pixelPerWorkgroup/2;
-      chunkSize=chunkSize/2;
-      if ((pixelPerWorkgroup == 0) || (chunkSize == 0))
       {
-        /* quit, fallback to CPU */
-        goto cleanup;
+        if (set->maxInputRows <= 3)
+          goto cleanup;
+        set->maxFilteredRows=(size_t) ((set->maxInputRows-3)*yFactor);
       }
-    }
-  }
+    set->maxFilteredRows=MAGICK_MIN(set->maxFilteredRows,(size_t) (tileLimit/
+      (filteredImage->columns*sizeof(PixelPacket))));
+    set->maxFilteredRows=MAGICK_MIN(set->maxFilteredRows,set->end-set->y);
+    if (set->maxFilteredRows == 0)
+      goto cleanup;
 
-  // resizeFilterType=(int)GetResizeFilterWeightingType(resizeFilter);
-  // resizeWindowType=(int)GetResizeFilterWindowWeightingType(resizeFilter);
-  resizeFilterType=filter_type;
+    if (acquireTileInfos(set->device,set->tiles,image->columns*
+          set->maxInputRows*sizeof(PixelPacket),0,filteredImage->columns*
+          set->maxFilteredRows*sizeof(PixelPacket),exception) == MagickFalse)
+      goto cleanup;
+    if (acquireTileSetQueues(set) == MagickFalse)
+      goto cleanup;
+  }
 
-  verticalKernel=AcquireOpenCLKernel(device,"ResizeVerticalFilter");
-  if (verticalKernel == (cl_kernel) NULL)
+  do
   {
-    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
-      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
-    goto cleanup;
-  }
+    pending=MagickFalse;
+    for (i = 0; i < number_sets; i++)
+    {
+      set=sets+i;
+      if (set->y >= set->end)
+        continue;
+      pending=MagickTrue;
+
+      /* the band that used this slot before has to leave it first */
+      tile=set->tiles+(set->band % CLTileSlots);
+      outputReady=flushTileInfo(tile,filteredImage,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+      outputReady=MagickFalse;
+
+      filteredY=set->y;
+      filteredTileRows=MAGICK_MIN(set->maxFilteredRows,set->end-filteredY);
+      start=(long) (filteredY/yFactor)-1;
+      inputY=start > 0 ? (size_t) start : 0;
+      inputEnd=(size_t) ((filteredY+filteredTileRows-1)/yFactor)+2;
+      inputEnd=MAGICK_MIN(inputEnd,image->rows);
+      inputTileRows=inputEnd-inputY;
+      if (inputTileRows > set->maxInputRows)
+        goto cleanup;
 
-  // resizeFilterScale=(float) GetResizeFilterScale(resizeFilter);
-  // resizeFilterSupport=(float) GetResizeFilterSupport(resizeFilter);
-  // resizeFilterBlur=(float) GetResizeFilterBlur(resizeFilter);
-  // resizeFilterWindowSupport=(float) GetResizeFilterWindowSupport(resizeFilter);
-  resizeFilterScale=scale;
-  resizeFilterSupport=support;
-  resizeFilterBlur=blur;
+      p=AcquireImagePixels(image,0,(long) inputY,image->columns,inputTileRows,
+        exception);
+      if (p == (const PixelPacket *) NULL)
+        goto cleanup;
+      (void) memcpy(tile->input_pixels,p,image->columns*inputTileRows*
+        sizeof(PixelPacket));
+      outputReady=WriteOpenCLBuffer(set->writeQueue,tile->input,
+        image->columns*inputTileRows*sizeof(PixelPacket),tile->input_pixels,
+        exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
 
-  i=0;
-  status =SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_mem),(void*)&imageBuffer);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&matte_or_cmyk);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&columns);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&rows);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_mem),(void*)&resizedImageBuffer);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&resizedColumns);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_uint),(void*)&resizedRows);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&yFactor);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(int),(void*)&resizeFilterType);
-  // status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(int),(void*)&resizeWindowType);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(cl_mem),(void*)&resizeFilterCubicCoefficients);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&resizeFilterScale);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&resizeFilterSupport);
-  // status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&resizeFilterWindowSupport);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(float),(void*)&resizeFilterBlur);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,imageCacheLocalMemorySize, NULL);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(int), &numCachedPixels);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(unsigned int), &pixelPerWorkgroup);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,sizeof(unsigned int), &chunkSize);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,pixelAccumulatorLocalMemorySize, NULL);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,weightAccumulatorLocalMemorySize, NULL);
-  status|=SetOpenCLKernelArg(verticalKernel,i++,gammaAccumulatorLocalMemorySize, NULL);
+      outputReady=scaleFilter(set->device,set->queue,(const Image *) NULL,
+        (Image *) NULL,tile->input,tile->output,tile->input->buffer,
+        matte_or_cmyk,(cl_uint) image->columns,(cl_uint) inputTileRows,
+        tile->output->buffer,(cl_uint) filteredImage->columns,
+        (cl_uint) filteredTileRows,yFactor,(cl_uint) inputY,
+        (cl_uint) filteredY,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
 
-  if (status != CL_SUCCESS)
-  {
-    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
-      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
-    goto cleanup;
-  }
+      outputReady=ReadOpenCLBuffer(set->readQueue,tile->output,
+        filteredImage->columns*filteredTileRows*sizeof(PixelPacket),
+        tile->output_pixels,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+      tile->y=filteredY;
+      tile->rows=filteredTileRows;
+      set->y+=filteredTileRows;
+      set->band++;
+    }
+  } while (pending != MagickFalse);
 
-  gsize[0]=resizedColumns;
-  gsize[1]=(resizedRows+pixelPerWorkgroup-1)/pixelPerWorkgroup*
-    workgroupSize;
-  lsize[0]=1;
-  lsize[1]=workgroupSize;
-  outputReady=EnqueueOpenCLKernel(queue,verticalKernel,2,(const size_t *) NULL,
-    gsize,lsize,image,filteredImage,MagickFalse,exception);
+  /* store the bands that are still in flight, oldest first */
+  for (i = 0; i < number_sets; i++)
+    for (j = 0; j < CLTileSlots; j++)
+    {
+      outputReady=flushTileInfo(sets[i].tiles+((sets[i].band+j) %
+        CLTileSlots),filteredImage,exception);
+      if (outputReady == MagickFalse)
+        goto cleanup;
+    }
 
 cleanup:
 
-  if (verticalKernel != (cl_kernel) NULL)
-    ReleaseOpenCLKernel(verticalKernel);
+  for (i = 0; i < number_sets; i++)
+    releaseTileSet(sets+i);
 
   return(outputReady);
 }
 
-static Image *ComputeResizeImage(const Image* image,MagickCLEnv clEnv,
-  const size_t resizedColumns,const size_t resizedRows,const size_t filter_type,
-  const FilterInfo *filter_info,const double blur,ExceptionInfo *exception)
+static Image *ComputeScaleImage(const Image* image,MagickCLEnv clEnv,
+  const size_t scaledColumns,const size_t scaledRows,ExceptionInfo *exception)
 {
   cl_command_queue
     queue;
 
   cl_mem
-    cubicCoefficientsBuffer,
     filteredImageBuffer,
-    imageBuffer,
-    tempImageBuffer;
+    imageBuffer;
 
   cl_uint
     matte_or_cmyk;
 
-  const double
-    *resizeFilterCoefficient;
-
-  float
-    coefficientBuffer[7],
-    xFactor,
-    yFactor;
+  CLTileSet
+    *sets,
+    tileSet;
 
   MagickBooleanType
     outputReady;
@@ -625,29 +3919,53 @@ static Image *ComputeResizeImage(const Image* image,MagickCLEnv clEnv,
     device;
 
   MagickSizeType
-    length;
+    length,
+    limit;
 
   Image
     *filteredImage;
 
   size_t
-    i;
+    i,
+    number_sets;
 
   filteredImage=NULL;
   imageBuffer=NULL;
   filteredImageBuffer=NULL;
-  tempImageBuffer=NULL;
-  cubicCoefficientsBuffer=NULL;
+  device=NULL;
+  queue=NULL;
   outputReady=MagickFalse;
 
+  /* share the rows between the devices when there are several */
+  sets=acquireTileSets(clEnv,scaledColumns,scaledRows,&number_sets);
+  if (sets != (CLTileSet *) NULL)
+  {
+    filteredImage=CloneImage(image,scaledColumns,scaledRows,MagickTrue,
+      exception);
+    if (filteredImage == (Image *) NULL)
+      goto cleanup;
+    outputReady=scaleImageTiles(sets,number_sets,image,filteredImage,
+      exception);
+    goto cleanup;
+  }
+
   device=RequestOpenCLDevice(clEnv);
   queue=AcquireOpenCLCommandQueue(device);
-  filteredImage=CloneImage(image,resizedColumns,resizedRows,MagickTrue,
+  filteredImage=CloneImage(image,scaledColumns,scaledRows,MagickTrue,
     exception);
   if (filteredImage == (Image *) NULL)
     goto cleanup;
-  // if (filteredImage->number_channels != image->number_channels)
-  //   goto cleanup;
+  limit=getTileBufferLimit(device);
+  length=MAGICK_MAX(image->columns*image->rows,scaledColumns*scaledRows);
+  if (length*sizeof(PixelPacket) > limit)
+  {
+    (void) memset(&tileSet,0,sizeof(tileSet));
+    tileSet.device=device;
+    tileSet.limit=limit;
+    tileSet.end=scaledRows;
+    outputReady=scaleImageTiles(&tileSet,1,image,filteredImage,exception);
+    goto cleanup;
+  }
   imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
   if (imageBuffer == (cl_mem) NULL)
     goto cleanup;
@@ -655,79 +3973,15 @@ static Image *ComputeResizeImage(const Image* image,MagickCLEnv clEnv,
   if (filteredImageBuffer == (cl_mem) NULL)
     goto cleanup;
 
-  /* resizeFilterCoefficient=GetResizeFilterCoefficient(resizeFilter);
-  for (i = 0; i < 7; i++)
-    coefficientBuffer[i]=(float) resizeFilterCoefficient[i];
-  cubicCoefficientsBuffer=CreateOpenCLBuffer(device,CL_MEM_COPY_HOST_PTR |
-    CL_MEM_READ_ONLY,sizeof(coefficientBuffer),&coefficientBuffer);
-  if (cubicCoefficientsBuffer == (cl_mem) NULL)
-  {
-    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
-      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
-    goto cleanup;
-  } */
-
-  // No number_channels in struct _Image in GM
-  // number_channels=(cl_uint) image->number_channels;
   matte_or_cmyk=(image->matte || image->colorspace == CMYKColorspace)?1:0;
-  xFactor=(float) resizedColumns/(float) image->columns;
-  yFactor=(float) resizedRows/(float) image->rows;
-  if (xFactor > yFactor)
-  {
-    length=resizedColumns*image->rows*4;
-    tempImageBuffer=CreateOpenCLBuffer(device,CL_MEM_READ_WRITE,length*
-      sizeof(CLQuantum),(void *) NULL);
-    if (tempImageBuffer == (cl_mem) NULL)
-    {
-      (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
-        ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
-      goto cleanup;
-    }
-
-    outputReady=resizeHorizontalFilter(device,queue,image,filteredImage,
-      imageBuffer,matte_or_cmyk,(cl_uint) image->columns,
-      (cl_uint) image->rows,tempImageBuffer,(cl_uint) resizedColumns,
-      (cl_uint) image->rows,filter_type,filter_info,blur,
-      cubicCoefficientsBuffer,xFactor,exception);
-    if (outputReady == MagickFalse)
-      goto cleanup;
-
-    outputReady=resizeVerticalFilter(device,queue,image,filteredImage,
-      tempImageBuffer,matte_or_cmyk,(cl_uint) resizedColumns,
-      (cl_uint) image->rows,filteredImageBuffer,(cl_uint) resizedColumns,
-      (cl_uint) resizedRows,filter_type,filter_info,blur,
-      cubicCoefficientsBuffer,yFactor,exception);
-    if (outputReady == MagickFalse)
-      goto cleanup;
-  }
-  else
-  {
-    length=image->columns*resizedRows*4;
-    tempImageBuffer=CreateOpenCLBuffer(device,CL_MEM_READ_WRITE,length*
-      sizeof(CLQuantum),(void *) NULL);
-    if (tempImageBuffer == (cl_mem) NULL)
-    {
-      (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
-        ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
-      goto cleanup;
-    }
-
-    outputReady=resizeVerticalFilter(device,queue,image,filteredImage,
-      imageBuffer,matte_or_cmyk,(cl_uint) image->columns,
-      (cl_int) image->rows,tempImageBuffer,(cl_uint) image->columns,
-      (cl_uint) resizedRows,filter_type,filter_info,blur,
-      cubicCoefficientsBuffer,yFactor,exception);
-    if (outputReady == MagickFalse)
-      goto cleanup;
 
-    outputReady=resizeHorizontalFilter(device,queue,image,filteredImage,
-      tempImageBuffer,matte_or_cmyk,(cl_uint) image->columns,
-      (cl_uint) resizedRows,filteredImageBuffer,(cl_uint) resizedColumns,
-      (cl_uint) resizedRows,filter_type,filter_info,blur,
-      cubicCoefficientsBuffer,xFactor,exception);
-    if (outputReady == MagickFalse)
-      goto cleanup;
-  }
+  outputReady=scaleFilter(device,queue,image,filteredImage,
+    (MagickCLCacheInfo) NULL,(MagickCLCacheInfo) NULL,
+    imageBuffer,matte_or_cmyk,(cl_uint) image->columns,
+    (cl_uint) image->rows,filteredImageBuffer,(cl_uint) scaledColumns,
+    (cl_uint) scaledRows,(float) scaledRows/(float) image->rows,0,0,exception);
+  if (outputReady == MagickFalse)
+    goto cleanup;
 
 cleanup:
 
@@ -735,14 +3989,12 @@ cleanup:
     ReleaseOpenCLMemObject(imageBuffer);
   if (filteredImageBuffer != (cl_mem) NULL)
     ReleaseOpenCLMemObject(filteredImageBuffer);
-  if (tempImageBuffer != (cl_mem) NULL)
-    ReleaseOpenCLMemObject(tempImageBuffer);
-  if (cubicCoefficientsBuffer != (cl_mem) NULL)
-    ReleaseOpenCLMemObject(cubicCoefficientsBuffer);
   if (queue != (cl_command_queue) NULL)
     ReleaseOpenCLCommandQueue(device,queue);
   if (device != (MagickCLDevice) NULL)
     ReleaseOpenCLDevice(device);
+  if (sets != (CLTileSet *) NULL)
+    sets=relinquishTileSets(sets,number_sets);
   if ((outputReady == MagickFalse) && (filteredImage != (Image *) NULL))
   {
     DestroyImage(filteredImage);
@@ -752,174 +4004,443 @@ cleanup:
   return(filteredImage);
 }
 
-MagickPrivate Image *AccelerateResizeImage(const Image *image,
-  const size_t resizedColumns,const size_t resizedRows,const size_t filter_type,
-  const FilterInfo *filter_info,const double blur,ExceptionInfo *exception)
+MagickPrivate Image *AccelerateScaleImage(const Image *image,
+  const size_t scaledColumns,const size_t scaledRows,
+  ExceptionInfo *exception)
+{
+  Image
+    *filteredImage;
+
+  MagickCLEnv
+    clEnv;
+
+  assert(image != NULL);
+  assert(exception != (ExceptionInfo *) NULL);
+
+  if (checkAccelerateCondition(image) == MagickFalse)
+    return((Image *) NULL);
+
+  clEnv=getOpenCLEnvironment(exception);
+  if (clEnv == (MagickCLEnv) NULL)
+    return((Image *) NULL);
+  if (CheckOpenCLOperationCost(clEnv,ScaleCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) scaledColumns*scaledRows) == MagickFalse)
+    return((Image *) NULL);
+
+  filteredImage=ComputeScaleImage(image,clEnv,scaledColumns,scaledRows,
+    exception);
+  return(filteredImage);
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e R o t a t e I m a g e                               %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+MagickPrivate Image *AccelerateRotateImage(const Image *image,
+  const double degrees,ExceptionInfo *exception)
 {
+  AffineMatrix
+    inverse_affine;
+
+  double
+    angle,
+    columns,
+    cosine,
+    crop_x,
+    crop_y,
+    rows,
+    shear_x,
+    shear_y,
+    sine;
+
   Image
-    *filteredImage;
+    *rotateImage;
+
+  long
+    x_offset,
+    y_offset;
 
   MagickCLEnv
     clEnv;
 
+  PointInfo
+    extent[4],
+    max,
+    min;
+
+  register long
+    i;
+
+  unsigned long
+    height,
+    max_height,
+    max_width,
+    rotations,
+    shear1_width,
+    shear2_height,
+    shear3_width,
+    width;
+
   assert(image != NULL);
   assert(exception != (ExceptionInfo *) NULL);
 
-  if (checkAccelerateCondition(image) == MagickFalse)
+  if (image->colorspace == CMYKColorspace)
     return((Image *) NULL);
 
-  // if ((gpuSupportedResizeWeighting(GetResizeFilterWeightingType(
-  //        resizeFilter)) == MagickFalse) ||
-  //     (gpuSupportedResizeWeighting(GetResizeFilterWindowWeightingType(
-  //        resizeFilter)) == MagickFalse))
-  //   return((Image *) NULL);
+  /*
+    Size the result like the three shears of RotateImage() and their crop.
+  */
+  angle=degrees-360.0*(int) (degrees/360);
+  if (angle < -45.0)
+    angle+=360.0;
+  for (rotations=0; angle > 45.0; rotations++)
+    angle-=90.0;
+  rotations%=4;
+  shear_x=(-tan(DegreesToRadians(angle)/2.0));
+  shear_y=sin(DegreesToRadians(angle));
+  /* quarter turns are exact copies which IntegralRotateImage() does best */
+  if ((shear_x == 0.0) || (shear_y == 0.0))
+    return((Image *) NULL);
+  width=(rotations & 1) ? image->rows : image->columns;
+  height=(rotations & 1) ? image->columns : image->rows;
+  shear1_width=(unsigned long) floor(fabs(height*shear_x)+width+0.5);
+  shear2_height=(unsigned long) floor(fabs(shear1_width*shear_y)+height+0.5);
+  shear3_width=(unsigned long) floor(fabs(shear2_height*shear_x)+
+    shear1_width+0.5);
+  max_width=MAGICK_MAX(shear3_width,shear1_width)+2;
+  max_height=shear2_height+2;
+  x_offset=(long) floor((max_width-width)/2.0+0.5);
+  y_offset=(long) floor((max_height-height)/2.0+0.5);
+  columns=(double) width+2*x_offset;
+  rows=(double) height+2*y_offset;
+  extent[0].x=(-(double) width/2.0);
+  extent[0].y=(-(double) height/2.0);
+  extent[1].x=(double) width/2.0;
+  extent[1].y=(-(double) height/2.0);
+  extent[2].x=(-(double) width/2.0);
+  extent[2].y=(double) height/2.0;
+  extent[3].x=(double) width/2.0;
+  extent[3].y=(double) height/2.0;
+  for (i=0; i < 4; i++)
+  {
+    extent[i].x+=shear_x*extent[i].y;
+    extent[i].y+=shear_y*extent[i].x;
+    extent[i].x+=shear_x*extent[i].y;
+    extent[i].x+=columns/2.0;
+    extent[i].y+=rows/2.0;
+  }
+  min=extent[0];
+  max=extent[0];
+  for (i=1; i < 4; i++)
+  {
+    min.x=MAGICK_MIN(min.x,extent[i].x);
+    min.y=MAGICK_MIN(min.y,extent[i].y);
+    max.x=MAGICK_MAX(max.x,extent[i].x);
+    max.y=MAGICK_MAX(max.y,extent[i].y);
+  }
+  crop_x=ceil(min.x-0.5);
+  crop_y=ceil(min.y-0.5);
+  if ((crop_x < 0.0) || (crop_y < 0.0) ||
+      (crop_x+floor(max.x-min.x+0.5) > columns) ||
+      (crop_y+floor(max.y-min.y+0.5) > rows))
+    return((Image *) NULL);
 
   clEnv=getOpenCLEnvironment(exception);
   if (clEnv == (MagickCLEnv) NULL)
     return((Image *) NULL);
+  if (CheckOpenCLOperationCost(clEnv,AffineCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) (max.x-min.x)*(max.y-min.y)) == MagickFalse)
+    return((Image *) NULL);
 
-  filteredImage=ComputeResizeImage(image,clEnv,resizedColumns,resizedRows,
-    filter_type,filter_info,blur,exception);
-  return(filteredImage);
+  rotateImage=CloneImage(image,(unsigned long) floor(max.x-min.x+0.5),
+    (unsigned long) floor(max.y-min.y+0.5),MagickTrue,exception);
+  if (rotateImage == (Image *) NULL)
+    return((Image *) NULL);
+  rotateImage->storage_class=DirectClass;
+  rotateImage->matte|=image->background_color.opacity != OpaqueOpacity;
+
+  /*
+    Map each pixel of the result back to the unrotated image about the
+    centres of both, the area outside is the background color like the
+    border around the sheared image.
+  */
+  cosine=cos(DegreesToRadians(degrees));
+  sine=sin(DegreesToRadians(degrees));
+  inverse_affine.sx=cosine;
+  inverse_affine.rx=(-sine);
+  inverse_affine.ry=sine;
+  inverse_affine.sy=cosine;
+  inverse_affine.tx=cosine*(crop_x-columns/2.0+0.5)+sine*
+    (crop_y-rows/2.0+0.5)+image->columns/2.0-0.5;
+  inverse_affine.ty=(-sine)*(crop_x-columns/2.0+0.5)+cosine*
+    (crop_y-rows/2.0+0.5)+image->rows/2.0-0.5;
+  if (ComputeDrawAffineImage(rotateImage,clEnv,image,&inverse_affine,0,
+        rotateImage->rows,(const long *) NULL,ConstantVirtualPixelMethod,
+        rotateImage->matte,MagickFalse,exception) == MagickFalse)
+    {
+      DestroyImage(rotateImage);
+      return((Image *) NULL);
+    }
+  rotateImage->page.width=0;
+  rotateImage->page.height=0;
+  return(rotateImage);
 }
 
-static MagickBooleanType scaleFilter(MagickCLDevice device,
-  cl_command_queue queue,const Image *image,Image *filteredImage,
-  cl_mem imageBuffer,cl_uint matte_or_cmyk,cl_uint columns,cl_uint rows,
-  cl_mem scaledImageBuffer,cl_uint scaledColumns,cl_uint scaledRows,
-  ExceptionInfo *exception)
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%     A c c e l e r a t e U n s h a r p M a s k I m a g e                     %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*/
+
+static Image *ComputeUnsharpMaskImage(const Image *image,MagickCLEnv clEnv,
+  const double *kernel,const unsigned long width,const double gain,
+  const double threshold,ExceptionInfo *exception)
 {
-  cl_kernel
-    scaleKernel;
+  cl_command_queue
+    queue;
 
   cl_int
     status;
 
-  const unsigned int
-    workgroupSize = 256;
+  cl_kernel
+    blurRowKernel,
+    unsharpMaskBlurColumnKernel;
+
+  cl_mem
+    filteredImageBuffer,
+    imageBuffer,
+    imageKernelBuffer,
+    tempImageBuffer;
+
+  cl_uint
+    channel_mask,
+    imageColumns,
+    imageRows,
+    kernelWidth,
+    normalizeEdges,
+    number_channels;
 
   float
-    xFactor;
+    fGain,
+    fThreshold;
 
-  int
-    numCachedPixels;
+  Image
+    *filteredImage;
 
   MagickBooleanType
     outputReady;
 
+  MagickCLDevice
+    device;
+
+  MagickSizeType
+    length;
+
   size_t
+    chunkSize,
     gsize[2],
     i,
-    imageCacheLocalMemorySize,
-    pixelAccumulatorLocalMemorySize,
-    lsize[2],
-    totalLocalMemorySize;
-
-  unsigned int
-    chunkSize,
-    pixelPerWorkgroup;
+    lsize[2];
 
-  scaleKernel=NULL;
+  filteredImage=NULL;
+  imageBuffer=NULL;
+  filteredImageBuffer=NULL;
+  imageKernelBuffer=NULL;
+  tempImageBuffer=NULL;
+  blurRowKernel=NULL;
+  unsharpMaskBlurColumnKernel=NULL;
   outputReady=MagickFalse;
 
-  xFactor=(float) scaledColumns/columns;
+  chunkSize=256;
 
-  if (scaledColumns < workgroupSize)
+  device=RequestOpenCLDevice(clEnv);
+  queue=AcquireOpenCLCommandQueue(device);
+
+  if ((chunkSize+width)*sizeof(cl_float4)+width*sizeof(float) >
+      device->local_memory_size)
+    goto cleanup;
+
+  filteredImage=CloneImage(image,image->columns,image->rows,MagickTrue,
+    exception);
+  if (filteredImage == (Image *) NULL)
+    goto cleanup;
+  imageBuffer=GetAuthenticOpenCLBuffer(image,device,exception);
+  if (imageBuffer == (cl_mem) NULL)
+    goto cleanup;
+  filteredImageBuffer=GetAuthenticOpenCLBuffer(filteredImage,device,exception);
+  if (filteredImageBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  imageKernelBuffer=createKernelInfo(device,kernel,width,exception);
+  if (imageKernelBuffer == (cl_mem) NULL)
+    goto cleanup;
+
+  length=image->columns*image->rows;
+  tempImageBuffer=CreateOpenCLBuffer(device,CL_MEM_READ_WRITE,length*
+    sizeof(cl_float4),(void *) NULL);
+  if (tempImageBuffer == (cl_mem) NULL)
   {
-    chunkSize=32;
-    pixelPerWorkgroup=32;
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"CreateOpenCLBuffer failed.",".");
+    goto cleanup;
   }
-  else
+
+  blurRowKernel=AcquireOpenCLKernel(device,"BlurRow");
+  if (blurRowKernel == (cl_kernel) NULL)
   {
-    chunkSize=workgroupSize;
-    pixelPerWorkgroup=workgroupSize;
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
   }
-
-DisableMSCWarning(4127)
-  while(1)
-RestoreMSCWarning
+  unsharpMaskBlurColumnKernel=AcquireOpenCLKernel(device,
+    "UnsharpMaskBlurColumn");
+  if (unsharpMaskBlurColumnKernel == (cl_kernel) NULL)
   {
-    /* calculate the local memory size needed per workgroup */
-    numCachedPixels=(int) ceil((pixelPerWorkgroup-1)/xFactor+2*(0.5+MagickEpsilon));
-    imageCacheLocalMemorySize=numCachedPixels*sizeof(CLQuantum)*4;
-    totalLocalMemorySize=imageCacheLocalMemorySize;
-
-    /* local size for the pixel accumulator */
-    pixelAccumulatorLocalMemorySize=chunkSize*sizeof(cl_float4);
-    totalLocalMemorySize+=pixelAccumulatorLocalMemorySize;
-
-    if (totalLocalMemorySize <= device->local_memory_size)
-      break;
-    else
-    {
-      pixelPerWorkgroup=pixelPerWorkgroup/2;
-      chunkSize=chunkSize/2;
-      if ((pixelPerWorkgroup == 0) || (chunkSize == 0))
-      {
-        /* quit, fallback to CPU */
-        goto cleanup;
-      }
-    }
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
   }
 
-  scaleKernel=AcquireOpenCLKernel(device,"ScaleFilter");
-  if (scaleKernel == (cl_kernel) NULL)
+  number_channels=4;
+  channel_mask=image->matte ? CLCompositeChannels : CLColorChannels;
+  kernelWidth=(cl_uint) width;
+  imageColumns=(cl_uint) image->columns;
+  imageRows=(cl_uint) image->rows;
+  normalizeEdges=1;
+  fGain=(float) gain;
+  fThreshold=(float) threshold;
+
+  i=0;
+  status =SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&number_channels);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&channel_mask);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_mem),(void *)&imageKernelBuffer);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&kernelWidth);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&imageColumns);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&imageRows);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_uint),&normalizeEdges);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_float4)*(chunkSize+width),(void *) NULL);
+  status|=SetOpenCLKernelArg(blurRowKernel,i++,sizeof(cl_mem),(void *)&tempImageBuffer);
+  if (status != CL_SUCCESS)
   {
     (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
-      ResourceLimitWarning,"AcquireOpenCLKernel failed.", ".");
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
     goto cleanup;
   }
 
-  i=0;
-  status =SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_mem),(void*)&imageBuffer);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&matte_or_cmyk);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&columns);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&rows);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_mem),(void*)&scaledImageBuffer);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&scaledColumns);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(cl_uint),(void*)&scaledRows);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,imageCacheLocalMemorySize,NULL);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(int),&numCachedPixels);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(unsigned int),&pixelPerWorkgroup);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,sizeof(unsigned int),&chunkSize);
-  status|=SetOpenCLKernelArg(scaleKernel,i++,pixelAccumulatorLocalMemorySize,NULL);
+  gsize[0]=chunkSize*((imageColumns+chunkSize-1)/chunkSize);
+  gsize[1]=imageRows;
+  lsize[0]=chunkSize;
+  lsize[1]=1;
+  outputReady=EnqueueOpenCLKernel(queue,blurRowKernel,2,(const size_t *) NULL,
+    gsize,lsize,image,filteredImage,MagickFalse,exception);
+  if (outputReady == MagickFalse)
+    goto cleanup;
 
+  i=0;
+  status =SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(cl_mem),(void *)&tempImageBuffer);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(cl_uint),&number_channels);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(cl_uint),&channel_mask);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(cl_uint),&imageColumns);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(cl_uint),&imageRows);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,(chunkSize+width-1)*sizeof(cl_float4),(void *) NULL);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,width*sizeof(float),(void *) NULL);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(cl_mem),(void *)&imageKernelBuffer);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(cl_uint),&kernelWidth);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(float),&fGain);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(float),&fThreshold);
+  status|=SetOpenCLKernelArg(unsharpMaskBlurColumnKernel,i++,sizeof(cl_mem),(void *)&filteredImageBuffer);
   if (status != CL_SUCCESS)
   {
+    outputReady=MagickFalse;
     (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
       ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
     goto cleanup;
   }
 
-  gsize[0]=(scaledColumns+pixelPerWorkgroup-1)/pixelPerWorkgroup*
-    workgroupSize;
-  gsize[1]=scaledRows;
-  lsize[0]=workgroupSize;
-  lsize[1]=1;
-  outputReady=EnqueueOpenCLKernel(queue,scaleKernel,2,
+  gsize[0]=imageColumns;
+  gsize[1]=chunkSize*((imageRows+chunkSize-1)/chunkSize);
+  lsize[0]=1;
+  lsize[1]=chunkSize;
+  outputReady=EnqueueOpenCLKernel(queue,unsharpMaskBlurColumnKernel,2,
     (const size_t *) NULL,gsize,lsize,image,filteredImage,MagickFalse,
     exception);
 
 cleanup:
 
-  if (scaleKernel != (cl_kernel) NULL)
-    ReleaseOpenCLKernel(scaleKernel);
+  if (imageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageBuffer);
+  if (filteredImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(filteredImageBuffer);
+  if (tempImageBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(tempImageBuffer);
+  if (imageKernelBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageKernelBuffer);
+  if (blurRowKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(blurRowKernel);
+  if (unsharpMaskBlurColumnKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(unsharpMaskBlurColumnKernel);
+  if (queue != (cl_command_queue) NULL)
+    ReleaseOpenCLCommandQueue(device,queue);
+  if (device != (MagickCLDevice) NULL)
+    ReleaseOpenCLDevice(device);
+  if ((outputReady == MagickFalse) && (filteredImage != (Image *) NULL))
+  {
+    DestroyImage(filteredImage);
+    filteredImage=(Image *) NULL;
+  }
 
-  return(outputReady);
+  return(filteredImage);
 }
 
-static Image *ComputeScaleImage(const Image* image,MagickCLEnv clEnv,
-  const size_t scaledColumns,const size_t scaledRows,ExceptionInfo *exception)
+static Image *ComputeUnsharpMaskImageSingle(const Image *image,
+  MagickCLEnv clEnv,const double *kernel,const unsigned long width,
+  const double gain,const double threshold,ExceptionInfo *exception)
 {
   cl_command_queue
     queue;
 
+  cl_int
+    status;
+
+  cl_kernel
+    unsharpMaskKernel;
+
   cl_mem
     filteredImageBuffer,
-    imageBuffer;
+    imageBuffer,
+    imageKernelBuffer;
 
   cl_uint
-    matte_or_cmyk;
+    channel_mask,
+    imageColumns,
+    imageRows,
+    kernelWidth,
+    number_channels;
+
+  float
+    fGain,
+    fThreshold;
+
+  Image
+    *filteredImage;
 
   MagickBooleanType
     outputReady;
@@ -927,23 +4448,21 @@ static Image *ComputeScaleImage(const Image* image,MagickCLEnv clEnv,
   MagickCLDevice
     device;
 
-  MagickSizeType
-    length;
-
-  Image
-    *filteredImage;
-
   size_t
-    i;
+    gsize[2],
+    i,
+    lsize[2];
 
   filteredImage=NULL;
   imageBuffer=NULL;
   filteredImageBuffer=NULL;
+  imageKernelBuffer=NULL;
+  unsharpMaskKernel=NULL;
   outputReady=MagickFalse;
 
   device=RequestOpenCLDevice(clEnv);
   queue=AcquireOpenCLCommandQueue(device);
-  filteredImage=CloneImage(image,scaledColumns,scaledRows,MagickTrue,
+  filteredImage=CloneImage(image,image->columns,image->rows,MagickTrue,
     exception);
   if (filteredImage == (Image *) NULL)
     goto cleanup;
@@ -954,14 +4473,52 @@ static Image *ComputeScaleImage(const Image* image,MagickCLEnv clEnv,
   if (filteredImageBuffer == (cl_mem) NULL)
     goto cleanup;
 
-  matte_or_cmyk=(image->matte || image->colorspace == CMYKColorspace)?1:0;
+  imageKernelBuffer=createKernelInfo(device,kernel,width,exception);
+  if (imageKernelBuffer == (cl_mem) NULL)
+    goto cleanup;
 
-  outputReady=scaleFilter(device,queue,image,filteredImage,
-    imageBuffer,matte_or_cmyk,(cl_uint) image->columns,
-    (cl_uint) image->rows,filteredImageBuffer,(cl_uint) scaledColumns,
-    (cl_uint) scaledRows,exception);
-  if (outputReady == MagickFalse)
+  unsharpMaskKernel=AcquireOpenCLKernel(device,"UnsharpMask");
+  if (unsharpMaskKernel == (cl_kernel) NULL)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"AcquireOpenCLKernel failed.",".");
+    goto cleanup;
+  }
+
+  number_channels=4;
+  channel_mask=image->matte ? CLCompositeChannels : CLColorChannels;
+  kernelWidth=(cl_uint) width;
+  imageColumns=(cl_uint) image->columns;
+  imageRows=(cl_uint) image->rows;
+  fGain=(float) gain;
+  fThreshold=(float) threshold;
+
+  i=0;
+  status =SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(cl_mem),(void *)&imageBuffer);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(cl_uint),&number_channels);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(cl_uint),&channel_mask);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(cl_mem),(void *)&imageKernelBuffer);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(cl_uint),&kernelWidth);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(cl_uint),&imageColumns);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(cl_uint),&imageRows);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(cl_float4)*(8*(32+width)),(void *) NULL);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(float),&fGain);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(float),&fThreshold);
+  status|=SetOpenCLKernelArg(unsharpMaskKernel,i++,sizeof(cl_mem),(void *)&filteredImageBuffer);
+  if (status != CL_SUCCESS)
+  {
+    (void) OpenCLThrowMagickException(device,exception,GetMagickModule(),
+      ResourceLimitWarning,"SetOpenCLKernelArg failed.",".");
     goto cleanup;
+  }
+
+  gsize[0]=((image->columns+7)/8)*8;
+  gsize[1]=((image->rows+31)/32)*32;
+  lsize[0]=8;
+  lsize[1]=32;
+  outputReady=EnqueueOpenCLKernel(queue,unsharpMaskKernel,2,
+    (const size_t *) NULL,gsize,lsize,image,filteredImage,MagickFalse,
+    exception);
 
 cleanup:
 
@@ -969,6 +4526,10 @@ cleanup:
     ReleaseOpenCLMemObject(imageBuffer);
   if (filteredImageBuffer != (cl_mem) NULL)
     ReleaseOpenCLMemObject(filteredImageBuffer);
+  if (imageKernelBuffer != (cl_mem) NULL)
+    ReleaseOpenCLMemObject(imageKernelBuffer);
+  if (unsharpMaskKernel != (cl_kernel) NULL)
+    ReleaseOpenCLKernel(unsharpMaskKernel);
   if (queue != (cl_command_queue) NULL)
     ReleaseOpenCLCommandQueue(device,queue);
   if (device != (MagickCLDevice) NULL)
@@ -982,9 +4543,9 @@ cleanup:
   return(filteredImage);
 }
 
-MagickPrivate Image *AccelerateScaleImage(const Image *image,
-  const size_t scaledColumns,const size_t scaledRows,
-  ExceptionInfo *exception)
+MagickPrivate Image *AccelerateUnsharpMaskImage(const Image *image,
+  const double *kernel,const unsigned long width,const double gain,
+  const double threshold,ExceptionInfo *exception)
 {
   Image
     *filteredImage;
@@ -993,6 +4554,7 @@ MagickPrivate Image *AccelerateScaleImage(const Image *image,
     clEnv;
 
   assert(image != NULL);
+  assert(kernel != (const double *) NULL);
   assert(exception != (ExceptionInfo *) NULL);
 
   if (checkAccelerateCondition(image) == MagickFalse)
@@ -1001,9 +4563,18 @@ MagickPrivate Image *AccelerateScaleImage(const Image *image,
   clEnv=getOpenCLEnvironment(exception);
   if (clEnv == (MagickCLEnv) NULL)
     return((Image *) NULL);
+  if (CheckOpenCLOperationCost(clEnv,UnsharpMaskCLOperation,
+        (MagickSizeType) image->columns*image->rows,
+        (MagickSizeType) image->columns*image->rows) == MagickFalse)
+    return((Image *) NULL);
 
-  filteredImage=ComputeScaleImage(image,clEnv,scaledColumns,scaledRows,
-    exception);
+  /* the fused kernel keeps (32+width) blurred rows of 8 pixels per group */
+  if (width < 25)
+    filteredImage=ComputeUnsharpMaskImageSingle(image,clEnv,kernel,width,gain,
+      threshold,exception);
+  else
+    filteredImage=ComputeUnsharpMaskImage(image,clEnv,kernel,width,gain,
+      threshold,exception);
   return(filteredImage);
 }
 
@@ -37,8 +37,12 @@
 #include "magick/gem.h"
 #include "magick/log.h"
 #include "magick/monitor.h"
+#include "magick/pixel_cache.h"
 #include "magick/pixel_iterator.h"
 #include "magick/utility.h"
+#if defined(HAVE_OPENCL)
+#include "magick/accelerate-private.h"
+#endif
 
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -339,6 +343,22 @@ MagickExport MagickPassFail RGBTransformImage(Image *image,
                ColorspaceTypeToString(image->colorspace),
                ColorspaceTypeToString(colorspace));
 
+#if defined(HAVE_OPENCL)
+  /*
+    The luma transforms may run on the OpenCL device, which requires the
+    image to still be in its RGB colorspace.
+  */
+  if (AccelerateGrayscaleImage(image,colorspace,&image->exception) != MagickFalse)
+    {
+      image->colorspace=colorspace;
+      image->is_grayscale=IsGrayColorspace(colorspace);
+      (void) LogMagickEvent(TransformEvent,GetMagickModule(),
+                            "Transform to colorspace %s completed",
+                            ColorspaceTypeToString(colorspace));
+      return(status);
+    }
+#endif
+
   /*
     Store colorspace in image.
   */
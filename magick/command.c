@@ -67,6 +67,9 @@
 #include "magick/module.h"
 #include "magick/monitor.h"
 #include "magick/montage.h"
+#if defined(HAVE_OPENCL)
+#include "magick/opencl.h"
+#endif /* HAVE_OPENCL */
 #include "magick/operator.h"
 #include "magick/paint.h"
 #include "magick/pixel_cache.h"
@@ -171,12 +174,19 @@ static void
   LiberateArgumentList(const int argc,char **argv),
   MogrifyUsage(void),
   MontageUsage(void),
+#if defined(HAVE_OPENCL)
+  OpenCLUsage(void),
+#endif /* HAVE_OPENCL */
   SetUsage(void),
   TimeUsage(void);
 
 static MagickPassFail
   HelpCommand(ImageInfo *image_info,int argc,char **argv,
               char **metadata,ExceptionInfo *exception),
+#if defined(HAVE_OPENCL)
+  OpenCLCommand(ImageInfo *image_info,int argc,char **argv,
+                char **metadata,ExceptionInfo *exception),
+#endif /* HAVE_OPENCL */
 #if defined(MSWINDOWS)
   RegisterCommand(ImageInfo *image_info,int argc,char **argv,
                  char **metadata,ExceptionInfo *exception),
@@ -229,6 +239,10 @@ static const struct
          MogrifyImageCommand, MogrifyUsage, 0, SingleMode | BatchMode },
       { "montage", "create a composite image (in a grid) from separate images",
          MontageImageCommand, MontageUsage, 0, SingleMode | BatchMode },
+#if defined(HAVE_OPENCL)
+      { "opencl", "compile and cache the OpenCL kernels of every device",
+         OpenCLCommand, OpenCLUsage, 0, SingleMode | BatchMode },
+#endif
       { "set", "change batch mode option",
          SetCommand, SetUsage, 1, BatchMode },
       { "time", "time one of the other commands",
@@ -16209,6 +16223,124 @@ static void ImportUsage(void)
 #endif /* HasX11 */
 
 
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%   O p e n C L C o m m a n d                                                 %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  OpenCLCommand() compiles the OpenCL kernels for every device, including
+%  the devices that are not enabled, and stores the program binaries in the
+%  OpenCL cache directory.  Running it once after installing or upgrading
+%  the library or the OpenCL driver spares later commands the compilation.
+%
+%  The format of the OpenCLCommand method is:
+%
+%      MagickPassFail OpenCLCommand(ImageInfo *image_info,const int argc,
+%        char **argv,char **metadata,ExceptionInfo *exception)
+%
+%  A description of each parameter follows:
+%
+%    o image_info: The image info.
+%
+%    o argc: The number of elements in the argument vector.
+%
+%    o argv: A text array containing the command line arguments.
+%
+%    o metadata: any metadata is returned here.
+%
+%    o exception: Return any errors or warnings in this structure.
+%
+*/
+#if defined(HAVE_OPENCL)
+static MagickPassFail OpenCLCommand(ImageInfo *image_info,
+                                    int argc,char **argv,char **metadata,
+                                    ExceptionInfo *exception)
+{
+  MagickCLDevice
+    *devices;
+
+  MagickPassFail
+    status;
+
+  size_t
+    i,
+    number_devices;
+
+  ARG_NOT_USED(image_info);
+  ARG_NOT_USED(metadata);
+
+  if (argc > 1)
+    {
+      if ((LocaleCompare("-help",argv[1]) == 0) ||
+          (LocaleCompare("-?",argv[1]) == 0))
+        {
+          OpenCLUsage();
+          return MagickPass;
+        }
+      (void) fprintf(stderr,"Error: unexpected parameter: %s\n",argv[1]);
+      OpenCLUsage();
+      return MagickFail;
+    }
+
+  devices=GetOpenCLDevices(&number_devices,exception);
+  if (number_devices == 0)
+    {
+      (void) fprintf(stderr,"No OpenCL device is available\n");
+      return MagickFail;
+    }
+  status=MagickPass;
+  for (i=0; i < number_devices; i++)
+    {
+      MagickBool
+        built;
+
+      built=BuildOpenCLDeviceKernels(devices[i],exception);
+      (void) fprintf(stdout,"%-40.1024s %s\n",
+                     GetOpenCLDeviceName(devices[i]),
+                     built ? "cached" : "failed");
+      if (!built)
+        status=MagickFail;
+    }
+  return status;
+}
+#endif /* HAVE_OPENCL */
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%   O p e n C L U s a g e                                                     %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  OpenCLUsage() displays the program command syntax.
+%
+%  The format of the OpenCLUsage method is:
+%
+%      void OpenCLUsage()
+%
+*/
+#if defined(HAVE_OPENCL)
+static void OpenCLUsage(void)
+{
+  (void) puts("Usage: opencl");
+  (void) puts("");
+  (void) puts("Compiles the OpenCL kernels for every device and stores the");
+  (void) puts("program binaries in the OpenCL cache directory, which may be");
+  (void) puts("selected with the MAGICK_OPENCL_CACHE_DIR environment variable.");
+}
+#endif /* HAVE_OPENCL */
+
+
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %                                                                             %
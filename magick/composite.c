@@ -46,6 +46,9 @@
 #include "magick/pixel_cache.h"
 #include "magick/pixel_iterator.h"
 #include "magick/utility.h"
+#if defined(HAVE_OPENCL)
+#include "magick/accelerate-private.h"
+#endif
 
 
 /*
@@ -3475,6 +3478,16 @@ CompositeImage(Image *canvas_image,
             char
               description[MaxTextExtent];
 
+#if defined(HAVE_OPENCL)
+            if (AccelerateCompositeImage(compose,&options,columns,rows,
+                                         change_image,composite_x,composite_y,
+                                         canvas_image,canvas_x,canvas_y,
+                                         &canvas_image->exception) != MagickFalse)
+              {
+                DestroyImage(change_image);
+                return(MagickPass);
+              }
+#endif
             FormatString(description,"[%%s] Composite %s image pixels ...",
                          CompositeOperatorToString(compose));
 
@@ -3679,6 +3692,13 @@ CompositeImageRegion(const CompositeOperator compose,
           ((unsigned long) update_y < update_image->rows) &&
           (columns != 0) && (rows != 0))
         {
+#if defined(HAVE_OPENCL)
+          if (AccelerateCompositeImage(compose,options,columns,rows,
+                                       update_image,update_x,update_y,
+                                       canvas_image,canvas_x,canvas_y,
+                                       exception) != MagickFalse)
+            return(MagickPass);
+#endif
           if (clear_pixels)
             {
               /*
@@ -54,6 +54,9 @@
 #include "magick/render.h"
 #include "magick/shear.h"
 #include "magick/utility.h"
+#if defined(HAVE_OPENCL)
+#include "magick/accelerate-private.h"
+#endif
 
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -808,6 +811,45 @@ static int GetBlurKernel(unsigned long width,const double sigma,double **kernel)
   return(width);
 }
 
+/*
+  Generate the 1-D blur kernel for the specified radius and standard
+  deviation.  A radius of zero selects the widest kernel which still
+  contributes to the result.
+*/
+static int GetOptimalBlurKernel(const double radius,const double sigma,
+                                double **kernel)
+{
+  int
+    width;
+
+  *kernel=(double *) NULL;
+  if (radius > 0)
+    width=GetBlurKernel((int) (2*ceil(radius)+1),sigma,kernel);
+  else
+    {
+      double
+        *last_kernel;
+
+      last_kernel=(double *) NULL;
+      width=GetBlurKernel(3,sigma,kernel);
+      while ((*kernel != (double *) NULL) && ((long) (MaxRGB*(*kernel)[0]) > 0))
+        {
+          if (last_kernel != (double *)NULL)
+            MagickFreeMemory(last_kernel);
+          last_kernel=*kernel;
+          *kernel=(double *) NULL;
+          width=GetBlurKernel(width+2,sigma,kernel);
+        }
+      if (last_kernel != (double *) NULL)
+        {
+          MagickFreeMemory(*kernel);
+          width-=2;
+          *kernel=last_kernel;
+        }
+    }
+  return(width);
+}
+
 static MagickPassFail BlurImageScanlines(Image *image,const double *kernel,
                                          const unsigned long width,
                                          const char *format,
@@ -953,31 +995,7 @@ BlurImage(const Image *original_image,const double radius,
   assert(original_image->signature == MagickSignature);
   assert(exception != (ExceptionInfo *) NULL);
   assert(exception->signature == MagickSignature);
-  kernel=(double *) NULL;
-  if (radius > 0)
-    width=GetBlurKernel((int) (2*ceil(radius)+1),sigma,&kernel);
-  else
-    {
-      double
-        *last_kernel;
-
-      last_kernel=(double *) NULL;
-      width=GetBlurKernel(3,sigma,&kernel);
-      while ((long) (MaxRGB*kernel[0]) > 0)
-        {
-          if (last_kernel != (double *)NULL)
-            MagickFreeMemory(last_kernel);
-          last_kernel=kernel;
-          kernel=(double *) NULL;
-          width=GetBlurKernel(width+2,sigma,&kernel);
-        }
-      if (last_kernel != (double *) NULL)
-        {
-          MagickFreeMemory(kernel);
-          width-=2;
-          kernel=last_kernel;
-        }
-    }
+  width=GetOptimalBlurKernel(radius,sigma,&kernel);
   if (width < 3)
     {
       MagickFreeMemory(kernel);
@@ -985,6 +1003,17 @@ BlurImage(const Image *original_image,const double radius,
                            KernelRadiusIsTooSmall);
     }
 
+#if defined(HAVE_OPENCL)
+  blur_image=AccelerateBlurImage(original_image,kernel,width,MagickTrue,
+    exception);
+  if (blur_image != (Image *) NULL)
+    {
+      MagickFreeMemory(kernel);
+      blur_image->is_grayscale=original_image->is_grayscale;
+      return(blur_image);
+    }
+#endif
+
   blur_image=RotateImage(original_image,90,exception);
   if (blur_image == (Image *) NULL)
     status=MagickFail;
@@ -1333,10 +1362,6 @@ MagickExport Image *ConvolveImage(const Image * restrict image,const unsigned in
   if (((long) image->columns < width) || ((long) image->rows < width))
     ThrowImageException3(OptionError,UnableToConvolveImage,
                          ImageSmallerThanKernelWidth);
-  convolve_image=CloneImage(image,image->columns,image->rows,MagickTrue,exception);
-  if (convolve_image == (Image *) NULL)
-    return((Image *) NULL);
-  convolve_image->storage_class=DirectClass;
   {
     /*
       Build normalized kernel.
@@ -1361,7 +1386,6 @@ MagickExport Image *ConvolveImage(const Image * restrict image,const unsigned in
                                               (size_t) width*width*sizeof(float_quantum_t));
     if (normal_kernel == (float_quantum_t *) NULL)
       {
-        DestroyImage(convolve_image);
         ThrowImageException(ResourceLimitError,MemoryAllocationFailed,
                             MagickMsg(OptionError,UnableToConvolveImage));
       }
@@ -1417,6 +1441,24 @@ MagickExport Image *ConvolveImage(const Image * restrict image,const unsigned in
         }
     }
 
+#if defined(HAVE_OPENCL)
+  convolve_image=AccelerateConvolveImage(image,kernel,width,exception);
+  if (convolve_image != (Image *) NULL)
+    {
+      MagickFreeAlignedMemory(normal_kernel);
+      convolve_image->is_grayscale=is_grayscale;
+      return(convolve_image);
+    }
+#endif
+
+  convolve_image=CloneImage(image,image->columns,image->rows,MagickTrue,exception);
+  if (convolve_image == (Image *) NULL)
+    {
+      MagickFreeAlignedMemory(normal_kernel);
+      return((Image *) NULL);
+    }
+  convolve_image->storage_class=DirectClass;
+
   status=MagickPass;
   /*
     Convolve image.
@@ -1670,6 +1712,15 @@ MagickExport Image *DespeckleImage(const Image *image,ExceptionInfo *exception)
   assert(exception != (ExceptionInfo *) NULL);
   assert(exception->signature == MagickSignature);
 
+#if defined(HAVE_OPENCL)
+  despeckle_image=AccelerateDespeckleImage(image,exception);
+  if (despeckle_image != (Image *) NULL)
+    {
+      despeckle_image->is_grayscale=image->is_grayscale;
+      return(despeckle_image);
+    }
+#endif
+
   /*
     Analyze image.
   */
@@ -1810,7 +1861,7 @@ MagickExport Image *DespeckleImage(const Image *image,ExceptionInfo *exception)
       j=(long) image->columns+2;
       for (y=0; y < (long) image->rows; y++)
         {
-          q=SetImagePixelsEx(despeckle_image,0,y,despeckle_image->columns,1,exception);
+          q=GetImagePixelsEx(despeckle_image,0,y,despeckle_image->columns,1,exception);
           if (q == (PixelPacket *) NULL)
             {
               status=MagickFail;
@@ -2317,6 +2368,36 @@ MagickExport Image *GaussianBlurImage(const Image *image,const double radius,
   if (((long) image->columns < width) || ((long) image->rows < width))
     ThrowImageException3(OptionError,UnableToBlurImage,
       ImageSmallerThanRadius);
+#if defined(HAVE_OPENCL)
+  /*
+    The 2-D Gaussian is separable, so the device may apply it as a row
+    and a column pass of the same (normalized) 1-D kernel.  The edge
+    pixels are repeated like the virtual pixels used by ConvolveImage().
+  */
+  kernel=MagickAllocateArray(double *,width,sizeof(double));
+  if (kernel != (double *) NULL)
+    {
+      double
+        normalize;
+
+      normalize=0.0;
+      for (i=0, u=(-width/2); u <= (width/2); u++, i++)
+        {
+          kernel[i]=exp(-((double) u*u)/(2.0*sigma*sigma));
+          normalize+=kernel[i];
+        }
+      for (i=0; i < width; i++)
+        kernel[i]/=normalize;
+      blur_image=AccelerateBlurImage(image,kernel,width,MagickFalse,
+        exception);
+      MagickFreeMemory(kernel);
+      if (blur_image != (Image *) NULL)
+        {
+          blur_image->is_grayscale=image->is_grayscale;
+          return(blur_image);
+        }
+    }
+#endif
   kernel=MagickAllocateArray(double *,MagickArraySize(width,width),sizeof(double));
   if (kernel == (double *) NULL)
     ThrowImageException(ResourceLimitError,MemoryAllocationFailed,
@@ -2974,6 +3055,20 @@ MagickExport Image *MotionBlurImage(const Image *image,const double radius,
         offsets[i].y=(int) ((double) i*y/sqrt((double) x*x+(double) y*y)+0.5);
       }
   }
+#if defined(HAVE_OPENCL)
+  /*
+    BlurOffsetInfo is a pair of ints, x then y.
+  */
+  blur_image=AccelerateMotionBlurImage(image,kernel,width,(const int *) offsets,
+                                       exception);
+  if (blur_image != (Image *) NULL)
+    {
+      MagickFreeMemory(kernel);
+      MagickFreeMemory(offsets);
+      blur_image->is_grayscale=image->is_grayscale;
+      return(blur_image);
+    }
+#endif
   /*
     Allocate blur image.
   */
@@ -4356,7 +4451,7 @@ MagickExport Image *SpreadImage(const Image *image,const unsigned int radius,
         else
           y_max=y+radius;
 
-        neighbors=AcquireImagePixels(image,0,y_min,image->columns,y_max-y_min,exception);
+        neighbors=AcquireImagePixels(image,0,y_min,image->columns,y_max-y_min+1,exception);
         if (neighbors == (PixelPacket *) NULL)
           thread_status=MagickFail;
         if (thread_status != MagickFail)
@@ -4743,6 +4838,27 @@ MagickExport Image *UnsharpMaskImage(const Image *image,const double radius,
   assert(image != (const Image *) NULL);
   assert(image->signature == MagickSignature);
   assert(exception != (ExceptionInfo *) NULL);
+#if defined(HAVE_OPENCL)
+  {
+    double
+      *kernel;
+
+    int
+      width;
+
+    sharp_image=(Image *) NULL;
+    width=GetOptimalBlurKernel(radius,sigma,&kernel);
+    if ((kernel != (double *) NULL) && (width >= 3))
+      sharp_image=AccelerateUnsharpMaskImage(image,kernel,width,amount,
+                                             threshold,exception);
+    MagickFreeMemory(kernel);
+    if (sharp_image != (Image *) NULL)
+      {
+        sharp_image->is_grayscale=image->is_grayscale;
+        return(sharp_image);
+      }
+  }
+#endif
   sharp_image=BlurImage(image,radius,sigma,exception);
   if (sharp_image == (Image *) NULL)
     return((Image *) NULL);
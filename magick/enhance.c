@@ -47,7 +47,11 @@
 #include "magick/pixel_iterator.h"
 #include "magick/log.h"
 #include "magick/monitor.h"
+#include "magick/pixel_cache.h"
 #include "magick/utility.h"
+#if defined(HAVE_OPENCL)
+#include "magick/accelerate-private.h"
+#endif
 
 static MagickPassFail
 BuildChannelHistogramsCB(void *mutable_data,          /* User provided mutable data */
@@ -221,6 +225,13 @@ MagickExport MagickPassFail ContrastImage(Image *image,const unsigned int sharpe
   is_grayscale=image->is_grayscale;
   sign=sharpen ? 1.0 : -1.0;
   progress_message=sharpen ? SharpenContrastImageText : DullContrastImageText;
+#if defined(HAVE_OPENCL)
+  if (AccelerateContrastImage(image,sharpen,&image->exception) != MagickFalse)
+    {
+      image->is_grayscale=is_grayscale;
+      return(status);
+    }
+#endif
   if (image->storage_class == PseudoClass)
     {
       (void) ContrastImagePixels(NULL,&sign,image,image->colormap,
@@ -346,6 +357,13 @@ MagickExport MagickPassFail EqualizeImage(Image *image)
   assert(image != (Image *) NULL);
   assert(image->signature == MagickSignature);
   is_grayscale=image->is_grayscale;
+#if defined(HAVE_OPENCL)
+  if (AccelerateEqualizeImage(image,&image->exception) != MagickFalse)
+    {
+      image->is_grayscale=is_grayscale;
+      return(status);
+    }
+#endif
   map=MagickAllocateMemory(DoublePixelPacket *,(MaxMap+1)*sizeof(DoublePixelPacket));
   levels.map=MagickAllocateMemory(PixelPacket *,(MaxMap+1)*sizeof(PixelPacket));
   if ((map == (DoublePixelPacket *) NULL) ||
@@ -1146,6 +1164,15 @@ MagickExport MagickPassFail ModulateImage(Image *image,const char *modulate)
                param.percent_brightness,param.percent_saturation,
                param.percent_hue);
   TransformColorspace(image,RGBColorspace);
+#if defined(HAVE_OPENCL)
+  if (AccelerateModulateImage(image,param.percent_brightness,
+                              param.percent_saturation,param.percent_hue,
+                              &image->exception) != MagickFalse)
+    {
+      image->is_grayscale=is_grayscale;
+      return(status);
+    }
+#endif
   if (image->storage_class == PseudoClass)
     {
       (void) ModulateImagePixels(NULL,&param,image,image->colormap,
@@ -1380,6 +1407,21 @@ MagickExport MagickPassFail NormalizeImage(Image *image)
   assert(image != (Image *) NULL);
   assert(image->signature == MagickSignature);
   is_grayscale=image->is_grayscale;
+  /*
+    The histogram boundaries are located at the 0.1 percent levels.
+  */
+  threshold_percent=0.1;
+  MagickAttributeToDouble(image,"histogram-threshold",threshold_percent);
+  threshold=(long) ((double) image->columns*image->rows*0.01*threshold_percent);
+  (void) LogMagickEvent(TransformEvent,GetMagickModule(),
+                        "Histogram Threshold = %g%% (%g)", threshold_percent, threshold);
+#if defined(HAVE_OPENCL)
+  if (AccelerateNormalizeImage(image,threshold,&image->exception) != MagickFalse)
+    {
+      image->is_grayscale=is_grayscale;
+      return(status);
+    }
+#endif
   levels.map=MagickAllocateMemory(PixelPacket *,(MaxMap+1)*sizeof(PixelPacket));
   if (levels.map == (PixelPacket *) NULL)
     ThrowBinaryException3(ResourceLimitError,MemoryAllocationFailed,
@@ -1394,13 +1436,8 @@ MagickExport MagickPassFail NormalizeImage(Image *image)
       return MagickFail;
     }
   /*
-    Find the histogram boundaries by locating the 0.1 percent levels.
+    Find the histogram boundaries.
   */
-  threshold_percent=0.1;
-  MagickAttributeToDouble(image,"histogram-threshold",threshold_percent);
-  threshold=(long) ((double) image->columns*image->rows*0.01*threshold_percent);
-  (void) LogMagickEvent(TransformEvent,GetMagickModule(),
-                        "Histogram Threshold = %g%% (%g)", threshold_percent, threshold);
   FindHistogramBounds(red,threshold,low,high,histogram);
   FindHistogramBounds(green,threshold,low,high,histogram);
   FindHistogramBounds(blue,threshold,low,high,histogram);
@@ -129,8 +129,8 @@ typedef unsigned char Quantum;
 #define QuantumFormat  "%u"
 #endif
 #elif (MAGICKCORE_QUANTUM_DEPTH == 16)
-#define MaxColormapSize  65536UL
-#define MaxMap  65535UL
+// #define MaxColormapSize  65536UL
+// #define MaxMap  65535UL
 
 #if defined(MAGICKCORE_HDRI_SUPPORT)
 typedef MagickFloatType Quantum;
@@ -142,8 +142,8 @@ typedef unsigned short Quantum;
 #define QuantumFormat  "%u"
 #endif
 #elif (MAGICKCORE_QUANTUM_DEPTH == 32)
-#define MaxColormapSize  65536UL
-#define MaxMap  65535UL
+// #define MaxColormapSize  65536UL
+// #define MaxMap  65535UL
 
 #if defined(MAGICKCORE_HDRI_SUPPORT)
 typedef MagickDoubleType Quantum;
@@ -156,8 +156,8 @@ typedef unsigned int Quantum;
 #endif
 #elif (MAGICKCORE_QUANTUM_DEPTH == 64)
 #define MAGICKCORE_HDRI_SUPPORT  1
-#define MaxColormapSize  65536UL
-#define MaxMap  65535UL
+// #define MaxColormapSize  65536UL
+// #define MaxMap  65535UL
 
 typedef MagickDoubleType Quantum;
 #define QuantumRange  18446744073709551615.0
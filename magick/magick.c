@@ -185,6 +185,7 @@ DestroyMagick(void)
   DestroyMagickInfoList();      /* Coder registrations + modules */
   DestroyConstitute();          /* Constitute semaphore */
   DestroyMagickRegistry();      /* Registered images */
+  DestroyPixelCachePool();      /* Pooled pixel cache memory */
   DestroyMagickResources();     /* Resource semaphore */
   DestroyMagickRandomGenerator(); /* Random number generator */
   DestroyTemporaryFiles();      /* Temporary files */
@@ -1253,6 +1254,7 @@ InitializeMagickEx(const char *path, unsigned int options,
     InitializeMagickSignalHandlers(); /* Signal handlers */
   InitializeTemporaryFiles();       /* Temporary files */
   InitializeMagickResources();      /* Resources */
+  InitializePixelCachePool();       /* Pooled pixel cache memory */
   InitializeMagickRegistry();       /* Image/blob registry */
   InitializeConstitute();           /* Constitute semaphore */
   InitializeMagickInfoList();       /* Coder registrations + modules */
@@ -71,6 +71,102 @@ typedef struct _MagickCLCacheInfo
 #define MAGICKCORE_OPENCL_UNDEFINED_SCORE -1.0
 #define MAGICKCORE_OPENCL_COMMAND_QUEUES 16
 
+/*
+  Alignment of the in-memory pixel caches.  Devices that share memory with
+  the host only use a CL_MEM_USE_HOST_PTR buffer in place when it is aligned
+  to CL_DEVICE_MEM_BASE_ADDR_ALIGN, and some drivers want a page boundary.
+*/
+#define MAGICKCORE_OPENCL_HOST_ALIGNMENT 4096
+
+/*
+  Images with fewer pixels than this are always processed by the CPU.
+*/
+#define MAGICKCORE_OPENCL_MINIMUM_PIXELS (512*512)
+
+/*
+  Operations known to the OpenCL cost model.
+*/
+typedef enum
+{
+  AffineCLOperation,
+  BlurCLOperation,
+  CompositeCLOperation,
+  ContrastCLOperation,
+  ConvolveCLOperation,
+  DespeckleCLOperation,
+  GrayscaleCLOperation,
+  HistogramCLOperation,
+  ModulateCLOperation,
+  MotionBlurCLOperation,
+  ResizeCLOperation,
+  ScaleCLOperation,
+  UnsharpMaskCLOperation,
+  NumberOfCLOperations
+} MagickCLOperation;
+
+typedef struct _MagickCLOperationCost
+{
+  double
+    usecs;
+
+  MagickSizeType
+    pixels;
+} MagickCLOperationCost;
+
+/*
+  A kernel or transfer whose time still has to be added to the cost model
+  (and to the profile for a transfer).  The event is only read once it
+  completed, so measuring never waits for the device.
+*/
+#define MAGICKCORE_OPENCL_PENDING_EVENTS 64
+
+typedef struct _MagickCLPendingEvent
+{
+  cl_event
+    event;
+
+  const char
+    *transfer;          /* name of the transfer, NULL for a kernel */
+
+  MagickCLOperation
+    operation;
+
+  MagickSizeType
+    bytes,
+    pixels;
+} MagickCLPendingEvent;
+
+/*
+  A command traced for the MAGICK_OCL_PROFILE report.  Kernels record their
+  work sizes, transfers the number of bytes they moved.
+*/
+#define MAGICKCORE_OPENCL_MAXIMUM_PROFILE_EVENTS (1024*1024)
+
+typedef struct _MagickCLProfileEvent
+{
+  char
+    *name;
+
+  cl_command_queue
+    queue;
+
+  cl_uint
+    work_dim;
+
+  cl_ulong
+    end,
+    queued,
+    start,
+    submit;
+
+  MagickSizeType
+    bytes;
+
+  size_t
+    gsize[3],
+    lsize[3];
+} MagickCLProfileEvent;
+
 /* Platform APIs */
 typedef CL_API_ENTRY cl_int
   (CL_API_CALL *MAGICKpfn_clGetPlatformIDs)(cl_uint num_entries,
@@ -200,6 +296,12 @@ typedef CL_API_ENTRY cl_int
     cl_uint num_events_in_wait_list,const cl_event *event_wait_list,
     cl_event *event) CL_API_SUFFIX__VERSION_1_0;
 
+typedef CL_API_ENTRY cl_int
+  (CL_API_CALL *MAGICKpfn_clEnqueueWriteBuffer)(cl_command_queue command_queue,
+    cl_mem buffer,cl_bool blocking_write,size_t offset,size_t cb,
+    const void *ptr,cl_uint num_events_in_wait_list,
+    const cl_event *event_wait_list,cl_event *event) CL_API_SUFFIX__VERSION_1_0;
+
 typedef CL_API_ENTRY void
   *(CL_API_CALL *MAGICKpfn_clEnqueueMapBuffer)(cl_command_queue command_queue,
     cl_mem buffer,cl_bool blocking_map,cl_map_flags map_flags,size_t offset,
@@ -288,6 +390,7 @@ struct MagickLibraryRec
   MAGICKpfn_clGetKernelInfo           clGetKernelInfo;
 
   MAGICKpfn_clEnqueueReadBuffer       clEnqueueReadBuffer;
+  MAGICKpfn_clEnqueueWriteBuffer      clEnqueueWriteBuffer;
   MAGICKpfn_clEnqueueMapBuffer        clEnqueueMapBuffer;
   MAGICKpfn_clEnqueueUnmapMemObject   clEnqueueUnmapMemObject;
   MAGICKpfn_clEnqueueNDRangeKernel    clEnqueueNDRangeKernel;
@@ -323,12 +426,18 @@ struct _MagickCLDevice
   cl_program
     program;
 
+  cl_bool
+    host_unified_memory;
+
   cl_uint
     max_clock_frequency,
-    max_compute_units;
+    max_compute_units,
+    memory_alignment;
 
   cl_ulong
-    local_memory_size;
+    global_memory_size,
+    local_memory_size,
+    max_mem_alloc_size;
 
   double
     score;
@@ -338,6 +447,7 @@ struct _MagickCLDevice
 
   MagickBooleanType
     enabled,
+    measure_costs,
     profile_kernels;
 
   SemaphoreInfo
@@ -351,10 +461,39 @@ struct _MagickCLDevice
 
   char
     *vendor_name;
+
+  MagickCLOperationCost
+    operation_costs[NumberOfCLOperations];
+
+  MagickCLPendingEvent
+    pending_events[MAGICKCORE_OPENCL_PENDING_EVENTS];
+
+  size_t
+    number_pending_events;
+
+  double
+    transfer_usecs;
+
+  MagickSizeType
+    transfer_bytes;
+
+  MagickBooleanType
+    trace_events;
+
+  MagickCLProfileEvent
+    *profile_events;
+
+  size_t
+    dropped_profile_events,
+    max_profile_events,
+    number_profile_events;
 };
 
 typedef struct _MagickCLEnv
 {
+  char
+    *profile_filename;
+
   cl_context
     *contexts;
 
@@ -362,6 +501,7 @@ typedef struct _MagickCLEnv
     cpu_score;
 
   MagickBooleanType
+    cost_model,
     enabled,
     initialized;
 
@@ -382,43 +522,45 @@ typedef struct _MagickCLEnv
     number_devices;
 } *MagickCLEnv;
 
+/*
+  The quantum constants are printed as single precision literals with enough
+  digits for the 16 and 32 bit quantum depths.
+*/
+#define CLQuantumOptions "-DQuantumRange=%.9ef -DQuantumScale=%.9ef " \
+  "-DCharQuantumScale=%.9ef -DMagickEpsilon=%.9ef -DMagickPI=%.9ef " \
+  "-DMaxMap=%u -DMAGICKCORE_QUANTUM_DEPTH=%u"
 #if defined(MAGICKCORE_HDRI_SUPPORT)
 #define CLOptions "-cl-single-precision-constant -cl-mad-enable -DMAGICKCORE_HDRI_SUPPORT=1 "\
-  "-DCLQuantum=float -DCLSignedQuantum=float -DCLPixelType=float4 -DQuantumRange=%ff " \
-  "-DQuantumScale=%f -DCharQuantumScale=%f -DMagickEpsilon=%f -DMagickPI=%f "\
-  "-DMaxMap=%u -DMAGICKCORE_QUANTUM_DEPTH=%u"
+  "-DCLQuantum=float -DCLSignedQuantum=float -DCLPixelType=float4 " \
+  CLQuantumOptions
 #define CLQuantum  cl_float
 #define CLPixelPacket  cl_float4
 #define CLCharQuantumScale 1.0f
 #elif (MAGICKCORE_QUANTUM_DEPTH == 8)
 #define CLOptions "-cl-single-precision-constant -cl-mad-enable " \
-  "-DCLQuantum=uchar -DCLSignedQuantum=char -DCLPixelType=uchar4 -DQuantumRange=%ff " \
-  "-DQuantumScale=%ff -DCharQuantumScale=%ff -DMagickEpsilon=%ff -DMagickPI=%ff "\
-  "-DMaxMap=%u -DMAGICKCORE_QUANTUM_DEPTH=%u"
+  "-DCLQuantum=uchar -DCLSignedQuantum=char -DCLPixelType=uchar4 " \
+  CLQuantumOptions
 #define CLQuantum  cl_uchar
 #define CLPixelPacket  cl_uchar4
 #define CLCharQuantumScale 1.0f
 #elif (MAGICKCORE_QUANTUM_DEPTH == 16)
 #define CLOptions "-cl-single-precision-constant -cl-mad-enable " \
-  "-DCLQuantum=ushort -DCLSignedQuantum=short -DCLPixelType=ushort4 -DQuantumRange=%ff "\
-  "-DQuantumScale=%f -DCharQuantumScale=%f -DMagickEpsilon=%f -DMagickPI=%f "\
-  "-DMaxMap=%u -DMAGICKCORE_QUANTUM_DEPTH=%u"
+  "-DCLQuantum=ushort -DCLSignedQuantum=short -DCLPixelType=ushort4 " \
+  CLQuantumOptions
 #define CLQuantum  cl_ushort
 #define CLPixelPacket  cl_ushort4
 #define CLCharQuantumScale 257.0f
 #elif (MAGICKCORE_QUANTUM_DEPTH == 32)
 #define CLOptions "-cl-single-precision-constant -cl-mad-enable " \
-  "-DCLQuantum=uint -DCLSignedQuantum=int -DCLPixelType=uint4 -DQuantumRange=%ff "\
-  "-DQuantumScale=%f -DCharQuantumScale=%f -DMagickEpsilon=%f -DMagickPI=%f "\
-  "-DMaxMap=%u -DMAGICKCORE_QUANTUM_DEPTH=%u"
+  "-DCLQuantum=uint -DCLSignedQuantum=int -DCLPixelType=uint4 " \
+  CLQuantumOptions
 #define CLQuantum  cl_uint
 #define CLPixelPacket  cl_uint4
 #define CLCharQuantumScale 16843009.0f
 #elif (MAGICKCORE_QUANTUM_DEPTH == 64)
 #define CLOptions "-cl-single-precision-constant -cl-mad-enable " \
-  "-DCLQuantum=ulong -DCLSignedQuantum=long -DCLPixelType=ulong4 -DQuantumRange=%ff "\
-  "-DQuantumScale=%f -DCharQuantumScale=%f -DMagickEpsilon=%f -DMagickPI=%f "\
-  "-DMaxMap=%u -DMAGICKCORE_QUANTUM_DEPTH=%u"
+  "-DCLQuantum=ulong -DCLSignedQuantum=long -DCLPixelType=ulong4 " \
+  CLQuantumOptions
 #define CLQuantum  cl_ulong
 #define CLPixelPacket  cl_ulong4
 #define CLCharQuantumScale 72340172838076673.0f
@@ -437,14 +579,24 @@ extern MagickPrivate cl_mem
   CreateOpenCLBuffer(MagickCLDevice,cl_mem_flags,size_t,void *);
 
 extern MagickPrivate MagickBooleanType
+  CheckOpenCLOperationCost(MagickCLEnv,const MagickCLOperation,
+    const MagickSizeType,const MagickSizeType),
   EnqueueOpenCLKernel(cl_command_queue,cl_kernel,cl_uint,const size_t *,
     const size_t *,const size_t *,const Image *,const Image *,
     MagickBooleanType,ExceptionInfo *),
+  EnqueueOpenCLTileKernel(cl_command_queue,cl_kernel,cl_uint,const size_t *,
+    const size_t *,MagickCLCacheInfo,MagickCLCacheInfo,const MagickSizeType,
+    ExceptionInfo *),
   InitializeOpenCL(MagickCLEnv,ExceptionInfo *),
   OpenCLThrowMagickException(MagickCLDevice,ExceptionInfo *,
     const char *,const char *,const size_t,const ExceptionType,const char *,
     const char *,...),
-  RecordProfileData(MagickCLDevice,cl_kernel,cl_event);
+  ReadOpenCLBuffer(cl_command_queue,MagickCLCacheInfo,const size_t,void *,
+    ExceptionInfo *),
+  RecordProfileData(MagickCLDevice,cl_kernel,cl_event,cl_uint,const size_t *,
+    const size_t *,const MagickSizeType),
+  WriteOpenCLBuffer(cl_command_queue,MagickCLCacheInfo,const size_t,
+    const void *,ExceptionInfo *);
 
 extern MagickPrivate MagickCLCacheInfo
   AcquireMagickCLCacheInfo(MagickCLDevice,Quantum *,const MagickSizeType),
@@ -452,7 +604,9 @@ extern MagickPrivate MagickCLCacheInfo
   RelinquishMagickCLCacheInfo(MagickCLCacheInfo,const MagickBooleanType);
 
 extern MagickPrivate MagickCLDevice
-  RequestOpenCLDevice(MagickCLEnv);
+  *ReleaseOpenCLDevices(MagickCLDevice *,const size_t),
+  RequestOpenCLDevice(MagickCLEnv),
+  *RequestOpenCLDevices(MagickCLEnv,size_t *);
 
 extern MagickPrivate MagickCLEnv
   GetCurrentOpenCLEnv(void);
@@ -468,7 +622,8 @@ extern MagickPrivate void
   ReleaseOpenCLKernel(cl_kernel),
   ReleaseOpenCLMemObject(cl_mem),
   RetainOpenCLEvent(cl_event),
-  RetainOpenCLMemObject(cl_mem);
+  RetainOpenCLMemObject(cl_mem),
+  SyncMagickCLCacheInfo(MagickCLCacheInfo);
 
 #endif
 
@@ -101,6 +101,7 @@
 #include "magick/pixel_cache.h"
 #include "magick/blob.h"
 #include "magick/resource.h"
+#include "magick/signature.h"
 #include "magick/accelerate-kernels-private.h"
 
 #if defined(HAVE_OPENCL)
@@ -117,6 +118,18 @@
 */
 #define IMAGEMAGICK_PROFILE_FILE "GraphicsMagickOpenCLDeviceProfile.xml"
 
+/*
+  Number of pixels processed by the timed iterations of RunOpenCLBenchmark(),
+  used to turn the benchmark scores into a cost per pixel.
+*/
+#define MAGICKCORE_OPENCL_BENCHMARK_PIXELS (2.0*3.0*2048.0*1536.0)
+
+/*
+  Version of the cached program binaries, part of the cache key.  Increment
+  it when the layout of the cache files changes.
+*/
+#define MAGICKCORE_OPENCL_CACHE_VERSION "2"
+
 /*
   Typedef declarations.
 */
@@ -148,6 +161,7 @@ typedef struct
 */
 
 static MagickBooleanType
+  CompileOpenCLDevice(MagickCLDevice,ExceptionInfo *),
   HasOpenCLDevices(MagickCLEnv,ExceptionInfo *),
   LoadOpenCLLibrary(void);
 
@@ -158,7 +172,15 @@ static MagickCLEnv
   RelinquishMagickCLEnv(MagickCLEnv);
 
 static void
-  BenchmarkOpenCLDevices(MagickCLEnv);
+  BenchmarkOpenCLDevices(MagickCLEnv),
+  MeasureOperationCost(MagickCLDevice,cl_kernel,cl_event,
+    const MagickSizeType),
+  QueuePendingEvent(MagickCLDevice,const MagickCLPendingEvent *),
+  UpdateOperationCosts(MagickCLDevice);
+
+static inline char
+  *GetOpenCLDeviceString(cl_device_id,cl_device_info),
+  *GetOpenCLPlatformString(cl_platform_id,cl_platform_info);
 
 extern const char
   *accelerateKernels, *accelerateKernels2;
@@ -431,46 +453,6 @@ static void SelectOpenCLDevice(MagickCLEnv clEnv,cl_device_type type)
   }
 }
 
-static size_t StringSignature(const char* string)
-{
-  size_t
-    n,
-    i,
-    j,
-    signature,
-    stringLength;
-
-  union
-  {
-    const char* s;
-    const size_t* u;
-  } p;
-
-  stringLength=(size_t) strlen(string);
-  signature=stringLength;
-  n=stringLength/sizeof(size_t);
-  p.s=string;
-  for (i = 0; i < n; i++)
-    signature^=p.u[i];
-  if (n * sizeof(size_t) != stringLength)
-    {
-      char
-        padded[4];
-
-      j=n*sizeof(size_t);
-      for (i = 0; i < 4; i++, j++)
-      {
-        if (j < stringLength)
-          padded[i]=p.s[j];
-        else
-          padded[i]=0;
-      }
-      p.s=padded;
-      signature^=p.u[0];
-    }
-  return(signature);
-}
-
 static void DestroyMagickCLCacheInfo(MagickCLCacheInfo info)
 {
   ssize_t
@@ -541,7 +523,8 @@ MagickPrivate cl_int SetOpenCLKernelArg(cl_kernel kernel,size_t arg_index,
 %
 %    o device: the OpenCL device.
 %
-%    o pixels: the pixel buffer of the image.
+%    o pixels: the pixel buffer of the image, NULL allocates a buffer that
+%      only lives on the device.
 %
 %    o length: the length of the pixel buffer.
 %
@@ -553,6 +536,9 @@ MagickPrivate MagickCLCacheInfo AcquireMagickCLCacheInfo(MagickCLDevice device,
   cl_int
     status;
 
+  cl_mem_flags
+    flags;
+
   MagickCLCacheInfo
     info;
 
@@ -566,9 +552,24 @@ MagickPrivate MagickCLCacheInfo AcquireMagickCLCacheInfo(MagickCLDevice device,
   info->pixels=pixels;
   // info->events_semaphore=AcquireSemaphoreInfo();
   info->events_semaphore=AllocateSemaphoreInfo();
-  info->buffer=openCL_library->clCreateBuffer(device->context,
-    CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,(size_t) length,(void *) pixels,
-    &status);
+  flags=CL_MEM_READ_WRITE;
+  if (pixels != (Quantum *) NULL)
+    {
+      /*
+        The buffer wraps the pixel cache.  A device that shares memory with
+        the host, such as a CPU device, then works on the pixels in place and
+        CopyMagickCLCacheInfo() only has to map them, unless they are not
+        aligned and the driver falls back to a copy.
+      */
+      flags|=CL_MEM_USE_HOST_PTR;
+      if ((device->host_unified_memory != CL_FALSE) &&
+          (((magick_uintptr_t) pixels % device->memory_alignment) != 0))
+        (void) LogMagickEvent(AccelerateEvent,GetMagickModule(),
+          "pixels are not aligned to %u bytes, the buffer may be copied",
+          (unsigned int) device->memory_alignment);
+    }
+  info->buffer=openCL_library->clCreateBuffer(device->context,flags,
+    (size_t) length,(void *) pixels,&status);
   if (status == CL_SUCCESS)
     return(info);
   DestroyMagickCLCacheInfo(info);
@@ -651,6 +652,13 @@ static MagickCLEnv AcquireMagickCLEnv(void)
             (strcmp(option,"CPU") == 0))
           clEnv->enabled=MagickTrue;
       }
+    clEnv->cost_model=MagickTrue;
+    option=getenv("MAGICK_OCL_COST_MODEL");
+    if (option != (const char *) NULL)
+      clEnv->cost_model=IsStringTrue(option);
+    option=getenv("MAGICK_OCL_PROFILE");
+    if ((option != (const char *) NULL) && (*option != '\0'))
+      clEnv->profile_filename=ConstantString(option);
   }
   return clEnv;
 }
@@ -698,7 +706,8 @@ MagickPrivate cl_command_queue AcquireOpenCLCommandQueue(MagickCLDevice device)
   {
     UnlockSemaphoreInfo(device->lock);
     properties=0;
-    if (device->profile_kernels != MagickFalse)
+    if ((device->profile_kernels != MagickFalse) ||
+        (device->measure_costs != MagickFalse))
       properties=CL_QUEUE_PROFILING_ENABLE;
     queue=openCL_library->clCreateCommandQueue(device->context,
       device->deviceID,properties,(cl_int *) NULL);
@@ -1231,6 +1240,7 @@ static void BenchmarkOpenCLDevices(MagickCLEnv clEnv)
   testEnv->number_devices=1;
   testEnv->benchmark_thread_id=GetMagickThreadId();
   testEnv->initialized=MagickTrue;
+  testEnv->cost_model=MagickFalse;
 
   for (i = 0; i < clEnv->number_devices; i++)
     clEnv->devices[i]->score=MAGICKCORE_OPENCL_UNDEFINED_SCORE;
@@ -1262,6 +1272,149 @@ static void BenchmarkOpenCLDevices(MagickCLEnv clEnv)
   CacheOpenCLBenchmarks(clEnv);
 }
 
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%   B u i l d O p e n C L D e v i c e K e r n e l s                           %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  BuildOpenCLDeviceKernels() compiles the kernels for the device, whether it
+%  is enabled or not, and stores the program binary in the OpenCL cache
+%  directory so that later processes only have to load it.  MagickTrue is
+%  returned when the kernels were already built or could be built.
+%
+%  The format of the BuildOpenCLDeviceKernels method is:
+%
+%      MagickBooleanType BuildOpenCLDeviceKernels(MagickCLDevice device,
+%        ExceptionInfo *exception)
+%
+%  A description of each parameter follows:
+%
+%    o device: the OpenCL device.
+%
+%    o exception: return any errors or warnings in this structure.
+%
+*/
+
+MagickExport MagickBooleanType BuildOpenCLDeviceKernels(MagickCLDevice device,
+  ExceptionInfo *exception)
+{
+  if (device == (MagickCLDevice) NULL)
+    return(MagickFalse);
+  return(CompileOpenCLDevice(device,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
++   C h e c k O p e n C L O p e r a t i o n C o s t                           %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  CheckOpenCLOperationCost() returns MagickTrue if the operation is expected
+%  to complete sooner on the OpenCL device than on the CPU.  Small images and
+%  downscales always stay on the CPU.  Otherwise the cost per pixel is seeded
+%  from the benchmark scores and refined with the times of the kernels which
+%  completed since, whether or not they are profiled, and with the transfer
+%  times measured for the profile.  Set MAGICK_OCL_COST_MODEL to false to
+%  always use the device.
+%
+%  The format of the CheckOpenCLOperationCost method is:
+%
+%      MagickBooleanType CheckOpenCLOperationCost(MagickCLEnv clEnv,
+%        const MagickCLOperation operation,const MagickSizeType input_pixels,
+%        const MagickSizeType output_pixels)
+%
+%  A description of each parameter follows:
+%
+%    o clEnv: the OpenCL environment.
+%
+%    o operation: the operation that is about to be executed.
+%
+%    o input_pixels: the number of pixels of the input image.
+%
+%    o output_pixels: the number of pixels of the output image.
+%
+*/
+
+MagickPrivate MagickBooleanType CheckOpenCLOperationCost(MagickCLEnv clEnv,
+  const MagickCLOperation operation,const MagickSizeType input_pixels,
+  const MagickSizeType output_pixels)
+{
+  double
+    cpu_cost,
+    device_cost,
+    device_rate,
+    transfer_rate;
+
+  MagickCLDevice
+    device;
+
+  MagickSizeType
+    pixels;
+
+  size_t
+    i;
+
+  if (clEnv->cost_model == MagickFalse)
+    return(MagickTrue);
+  pixels=MagickMax(input_pixels,output_pixels);
+  if (pixels < MAGICKCORE_OPENCL_MINIMUM_PIXELS)
+    return(MagickFalse);
+  if (((operation == ResizeCLOperation) || (operation == ScaleCLOperation)) &&
+      (output_pixels < input_pixels))
+    return(MagickFalse);
+
+  /* without a CPU benchmark there is nothing to compare with */
+  if (clEnv->cpu_score == MAGICKCORE_OPENCL_UNDEFINED_SCORE)
+    return(MagickTrue);
+
+  device=(MagickCLDevice) NULL;
+  LockSemaphoreInfo(clEnv->lock);
+  for (i = 0; i < clEnv->number_devices; i++)
+  {
+    if (clEnv->devices[i]->enabled == MagickFalse)
+      continue;
+    if ((device == (MagickCLDevice) NULL) ||
+        (clEnv->devices[i]->score < device->score))
+      device=clEnv->devices[i];
+  }
+  UnlockSemaphoreInfo(clEnv->lock);
+  if (device == (MagickCLDevice) NULL)
+    return(MagickFalse);
+  if (device->score == MAGICKCORE_OPENCL_UNDEFINED_SCORE)
+    return(MagickTrue);
+
+  UpdateOperationCosts(device);
+  LockSemaphoreInfo(device->lock);
+  if (device->operation_costs[operation].pixels != 0)
+    device_rate=device->operation_costs[operation].usecs/
+      device->operation_costs[operation].pixels;
+  else
+    device_rate=1.0e6*device->score/MAGICKCORE_OPENCL_BENCHMARK_PIXELS;
+  transfer_rate=0.0;
+  if (device->transfer_bytes != 0)
+    transfer_rate=device->transfer_usecs/device->transfer_bytes;
+  UnlockSemaphoreInfo(device->lock);
+
+  cpu_cost=1.0e6*clEnv->cpu_score*pixels/MAGICKCORE_OPENCL_BENCHMARK_PIXELS;
+  device_cost=device_rate*pixels+transfer_rate*(input_pixels+output_pixels)*
+    sizeof(PixelPacket);
+  (void) LogMagickEvent(AccelerateEvent,GetMagickModule(),
+    "operation %d: estimated %.0f usecs on the device, %.0f usecs on the CPU",
+    (int) operation,device_cost,cpu_cost);
+  return(device_cost < cpu_cost ? MagickTrue : MagickFalse);
+}
+
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %                                                                             %
@@ -1273,13 +1426,15 @@ static void BenchmarkOpenCLDevices(MagickCLEnv clEnv)
 %                                                                             %
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %
+%
 %  CompileOpenCLKernel() compiles the kernel for the specified device. The
-%  kernel will be cached on disk to reduce the compilation time.
+%  program binary is cached on disk, under a name derived from the signature,
+%  to reduce the compilation time of the next process.
 %
 %  The format of the CompileOpenCLKernel method is:
 %
-%      MagickBooleanType AcquireOpenCLKernel(MagickCLDevice clEnv,
-%        unsigned int signature,const char *kernel,const char *options,
+%      MagickBooleanType CompileOpenCLKernel(MagickCLDevice device,
+%        const char *kernel,const char *options,const char *signature,
 %        ExceptionInfo *exception)
 %
 %  A description of each parameter follows:
@@ -1290,15 +1445,19 @@ static void BenchmarkOpenCLDevices(MagickCLEnv clEnv)
 %
 %    o options: options for the compiler.
 %
-%    o signature: a number to uniquely identify the kernel
+%    o signature: a string that uniquely identifies the program binary, see
+%      GetOpenCLProgramSignature().
 %
 %    o exception: return any errors or warnings in this structure.
 %
 */
 
-static void CacheOpenCLKernel(MagickCLDevice device,char *filename,
+static void CacheOpenCLKernel(MagickCLDevice device,const char *filename,
   ExceptionInfo *exception)
 {
+  char
+    temporary_filename[MagickPathExtent];
+
   cl_uint
     status;
 
@@ -1323,9 +1482,19 @@ static void CacheOpenCLKernel(MagickCLDevice device,char *filename,
     CL_PROGRAM_BINARIES,sizeof(unsigned char*),&binaryProgram,NULL);
   if (status == CL_SUCCESS)
     {
+      /*
+        Write the binary to a file private to this process and rename it
+        into place, so that a concurrent process never loads a partially
+        written cache file.
+      */
+      (void) FormatLocaleString(temporary_filename,MagickPathExtent,
+        "%s.%ld.tmp",filename,(long) getpid());
       (void) LogMagickEvent(AccelerateEvent,GetMagickModule(),
         "Creating cache file: \"%s\"",filename);
-      (void) BlobToFile(filename,binaryProgram,binaryProgramSize,exception);
+      if ((BlobToFile(temporary_filename,binaryProgram,binaryProgramSize,
+             exception) == MagickFail) ||
+          (rename(temporary_filename,filename) != 0))
+        (void) remove(temporary_filename);
     }
   binaryProgram=(unsigned char *) RelinquishMagickMemory(binaryProgram);
 }
@@ -1362,8 +1531,14 @@ static MagickBooleanType LoadCachedOpenCLKernels(MagickCLDevice device,
     &device->deviceID,&length,(const unsigned char**)&binaryProgram,
     &binaryStatus,&status);
   binaryProgram=(unsigned char *) RelinquishMagickMemory(binaryProgram);
-  return((status != CL_SUCCESS) || (binaryStatus != CL_SUCCESS) ? MagickFalse :
-    MagickTrue);
+  if ((status != CL_SUCCESS) || (binaryStatus != CL_SUCCESS))
+    {
+      if (device->program != (cl_program) NULL)
+        openCL_library->clReleaseProgram(device->program);
+      device->program=(cl_program) NULL;
+      return(MagickFalse);
+    }
+  return(MagickTrue);
 }
 
 static void LogOpenCLBuildFailure(MagickCLDevice device,const char *kernel,
@@ -1397,7 +1572,7 @@ static void LogOpenCLBuildFailure(MagickCLDevice device,const char *kernel,
 }
 
 static MagickBooleanType CompileOpenCLKernel(MagickCLDevice device,
-  const char *kernel,const char *options,size_t signature,
+  const char *kernel,const char *options,const char *signature,
   ExceptionInfo *exception)
 {
   char
@@ -1408,9 +1583,6 @@ static MagickBooleanType CompileOpenCLKernel(MagickCLDevice device,
   cl_int
     status;
 
-  MagickBooleanType
-    loaded;
-
   size_t
     length;
 
@@ -1425,19 +1597,31 @@ static MagickBooleanType CompileOpenCLKernel(MagickCLDevice device,
       *ptr = '_';
     ptr++;
   }
-  (void) FormatLocaleString(filename,MagickPathExtent,
-    "%s%s%s_%s_%08x_%.20g.bin",GetOpenCLCacheDirectory(),
-    DirectorySeparator,"magick_opencl",deviceName,(unsigned int) signature,
-    (double) sizeof(char*)*8);
-  loaded=LoadCachedOpenCLKernels(device,filename);
-  if (loaded == MagickFalse)
+  (void) FormatLocaleString(filename,MagickPathExtent,"%s%s%s_%s_%s.bin",
+    GetOpenCLCacheDirectory(),DirectorySeparator,"magick_opencl",deviceName,
+    signature);
+  if (LoadCachedOpenCLKernels(device,filename) != MagickFalse)
     {
-      /* Binary CL program unavailable, compile the program from source */
-      length=strlen(kernel);
-      device->program=openCL_library->clCreateProgramWithSource(
-        device->context,1,&kernel,&length,&status);
-      if (status != CL_SUCCESS)
-        return(MagickFalse);
+      status=openCL_library->clBuildProgram(device->program,1,
+        &device->deviceID,options,NULL,NULL);
+      if (status == CL_SUCCESS)
+        return(MagickTrue);
+      /* The driver rejected the cached binary, rebuild it from source */
+      (void) LogMagickEvent(AccelerateEvent,GetMagickModule(),
+        "Discarding cache file: \"%s\" (%d)",filename,(int)status);
+      openCL_library->clReleaseProgram(device->program);
+      device->program=(cl_program) NULL;
+      (void) remove(filename);
+    }
+
+  /* Binary CL program unavailable, compile the program from source */
+  length=strlen(kernel);
+  device->program=openCL_library->clCreateProgramWithSource(
+    device->context,1,&kernel,&length,&status);
+  if (status != CL_SUCCESS)
+    {
+      device->program=(cl_program) NULL;
+      return(MagickFalse);
     }
 
   status=openCL_library->clBuildProgram(device->program,1,&device->deviceID,
@@ -1449,16 +1633,113 @@ static MagickBooleanType CompileOpenCLKernel(MagickCLDevice device,
     (void) LogMagickEvent(AccelerateEvent,GetMagickModule(), // TODO(ocl)
       "clBuildProgram failed: %d",(int)status);
     LogOpenCLBuildFailure(device,kernel,exception);
+    openCL_library->clReleaseProgram(device->program);
+    device->program=(cl_program) NULL;
     return(MagickFalse);
   }
 
   /* Save the binary to a file to avoid re-compilation of the kernels */
-  if (loaded == MagickFalse)
-    CacheOpenCLKernel(device,filename,exception);
+  CacheOpenCLKernel(device,filename,exception);
 
   return(MagickTrue);
 }
 
+static inline void UpdateOpenCLSignature(SignatureInfo *signature_info,
+  const char *value)
+{
+  if (value == (const char *) NULL)
+    value="";
+  /* Include the terminator so that adjacent values cannot run together */
+  UpdateSignature(signature_info,(const unsigned char *) value,
+    strlen(value)+1);
+}
+
+static void GetOpenCLProgramSignature(MagickCLDevice device,
+  const char *kernel,const char *options,char *signature)
+{
+  char
+    *value;
+
+  cl_platform_id
+    platform;
+
+  SignatureInfo
+    signature_info;
+
+  /*
+    The binary depends on the kernel source, the build options (which carry
+    the quantum depth), the device and the exact driver that compiled it.
+  */
+  GetSignatureInfo(&signature_info);
+  UpdateOpenCLSignature(&signature_info,MAGICKCORE_OPENCL_CACHE_VERSION);
+  UpdateOpenCLSignature(&signature_info,options);
+  UpdateOpenCLSignature(&signature_info,kernel);
+  UpdateOpenCLSignature(&signature_info,device->platform_name);
+  UpdateOpenCLSignature(&signature_info,device->vendor_name);
+  UpdateOpenCLSignature(&signature_info,device->name);
+  UpdateOpenCLSignature(&signature_info,device->version);
+  value=GetOpenCLDeviceString(device->deviceID,CL_DEVICE_VERSION);
+  UpdateOpenCLSignature(&signature_info,value);
+  value=(char *) RelinquishMagickMemory(value);
+  if (openCL_library->clGetDeviceInfo(device->deviceID,CL_DEVICE_PLATFORM,
+        sizeof(cl_platform_id),&platform,NULL) == CL_SUCCESS)
+    {
+      value=GetOpenCLPlatformString(platform,CL_PLATFORM_VERSION);
+      UpdateOpenCLSignature(&signature_info,value);
+      value=(char *) RelinquishMagickMemory(value);
+    }
+  UpdateOpenCLSignature(&signature_info,sizeof(char *) == 8 ? "64" : "32");
+  FinalizeSignature(&signature_info);
+  FormatString(signature,"%08lx%08lx%08lx%08lx%08lx%08lx%08lx%08lx",
+    signature_info.digest[0],signature_info.digest[1],signature_info.digest[2],
+    signature_info.digest[3],signature_info.digest[4],signature_info.digest[5],
+    signature_info.digest[6],signature_info.digest[7]);
+}
+
+static MagickBooleanType CompileOpenCLDevice(MagickCLDevice device,
+  ExceptionInfo *exception)
+{
+  char
+    *accelerateKernelsBuffer,
+    options[MagickPathExtent],
+    signature[MagickPathExtent];
+
+  MagickBooleanType
+    status;
+
+  if (device->program != (cl_program) NULL)
+    return(MagickTrue);
+
+  LockSemaphoreInfo(device->lock);
+  if (device->program != (cl_program) NULL)
+    {
+      UnlockSemaphoreInfo(device->lock);
+      return(MagickTrue);
+    }
+
+  /* Get additional options */
+  (void) FormatLocaleString(options,MagickPathExtent,CLOptions,
+    (float)QuantumRange,(float)QuantumScale,(float)CLCharQuantumScale,
+    (float)MagickEpsilon,(float)MagickPI,(unsigned int)MaxMap,
+    (unsigned int)MAGICKCORE_QUANTUM_DEPTH);
+
+  accelerateKernelsBuffer=(char*) AcquireQuantumMemory(1,
+    strlen(accelerateKernels)+strlen(accelerateKernels2)+1);
+  if (accelerateKernelsBuffer == (char*) NULL)
+    {
+      UnlockSemaphoreInfo(device->lock);
+      return(MagickFalse);
+    }
+  sprintf(accelerateKernelsBuffer,"%s%s",accelerateKernels,accelerateKernels2);
+
+  GetOpenCLProgramSignature(device,accelerateKernelsBuffer,options,signature);
+  status=CompileOpenCLKernel(device,accelerateKernelsBuffer,options,signature,
+    exception);
+  UnlockSemaphoreInfo(device->lock);
+  accelerateKernelsBuffer=RelinquishMagickMemory(accelerateKernelsBuffer);
+  return(status);
+}
+
 static cl_event* CopyOpenCLEvents(MagickCLCacheInfo first,
   MagickCLCacheInfo second,cl_uint *event_count)
 {
@@ -1503,6 +1784,84 @@ static cl_event* CopyOpenCLEvents(MagickCLCacheInfo first,
   return(events);
 }
 
+static void RecordProfileEvent(MagickCLDevice device,const char *name,
+  cl_event event,cl_uint work_dim,const size_t *gsize,const size_t *lsize,
+  const MagickSizeType bytes)
+{
+  cl_int
+    status;
+
+  MagickCLProfileEvent
+    profile_event;
+
+  size_t
+    i;
+
+  if (device->trace_events == MagickFalse)
+    return;
+  (void) memset(&profile_event,0,sizeof(profile_event));
+  status=openCL_library->clGetEventInfo(event,CL_EVENT_COMMAND_QUEUE,
+    sizeof(cl_command_queue),&profile_event.queue,NULL);
+  status|=openCL_library->clGetEventProfilingInfo(event,
+    CL_PROFILING_COMMAND_QUEUED,sizeof(cl_ulong),&profile_event.queued,NULL);
+  status|=openCL_library->clGetEventProfilingInfo(event,
+    CL_PROFILING_COMMAND_SUBMIT,sizeof(cl_ulong),&profile_event.submit,NULL);
+  status|=openCL_library->clGetEventProfilingInfo(event,
+    CL_PROFILING_COMMAND_START,sizeof(cl_ulong),&profile_event.start,NULL);
+  status|=openCL_library->clGetEventProfilingInfo(event,
+    CL_PROFILING_COMMAND_END,sizeof(cl_ulong),&profile_event.end,NULL);
+  if (status != CL_SUCCESS)
+    return;
+  profile_event.work_dim=MagickMin(work_dim,3);
+  for (i=0; i < profile_event.work_dim; i++)
+  {
+    profile_event.gsize[i]=gsize[i];
+    if (lsize != (const size_t *) NULL)
+      profile_event.lsize[i]=lsize[i];
+  }
+  profile_event.bytes=bytes;
+  LockSemaphoreInfo(device->lock);
+  if (device->number_profile_events == device->max_profile_events)
+    {
+      if (device->max_profile_events >= MAGICKCORE_OPENCL_MAXIMUM_PROFILE_EVENTS)
+        {
+          device->dropped_profile_events++;
+          UnlockSemaphoreInfo(device->lock);
+          return;
+        }
+      device->max_profile_events=MagickMax(2*device->max_profile_events,1024);
+      device->profile_events=(MagickCLProfileEvent *) ResizeQuantumMemory(
+        device->profile_events,device->max_profile_events,
+        sizeof(*device->profile_events));
+      if (device->profile_events == (MagickCLProfileEvent *) NULL)
+        MagickFatalError(ResourceLimitFatalError,MemoryAllocationFailed,
+          "ocl: RecordProfileEvent");
+    }
+  profile_event.name=ConstantString(name);
+  device->profile_events[device->number_profile_events++]=profile_event;
+  UnlockSemaphoreInfo(device->lock);
+}
+
+/*
+  The transfer is measured by UpdateOperationCosts() once it completed, the
+  pipelined band transfers must not wait for each other.
+*/
+static void RecordTransferProfileData(MagickCLDevice device,const char *name,
+  cl_event event,const MagickSizeType length)
+{
+  MagickCLPendingEvent
+    pending;
+
+  if ((device->profile_kernels == MagickFalse) &&
+      (device->measure_costs == MagickFalse))
+    return;
+  (void) memset(&pending,0,sizeof(pending));
+  pending.event=event;
+  pending.transfer=name;
+  pending.bytes=length;
+  QueuePendingEvent(device,&pending);
+}
+
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %                                                                             %
@@ -1544,11 +1903,21 @@ MagickPrivate MagickCLCacheInfo CopyMagickCLCacheInfo(MagickCLCacheInfo info)
   events=CopyOpenCLEvents(info,(MagickCLCacheInfo) NULL,&event_count);
   if (events != (cl_event *) NULL)
     {
+      cl_event
+        event;
+
+      event=(cl_event) NULL;
       queue=AcquireOpenCLCommandQueue(info->device);
       pixels=openCL_library->clEnqueueMapBuffer(queue,info->buffer,CL_TRUE,
         CL_MAP_READ | CL_MAP_WRITE,0,info->length,event_count,events,
-        (cl_event *) NULL,(cl_int *) NULL);
+        &event,(cl_int *) NULL);
       assert(pixels == info->pixels);
+      if (event != (cl_event) NULL)
+        {
+          RecordTransferProfileData(info->device,"MapBuffer",event,
+            info->length);
+          openCL_library->clReleaseEvent(event);
+        }
       ReleaseOpenCLCommandQueue(info->device,queue);
       events=(cl_event *) RelinquishMagickMemory(events);
     }
@@ -1566,7 +1935,9 @@ MagickPrivate MagickCLCacheInfo CopyMagickCLCacheInfo(MagickCLCacheInfo info)
 %                                                                             %
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %
-%  DumpOpenCLProfileData() dumps the kernel profile data.
+%  DumpOpenCLProfileData() dumps the kernel profile data.  When
+%  MAGICK_OCL_PROFILE names a file, every profiled kernel and transfer is
+%  also written to it as Chrome trace events in JSON.
 %
 %  The format of the DumpProfileData method is:
 %
@@ -1574,33 +1945,178 @@ MagickPrivate MagickCLCacheInfo CopyMagickCLCacheInfo(MagickCLCacheInfo info)
 %
 */
 
-MagickPrivate void DumpOpenCLProfileData()
+static void WriteOpenCLProfileString(FILE *file,const char *value)
 {
-#define OpenCLLog(message) \
-   fwrite(message,sizeof(char),strlen(message),log); \
-   fwrite("\n",sizeof(char),1,log);
+  const char
+    *p;
 
-  char
-    buf[4096],
-    filename[MagickPathExtent],
-    indent[160];
+  (void) fputc('"',file);
+  for (p=value; (p != (const char *) NULL) && (*p != '\0'); p++)
+  {
+    if ((*p == '"') || (*p == '\\'))
+      (void) fprintf(file,"\\%c",*p);
+    else if ((unsigned char) *p < 0x20)
+      (void) fprintf(file,"\\u%04x",(unsigned int) (unsigned char) *p);
+    else
+      (void) fputc(*p,file);
+  }
+  (void) fputc('"',file);
+}
+
+static void WriteOpenCLProfileSizes(FILE *file,const char *key,
+  const MagickCLProfileEvent *profile_event,const size_t *sizes)
+{
+  size_t
+    i;
+
+  (void) fprintf(file,",\"%s\":[",key);
+  for (i=0; i < profile_event->work_dim; i++)
+    (void) fprintf(file,"%s%lu",i == 0 ? "" : ",",(unsigned long) sizes[i]);
+  (void) fputc(']',file);
+}
+
+static void WriteOpenCLProfileReport(void)
+{
+  cl_command_queue
+    *queues;
 
   FILE
-    *log;
+    *file;
+
+  MagickBooleanType
+    first;
 
   size_t
     i,
-    j;
-
-  if (default_CLEnv == (MagickCLEnv) NULL)
-    return;
+    j,
+    k,
+    number_queues;
 
+  file=fopen(default_CLEnv->profile_filename,"wb");
+  if (file == (FILE *) NULL)
+    {
+      (void) LogMagickEvent(AccelerateEvent,GetMagickModule(),
+        "Unable to write OpenCL profile %s",default_CLEnv->profile_filename);
+      return;
+    }
+  /*
+    Chrome trace events: one process per device and one thread per command
+    queue, the raw device timestamps are kept in nanoseconds.
+  */
+  (void) fprintf(file,"{\"traceEvents\":[");
+  first=MagickTrue;
   for (i = 0; i < default_CLEnv->number_devices; i++)
-    if (default_CLEnv->devices[i]->profile_kernels != MagickFalse)
-      break;
-  if (i == default_CLEnv->number_devices)
+  {
+    cl_ulong
+      origin;
+
+    MagickCLDevice
+      device;
+
+    device=default_CLEnv->devices[i];
+    if (device->number_profile_events == 0)
+      continue;
+    (void) fprintf(file,"%s\n{\"name\":\"process_name\",\"ph\":\"M\","
+      "\"pid\":%lu,\"args\":{\"name\":",first != MagickFalse ? "" : ",",
+      (unsigned long) i);
+    WriteOpenCLProfileString(file,device->name);
+    (void) fprintf(file,",\"platform\":");
+    WriteOpenCLProfileString(file,device->platform_name);
+    (void) fprintf(file,",\"version\":");
+    WriteOpenCLProfileString(file,device->version);
+    (void) fprintf(file,",\"dropped_events\":%lu}}",
+      (unsigned long) device->dropped_profile_events);
+    first=MagickFalse;
+    queues=(cl_command_queue *) AcquireQuantumMemory(
+      device->number_profile_events,sizeof(*queues));
+    if (queues == (cl_command_queue *) NULL)
+      continue;
+    number_queues=0;
+    origin=device->profile_events[0].queued;
+    for (j=1; j < device->number_profile_events; j++)
+      origin=MagickMin(origin,device->profile_events[j].queued);
+    for (j=0; j < device->number_profile_events; j++)
+    {
+      MagickCLProfileEvent
+        *profile_event;
+
+      profile_event=device->profile_events+j;
+      for (k=0; k < number_queues; k++)
+        if (queues[k] == profile_event->queue)
+          break;
+      if (k == number_queues)
+        queues[number_queues++]=profile_event->queue;
+      (void) fprintf(file,",\n{\"name\":");
+      WriteOpenCLProfileString(file,profile_event->name);
+      (void) fprintf(file,",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%lu,"
+        "\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"device\":",
+        profile_event->work_dim != 0 ? "kernel" : "transfer",(unsigned long) i,
+        (unsigned long) k,(profile_event->start-origin)/1000.0,
+        (profile_event->end-profile_event->start)/1000.0);
+      WriteOpenCLProfileString(file,device->name);
+      (void) fprintf(file,",\"queue\":%lu,\"queued\":%.0f,\"submit\":%.0f,"
+        "\"start\":%.0f,\"end\":%.0f,\"bytes\":%.0f",(unsigned long) k,
+        (double) profile_event->queued,(double) profile_event->submit,
+        (double) profile_event->start,(double) profile_event->end,
+        (double) profile_event->bytes);
+      if (profile_event->work_dim != 0)
+        {
+          WriteOpenCLProfileSizes(file,"global_work_size",profile_event,
+            profile_event->gsize);
+          WriteOpenCLProfileSizes(file,"local_work_size",profile_event,
+            profile_event->lsize);
+        }
+      (void) fprintf(file,"}}");
+    }
+    queues=(cl_command_queue *) RelinquishMagickMemory(queues);
+  }
+  (void) fprintf(file,"\n],\"displayTimeUnit\":\"ns\"}\n");
+  (void) fclose(file);
+}
+
+MagickPrivate void DumpOpenCLProfileData()
+{
+#define OpenCLLog(message) \
+   fwrite(message,sizeof(char),strlen(message),log); \
+   fwrite("\n",sizeof(char),1,log);
+
+  char
+    buf[4096],
+    filename[MagickPathExtent],
+    indent[160];
+
+  FILE
+    *log;
+
+  size_t
+    i,
+    j;
+
+  if (default_CLEnv == (MagickCLEnv) NULL)
     return;
 
+  for (i = 0; i < default_CLEnv->number_devices; i++)
+    if (default_CLEnv->devices[i]->profile_kernels != MagickFalse)
+      break;
+  if (i == default_CLEnv->number_devices)
+    return;
+
+  /* the transfers still queued belong in the report */
+  for (i = 0; i < default_CLEnv->number_devices; i++)
+  {
+    MagickCLDevice
+      device;
+
+    device=default_CLEnv->devices[i];
+    for (j = 0; j < device->number_pending_events; j++)
+      (void) openCL_library->clWaitForEvents(1,
+        &device->pending_events[j].event);
+    UpdateOperationCosts(device);
+  }
+
+  if (default_CLEnv->profile_filename != (char *) NULL)
+    WriteOpenCLProfileReport();
+
   (void) FormatLocaleString(filename,MagickPathExtent,"%s%s%s",
     GetOpenCLCacheDirectory(),DirectorySeparator,"ImageMagickOpenCL.log");
 
@@ -1719,15 +2235,12 @@ static MagickBooleanType RegisterCacheEvent(MagickCLCacheInfo info,
   return(MagickTrue);
 }
 
-MagickPrivate MagickBooleanType EnqueueOpenCLKernel(cl_command_queue queue,
+static MagickBooleanType EnqueueOpenCLKernelInfo(cl_command_queue queue,
   cl_kernel kernel,cl_uint work_dim,const size_t *offset,const size_t *gsize,
-  const size_t *lsize,const Image *input_image,const Image *output_image,
+  const size_t *lsize,MagickCLCacheInfo input_cl_info,
+  MagickCLCacheInfo output_cl_info,const MagickSizeType pixels,
   MagickBooleanType flush,ExceptionInfo *exception)
 {
-  CacheInfo
-    *output_info,
-    *input_info;
-
   cl_event
     event,
     *events;
@@ -1738,28 +2251,8 @@ MagickPrivate MagickBooleanType EnqueueOpenCLKernel(cl_command_queue queue,
   cl_uint
     event_count;
 
-  MagickCLCacheInfo
-    output_cl_info,
-    input_cl_info;
-
-  assert(input_image != (const Image *) NULL);
-  input_info=(CacheInfo *) input_image->cache;
-  input_cl_info=GetCacheInfoOpenCL(input_info);
-  assert(input_info != (CacheInfo *) NULL);
   assert(input_cl_info != (MagickCLCacheInfo) NULL);
-  output_info=(CacheInfo *) NULL;
-  if (output_image == (const Image *) NULL)
-    events=CopyOpenCLEvents(input_cl_info,(MagickCLCacheInfo) NULL,
-      &event_count);
-  else
-    {
-      output_info=(CacheInfo *) output_image->cache;
-      output_cl_info=GetCacheInfoOpenCL(output_info);
-      assert(output_info != (CacheInfo *) NULL);
-      assert(output_cl_info != (MagickCLCacheInfo) NULL);
-      events=CopyOpenCLEvents(input_cl_info,output_cl_info,
-        &event_count);
-    }
+  events=CopyOpenCLEvents(input_cl_info,output_cl_info,&event_count);
   status=openCL_library->clEnqueueNDRangeKernel(queue,kernel,work_dim,offset,
     gsize,lsize,event_count,events,&event);
   /* This can fail due to memory issues and calling clFinish might help. */
@@ -1779,11 +2272,13 @@ MagickPrivate MagickBooleanType EnqueueOpenCLKernel(cl_command_queue queue,
     }
   if (flush != MagickFalse)
     openCL_library->clFlush(queue);
-  if (RecordProfileData(input_cl_info->device,kernel,event) == MagickFalse)
+  if (RecordProfileData(input_cl_info->device,kernel,event,work_dim,gsize,
+        lsize,pixels) == MagickFalse)
     {
+      MeasureOperationCost(input_cl_info->device,kernel,event,pixels);
       if (RegisterCacheEvent(input_cl_info,event) != MagickFalse)
         {
-          if (output_info != (CacheInfo *) NULL)
+          if (output_cl_info != (MagickCLCacheInfo) NULL)
             (void) RegisterCacheEvent(output_cl_info,event);
         }
     }
@@ -1791,6 +2286,271 @@ MagickPrivate MagickBooleanType EnqueueOpenCLKernel(cl_command_queue queue,
   return(MagickTrue);
 }
 
+MagickPrivate MagickBooleanType EnqueueOpenCLKernel(cl_command_queue queue,
+  cl_kernel kernel,cl_uint work_dim,const size_t *offset,const size_t *gsize,
+  const size_t *lsize,const Image *input_image,const Image *output_image,
+  MagickBooleanType flush,ExceptionInfo *exception)
+{
+  CacheInfo
+    *output_info,
+    *input_info;
+
+  MagickCLCacheInfo
+    output_cl_info,
+    input_cl_info;
+
+  assert(input_image != (const Image *) NULL);
+  input_info=(CacheInfo *) input_image->cache;
+  assert(input_info != (CacheInfo *) NULL);
+  input_cl_info=GetCacheInfoOpenCL(input_info);
+  assert(input_cl_info != (MagickCLCacheInfo) NULL);
+  output_cl_info=(MagickCLCacheInfo) NULL;
+  if (output_image != (const Image *) NULL)
+    {
+      output_info=(CacheInfo *) output_image->cache;
+      assert(output_info != (CacheInfo *) NULL);
+      output_cl_info=GetCacheInfoOpenCL(output_info);
+      assert(output_cl_info != (MagickCLCacheInfo) NULL);
+    }
+  return(EnqueueOpenCLKernelInfo(queue,kernel,work_dim,offset,gsize,lsize,
+    input_cl_info,output_cl_info,output_image != (const Image *) NULL ?
+    (MagickSizeType) output_image->columns*output_image->rows :
+    (MagickSizeType) input_image->columns*input_image->rows,flush,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
++   E n q u e u e O p e n C L T i l e K e r n e l                             %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  EnqueueOpenCLTileKernel() enqueues a kernel that works on buffers that are
+%  not owned by a pixel cache, such as the tiles used when an image does not
+%  fit in a single device allocation or a histogram.  Like EnqueueOpenCLKernel() the kernel
+%  waits for the events of both cache infos and its event is registered with
+%  them, so the tiles can be shared between command queues.
+%
+%  The format of the EnqueueOpenCLTileKernel method is:
+%
+%      MagickBooleanType EnqueueOpenCLTileKernel(cl_command_queue queue,
+%        cl_kernel kernel,cl_uint work_dim,const size_t *gsize,
+%        const size_t *lsize,MagickCLCacheInfo input_info,
+%        MagickCLCacheInfo output_info,const MagickSizeType pixels,
+%        ExceptionInfo *exception)
+%
+%  A description of each parameter follows:
+%
+%    o queue: the command queue.
+%
+%    o kernel: the kernel to execute.
+%
+%    o work_dim: the number of dimensions of gsize and lsize.
+%
+%    o gsize: the global work size.
+%
+%    o lsize: the local work size.
+%
+%    o input_info: the tile read by the kernel.
+%
+%    o output_info: the tile written by the kernel.
+%
+%    o pixels: the number of pixels written by the kernel.
+%
+%    o exception: return any errors or warnings in this structure.
+%
+*/
+
+MagickPrivate MagickBooleanType EnqueueOpenCLTileKernel(cl_command_queue queue,
+  cl_kernel kernel,cl_uint work_dim,const size_t *gsize,const size_t *lsize,
+  MagickCLCacheInfo input_info,MagickCLCacheInfo output_info,
+  const MagickSizeType pixels,ExceptionInfo *exception)
+{
+  return(EnqueueOpenCLKernelInfo(queue,kernel,work_dim,(const size_t *) NULL,
+    gsize,lsize,input_info,output_info,pixels,MagickTrue,exception));
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
++   R e a d O p e n C L B u f f e r                                           %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  ReadOpenCLBuffer() enqueues a non-blocking copy of a tile to host memory.
+%  The copy waits for the events of the tile and registers its own event, the
+%  host memory may only be used after SyncMagickCLCacheInfo().
+%
+%  The format of the ReadOpenCLBuffer method is:
+%
+%      MagickBooleanType ReadOpenCLBuffer(cl_command_queue queue,
+%        MagickCLCacheInfo info,const size_t length,void *pixels,
+%        ExceptionInfo *exception)
+%
+%  A description of each parameter follows:
+%
+%    o queue: the command queue.
+%
+%    o info: the tile to read from.
+%
+%    o length: the number of bytes to read.
+%
+%    o pixels: the host memory that receives the data.
+%
+%    o exception: return any errors or warnings in this structure.
+%
+*/
+
+MagickPrivate MagickBooleanType ReadOpenCLBuffer(cl_command_queue queue,
+  MagickCLCacheInfo info,const size_t length,void *pixels,
+  ExceptionInfo *exception)
+{
+  cl_event
+    event,
+    *events;
+
+  cl_int
+    status;
+
+  cl_uint
+    event_count;
+
+  events=CopyOpenCLEvents(info,(MagickCLCacheInfo) NULL,&event_count);
+  status=openCL_library->clEnqueueReadBuffer(queue,info->buffer,CL_FALSE,0,
+    length,pixels,event_count,events,&event);
+  events=(cl_event *) RelinquishMagickMemory(events);
+  if (status != CL_SUCCESS)
+    {
+      (void) OpenCLThrowMagickException(info->device,exception,
+        GetMagickModule(),ResourceLimitWarning,"clEnqueueReadBuffer failed.",
+        "'%s'",".");
+      return(MagickFalse);
+    }
+  openCL_library->clFlush(queue);
+  RecordTransferProfileData(info->device,"ReadBuffer",event,length);
+  (void) RegisterCacheEvent(info,event);
+  openCL_library->clReleaseEvent(event);
+  return(MagickTrue);
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
++   S y n c M a g i c k C L C a c h e I n f o                                 %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  SyncMagickCLCacheInfo() waits until all the commands registered with the
+%  cache info have completed and releases their events.
+%
+%  The format of the SyncMagickCLCacheInfo method is:
+%
+%      void SyncMagickCLCacheInfo(MagickCLCacheInfo info)
+%
+%  A description of each parameter follows:
+%
+%    o info: the OpenCL cache info.
+%
+*/
+
+MagickPrivate void SyncMagickCLCacheInfo(MagickCLCacheInfo info)
+{
+  ssize_t
+    i;
+
+  if (info == (MagickCLCacheInfo) NULL)
+    return;
+  LockSemaphoreInfo(info->events_semaphore);
+  if (info->event_count > 0)
+    {
+      (void) openCL_library->clWaitForEvents(info->event_count,info->events);
+      for (i=0; i < (ssize_t) info->event_count; i++)
+        openCL_library->clReleaseEvent(info->events[i]);
+      info->events=(cl_event *) RelinquishMagickMemory(info->events);
+      info->event_count=0;
+    }
+  UnlockSemaphoreInfo(info->events_semaphore);
+}
+
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
++   W r i t e O p e n C L B u f f e r                                         %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  WriteOpenCLBuffer() enqueues a non-blocking copy of host memory to a tile.
+%  The copy waits for the events of the tile and registers its own event, the
+%  host memory must not change until SyncMagickCLCacheInfo().
+%
+%  The format of the WriteOpenCLBuffer method is:
+%
+%      MagickBooleanType WriteOpenCLBuffer(cl_command_queue queue,
+%        MagickCLCacheInfo info,const size_t length,const void *pixels,
+%        ExceptionInfo *exception)
+%
+%  A description of each parameter follows:
+%
+%    o queue: the command queue.
+%
+%    o info: the tile to write to.
+%
+%    o length: the number of bytes to write.
+%
+%    o pixels: the host memory to copy.
+%
+%    o exception: return any errors or warnings in this structure.
+%
+*/
+
+MagickPrivate MagickBooleanType WriteOpenCLBuffer(cl_command_queue queue,
+  MagickCLCacheInfo info,const size_t length,const void *pixels,
+  ExceptionInfo *exception)
+{
+  cl_event
+    event,
+    *events;
+
+  cl_int
+    status;
+
+  cl_uint
+    event_count;
+
+  events=CopyOpenCLEvents(info,(MagickCLCacheInfo) NULL,&event_count);
+  status=openCL_library->clEnqueueWriteBuffer(queue,info->buffer,CL_FALSE,0,
+    length,pixels,event_count,events,&event);
+  events=(cl_event *) RelinquishMagickMemory(events);
+  if (status != CL_SUCCESS)
+    {
+      (void) OpenCLThrowMagickException(info->device,exception,
+        GetMagickModule(),ResourceLimitWarning,"clEnqueueWriteBuffer failed.",
+        "'%s'",".");
+      return(MagickFalse);
+    }
+  openCL_library->clFlush(queue);
+  RecordTransferProfileData(info->device,"WriteBuffer",event,length);
+  (void) RegisterCacheEvent(info,event);
+  openCL_library->clReleaseEvent(event);
+  return(MagickTrue);
+}
+
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %                                                                             %
@@ -2170,19 +2930,12 @@ MagickExport const KernelProfileRecord *GetOpenCLKernelProfileRecords(
 static MagickBooleanType HasOpenCLDevices(MagickCLEnv clEnv,
   ExceptionInfo *exception)
 {
-  char
-    *accelerateKernelsBuffer,
-    options[MagickPathExtent];
-
-  /*MagickStatusType*/unsigned int
+  MagickBooleanType
     status;
 
   size_t
     i;
 
-  size_t
-    signature;
-
   /* Check if there are enabled devices */
   for (i = 0; i < clEnv->number_devices; i++)
   {
@@ -2192,63 +2945,16 @@ static MagickBooleanType HasOpenCLDevices(MagickCLEnv clEnv,
   if (i == clEnv->number_devices)
     return(MagickFalse);
 
-  /* Check if we need to compile a kernel for one of the devices */
+  /* Compile the kernels for the enabled devices that need them */
   status=MagickTrue;
   for (i = 0; i < clEnv->number_devices; i++)
   {
-    if ((clEnv->devices[i]->enabled != MagickFalse) &&
-        (clEnv->devices[i]->program == (cl_program) NULL))
-    {
-      status=MagickFalse;
-      break;
-    }
-  }
-  if (status != MagickFalse)
-    return(MagickTrue);
-
-  /* Get additional options */
-  (void) FormatLocaleString(options,MagickPathExtent,CLOptions,
-    (float)QuantumRange,(float)QuantumScale,(float)CLCharQuantumScale,
-    (float)MagickEpsilon,(float)MagickPI,(unsigned int)MaxMap,
-    (unsigned int)MAGICKCORE_QUANTUM_DEPTH);
-
-  signature=StringSignature(options);
-  accelerateKernelsBuffer=(char*) AcquireQuantumMemory(1,
-    strlen(accelerateKernels)+strlen(accelerateKernels2)+1);
-  if (accelerateKernelsBuffer == (char*) NULL)
-    return(MagickFalse);
-  sprintf(accelerateKernelsBuffer,"%s%s",accelerateKernels,accelerateKernels2);
-  signature^=StringSignature(accelerateKernelsBuffer);
-
-  status=MagickTrue;
-  for (i = 0; i < clEnv->number_devices; i++)
-  {
-    MagickCLDevice
-      device;
-
-    size_t
-      device_signature;
-
-    device=clEnv->devices[i];
-    if ((device->enabled == MagickFalse) ||
-        (device->program != (cl_program) NULL))
-      continue;
-
-    LockSemaphoreInfo(device->lock);
-    if (device->program != (cl_program) NULL)
-    {
-      UnlockSemaphoreInfo(device->lock);
+    if (clEnv->devices[i]->enabled == MagickFalse)
       continue;
-    }
-    device_signature=signature;
-    device_signature^=StringSignature(device->platform_name);
-    status=CompileOpenCLKernel(device,accelerateKernelsBuffer,options,
-      device_signature,exception);
-    UnlockSemaphoreInfo(device->lock);
+    status=CompileOpenCLDevice(clEnv->devices[i],exception);
     if (status == MagickFalse)
       break;
   }
-  accelerateKernelsBuffer=RelinquishMagickMemory(accelerateKernelsBuffer);
   return(status);
 }
 
@@ -2464,9 +3170,38 @@ static void LoadOpenCLDevices(MagickCLEnv clEnv)
       openCL_library->clGetDeviceInfo(devices[j],CL_DEVICE_LOCAL_MEM_SIZE,
         sizeof(cl_ulong),&device->local_memory_size,NULL);
 
+      openCL_library->clGetDeviceInfo(devices[j],CL_DEVICE_GLOBAL_MEM_SIZE,
+        sizeof(cl_ulong),&device->global_memory_size,NULL);
+
+      openCL_library->clGetDeviceInfo(devices[j],CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+        sizeof(cl_ulong),&device->max_mem_alloc_size,NULL);
+
+      /* devices sharing memory with the host can use the pixels in place */
+      device->host_unified_memory=CL_FALSE;
+      openCL_library->clGetDeviceInfo(devices[j],CL_DEVICE_HOST_UNIFIED_MEMORY,
+        sizeof(cl_bool),&device->host_unified_memory,NULL);
+
+      /* the base address alignment is reported in bits */
+      device->memory_alignment=0;
+      openCL_library->clGetDeviceInfo(devices[j],CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+        sizeof(cl_uint),&device->memory_alignment,NULL);
+      device->memory_alignment=MagickMax(device->memory_alignment/8,1);
+
+      /* the cost model reads the kernel times from their events */
+      device->measure_costs=clEnv->cost_model;
+
+      /* the report needs the timestamps of the profiled commands */
+      if (clEnv->profile_filename != (char *) NULL)
+        {
+          device->profile_kernels=MagickTrue;
+          device->trace_events=MagickTrue;
+        }
+
       clEnv->devices[next]=device;
       (void) LogMagickEvent(AccelerateEvent,GetMagickModule(),
-        "Found device: %s (%s)",device->name,device->platform_name);
+        "Found device: %s (%s)%s",device->name,device->platform_name,
+        device->host_unified_memory != CL_FALSE ? ", host unified memory" :
+        "");
     }
   }
   if (next != clEnv->number_devices)
@@ -2585,6 +3320,7 @@ static MagickBooleanType BindOpenCLFunctions()
   BIND(clGetKernelInfo);
 
   BIND(clEnqueueReadBuffer);
+  BIND(clEnqueueWriteBuffer);
   BIND(clEnqueueMapBuffer);
   BIND(clEnqueueUnmapMemObject);
   BIND(clEnqueueNDRangeKernel);
@@ -2751,19 +3487,218 @@ MagickPrivate MagickBooleanType OpenCLThrowMagickException(
 %
 %  The format of the RecordProfileData method is:
 %
-%      void RecordProfileData(MagickCLDevice device,ProfiledKernels kernel,
-%        cl_event event)
+%      void RecordProfileData(MagickCLDevice device,cl_kernel kernel,
+%        cl_event event,cl_uint work_dim,const size_t *gsize,
+%        const size_t *lsize,const MagickSizeType pixels)
 %
 %  A description of each parameter follows:
 %
 %    o device: the OpenCL device that did the operation.
 %
+%    o kernel: the kernel that was executed.
+%
 %    o event: the event that contains the profiling data.
 %
+%    o work_dim: the number of dimensions of the work sizes.
+%
+%    o gsize: the global work size.
+%
+%    o lsize: the local work size, NULL when the driver picked it.
+%
+%    o pixels: the number of pixels processed by the kernel, the measured
+%      time refines the cost model of the operation using the kernel.
+%
 */
 
+static const struct
+{
+  const char
+    *name;
+
+  MagickCLOperation
+    operation;
+
+  MagickBooleanType
+    count_pixels;
+} OpenCLKernelOperations[] =
+{
+  { "DrawAffine", AffineCLOperation, MagickTrue },
+  { "BlurRow", BlurCLOperation, MagickFalse },
+  { "BlurColumn", BlurCLOperation, MagickTrue },
+  { "Composite", CompositeCLOperation, MagickTrue },
+  { "Contrast", ContrastCLOperation, MagickTrue },
+  { "ConvolveOptimized", ConvolveCLOperation, MagickTrue },
+  { "Convolve", ConvolveCLOperation, MagickTrue },
+  { "HullPass1", DespeckleCLOperation, MagickFalse },
+  { "HullPass2", DespeckleCLOperation, MagickTrue },
+  { "Histogram", HistogramCLOperation, MagickFalse },
+  { "ContrastStretch", HistogramCLOperation, MagickTrue },
+  { "EqualizeMap", HistogramCLOperation, MagickFalse },
+  { "Equalize", HistogramCLOperation, MagickTrue },
+  { "Grayscale", GrayscaleCLOperation, MagickTrue },
+  { "Modulate", ModulateCLOperation, MagickTrue },
+  { "MotionBlur", MotionBlurCLOperation, MagickTrue },
+  { "ResizeHorizontalFilter", ResizeCLOperation, MagickFalse },
+  { "ResizeVerticalFilter", ResizeCLOperation, MagickTrue },
+  { "ScaleFilter", ScaleCLOperation, MagickTrue },
+  { "UnsharpMaskBlurColumn", UnsharpMaskCLOperation, MagickTrue },
+  { "UnsharpMask", UnsharpMaskCLOperation, MagickTrue }
+};
+
+static void RecordOperationCost(MagickCLDevice device,const char *name,
+  const unsigned long elapsed,const MagickSizeType pixels)
+{
+  size_t
+    i;
+
+  for (i = 0; i < sizeof(OpenCLKernelOperations)/sizeof(*OpenCLKernelOperations); i++)
+  {
+    MagickCLOperationCost
+      *cost;
+
+    if (LocaleCompare(OpenCLKernelOperations[i].name,name) != 0)
+      continue;
+    cost=device->operation_costs+OpenCLKernelOperations[i].operation;
+    cost->usecs+=elapsed;
+    if (OpenCLKernelOperations[i].count_pixels != MagickFalse)
+      cost->pixels+=pixels;
+    break;
+  }
+}
+
+/*
+  Keep the event of a kernel or transfer until it completed, a sample is
+  dropped when too many of them are still running.
+*/
+static void QueuePendingEvent(MagickCLDevice device,
+  const MagickCLPendingEvent *pending)
+{
+  MagickBooleanType
+    full;
+
+  LockSemaphoreInfo(device->lock);
+  full=device->number_pending_events == MAGICKCORE_OPENCL_PENDING_EVENTS ?
+    MagickTrue : MagickFalse;
+  UnlockSemaphoreInfo(device->lock);
+  if (full != MagickFalse)
+    UpdateOperationCosts(device);
+  LockSemaphoreInfo(device->lock);
+  if ((device->number_pending_events < MAGICKCORE_OPENCL_PENDING_EVENTS) &&
+      (openCL_library->clRetainEvent(pending->event) == CL_SUCCESS))
+    device->pending_events[device->number_pending_events++]=(*pending);
+  else if (pending->transfer != (const char *) NULL)
+    device->dropped_profile_events++;
+  UnlockSemaphoreInfo(device->lock);
+}
+
+/*
+  Queue the event of a kernel which is not profiled, UpdateOperationCosts()
+  adds its time to the cost model once it completed.
+*/
+static void MeasureOperationCost(MagickCLDevice device,cl_kernel kernel,
+  cl_event event,const MagickSizeType pixels)
+{
+  char
+    name[MagickPathExtent];
+
+  MagickCLPendingEvent
+    pending;
+
+  size_t
+    i;
+
+  if (device->measure_costs == MagickFalse)
+    return;
+  if (openCL_library->clGetKernelInfo(kernel,CL_KERNEL_FUNCTION_NAME,
+        sizeof(name),name,(size_t *) NULL) != CL_SUCCESS)
+    return;
+  for (i = 0; i < sizeof(OpenCLKernelOperations)/sizeof(*OpenCLKernelOperations); i++)
+    if (LocaleCompare(OpenCLKernelOperations[i].name,name) == 0)
+      break;
+  if (i == sizeof(OpenCLKernelOperations)/sizeof(*OpenCLKernelOperations))
+    return;
+  (void) memset(&pending,0,sizeof(pending));
+  pending.event=event;
+  pending.operation=OpenCLKernelOperations[i].operation;
+  if (OpenCLKernelOperations[i].count_pixels != MagickFalse)
+    pending.pixels=pixels;
+  QueuePendingEvent(device,&pending);
+}
+
+/*
+  Add the times of the queued kernels and transfers which completed to the
+  cost model and the profile, the ones which are still running stay queued.
+*/
+static void UpdateOperationCosts(MagickCLDevice device)
+{
+  MagickCLPendingEvent
+    completed[MAGICKCORE_OPENCL_PENDING_EVENTS];
+
+  size_t
+    i,
+    j,
+    number_completed;
+
+  number_completed=0;
+  LockSemaphoreInfo(device->lock);
+  for (i=0, j=0; i < device->number_pending_events; i++)
+  {
+    cl_int
+      event_status;
+
+    event_status=CL_COMPLETE;
+    (void) openCL_library->clGetEventInfo(device->pending_events[i].event,
+      CL_EVENT_COMMAND_EXECUTION_STATUS,sizeof(event_status),&event_status,
+      NULL);
+    if (event_status > CL_COMPLETE)
+      device->pending_events[j++]=device->pending_events[i];
+    else
+      completed[number_completed++]=device->pending_events[i];
+  }
+  device->number_pending_events=j;
+  UnlockSemaphoreInfo(device->lock);
+  for (i=0; i < number_completed; i++)
+  {
+    cl_int
+      status;
+
+    cl_ulong
+      end,
+      start;
+
+    start=end=0;
+    status=openCL_library->clGetEventProfilingInfo(completed[i].event,
+      CL_PROFILING_COMMAND_START,sizeof(cl_ulong),&start,NULL);
+    status|=openCL_library->clGetEventProfilingInfo(completed[i].event,
+      CL_PROFILING_COMMAND_END,sizeof(cl_ulong),&end,NULL);
+    if ((status == CL_SUCCESS) && (end >= start) &&
+        (completed[i].transfer != (const char *) NULL))
+      {
+        LockSemaphoreInfo(device->lock);
+        device->transfer_usecs+=(end-start)/1000.0;
+        device->transfer_bytes+=completed[i].bytes;
+        UnlockSemaphoreInfo(device->lock);
+        RecordProfileEvent(device,completed[i].transfer,completed[i].event,0,
+          (const size_t *) NULL,(const size_t *) NULL,completed[i].bytes);
+      }
+    else if ((status == CL_SUCCESS) && (end >= start))
+      {
+        MagickCLOperationCost
+          *cost;
+
+        LockSemaphoreInfo(device->lock);
+        cost=device->operation_costs+completed[i].operation;
+        cost->usecs+=(end-start)/1000.0;
+        cost->pixels+=completed[i].pixels;
+        UnlockSemaphoreInfo(device->lock);
+      }
+    (void) openCL_library->clReleaseEvent(completed[i].event);
+  }
+}
+
 MagickPrivate MagickBooleanType RecordProfileData(MagickCLDevice device,
-  cl_kernel kernel,cl_event event)
+  cl_kernel kernel,cl_event event,cl_uint work_dim,const size_t *gsize,
+  const size_t *lsize,const MagickSizeType pixels)
 {
   char
     *name;
@@ -2846,7 +3781,10 @@ MagickPrivate MagickBooleanType RecordProfileData(MagickCLDevice device,
     profile_record->max=elapsed;
   profile_record->total+=elapsed;
   profile_record->count+=1;
+  RecordOperationCost(device,profile_record->kernel_name,elapsed,pixels);
   UnlockSemaphoreInfo(device->lock);
+  RecordProfileEvent(device,profile_record->kernel_name,event,work_dim,gsize,
+    lsize,0);
   return(MagickTrue);
 }
 
@@ -2909,16 +3847,24 @@ MagickPrivate void ReleaseOpenCLCommandQueue(MagickCLDevice device,
 %                                                                             %
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %
-%  ReleaseOpenCLDevice() returns the OpenCL device to the environment
+%  ReleaseOpenCLDevice() returns the OpenCL device to the environment.
+%  ReleaseOpenCLDevices() does the same for the devices returned by
+%  RequestOpenCLDevices() and relinquishes the array.
 %
 %  The format of the ReleaseOpenCLDevice method is:
 %
 %      void ReleaseOpenCLDevice(MagickCLDevice device)
+%      MagickCLDevice *ReleaseOpenCLDevices(MagickCLDevice *devices,
+%        const size_t number_devices)
 %
 %  A description of each parameter follows:
 %
 %    o device: the OpenCL device to be released.
 %
+%    o devices: the OpenCL devices to be released.
+%
+%    o number_devices: the number of devices.
+%
 */
 
 MagickPrivate void ReleaseOpenCLDevice(MagickCLDevice device)
@@ -2929,6 +3875,19 @@ MagickPrivate void ReleaseOpenCLDevice(MagickCLDevice device)
   UnlockSemaphoreInfo(openCL_lock);
 }
 
+MagickPrivate MagickCLDevice *ReleaseOpenCLDevices(MagickCLDevice *devices,
+  const size_t number_devices)
+{
+  size_t
+    i;
+
+  if (devices == (MagickCLDevice *) NULL)
+    return((MagickCLDevice *) NULL);
+  for (i = 0; i < number_devices; i++)
+    ReleaseOpenCLDevice(devices[i]);
+  return((MagickCLDevice *) RelinquishMagickMemory(devices));
+}
+
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %                                                                             %
@@ -2993,7 +3952,7 @@ static void CL_API_CALL DestroyMagickCLCacheInfoAndPixels(
   pixels=info->pixels;
   LiberateMagickResource(MemoryResource,info->length);
   DestroyMagickCLCacheInfo(info);
-  MagickFreeMemory(pixels);
+  MagickFreeAlignedMemory(pixels);
 }
 
 MagickPrivate MagickCLCacheInfo RelinquishMagickCLCacheInfo(
@@ -3040,6 +3999,20 @@ static MagickCLDevice RelinquishMagickCLDevice(MagickCLDevice device)
   device->vendor_name=RelinquishMagickMemory(device->vendor_name);
   device->name=RelinquishMagickMemory(device->name);
   device->version=RelinquishMagickMemory(device->version);
+  if (device->profile_events != (MagickCLProfileEvent *) NULL)
+    {
+      size_t
+        i;
+
+      for (i=0; i < device->number_profile_events; i++)
+        device->profile_events[i].name=DestroyString(
+          device->profile_events[i].name);
+      device->profile_events=(MagickCLProfileEvent *) RelinquishMagickMemory(
+        device->profile_events);
+    }
+  while (device->number_pending_events > 0)
+    (void) openCL_library->clReleaseEvent(
+      device->pending_events[--device->number_pending_events].event);
   if (device->program != (cl_program) NULL)
     (void) openCL_library->clReleaseProgram(device->program);
   while (device->command_queues_index >= 0)
@@ -3079,6 +4052,8 @@ static MagickCLEnv RelinquishMagickCLEnv(MagickCLEnv clEnv)
 
   RelinquishSemaphoreInfo(&clEnv->lock);
   RelinquishMagickCLDevices(clEnv);
+  if (clEnv->profile_filename != (char *) NULL)
+    clEnv->profile_filename=DestroyString(clEnv->profile_filename);
   if (clEnv->contexts != (cl_context *) NULL)
     {
       ssize_t
@@ -3160,6 +4135,65 @@ MagickPrivate MagickCLDevice RequestOpenCLDevice(MagickCLEnv clEnv)
   return(device);
 }
 
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
++   R e q u e s t O p e n C L D e v i c e s                                   %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  RequestOpenCLDevices() returns all the enabled OpenCL devices, so that an
+%  operation can share its work between them.  Release them with
+%  ReleaseOpenCLDevices().
+%
+%  The format of the RequestOpenCLDevices method is:
+%
+%      MagickCLDevice *RequestOpenCLDevices(MagickCLEnv clEnv,
+%        size_t *number_devices)
+%
+%  A description of each parameter follows:
+%
+%    o clEnv: the OpenCL environment.
+%
+%    o number_devices: returns the number of devices.
+%
+*/
+
+MagickPrivate MagickCLDevice *RequestOpenCLDevices(MagickCLEnv clEnv,
+  size_t *number_devices)
+{
+  MagickCLDevice
+    *devices;
+
+  size_t
+    i;
+
+  assert(number_devices != (size_t *) NULL);
+  *number_devices=0;
+  if ((clEnv == (MagickCLEnv) NULL) || (clEnv->number_devices == 0))
+    return((MagickCLDevice *) NULL);
+  devices=(MagickCLDevice *) AcquireQuantumMemory(clEnv->number_devices,
+    sizeof(*devices));
+  if (devices == (MagickCLDevice *) NULL)
+    return((MagickCLDevice *) NULL);
+  LockSemaphoreInfo(openCL_lock);
+  for (i = 0; i < clEnv->number_devices; i++)
+  {
+    if (clEnv->devices[i]->enabled == MagickFalse)
+      continue;
+    clEnv->devices[i]->requested++;
+    devices[(*number_devices)++]=clEnv->devices[i];
+  }
+  UnlockSemaphoreInfo(openCL_lock);
+  if (*number_devices == 0)
+    devices=(MagickCLDevice *) RelinquishMagickMemory(devices);
+  return(devices);
+}
+
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %                                                                             %
@@ -68,6 +68,7 @@ extern MagickExport MagickCLDeviceType
   GetOpenCLDeviceType(const MagickCLDevice);
 
 extern MagickExport MagickBooleanType
+  BuildOpenCLDeviceKernels(MagickCLDevice,ExceptionInfo *),
   GetOpenCLDeviceEnabled(const MagickCLDevice),
   GetOpenCLEnabled(void),
   SetOpenCLEnabled(const MagickBooleanType);
@@ -60,6 +60,14 @@
   extern void
   DestroyCacheInfo(Cache cache);
 
+  /*
+    DestroyPixelCachePool() frees the pooled memory cache pixels.
+
+    Used only by DestroyMagick().
+  */
+  extern void
+  DestroyPixelCachePool(void);
+
   /*
     GetCacheInfo() initializes the Cache structure.
 
@@ -82,6 +90,15 @@
   extern MagickExport MagickBool
   GetPixelCachePresent(const Image *image) MAGICK_FUNC_PURE;
 
+  /*
+    InitializePixelCachePool() initializes the pool of memory cache
+    pixels.
+
+    Used only by InitializeMagick().
+  */
+  extern MagickPassFail
+  InitializePixelCachePool(void);
+
   /*
     Obtain an interpolated pixel value via bi-linear interpolation.
   */
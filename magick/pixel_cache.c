@@ -139,7 +139,8 @@ typedef enum
   PingCache,      /* Cache is ignored */
   MemoryCache,    /* Cache is a heap memory allocation */
   DiskCache,      /* Cache is a file accessed via read/write */
-  MapCache        /* Cache is a file accessed via memory map */
+  MapCache,       /* Cache is a file accessed via memory map */
+  CompressedCache /* Cache is a set of compressed heap allocations */
 } CacheType;
 
 /*
@@ -205,6 +206,40 @@ typedef struct _CacheInfo
   /* Open file handle for disk cache */
   int file;
 
+  /* Memory cache pixels are a mapping (see MapCachePixels()) */
+  MagickBool memory_mapped;
+
+  /* Anonymous file which the memory cache pixels are a shared mapping of */
+  int memory_file;
+
+  /* Bytes allocated for the memory cache pixels (the size class of the
+     length when pooled, see CachePoolExtent()) */
+  magick_uint64_t memory_length;
+
+  /* Compressed cache bands (see OpenCompressedCache()) */
+  struct _CompressedCacheInfo *compressed;
+
+  /* Disk/map cache pixel reads, how many were read ahead, and the bytes
+     read (file_semaphore for disk caches, atomic for map caches) */
+  magick_uint64_t io_reads;
+  magick_uint64_t io_read_ahead_hits;
+  magick_uint64_t io_read_bytes;
+
+  /* Disk/map cache pixel writes and the bytes written (as above) */
+  magick_uint64_t io_writes;
+  magick_uint64_t io_write_bytes;
+
+  /* Seconds spent waiting for disk cache reads and writes (file_semaphore) */
+  double io_read_time;
+  double io_write_time;
+
+  /* Bytes written to the disk cache since the last write-behind request */
+  magick_uint64_t write_behind_pending;
+
+  /* The disk cache is too large to stay in the page cache, so write-back
+     is started early (see WriteBehindCache()) */
+  MagickBool write_behind;
+
 #if defined(HAVE_OPENCL)
   MagickCLCacheInfo opencl;
   SemaphoreInfo* semaphore;
@@ -256,6 +291,23 @@ typedef struct _NexusInfo
   MagickBool direct_flag;
 #endif
 
+  /* Disk/map cache offsets (in bytes) of the start and just past the end
+     of the previous region */
+  magick_off_t read_ahead_offset;
+  magick_off_t read_ahead_next;
+
+  /* Disk/map cache offset (in bytes) at which sequential access started */
+  magick_off_t read_ahead_start;
+
+  /* Disk/map cache offset (in bytes) up to which read ahead was requested */
+  magick_off_t read_ahead_end;
+
+  /* Read ahead window (in bytes), zero until access looks sequential */
+  magick_off_t read_ahead_window;
+
+  /* The region was within the range already read ahead */
+  MagickBool read_ahead_hit;
+
   /* Working NexusInfo for temporary/recursive use */
   struct _NexusInfo *image_nexus;
 
@@ -372,66 +424,1379 @@ FilePositionRead(int file, void *buffer, size_t length,magick_off_t offset)
       if (count <= 0)
         break;
     }
-  if (count < 0)
-    return (ssize_t)-1;
-  return (ssize_t) total_count;
+  if (count < 0)
+    return (ssize_t)-1;
+  return (ssize_t) total_count;
+}
+/*
+
+  Write data pointed to by 'buffer', with size 'length', to file
+  descriptor 'file' at specified offset 'offset'.  Care is taken to
+  make sure that all data is written if system calls are interrupted
+  by signals.
+
+*/
+static ssize_t
+FilePositionWrite(int file, const void *buffer,size_t length,magick_off_t offset)
+{
+  register ssize_t
+    count=0;
+
+  register size_t
+    total_count;
+
+  MAGICK_POSIX_IO_SIZE_T
+    io_size;
+
+#if !HAVE_PWRITE
+  if ((MagickSeek(file,offset,SEEK_SET)) < 0)
+    return (ssize_t)-1;
+#endif /* !HAVE_PWRITE */
+  for (total_count=0; total_count < length; total_count+=count)
+    {
+      char
+        *io_buff_address;
+
+      size_t
+        requested_io_size;
+
+#if HAVE_PWRITE
+      off_t
+        io_file_offset;
+#endif
+
+      io_buff_address=(char *) buffer+total_count;
+      requested_io_size=length-total_count;
+      if (requested_io_size > MAGICK_IO_MAX)
+        io_size=MAGICK_IO_MAX;
+      else
+        io_size=(MAGICK_POSIX_IO_SIZE_T) requested_io_size;
+#if HAVE_PWRITE
+      io_file_offset=offset+total_count;
+      count=pwrite(file,io_buff_address,io_size,io_file_offset);
+#else
+      count=write(file,io_buff_address,io_size);
+#endif
+      if (count <= 0)
+        break;
+    }
+  if (count < 0)
+    return (ssize_t)-1;
+  return (ssize_t) total_count;
+}
+
+/*
+  Disk and memory-mapped caches read ahead of sequential access.  Each
+  nexus keeps track of where its previous region started and ended.  While
+  regions keep moving forward, overlapping the previous region or skipping
+  less than the read ahead window past it, the window is
+  doubled (up to MaxReadAheadExtent) and the kernel is asked to start
+  reading the pixels (and indexes) which follow, so that the I/O overlaps
+  with the processing of the current rows.  Read ahead only starts once
+  access has stayed sequential for MinReadAheadExtent bytes, since access
+  which keeps stepping back (e.g. dithering along a space filling curve)
+  would otherwise request a window for almost every pixel.  Disk cache writes are handed
+  to the kernel for write-back every WriteBehindExtent bytes rather than
+  being left to accumulate as dirty pages, but only for caches which are
+  larger than physical memory.  Smaller cache files are likely to be read
+  back from the page cache, and starting their write-back early only
+  stalls the writes which re-dirty pages under write-back.
+*/
+#define MinReadAheadExtent (256*1024)
+#define MaxReadAheadExtent (16*1024*1024)
+#define WriteBehindExtent (8*1024*1024)
+
+/*
+  Monotonic time in seconds, used for the disk cache statistics.
+*/
+static inline double
+CacheTime(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec
+    timer;
+
+  (void) clock_gettime(CLOCK_MONOTONIC,&timer);
+  return((double) timer.tv_sec+timer.tv_nsec/1.0e9);
+#else
+  return(0.0);
+#endif
+}
+
+/*
+  Ask the kernel to read the specified byte range of the cache pixel area
+  (and the matching range of the indexes area) in the background.
+*/
+static void
+AdviseCacheRange(const CacheInfo *cache_info,const magick_off_t offset,
+                 const magick_off_t length)
+{
+  magick_off_t
+    extent[2][2];
+
+  unsigned int
+    i;
+
+  extent[0][0]=offset;
+  extent[0][1]=length;
+  extent[1][0]=(magick_off_t) ((magick_uint64_t) cache_info->columns*
+                               cache_info->rows*sizeof(PixelPacket)+
+                               (offset/sizeof(PixelPacket))*
+                               sizeof(IndexPacket));
+  extent[1][1]=(magick_off_t) ((length/sizeof(PixelPacket))*
+                               sizeof(IndexPacket));
+  for (i=0; i < (cache_info->indexes_valid ? 2U : 1U); i++)
+    {
+#if defined(HAVE_MADVISE) && defined(MADV_WILLNEED)
+      if (cache_info->type == MapCache)
+        {
+          size_t
+            page_offset;
+
+          char
+            *address;
+
+          address=(char *) cache_info->pixels+extent[i][0];
+          page_offset=(size_t) address % (size_t) MagickGetMMUPageSize();
+          (void) madvise(address-page_offset,(size_t) extent[i][1]+page_offset,
+                         MADV_WILLNEED);
+        }
+#endif /* defined(HAVE_MADVISE) && defined(MADV_WILLNEED) */
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+      if ((cache_info->type == DiskCache) && (cache_info->file != -1))
+        (void) posix_fadvise(cache_info->file,
+                             (off_t) cache_info->offset+extent[i][0],
+                             (off_t) extent[i][1],POSIX_FADV_WILLNEED);
+#endif /* defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED) */
+    }
+}
+
+/*
+  Update the sequential access state of the nexus for its new region of a
+  disk or memory-mapped cache, and read ahead if access is sequential.
+*/
+static void
+ReadAheadCacheNexus(const CacheInfo *cache_info,NexusInfo *nexus_info)
+{
+  magick_off_t
+    end,
+    extent,
+    offset;
+
+  offset=(magick_off_t) ((nexus_info->region.y*(magick_off_t)
+                          cache_info->columns+nexus_info->region.x)*
+                         sizeof(PixelPacket));
+  end=(magick_off_t) (((nexus_info->region.y+nexus_info->region.height-1)*
+                       (magick_off_t) cache_info->columns+
+                       nexus_info->region.x+nexus_info->region.width)*
+                      sizeof(PixelPacket));
+  extent=(magick_off_t) ((magick_uint64_t) cache_info->columns*
+                         cache_info->rows*sizeof(PixelPacket));
+  nexus_info->read_ahead_hit=MagickFalse;
+  if ((offset >= nexus_info->read_ahead_offset) &&
+      (offset <= nexus_info->read_ahead_next+
+       Max(nexus_info->read_ahead_window,MinReadAheadExtent)))
+    {
+      /*
+        Sequential access.
+      */
+      nexus_info->read_ahead_hit=(end <= nexus_info->read_ahead_end);
+      if ((end-nexus_info->read_ahead_start >= MinReadAheadExtent) &&
+          (end+nexus_info->read_ahead_window/2 > nexus_info->read_ahead_end))
+        {
+          magick_off_t
+            start;
+
+          nexus_info->read_ahead_window=
+            Min(Max(2*nexus_info->read_ahead_window,MinReadAheadExtent),
+                MaxReadAheadExtent);
+          start=Max(end,nexus_info->read_ahead_end);
+          nexus_info->read_ahead_end=Min(end+nexus_info->read_ahead_window,
+                                         extent);
+          if (nexus_info->read_ahead_end > start)
+            AdviseCacheRange(cache_info,start,nexus_info->read_ahead_end-start);
+        }
+    }
+  else
+    {
+      nexus_info->read_ahead_start=offset;
+      nexus_info->read_ahead_window=0;
+      nexus_info->read_ahead_end=0;
+    }
+  nexus_info->read_ahead_offset=offset;
+  nexus_info->read_ahead_next=end;
+}
+
+/*
+  Account for bytes written to the disk cache, starting write-back of the
+  cache file once enough have accumulated.  Invoked with the file
+  semaphore held.
+*/
+static void
+WriteBehindCache(CacheInfo *cache_info,const int file,const size_t length)
+{
+  if (!cache_info->write_behind)
+    return;
+  cache_info->write_behind_pending+=length;
+  if (cache_info->write_behind_pending < WriteBehindExtent)
+    return;
+  cache_info->write_behind_pending=0;
+#if defined(SYNC_FILE_RANGE_WRITE)
+  (void) sync_file_range(file,0,0,SYNC_FILE_RANGE_WRITE);
+#else
+  ARG_NOT_USED(file);
+#endif /* defined(SYNC_FILE_RANGE_WRITE) */
+}
+
+/*
+  Account for a region of a memory-mapped cache.  Its pages are faulted in
+  (or dirtied) by whoever touches the pixels, so only the regions, their
+  size and whether they were read ahead are counted, not the time spent.
+  The nexuses of several threads use the cache without a lock.
+*/
+static void
+CountMapCacheRegion(CacheInfo *cache_info,const NexusInfo *nexus_info,
+                    const MagickBool write)
+{
+  magick_uint64_t
+    bytes;
+
+  bytes=(magick_uint64_t) nexus_info->region.width*
+    nexus_info->region.height*sizeof(PixelPacket);
+  if (write)
+    {
+#if defined(HAVE_OPENMP)
+#  pragma omp atomic
+#endif
+      cache_info->io_writes++;
+#if defined(HAVE_OPENMP)
+#  pragma omp atomic
+#endif
+      cache_info->io_write_bytes+=bytes;
+      return;
+    }
+#if defined(HAVE_OPENMP)
+#  pragma omp atomic
+#endif
+  cache_info->io_reads++;
+#if defined(HAVE_OPENMP)
+#  pragma omp atomic
+#endif
+  cache_info->io_read_bytes+=bytes;
+  if (nexus_info->read_ahead_hit)
+    {
+#if defined(HAVE_OPENMP)
+#  pragma omp atomic
+#endif
+      cache_info->io_read_ahead_hits++;
+    }
+}
+
+
+/*
+  Large memory caches are allocated as a shared mapping of an anonymous
+  file where the platform supports it.  ClonePixelCache() then maps the
+  same file privately for the clone, so that both caches share the pixels
+  until a page is written (see ShareCachePixels()).
+*/
+#if defined(HAVE_MMAP_FILEIO) && defined(MFD_CLOEXEC)
+#  define MAGICK_COW_PIXEL_CACHE 1
+#  define CopyOnWriteExtent (4*1024*1024)
+#endif
+
+/*
+  Large memory caches may instead be mapped privately, aligned to huge
+  pages, and advised to be backed by them (MAGICK_CACHE_HUGE_PAGES), which
+  saves TLB misses at the expense of copy-on-write clones.  The pages of
+  new memory caches may also be faulted in by the threads which go on to
+  process their rows (MAGICK_CACHE_FIRST_TOUCH) so that, on NUMA systems,
+  they are local to those threads.
+*/
+#if defined(MAGICK_COW_PIXEL_CACHE) && defined(HAVE_MADVISE) && \
+  defined(MADV_HUGEPAGE) && defined(MAP_ANONYMOUS)
+#  define MAGICK_HUGE_PAGE_PIXEL_CACHE 1
+#  define HugePageExtent (2*1024*1024)
+#endif
+
+static MagickBool
+  cache_huge_pages = MagickFalse,
+  cache_first_touch = MagickFalse;
+
+/*
+  Free memory cache pixels, which are a mapping of the anonymous file (if
+  any) when mapped.
+*/
+static void
+FreeMemoryPixels(void *pixels,const size_t length,const MagickBool mapped,
+                 const int file)
+{
+#if defined(MAGICK_COW_PIXEL_CACHE)
+  if (mapped)
+    {
+      (void) munmap(pixels,length);
+      if (file != -1)
+        {
+          (void) close(file);
+          LiberateMagickResource(FileResource,1);
+        }
+      return;
+    }
+#else
+  ARG_NOT_USED(length);
+  ARG_NOT_USED(mapped);
+  ARG_NOT_USED(file);
+#endif
+#if defined(HAVE_OPENCL)
+  MagickFreeAlignedMemory(pixels);
+#else
+  MagickFreeMemory(pixels);
+#endif
+}
+
+/*
+  Release the memory cache pixels.
+*/
+static void
+FreeCachePixels(CacheInfo *cache_info)
+{
+  FreeMemoryPixels((void *) cache_info->pixels,
+                   (size_t) cache_info->memory_length,
+                   cache_info->memory_mapped,cache_info->memory_file);
+  cache_info->pixels=(PixelPacket *) NULL;
+  cache_info->memory_mapped=MagickFalse;
+  cache_info->memory_file=(-1);
+  cache_info->memory_length=0;
+}
+
+/*
+  Memory cache pixels are not freed when their cache is destroyed but kept
+  in a pool so that the next memory cache of the same size class (e.g. for
+  the next image of a batch) reuses them, instead of allocating (and page
+  faulting) them afresh.  Pooled pixels remain charged to the memory
+  resource.  The pool holds at most MAGICK_CACHE_POOL_LIMIT bytes (by
+  default an eighth of the memory resource limit, zero disables the pool)
+  and is emptied whenever memory for a cache can not otherwise be acquired.
+*/
+#define MinCachePoolExtent (1024*1024)
+#define MaxCachePoolBuffers 16
+
+typedef struct _CachePoolBuffer
+{
+  /* Pixels as for FreeMemoryPixels() */
+  void *pixels;
+  size_t length;
+  MagickBool mapped;
+  int file;
+} CachePoolBuffer;
+
+typedef struct _CachePoolInfo
+{
+  /* Pooled pixels, least recently released first */
+  CachePoolBuffer buffers[MaxCachePoolBuffers];
+  unsigned int number_buffers;
+
+  /* Bytes of pooled pixels */
+  magick_uint64_t length;
+
+  /* Limit on the bytes of pooled pixels (-1 for the default, 0 when the
+     pool is disabled) */
+  magick_int64_t limit;
+
+  /* Pool lookups which found and did not find pixels */
+  magick_uint64_t hits;
+  magick_uint64_t misses;
+} CachePoolInfo;
+
+static SemaphoreInfo
+  *cache_pool_semaphore = (SemaphoreInfo *) NULL;
+
+static CachePoolInfo
+  cache_pool;
+
+/*
+  Returns the length to allocate for memory cache pixels of the given
+  length.  Poolable lengths are rounded up to one of eight size classes
+  per power of two.
+*/
+static magick_uint64_t
+CachePoolExtent(const magick_uint64_t length)
+{
+  magick_uint64_t
+    granule;
+
+  if ((cache_pool.limit == 0) || (length < MinCachePoolExtent))
+    return(length);
+  for (granule=MinCachePoolExtent/8; granule*16 <= length; granule<<=1)
+    ;
+  return((length+granule-1) & ~(granule-1));
+}
+
+/*
+  Remove the pooled pixels at the given index.  Invoked with the pool
+  semaphore held.
+*/
+static void
+RemoveCachePoolBuffer(const unsigned int index,const MagickBool free_pixels)
+{
+  CachePoolBuffer
+    *buffer;
+
+  buffer=&cache_pool.buffers[index];
+  if (free_pixels)
+    FreeMemoryPixels(buffer->pixels,buffer->length,buffer->mapped,
+                     buffer->file);
+  cache_pool.length-=buffer->length;
+  LiberateMagickResource(MemoryResource,buffer->length);
+  cache_pool.number_buffers--;
+  (void) memmove(buffer,buffer+1,(cache_pool.number_buffers-index)*
+                 sizeof(CachePoolBuffer));
+}
+
+/*
+  Free all pooled pixels, returning MagickPass if there were any.
+*/
+static MagickPassFail
+EmptyCachePool(void)
+{
+  MagickPassFail
+    status=MagickFail;
+
+  if (cache_pool_semaphore == (SemaphoreInfo *) NULL)
+    return(MagickFail);
+  LockSemaphoreInfo(cache_pool_semaphore);
+  if (cache_pool.number_buffers != 0)
+    status=MagickPass;
+  while (cache_pool.number_buffers != 0)
+    RemoveCachePoolBuffer(cache_pool.number_buffers-1,MagickTrue);
+  UnlockSemaphoreInfo(cache_pool_semaphore);
+  return(status);
+}
+
+/*
+  Charge memory to the memory resource, freeing the pooled pixels if that
+  is what it takes.
+*/
+static MagickPassFail
+AcquireCacheMemory(const magick_uint64_t size)
+{
+  if (AcquireMagickResource(MemoryResource,size) == MagickPass)
+    return(MagickPass);
+  if (EmptyCachePool() == MagickFail)
+    return(MagickFail);
+  return(AcquireMagickResource(MemoryResource,size));
+}
+
+/*
+  Take the most recently pooled pixels of the given length (a size class)
+  for a cache which has none.
+*/
+static MagickPassFail
+AcquirePooledCachePixels(CacheInfo *cache_info,const magick_uint64_t length)
+{
+  CachePoolBuffer
+    *buffer;
+
+  MagickPassFail
+    status=MagickFail;
+
+  unsigned int
+    i;
+
+  if ((cache_pool.limit == 0) || (length < MinCachePoolExtent) ||
+      (cache_pool_semaphore == (SemaphoreInfo *) NULL))
+    return(MagickFail);
+  LockSemaphoreInfo(cache_pool_semaphore);
+  for (i=cache_pool.number_buffers; i != 0; i--)
+    {
+      buffer=&cache_pool.buffers[i-1];
+      if (buffer->length != length)
+        continue;
+      cache_info->pixels=(PixelPacket *) buffer->pixels;
+      cache_info->memory_mapped=buffer->mapped;
+      cache_info->memory_file=buffer->file;
+      cache_info->memory_length=buffer->length;
+      RemoveCachePoolBuffer(i-1,MagickFalse);
+      status=MagickPass;
+      break;
+    }
+  if (status == MagickPass)
+    cache_pool.hits++;
+  else
+    cache_pool.misses++;
+  UnlockSemaphoreInfo(cache_pool_semaphore);
+  return(status);
+}
+
+/*
+  Release the memory cache pixels to the pool, making room for them by
+  freeing the least recently pooled pixels, or free them if they can not be
+  pooled.  Private mappings (see ShareCachePixels()) are not pooled since
+  they could not be shared again, unless caches are mapped privately for
+  huge pages anyway.  Nor are shared mappings whose pages clones still map
+  privately (the cache is then read-only), since writing them would alter
+  the clones.
+*/
+static void
+ReleaseCachePixels(CacheInfo *cache_info)
+{
+  magick_int64_t
+    limit;
+
+  magick_uint64_t
+    length;
+
+  CachePoolBuffer
+    *buffer;
+
+  length=cache_info->memory_length;
+  if ((cache_info->pixels != (PixelPacket *) NULL) &&
+      (cache_pool.limit != 0) && (length >= MinCachePoolExtent) &&
+      (length == CachePoolExtent(length)) &&
+      ((!cache_info->memory_mapped) ||
+       ((cache_info->memory_file != -1) && (!cache_info->read_only)) ||
+       ((cache_info->memory_file == -1) && (cache_huge_pages))) &&
+      (cache_pool_semaphore != (SemaphoreInfo *) NULL))
+    {
+      LockSemaphoreInfo(cache_pool_semaphore);
+      limit=cache_pool.limit;
+      if (limit < 0)
+        limit=GetMagickResourceLimit(MemoryResource)/8;
+      if (length <= (magick_uint64_t) limit)
+        {
+          while ((cache_pool.number_buffers != 0) &&
+                 ((cache_pool.number_buffers == MaxCachePoolBuffers) ||
+                  (cache_pool.length+length > (magick_uint64_t) limit)))
+            RemoveCachePoolBuffer(0,MagickTrue);
+          if (AcquireMagickResource(MemoryResource,length) == MagickPass)
+            {
+              buffer=&cache_pool.buffers[cache_pool.number_buffers++];
+              buffer->pixels=(void *) cache_info->pixels;
+              buffer->length=(size_t) length;
+              buffer->mapped=cache_info->memory_mapped;
+              buffer->file=cache_info->memory_file;
+              cache_pool.length+=length;
+              cache_info->pixels=(PixelPacket *) NULL;
+              cache_info->memory_mapped=MagickFalse;
+              cache_info->memory_file=(-1);
+              cache_info->memory_length=0;
+            }
+        }
+      UnlockSemaphoreInfo(cache_pool_semaphore);
+    }
+  if (cache_info->pixels != (PixelPacket *) NULL)
+    FreeCachePixels(cache_info);
+}
+
+#if defined(MAGICK_COW_PIXEL_CACHE)
+/*
+  Replace the memory cache pixels with a shared mapping of a new anonymous
+  file, preserving the existing pixels.  The file stays open as long as the
+  mapping (or a clone) may need it, so it is charged to the file resource.
+  Mappings are only made while no more than half of the open file limit is
+  used, which leaves the rest to disk caches and coders, and caches stay on
+  the heap beyond that.
+*/
+static MagickPassFail
+MapCachePixels(CacheInfo *cache_info,const magick_uint64_t length)
+{
+  int
+    file;
+
+  void
+    *pixels;
+
+  if (length != (magick_uint64_t) ((size_t) length))
+    return(MagickFail);
+  if ((GetMagickResource(FileResource) >=
+       GetMagickResourceLimit(FileResource)/2) ||
+      (AcquireMagickResource(FileResource,1) == MagickFail))
+    return(MagickFail);
+  file=memfd_create("GraphicsMagick pixel cache",MFD_CLOEXEC);
+  if (file == -1)
+    {
+      LiberateMagickResource(FileResource,1);
+      return(MagickFail);
+    }
+  if (ftruncate(file,(off_t) length) != 0)
+    {
+      (void) close(file);
+      LiberateMagickResource(FileResource,1);
+      return(MagickFail);
+    }
+  pixels=mmap((void *) NULL,(size_t) length,PROT_READ | PROT_WRITE,
+              MAP_SHARED,file,0);
+  if (pixels == MAP_FAILED)
+    {
+      (void) close(file);
+      LiberateMagickResource(FileResource,1);
+      return(MagickFail);
+    }
+  if (cache_info->pixels != (PixelPacket *) NULL)
+    {
+      (void) memcpy(pixels,cache_info->pixels,
+                    (size_t) Min(cache_info->memory_length,length));
+      FreeCachePixels(cache_info);
+    }
+  cache_info->pixels=(PixelPacket *) pixels;
+  cache_info->memory_mapped=MagickTrue;
+  cache_info->memory_file=file;
+  cache_info->memory_length=length;
+  return(MagickPass);
+}
+
+#if defined(MAGICK_HUGE_PAGE_PIXEL_CACHE)
+/*
+  Replace the memory cache pixels with a private anonymous mapping which
+  starts on a huge page boundary and is advised to be backed by huge pages,
+  preserving the existing pixels.
+*/
+static MagickPassFail
+MapHugeCachePixels(CacheInfo *cache_info,const magick_uint64_t length)
+{
+  char
+    *map,
+    *pixels;
+
+  size_t
+    head,
+    page_size,
+    span,
+    tail;
+
+  if ((length != (magick_uint64_t) ((size_t) length)) ||
+      ((size_t) length+HugePageExtent < (size_t) length))
+    return(MagickFail);
+  span=(size_t) length+HugePageExtent;
+  map=(char *) mmap((void *) NULL,span,PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+  if (map == (char *) MAP_FAILED)
+    return(MagickFail);
+  pixels=(char *) (((magick_uintptr_t) map+HugePageExtent-1) &
+                   ~((magick_uintptr_t) HugePageExtent-1));
+  head=(size_t) (pixels-map);
+  page_size=(size_t) MagickGetMMUPageSize();
+  tail=head+(((size_t) length+page_size-1) & ~(page_size-1));
+  if (head != 0)
+    (void) munmap((void *) map,head);
+  if (tail < span)
+    (void) munmap((void *) (map+tail),span-tail);
+  (void) madvise((void *) pixels,(size_t) length,MADV_HUGEPAGE);
+  if (cache_info->pixels != (PixelPacket *) NULL)
+    {
+      (void) memcpy(pixels,cache_info->pixels,
+                    (size_t) Min(cache_info->memory_length,length));
+      FreeCachePixels(cache_info);
+    }
+  cache_info->pixels=(PixelPacket *) pixels;
+  cache_info->memory_mapped=MagickTrue;
+  cache_info->memory_file=(-1);
+  cache_info->memory_length=length;
+  return(MagickPass);
+}
+#endif /* defined(MAGICK_HUGE_PAGE_PIXEL_CACHE) */
+
+/*
+  Make the clone cache pixels a private mapping of the anonymous file
+  behind the source cache pixels, so that the clone shares the pages of
+  the file until it writes them.  The source pixels are left as they are,
+  since other images referencing the source cache may be reading them.
+  They remain a shared mapping of the file, whose updates would show
+  through the clone's unwritten pages, so the source is made read-only:
+  ModifyCache() clones it in turn (sharing the pages again) before it is
+  updated.  Invoked with the source reference semaphore held.
+*/
+static MagickPassFail
+ShareCachePixels(CacheInfo *cache_info,CacheInfo *clone_info)
+{
+  void
+    *pixels;
+
+  if ((!cache_info->memory_mapped) || (cache_info->memory_file == -1) ||
+      (cache_info->memory_length != clone_info->memory_length))
+    return(MagickFail);
+  pixels=mmap((void *) NULL,(size_t) cache_info->memory_length,
+              PROT_READ | PROT_WRITE,MAP_PRIVATE,cache_info->memory_file,0);
+  if (pixels == MAP_FAILED)
+    return(MagickFail);
+  cache_info->read_only=MagickTrue;
+  ReleaseCachePixels(clone_info);
+  clone_info->pixels=(PixelPacket *) pixels;
+  clone_info->memory_mapped=MagickTrue;
+  clone_info->memory_length=cache_info->memory_length;
+  clone_info->indexes=(IndexPacket *) NULL;
+  if (clone_info->indexes_valid)
+    clone_info->indexes=(IndexPacket *) (clone_info->pixels+
+      (magick_uint64_t) clone_info->columns*clone_info->rows);
+  return(MagickPass);
+}
+#endif /* defined(MAGICK_COW_PIXEL_CACHE) */
+
+/*
+  Fault in the pages of new memory cache pixels (and indexes) from the
+  threads which will process the image, each touching the rows of a static
+  partition like the one the OpenMP loops start out with, so that the
+  pages are placed on the nodes of those threads.
+*/
+static void
+FirstTouchCachePixels(const CacheInfo *cache_info)
+{
+  char
+    *indexes,
+    *pixels;
+
+  long
+    y;
+
+  size_t
+    index_row,
+    page_size,
+    pixel_row;
+
+  page_size=(size_t) MagickGetMMUPageSize();
+  pixels=(char *) cache_info->pixels;
+  indexes=pixels+(size_t) cache_info->columns*cache_info->rows*
+    sizeof(PixelPacket);
+  pixel_row=(size_t) cache_info->columns*sizeof(PixelPacket);
+  index_row=(size_t) cache_info->columns*sizeof(IndexPacket);
+#if defined(HAVE_OPENMP)
+#  pragma omp parallel for schedule(static)
+#endif
+  for (y=0; y < (long) cache_info->rows; y++)
+    {
+      size_t
+        i;
+
+      /*
+        Touch the pages which start within the row.
+      */
+      for (i=(page_size-((magick_uintptr_t) (pixels+y*pixel_row) &
+                         (page_size-1))) & (page_size-1);
+           i < pixel_row; i+=page_size)
+        pixels[y*pixel_row+i]=0;
+      for (i=(page_size-((magick_uintptr_t) (indexes+y*index_row) &
+                         (page_size-1))) & (page_size-1);
+           i < index_row; i+=page_size)
+        indexes[y*index_row+i]=0;
+    }
+}
+
+
+#if defined(HasZLIB)
+/*
+  A compressed cache holds the image as bands of rows, each compressed
+  with zlib, for images which do not fit in the memory limit.  A band
+  holds the pixels of its rows followed by their indexes.  Bands are
+  decompressed into a small set of buffers which are replaced in least
+  recently used order, a modified buffer being compressed again when it
+  is replaced.  Bands which never were written are not stored.  A band
+  which does not compress well, or which would take the memory resource
+  past three quarters of its limit (leaving room for the nexus buffers
+  and other images), is stored uncompressed in a temporary file instead.
+  Access which uses only a small part of each band (e.g. by column)
+  would keep decompressing the same bands, so the cache is converted to
+  a memory-mapped (or disk) cache when that is seen, as it is when the
+  memory for a large nexus region is not available.  All access is
+  serialized by the cache file semaphore.
+*/
+#define CompressedBandExtent (256*1024)
+
+typedef struct _CacheBand
+{
+  /* Compressed band, or NULL if it is all zero or in the cache file */
+  unsigned char *data;
+
+  /* Length of the compressed band */
+  size_t length;
+
+  /* Band is stored uncompressed in the cache file */
+  MagickBool on_disk;
+} CacheBand;
+
+typedef struct _CacheBandBuffer
+{
+  /* Band held by the buffer (-1 if none) */
+  long band;
+
+  /* Buffer has been updated since the band was stored */
+  MagickBool dirty;
+
+  /* Last access, for least recently used replacement */
+  magick_uint64_t tick;
+
+  /* Decompressed pixels followed by indexes */
+  unsigned char *data;
+} CacheBandBuffer;
+
+typedef struct _CompressedCacheInfo
+{
+  /* Rows per band, and the number of bands */
+  unsigned long band_rows,
+    number_bands;
+
+  /* Decompressed size of a band */
+  size_t band_length;
+
+  /* Stored bands */
+  CacheBand *bands;
+
+  /* Decompressed band buffers */
+  CacheBandBuffer *buffers;
+
+  unsigned int number_buffers;
+
+  /* Access counter */
+  magick_uint64_t tick;
+
+  /* Compression output, sized for the worst case */
+  unsigned char *scratch;
+
+  size_t scratch_length;
+
+  /* Memory charged to MemoryResource for the buffers and scratch */
+  magick_uint64_t buffer_memory;
+
+  /* Bytes of compressed bands charged to MemoryResource */
+  magick_uint64_t band_memory;
+
+  /* No more bands fit in the memory limit */
+  MagickBool memory_exhausted;
+
+  /* Bands loaded, and bytes copied to or from them, since the last check
+     for access which wastes the decompression */
+  magick_uint64_t loads,
+    copied;
+
+  /* Conversion to a memory-mapped or disk cache failed */
+  MagickBool spill_failed;
+
+  /* Temporary file for bands which are stored uncompressed */
+  int file;
+
+  char filename[MaxTextExtent];
+} CompressedCacheInfo;
+
+/*
+  Charge memory for the compressed cache, provided that the memory in use
+  stays within three quarters of the memory limit.
+*/
+static MagickPassFail
+AcquireCompressedCacheMemory(const magick_uint64_t size)
+{
+  magick_int64_t
+    limit;
+
+  limit=GetMagickResourceLimit(MemoryResource);
+  if ((magick_uint64_t) GetMagickResource(MemoryResource)+size >
+      (magick_uint64_t) (limit-limit/4))
+    {
+      if (EmptyCachePool() == MagickFail)
+        return(MagickFail);
+      if ((magick_uint64_t) GetMagickResource(MemoryResource)+size >
+          (magick_uint64_t) (limit-limit/4))
+        return(MagickFail);
+    }
+  return(AcquireMagickResource(MemoryResource,size));
+}
+
+/*
+  Release a compressed cache.
+*/
+static void
+DestroyCompressedCache(CacheInfo *cache_info)
+{
+  CompressedCacheInfo
+    *compressed;
+
+  unsigned long
+    i,
+    on_disk=0;
+
+  compressed=cache_info->compressed;
+  if (compressed == (CompressedCacheInfo *) NULL)
+    return;
+  if (compressed->bands != (CacheBand *) NULL)
+    for (i=0; i < compressed->number_bands; i++)
+      {
+        if (compressed->bands[i].on_disk)
+          on_disk++;
+        MagickFreeMemory(compressed->bands[i].data);
+      }
+  if (compressed->tick != 0)
+    (void) LogMagickEvent(CacheEvent,GetMagickModule(),
+                          "%.1024s: %" MAGICK_UINT64_F "u bytes of compressed"
+                          " bands, %lu of %lu bands on disk",
+                          cache_info->filename,
+                          (magick_uint64_t) compressed->band_memory,on_disk,
+                          compressed->number_bands);
+  if (compressed->buffers != (CacheBandBuffer *) NULL)
+    for (i=0; i < compressed->number_buffers; i++)
+      MagickFreeMemory(compressed->buffers[i].data);
+  MagickFreeMemory(compressed->bands);
+  MagickFreeMemory(compressed->buffers);
+  MagickFreeMemory(compressed->scratch);
+  LiberateMagickResource(MemoryResource,compressed->buffer_memory+
+                         compressed->band_memory);
+  if (compressed->file != -1)
+    {
+      (void) close(compressed->file);
+      LiberateMagickResource(FileResource,1);
+      LiberateMagickResource(DiskResource,(magick_uint64_t)
+                             compressed->band_length*
+                             compressed->number_bands);
+      (void) LiberateTemporaryFile(compressed->filename);
+    }
+  MagickFreeMemory(cache_info->compressed);
+}
+
+/*
+  Allocate an empty (all zero) compressed cache for the cache dimensions.
+*/
+static MagickPassFail
+OpenCompressedCache(CacheInfo *cache_info)
+{
+  CompressedCacheInfo
+    *compressed;
+
+  size_t
+    row_length;
+
+  unsigned long
+    i;
+
+  row_length=(size_t) cache_info->columns*
+    (sizeof(PixelPacket)+sizeof(IndexPacket));
+  if (row_length/(sizeof(PixelPacket)+sizeof(IndexPacket)) !=
+      cache_info->columns)
+    return(MagickFail);
+  compressed=MagickAllocateClearedMemory(CompressedCacheInfo *,
+                                         sizeof(CompressedCacheInfo));
+  if (compressed == (CompressedCacheInfo *) NULL)
+    return(MagickFail);
+  cache_info->compressed=compressed;
+  compressed->file=(-1);
+  compressed->band_rows=Max(CompressedBandExtent/row_length,1);
+  compressed->band_rows=Min(compressed->band_rows,cache_info->rows);
+  compressed->band_length=compressed->band_rows*row_length;
+  compressed->number_bands=(cache_info->rows+compressed->band_rows-1)/
+    compressed->band_rows;
+  compressed->number_buffers=Max(4,2*omp_get_max_threads());
+  compressed->scratch_length=(size_t) compressBound((uLong)
+                                                    compressed->band_length);
+  compressed->buffer_memory=(magick_uint64_t) compressed->number_buffers*
+    compressed->band_length+compressed->scratch_length;
+  if ((compressed->band_length/row_length != compressed->band_rows) ||
+      (compressed->band_length != (size_t) ((uLong) compressed->band_length)) ||
+      !AcquireCompressedCacheMemory(compressed->buffer_memory))
+    {
+      compressed->buffer_memory=0;
+      DestroyCompressedCache(cache_info);
+      return(MagickFail);
+    }
+  compressed->bands=MagickAllocateClearedArray(CacheBand *,
+                                               compressed->number_bands,
+                                               sizeof(CacheBand));
+  compressed->buffers=MagickAllocateClearedArray(CacheBandBuffer *,
+                                                 compressed->number_buffers,
+                                                 sizeof(CacheBandBuffer));
+  compressed->scratch=MagickAllocateMemory(unsigned char *,
+                                           compressed->scratch_length);
+  if ((compressed->bands == (CacheBand *) NULL) ||
+      (compressed->buffers == (CacheBandBuffer *) NULL) ||
+      (compressed->scratch == (unsigned char *) NULL))
+    {
+      DestroyCompressedCache(cache_info);
+      return(MagickFail);
+    }
+  for (i=0; i < compressed->number_buffers; i++)
+    {
+      compressed->buffers[i].band=(-1);
+      compressed->buffers[i].data=
+        MagickAllocateMemory(unsigned char *,compressed->band_length);
+      if (compressed->buffers[i].data == (unsigned char *) NULL)
+        {
+          DestroyCompressedCache(cache_info);
+          return(MagickFail);
+        }
+    }
+  return(MagickPass);
+}
+
+/*
+  Store the band held by a buffer, compressed if that saves at least an
+  eighth of its size and fits in the memory limit, and otherwise in the
+  cache file.
+*/
+static MagickPassFail
+StoreCacheBand(CompressedCacheInfo *compressed,CacheBandBuffer *buffer)
+{
+  CacheBand
+    *band;
+
+  uLongf
+    length;
+
+  band=compressed->bands+buffer->band;
+  length=(uLongf) compressed->scratch_length;
+  if ((!compressed->memory_exhausted) &&
+      (compress2(compressed->scratch,&length,buffer->data,
+                 (uLong) compressed->band_length,Z_BEST_SPEED) == Z_OK) &&
+      (length <= compressed->band_length-compressed->band_length/8))
+    {
+      unsigned char
+        *data;
+
+      if (AcquireCompressedCacheMemory(length))
+        {
+          data=MagickAllocateMemory(unsigned char *,length);
+          if (data != (unsigned char *) NULL)
+            {
+              (void) memcpy(data,compressed->scratch,length);
+              MagickFreeMemory(band->data);
+              LiberateMagickResource(MemoryResource,band->length);
+              compressed->band_memory+=length;
+              compressed->band_memory-=band->length;
+              band->data=data;
+              band->length=length;
+              band->on_disk=MagickFalse;
+              buffer->dirty=MagickFalse;
+              return(MagickPass);
+            }
+          LiberateMagickResource(MemoryResource,length);
+        }
+      compressed->memory_exhausted=MagickTrue;
+    }
+  if (compressed->file == -1)
+    {
+      magick_uint64_t
+        file_length;
+
+      file_length=(magick_uint64_t) compressed->band_length*
+        compressed->number_bands;
+      if (!AcquireMagickResource(DiskResource,file_length))
+        return(MagickFail);
+      if (!AcquireMagickResource(FileResource,1))
+        {
+          LiberateMagickResource(DiskResource,file_length);
+          return(MagickFail);
+        }
+      if (AcquireTemporaryFileName(compressed->filename))
+        {
+          compressed->file=open(compressed->filename,O_RDWR | O_CREAT |
+                                O_BINARY | O_EXCL,S_MODE);
+          if (compressed->file == -1)
+            compressed->file=open(compressed->filename,O_RDWR | O_BINARY,
+                                  S_MODE);
+        }
+      if (compressed->file == -1)
+        {
+          LiberateMagickResource(FileResource,1);
+          LiberateMagickResource(DiskResource,file_length);
+          if (*compressed->filename != '\0')
+            (void) LiberateTemporaryFile(compressed->filename);
+          return(MagickFail);
+        }
+    }
+  if (FilePositionWrite(compressed->file,buffer->data,compressed->band_length,
+                        (magick_off_t) compressed->band_length*buffer->band) <
+      (ssize_t) compressed->band_length)
+    return(MagickFail);
+  MagickFreeMemory(band->data);
+  LiberateMagickResource(MemoryResource,band->length);
+  compressed->band_memory-=band->length;
+  band->length=0;
+  band->on_disk=MagickTrue;
+  buffer->dirty=MagickFalse;
+  return(MagickPass);
+}
+
+/*
+  Return the buffer holding the specified band, replacing the least
+  recently used buffer if the band is not already held.
+*/
+static CacheBandBuffer *
+AcquireCacheBand(CompressedCacheInfo *compressed,const long band_number)
+{
+  CacheBand
+    *band;
+
+  CacheBandBuffer
+    *buffer;
+
+  unsigned int
+    i;
+
+  buffer=compressed->buffers;
+  for (i=0; i < compressed->number_buffers; i++)
+    {
+      if (compressed->buffers[i].band == band_number)
+        {
+          buffer=compressed->buffers+i;
+          buffer->tick=++compressed->tick;
+          return(buffer);
+        }
+      if (compressed->buffers[i].tick < buffer->tick)
+        buffer=compressed->buffers+i;
+    }
+  if ((buffer->band >= 0) && (buffer->dirty) &&
+      (StoreCacheBand(compressed,buffer) == MagickFail))
+    return((CacheBandBuffer *) NULL);
+  buffer->band=(-1);
+  compressed->loads++;
+  band=compressed->bands+band_number;
+  if (band->data != (unsigned char *) NULL)
+    {
+      uLongf
+        length;
+
+      length=(uLongf) compressed->band_length;
+      if ((uncompress(buffer->data,&length,band->data,(uLong) band->length)
+           != Z_OK) || (length != compressed->band_length))
+        return((CacheBandBuffer *) NULL);
+    }
+  else if (band->on_disk)
+    {
+      if (FilePositionRead(compressed->file,buffer->data,
+                           compressed->band_length,
+                           (magick_off_t) compressed->band_length*band_number)
+          < (ssize_t) compressed->band_length)
+        return((CacheBandBuffer *) NULL);
+    }
+  else
+    (void) memset(buffer->data,0,compressed->band_length);
+  buffer->band=band_number;
+  buffer->dirty=MagickFalse;
+  buffer->tick=++compressed->tick;
+  return(buffer);
+}
+
+/*
+  Convert a compressed cache to a memory-mapped cache, or to a disk cache
+  if the file can not be mapped.  Invoked with the file semaphore held.
+*/
+static MagickPassFail
+SpillCompressedCache(CacheInfo *cache_info)
+{
+  CompressedCacheInfo
+    *compressed;
+
+  int
+    file;
+
+  magick_uint64_t
+    number_pixels;
+
+  MagickPassFail
+    status=MagickPass;
+
+  unsigned long
+    band;
+
+  compressed=cache_info->compressed;
+  number_pixels=(magick_uint64_t) cache_info->columns*cache_info->rows;
+  if (!AcquireMagickResource(DiskResource,cache_info->length))
+    return(MagickFail);
+  if (!AcquireMagickResource(FileResource,1))
+    {
+      LiberateMagickResource(DiskResource,cache_info->length);
+      return(MagickFail);
+    }
+  file=(-1);
+  if (AcquireTemporaryFileName(cache_info->cache_filename))
+    {
+      file=open(cache_info->cache_filename,O_RDWR | O_CREAT | O_BINARY |
+                O_EXCL,S_MODE);
+      if (file == -1)
+        file=open(cache_info->cache_filename,O_RDWR | O_BINARY,S_MODE);
+    }
+  for (band=0; (file != -1) && (band < compressed->number_bands); band++)
+    {
+      CacheBandBuffer
+        *buffer;
+
+      magick_off_t
+        offset;
+
+      size_t
+        length;
+
+      buffer=AcquireCacheBand(compressed,(long) band);
+      if (buffer == (CacheBandBuffer *) NULL)
+        {
+          status=MagickFail;
+          break;
+        }
+      offset=(magick_off_t) band*compressed->band_rows*cache_info->columns;
+      length=(size_t) Min(compressed->band_rows,
+                          cache_info->rows-band*compressed->band_rows)*
+        cache_info->columns;
+      if (FilePositionWrite(file,buffer->data,length*sizeof(PixelPacket),
+                            offset*sizeof(PixelPacket)) <
+          (ssize_t) (length*sizeof(PixelPacket)))
+        {
+          status=MagickFail;
+          break;
+        }
+      if (cache_info->indexes_valid &&
+          (FilePositionWrite(file,buffer->data+(size_t) compressed->band_rows*
+                             cache_info->columns*sizeof(PixelPacket),
+                             length*sizeof(IndexPacket),
+                             number_pixels*sizeof(PixelPacket)+
+                             offset*sizeof(IndexPacket)) <
+           (ssize_t) (length*sizeof(IndexPacket))))
+        {
+          status=MagickFail;
+          break;
+        }
+    }
+  if ((file == -1) || (status == MagickFail))
+    {
+      if (file != -1)
+        (void) close(file);
+      if (*cache_info->cache_filename != '\0')
+        (void) LiberateTemporaryFile(cache_info->cache_filename);
+      *cache_info->cache_filename='\0';
+      LiberateMagickResource(FileResource,1);
+      LiberateMagickResource(DiskResource,cache_info->length);
+      return(MagickFail);
+    }
+  DestroyCompressedCache(cache_info);
+  if ((cache_info->length > MinBlobExtent) &&
+      (cache_info->length == ((size_t) cache_info->length)) &&
+      AcquireMagickResource(MapResource,cache_info->length))
+    {
+      PixelPacket
+        *pixels;
+
+      pixels=(PixelPacket *) MapBlob(file,IOMode,(off_t) cache_info->offset,
+                                     (size_t) cache_info->length);
+      if (pixels == (PixelPacket *) NULL)
+        LiberateMagickResource(MapResource,cache_info->length);
+      else
+        {
+          (void) close(file);
+          file=(-1);
+          LiberateMagickResource(FileResource,1);
+          cache_info->pixels=pixels;
+          if (cache_info->indexes_valid)
+            cache_info->indexes=(IndexPacket *) (pixels+number_pixels);
+          cache_info->type=MapCache;
+        }
+    }
+  if (cache_info->type == CompressedCache)
+    {
+      cache_info->file=file;
+      cache_info->type=DiskCache;
+    }
+  (void) LogMagickEvent(CacheEvent,GetMagickModule(),
+                        "converted compressed cache %.1024s to %s cache"
+                        " %.1024s",cache_info->filename,
+                        cache_info->type == MapCache ? "memory-mapped" :
+                        "disk",cache_info->cache_filename);
+  return(MagickPass);
 }
-/*
-
-  Write data pointed to by 'buffer', with size 'length', to file
-  descriptor 'file' at specified offset 'offset'.  Care is taken to
-  make sure that all data is written if system calls are interrupted
-  by signals.
 
+/*
+  Copy a region of pixels (or of indexes) between a compressed cache and
+  a nexus.  Returns MagickFalse, with the nexus untouched, if the cache is
+  no longer a compressed cache, since another thread may have converted
+  it.  Otherwise the status of the copy is returned via status.
 */
-static ssize_t
-FilePositionWrite(int file, const void *buffer,size_t length,magick_off_t offset)
+static MagickBool
+CopyCompressedCacheRegion(CacheInfo *cache_info,const RectangleInfo *region,
+                          void *nexus_packets,const MagickBool indexes,
+                          const MagickBool to_cache,MagickPassFail *status)
 {
-  register ssize_t
-    count=0;
+  CompressedCacheInfo
+    *compressed;
 
-  register size_t
-    total_count;
+  magick_off_t
+    area_offset;
 
-  MAGICK_POSIX_IO_SIZE_T
-    io_size;
+  long
+    y;
 
-#if !HAVE_PWRITE
-  if ((MagickSeek(file,offset,SEEK_SET)) < 0)
-    return (ssize_t)-1;
-#endif /* !HAVE_PWRITE */
-  for (total_count=0; total_count < length; total_count+=count)
-    {
-      char
-        *io_buff_address;
+  size_t
+    length,
+    packet_size;
 
-      size_t
-        requested_io_size;
+  unsigned char
+    *q;
 
-#if HAVE_PWRITE
-      off_t
-        io_file_offset;
-#endif
+  *status=MagickFail;
+  if ((region->x < 0) || (region->y < 0) ||
+      ((unsigned long) region->x+region->width > cache_info->columns) ||
+      ((unsigned long) region->y+region->height > cache_info->rows))
+    return(MagickTrue);
+  LockSemaphoreInfo(cache_info->file_semaphore);
+  if (cache_info->type != CompressedCache)
+    {
+      UnlockSemaphoreInfo(cache_info->file_semaphore);
+      return(MagickFalse);
+    }
+  compressed=cache_info->compressed;
+  area_offset=0;
+  packet_size=sizeof(PixelPacket);
+  if (indexes)
+    {
+      area_offset=(magick_off_t) compressed->band_rows*cache_info->columns*
+        sizeof(PixelPacket);
+      packet_size=sizeof(IndexPacket);
+    }
+  length=region->width*packet_size;
+  q=(unsigned char *) nexus_packets;
+  *status=MagickPass;
+  for (y=region->y; y < (long) (region->y+region->height); y++)
+    {
+      CacheBandBuffer
+        *buffer;
 
-      io_buff_address=(char *) buffer+total_count;
-      requested_io_size=length-total_count;
-      if (requested_io_size > MAGICK_IO_MAX)
-        io_size=MAGICK_IO_MAX;
+      unsigned char
+        *p;
+
+      buffer=AcquireCacheBand(compressed,
+                              (long) ((unsigned long) y/compressed->band_rows));
+      if (buffer == (CacheBandBuffer *) NULL)
+        {
+          *status=MagickFail;
+          break;
+        }
+      p=buffer->data+area_offset+
+        (((unsigned long) y % compressed->band_rows)*cache_info->columns+
+         region->x)*packet_size;
+      if (to_cache)
+        {
+          (void) memcpy(p,q,length);
+          buffer->dirty=MagickTrue;
+        }
       else
-        io_size=(MAGICK_POSIX_IO_SIZE_T) requested_io_size;
-#if HAVE_PWRITE
-      io_file_offset=offset+total_count;
-      count=pwrite(file,io_buff_address,io_size,io_file_offset);
-#else
-      count=write(file,io_buff_address,io_size);
-#endif
-      if (count <= 0)
-        break;
+        (void) memcpy(q,p,length);
+      q+=length;
     }
-  if (count < 0)
-    return (ssize_t)-1;
-  return (ssize_t) total_count;
+  compressed->copied+=(magick_uint64_t) length*(y-region->y);
+  if ((*status == MagickPass) &&
+      (compressed->loads >= 2*Max(compressed->number_bands,
+                                  compressed->number_buffers)))
+    {
+      /*
+        Convert the cache if, on average, less than half of each band
+        which was decompressed has been used.
+      */
+      if ((!compressed->spill_failed) &&
+          (compressed->copied < compressed->loads*
+           (compressed->band_length/2)) &&
+          (SpillCompressedCache(cache_info) == MagickFail))
+        compressed->spill_failed=MagickTrue;
+      if (cache_info->type == CompressedCache)
+        {
+          compressed->loads=0;
+          compressed->copied=0;
+        }
+    }
+  UnlockSemaphoreInfo(cache_info->file_semaphore);
+  return(MagickTrue);
 }
+#endif /* defined(HasZLIB) */
+
 
 static NexusInfo *InitializeCacheNexus(NexusInfo * restrict nexus_info)
 {
@@ -652,6 +2017,7 @@ SetNexus(const Image * restrict image,const long x,const long y,
 
   if ((cache_info->type != PingCache) &&
       (cache_info->type != DiskCache) &&
+      (cache_info->type != CompressedCache) &&
       (/* Region must entirely be in bounds of image raster */
        (x >= 0) && (y >= 0) && ((y+rows) <= cache_info->rows)
        ) &&
@@ -802,10 +2168,29 @@ SetNexus(const Image * restrict image,const long x,const long y,
       nexus_info->staging_length=0;
       MagickFreeAlignedMemory(nexus_info->staging);
 
-      if (AcquireMagickResource(MemoryResource,length) == MagickPass)
+      if (AcquireCacheMemory(length) == MagickPass)
         nexus_info->staging=MagickAllocateAlignedMemory(PixelPacket *,
                                                         MAGICK_CACHE_LINE_SIZE,
                                                         length);
+#if defined(HasZLIB)
+      /*
+        The bands of a compressed cache may hold the memory needed for
+        a large region, convert the cache (to one which may not need
+        the staging area at all) and try again.
+      */
+      else if (cache_info->type == CompressedCache)
+        {
+          MagickPassFail
+            spilled=MagickFail;
+
+          LockSemaphoreInfo(cache_info->file_semaphore);
+          if (cache_info->type == CompressedCache)
+            spilled=SpillCompressedCache((CacheInfo *) cache_info);
+          UnlockSemaphoreInfo(cache_info->file_semaphore);
+          if (spilled == MagickPass)
+            return(SetNexus(image,x,y,columns,rows,nexus_info,set,exception));
+        }
+#endif /* defined(HasZLIB) */
       if (nexus_info->staging != (PixelPacket *) NULL)
         {
           nexus_info->staging_length=length;
@@ -1022,6 +2407,18 @@ ReadCacheIndexes(const Cache cache,const NexusInfo *nexus_info,
     return(MagickFail);
   if (nexus_info->in_core)
     return(MagickPass);
+#if defined(HasZLIB)
+  if (cache_info->type == CompressedCache)
+    {
+      MagickPassFail
+        status;
+
+      if (CopyCompressedCacheRegion(cache_info,&nexus_info->region,
+                                    nexus_info->indexes,MagickTrue,MagickFalse,
+                                    &status))
+        return(status);
+    }
+#endif /* defined(HasZLIB) */
   offset=nexus_info->region.y*(magick_off_t) cache_info->columns+nexus_info->region.x;
   length=nexus_info->region.width*sizeof(IndexPacket);
   rows=nexus_info->region.height;
@@ -1165,6 +2562,18 @@ ReadCachePixels(const Cache cache,const NexusInfo *nexus_info,
   assert(cache_info->signature == MagickSignature);
   if (nexus_info->in_core)
     return(MagickPass);
+#if defined(HasZLIB)
+  if (cache_info->type == CompressedCache)
+    {
+      MagickPassFail
+        status;
+
+      if (CopyCompressedCacheRegion(cache_info,&nexus_info->region,
+                                    nexus_info->pixels,MagickFalse,MagickFalse,
+                                    &status))
+        return(status);
+    }
+#endif /* defined(HasZLIB) */
   offset=nexus_info->region.y*(magick_off_t) cache_info->columns;
   if ((long) (offset/cache_info->columns) != nexus_info->region.y)
     return MagickFail;
@@ -1225,6 +2634,10 @@ ReadCachePixels(const Cache cache,const NexusInfo *nexus_info,
           open(cache_info->cache_filename,O_RDONLY | O_BINARY));
     if (file != -1)
       {
+        double
+          start_time;
+
+        start_time=CacheTime();
         for (y=0; y < (long) rows; y++)
           {
             if ((FilePositionRead(file,pixels,length,
@@ -1234,6 +2647,11 @@ ReadCachePixels(const Cache cache,const NexusInfo *nexus_info,
             pixels+=nexus_info->region.width;
             offset+=cache_info->columns;
           }
+        cache_info->io_read_time+=CacheTime()-start_time;
+        cache_info->io_reads++;
+        cache_info->io_read_bytes+=(magick_uint64_t) y*length;
+        if (nexus_info->read_ahead_hit)
+          cache_info->io_read_ahead_hits++;
         if (cache_info->file == -1)
           (void) close(file);
         if (QuantumTick(nexus_info->region.y,cache_info->rows))
@@ -1311,6 +2729,18 @@ WriteCacheIndexes(Cache cache,const NexusInfo *nexus_info)
     return(MagickFail);
   if (nexus_info->in_core)
     return(MagickPass);
+#if defined(HasZLIB)
+  if (cache_info->type == CompressedCache)
+    {
+      MagickPassFail
+        status;
+
+      if (CopyCompressedCacheRegion(cache_info,&nexus_info->region,
+                                    nexus_info->indexes,MagickTrue,MagickTrue,
+                                    &status))
+        return(status);
+    }
+#endif /* defined(HasZLIB) */
   offset=nexus_info->region.y*(magick_off_t) cache_info->columns+nexus_info->region.x;
   length=nexus_info->region.width*sizeof(IndexPacket);
   rows=nexus_info->region.height;
@@ -1477,6 +2907,18 @@ WriteCachePixels(Cache cache,const NexusInfo *nexus_info)
   assert(cache_info->signature == MagickSignature);
   if (nexus_info->in_core)
     return(MagickPass);
+#if defined(HasZLIB)
+  if (cache_info->type == CompressedCache)
+    {
+      MagickPassFail
+        status;
+
+      if (CopyCompressedCacheRegion(cache_info,&nexus_info->region,
+                                    nexus_info->pixels,MagickFalse,MagickTrue,
+                                    &status))
+        return(status);
+    }
+#endif /* defined(HasZLIB) */
   offset=nexus_info->region.y*(magick_off_t) cache_info->columns+nexus_info->region.x;
   length=nexus_info->region.width*sizeof(PixelPacket);
   rows=nexus_info->region.height;
@@ -1539,6 +2981,10 @@ WriteCachePixels(Cache cache,const NexusInfo *nexus_info)
       }
     if (file != -1)
       {
+        double
+          start_time;
+
+        start_time=CacheTime();
         for (y=0; y < (long) rows; y++)
           {
             magick_off_t
@@ -1566,8 +3012,13 @@ WriteCachePixels(Cache cache,const NexusInfo *nexus_info)
             pixels+=nexus_info->region.width;
             offset+=cache_info->columns;
           }
+        cache_info->io_write_time+=CacheTime()-start_time;
+        cache_info->io_writes++;
+        cache_info->io_write_bytes+=(magick_uint64_t) y*length;
         if (cache_info->file == -1)
           (void) close(file);
+        else
+          WriteBehindCache(cache_info,file,(size_t) y*length);
         if (QuantumTick(nexus_info->region.y,cache_info->rows))
           (void) LogMagickEvent(CacheEvent,GetMagickModule(),"%lux%lu%+ld%+ld",
                                 nexus_info->region.width,nexus_info->region.height,
@@ -1646,6 +3097,10 @@ GetCacheNexus(Image *image,const long x,const long y,
         updated in-place, then make a working copy in our cache view
         buffer.
       */
+      if ((cache_info->type == DiskCache) || (cache_info->type == MapCache))
+        ReadAheadCacheNexus(cache_info,nexus_info);
+      if (cache_info->type == MapCache)
+        CountMapCacheRegion(cache_info,nexus_info,MagickFalse);
       if (!nexus_info->in_core)
         {
           MagickPassFail
@@ -1871,6 +3326,10 @@ AcquireCacheNexus(const Image *image,const long x,const long y,
         /*
           Pixel request is inside cache extents.
         */
+        if ((cache_info->type == DiskCache) || (cache_info->type == MapCache))
+          ReadAheadCacheNexus(cache_info,nexus_info);
+        if (cache_info->type == MapCache)
+          CountMapCacheRegion(cache_info,nexus_info,MagickFalse);
         if (!nexus_info->in_core)
           {
             MagickPassFail
@@ -2288,6 +3747,8 @@ SyncCacheNexus(Image *image,const NexusInfo *nexus_info,
     }
   else if (nexus_info->in_core)
     {
+      if (cache_info->type == MapCache)
+        CountMapCacheRegion(cache_info,nexus_info,MagickTrue);
       status=MagickPass;
     }
   else
@@ -2388,12 +3849,18 @@ OpenCache(Image *image,const MapMode mode,ExceptionInfo *exception)
     *cache_info;
 
   magick_uint64_t
+    extent,
     number_pixels,
     offset;
 
   int
     file;
 
+  MagickBool
+    first_touch,
+    reallocated=MagickFalse,
+    same_dimensions;
+
   PixelPacket
     *pixels;
 
@@ -2422,6 +3889,14 @@ OpenCache(Image *image,const MapMode mode,ExceptionInfo *exception)
                      image->filename);
       return MagickFail;
     }
+#if defined(HAVE_OPENCL)
+  /*
+    The pixels may be reallocated below.
+  */
+  CopyOpenCLBuffer(cache_info);
+#endif
+  same_dimensions=((cache_info->rows == image->rows) &&
+                   (cache_info->columns == image->columns));
   cache_info->rows=image->rows;
   cache_info->columns=image->columns;
   if (cache_info->storage_class != UndefinedClass)
@@ -2460,6 +3935,21 @@ OpenCache(Image *image,const MapMode mode,ExceptionInfo *exception)
             LiberateMagickResource(MapResource,cache_info->length);
             break;
           }
+        case CompressedCache:
+          {
+            /*
+              The bands are kept (and remain charged) if the dimensions
+              are the same since they always provide for indexes.
+            */
+#if defined(HasZLIB)
+            if (!same_dimensions)
+              {
+                DestroyCompressedCache(cache_info);
+                cache_info->type=UndefinedCache;
+              }
+#endif /* defined(HasZLIB) */
+            break;
+          }
         }
     }
 
@@ -2516,9 +4006,90 @@ OpenCache(Image *image,const MapMode mode,ExceptionInfo *exception)
       (offset == (magick_uint64_t) ((size_t) offset)) &&
       ((cache_info->type == UndefinedCache) ||
        (cache_info->type == MemoryCache)) &&
-      (AcquireMagickResource(MemoryResource,offset)))
+      (AcquireCacheMemory(offset)))
     {
-      MagickReallocMemory(PixelPacket *,cache_info->pixels,(size_t) offset);
+      /*
+        Pixels of the right size class are kept, and a cache without
+        pixels takes them from the pool if it can.
+      */
+      extent=CachePoolExtent(offset);
+      if (extent != (magick_uint64_t) ((size_t) extent))
+        extent=offset;
+      first_touch=((cache_first_touch) && (extent >= MinCachePoolExtent) &&
+                   (cache_info->pixels == (PixelPacket *) NULL));
+      if (cache_info->pixels != (PixelPacket *) NULL)
+        reallocated=(cache_info->memory_length == extent);
+      else if (AcquirePooledCachePixels(cache_info,extent) == MagickPass)
+        {
+          reallocated=MagickTrue;
+          first_touch=MagickFalse;
+          if (image->logging)
+            (void) LogMagickEvent(CacheEvent,GetMagickModule(),
+                                  "reuse pooled pixels for %.1024s",
+                                  cache_info->filename);
+        }
+#if defined(MAGICK_HUGE_PAGE_PIXEL_CACHE)
+      if ((!reallocated) && (cache_huge_pages) && (extent >= HugePageExtent))
+        reallocated=(MapHugeCachePixels(cache_info,extent) == MagickPass);
+#endif /* defined(MAGICK_HUGE_PAGE_PIXEL_CACHE) */
+#if defined(MAGICK_COW_PIXEL_CACHE)
+      /*
+        Large caches are mapped so that clones can share their pages (see
+        ShareCachePixels()).
+      */
+      if ((!reallocated) &&
+          ((cache_info->memory_mapped) || (extent >= CopyOnWriteExtent)))
+        reallocated=(MapCachePixels(cache_info,extent) == MagickPass);
+#endif /* defined(MAGICK_COW_PIXEL_CACHE) */
+      if ((!reallocated) && (cache_info->memory_mapped))
+        {
+          /*
+            Mapped pixels which can not be mapped again at the new size
+            are moved to the heap.
+          */
+#if defined(HAVE_OPENCL)
+          pixels=MagickAllocateAlignedMemory(PixelPacket *,
+                                             MAGICKCORE_OPENCL_HOST_ALIGNMENT,
+                                             (size_t) extent);
+#else
+          pixels=MagickAllocateMemory(PixelPacket *,(size_t) extent);
+#endif /* defined(HAVE_OPENCL) */
+          if (pixels != (PixelPacket *) NULL)
+            (void) memcpy(pixels,cache_info->pixels,
+                          (size_t) Min(cache_info->memory_length,extent));
+          FreeCachePixels(cache_info);
+          cache_info->pixels=pixels;
+          if (pixels != (PixelPacket *) NULL)
+            cache_info->memory_length=extent;
+          reallocated=MagickTrue;
+        }
+      if (!reallocated)
+      {
+#if defined(HAVE_OPENCL)
+      /*
+        OpenCL devices which share memory with the host use the pixels in
+        place (see GetAuthenticOpenCLBuffer()) provided they are aligned.
+        Aligned memory can not be reallocated so the reallocation is done
+        here, preserving the pixels like MagickReallocMemory().
+      */
+      pixels=MagickAllocateAlignedMemory(PixelPacket *,
+                                         MAGICKCORE_OPENCL_HOST_ALIGNMENT,
+                                         (size_t) extent);
+      if (cache_info->pixels != (PixelPacket *) NULL)
+        {
+          if (pixels != (PixelPacket *) NULL)
+            (void) memcpy(pixels,cache_info->pixels,
+                          (size_t) Min(cache_info->memory_length,extent));
+          MagickFreeAlignedMemory(cache_info->pixels);
+        }
+      cache_info->pixels=pixels;
+#else
+      MagickReallocMemory(PixelPacket *,cache_info->pixels,(size_t) extent);
+#endif /* defined(HAVE_OPENCL) */
+      cache_info->memory_length=0;
+      if (cache_info->pixels != (PixelPacket *) NULL)
+        cache_info->memory_length=extent;
+      }
       pixels=cache_info->pixels;
       if (pixels == (PixelPacket *) NULL)
         LiberateMagickResource(MemoryResource,offset);
@@ -2535,6 +4106,8 @@ OpenCache(Image *image,const MapMode mode,ExceptionInfo *exception)
           cache_info->indexes=(IndexPacket *) NULL;
           if (cache_info->indexes_valid)
             cache_info->indexes=(IndexPacket *) (pixels+number_pixels);
+          if (first_touch)
+            FirstTouchCachePixels(cache_info);
           FormatSize(cache_info->length,format);
           if (image->logging)
             (void) LogMagickEvent(CacheEvent,GetMagickModule(),
@@ -2546,6 +4119,33 @@ OpenCache(Image *image,const MapMode mode,ExceptionInfo *exception)
           return(MagickPass);
         }
     }
+#if defined(HasZLIB)
+  /*
+    Attempt to create a compressed pixel cache in memory.
+  */
+  if (((cache_info->type == UndefinedCache) &&
+       (*cache_info->cache_filename == '\0') &&
+       (OpenCompressedCache(cache_info) == MagickPass)) ||
+      (cache_info->type == CompressedCache))
+    {
+      cache_info->storage_class=image->storage_class;
+      cache_info->colorspace=image->colorspace;
+      cache_info->type=CompressedCache;
+      cache_info->pixels=(PixelPacket *) NULL;
+      cache_info->indexes=(IndexPacket *) NULL;
+      FormatSize(cache_info->length,format);
+      if (image->logging)
+        (void) LogMagickEvent(CacheEvent,GetMagickModule(),
+                              "open %.1024s (%.1024s, compressed, %lu bands"
+                              " of %lu rows) storage_class=%s, colorspace=%s",
+                              cache_info->filename,format,
+                              cache_info->compressed->number_bands,
+                              cache_info->compressed->band_rows,
+                              ClassTypeToString(cache_info->storage_class),
+                              ColorspaceTypeToString(cache_info->colorspace));
+      return(MagickPass);
+    }
+#endif /* defined(HasZLIB) */
   /*
     Create pixel cache on disk.
   */
@@ -2647,6 +4247,18 @@ OpenCache(Image *image,const MapMode mode,ExceptionInfo *exception)
         cache_info->file=file;
       else
         (void) close(file);
+#if defined(HAVE_SYSCONF) && defined(_SC_PHYS_PAGES)
+      {
+        long
+          pages;
+
+        pages=sysconf(_SC_PHYS_PAGES);
+        cache_info->write_behind=((pages > 0) &&
+                                  (cache_info->length/
+                                   (magick_uint64_t) MagickGetMMUPageSize() >
+                                   (magick_uint64_t) pages));
+      }
+#endif /* defined(HAVE_SYSCONF) && defined(_SC_PHYS_PAGES) */
     }
 #if defined(SIGBUS)
   /*   (void) signal(SIGBUS,CacheSignalHandler); */
@@ -3009,7 +4621,14 @@ AcquireOneCacheViewPixelInlined(View *view_info,
   MagickPassFail
     status=MagickFail;
 
+  /*
+    Pixels still held by an OpenCL device are not yet in host memory, so
+    those reads go through AcquireCacheNexus(), which copies them back.
+  */
   if (((MemoryCache == cache_info->type) || (MapCache == cache_info->type)) &&
+#if defined(HAVE_OPENCL)
+      (cache_info->opencl == (MagickCLCacheInfo) NULL) &&
+#endif
       ((x >= 0) && (y >= 0) &&
        ((unsigned long) x < cache_info->columns) &&
        ((unsigned long) y < cache_info->rows)))
@@ -3313,7 +4932,12 @@ ClonePixelCache(Image *image,Image *clone_image,ExceptionInfo *exception)
 
   cache_info=(CacheInfo *) image->cache;
   clone_info=(CacheInfo *) clone_image->cache;
-  if (cache_info->length != clone_info->length)
+#if defined(HAVE_OPENCL)
+  CopyOpenCLBuffer(cache_info);
+#endif
+  if ((cache_info->length != clone_info->length) ||
+      (cache_info->type == CompressedCache) ||
+      (clone_info->type == CompressedCache))
     {
       Image
         *clip_mask,
@@ -3385,6 +5009,15 @@ ClonePixelCache(Image *image,Image *clone_image,ExceptionInfo *exception)
   /*
     Optimized pixel cache clone.
   */
+#if defined(MAGICK_COW_PIXEL_CACHE)
+  if ((cache_info->type == MemoryCache) && (clone_info->type == MemoryCache) &&
+      (ShareCachePixels(cache_info,clone_info) == MagickPass))
+    {
+      (void) LogMagickEvent(CacheEvent,GetMagickModule(),
+                            "memory => memory copy-on-write clone");
+      return(MagickPass);
+    }
+#endif /* defined(MAGICK_COW_PIXEL_CACHE) */
   if ((cache_info->type != DiskCache) && (clone_info->type != DiskCache))
     {
       (void) LogMagickEvent(CacheEvent,GetMagickModule(),
@@ -3641,7 +5274,15 @@ DestroyCacheInfo(Cache cache_info)
   /*
     Release Cache Pixel Resources
   */
-  if (MemoryCache == cache_info->type)
+  if ((MemoryCache == cache_info->type) && (cache_info->memory_mapped))
+    {
+#if defined(HAVE_OPENCL)
+      CopyOpenCLBuffer(cache_info);
+#endif
+      LiberateMagickResource(MemoryResource,cache_info->length);
+      ReleaseCachePixels(cache_info);
+    }
+  else if (MemoryCache == cache_info->type)
     {
 #if defined(HAVE_OPENCL)
       if (cache_info->opencl != (MagickCLCacheInfo) NULL)
@@ -3650,9 +5291,14 @@ DestroyCacheInfo(Cache cache_info)
             MagickTrue);
           cache_info->pixels=(Quantum *) NULL;
         }
+      else
+        {
+          LiberateMagickResource(MemoryResource,cache_info->length);
+          ReleaseCachePixels(cache_info);
+        }
 #else
-      MagickFreeMemory(cache_info->pixels);
       LiberateMagickResource(MemoryResource,cache_info->length);
+      ReleaseCachePixels(cache_info);
 #endif
     }
   else if (MapCache == cache_info->type)
@@ -3661,10 +5307,32 @@ DestroyCacheInfo(Cache cache_info)
       cache_info->pixels = NULL;
       LiberateMagickResource(MapResource,cache_info->length);
     }
+#if defined(HasZLIB)
+  else if (CompressedCache == cache_info->type)
+    {
+      DestroyCompressedCache(cache_info);
+    }
+#endif /* defined(HasZLIB) */
 
   /*
     Release Cache File Resources
   */
+  if (((DiskCache == cache_info->type) || (MapCache == cache_info->type)) &&
+      ((cache_info->io_reads != 0) || (cache_info->io_writes != 0)))
+    (void) LogMagickEvent(CacheEvent,GetMagickModule(),
+                          "%.1024s: %s cache %" MAGICK_UINT64_F "u reads (%"
+                          MAGICK_UINT64_F "u bytes, %.1f%% read ahead, %.3fs"
+                          " waiting), %" MAGICK_UINT64_F "u writes (%"
+                          MAGICK_UINT64_F "u bytes, %.3fs waiting)",
+                          cache_info->filename,
+                          DiskCache == cache_info->type ? "disk" : "map",
+                          cache_info->io_reads,cache_info->io_read_bytes,
+                          cache_info->io_reads == 0 ? 0.0 :
+                          100.0*cache_info->io_read_ahead_hits/
+                          cache_info->io_reads,
+                          cache_info->io_read_time,cache_info->io_writes,
+                          cache_info->io_write_bytes,
+                          cache_info->io_write_time);
   if ((MapCache == cache_info->type) || (DiskCache == cache_info->type))
     {
       if (cache_info->file != -1)
@@ -3721,6 +5389,42 @@ DestroyImagePixels(Image *image)
   image->cache=(Cache) NULL;
 }
 
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
++   D e s t r o y P i x e l C a c h e P o o l                                 %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  DestroyPixelCachePool() frees the pooled memory cache pixels and logs
+%  how often the pool was able to provide pixels.  Memory caches released
+%  after this are freed.
+%
+%  The format of the DestroyPixelCachePool() method is:
+%
+%      void DestroyPixelCachePool(void)
+%
+%
+*/
+void
+DestroyPixelCachePool(void)
+{
+  if (cache_pool_semaphore == (SemaphoreInfo *) NULL)
+    return;
+  (void) EmptyCachePool();
+  if ((cache_pool.hits != 0) || (cache_pool.misses != 0))
+    (void) LogMagickEvent(CacheEvent,GetMagickModule(),
+                          "pixel cache pool: %" MAGICK_UINT64_F "u hits, %"
+                          MAGICK_UINT64_F "u misses",cache_pool.hits,
+                          cache_pool.misses);
+  cache_pool.limit=0;
+  DestroySemaphoreInfo(&cache_pool_semaphore);
+}
+
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %                                                                             %
@@ -3770,6 +5474,7 @@ GetCacheInfo(Cache *cache)
   cache_info->reference_count=1;
   UnlockSemaphoreInfo(cache_info->reference_semaphore);
   cache_info->file=(-1);
+  cache_info->memory_file=(-1);
   if (cache_info->reference_semaphore == (SemaphoreInfo *) NULL)
     MagickFatalError3(ResourceLimitFatalError,MemoryAllocationFailed,
                       UnableToAllocateCacheInfo);
@@ -4380,6 +6085,59 @@ GetPixelCachePresent(const Image *image)
   return MagickTrue;
 }
 
+/*
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%                                                                             %
+%                                                                             %
+%                                                                             %
++   I n i t i a l i z e P i x e l C a c h e P o o l                           %
+%                                                                             %
+%                                                                             %
+%                                                                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%
+%  InitializePixelCachePool() initializes the pool of memory cache pixels,
+%  which holds up to MAGICK_CACHE_POOL_LIMIT bytes (by default an eighth of
+%  the memory resource limit).  A limit of zero disables the pool.  How
+%  the pooled pixels are allocated (MAGICK_CACHE_HUGE_PAGES and
+%  MAGICK_CACHE_FIRST_TOUCH) is decided here as well.
+%
+%  The format of the InitializePixelCachePool() method is:
+%
+%      MagickPassFail InitializePixelCachePool(void)
+%
+%
+*/
+MagickPassFail
+InitializePixelCachePool(void)
+{
+  const char
+    *p;
+
+  assert(cache_pool_semaphore == (SemaphoreInfo *) NULL);
+  (void) memset(&cache_pool,0,sizeof(cache_pool));
+  cache_pool.limit=(-1);
+  if ((p=getenv("MAGICK_CACHE_POOL_LIMIT")) != (const char *) NULL)
+    {
+      cache_pool.limit=MagickSizeStrToInt64(p,1024);
+      if (cache_pool.limit < 0)
+        {
+          (void) LogMagickEvent(CacheEvent,GetMagickModule(),
+                                "Ignoring unreasonable"
+                                " MAGICK_CACHE_POOL_LIMIT \"%s\"",p);
+          cache_pool.limit=(-1);
+        }
+    }
+  p=getenv("MAGICK_CACHE_HUGE_PAGES");
+  cache_huge_pages=((p != (const char *) NULL) &&
+                    (LocaleCompare(p,"TRUE") == 0));
+  p=getenv("MAGICK_CACHE_FIRST_TOUCH");
+  cache_first_touch=((p != (const char *) NULL) &&
+                     (LocaleCompare(p,"TRUE") == 0));
+  cache_pool_semaphore=AllocateSemaphoreInfo();
+  return(MagickPass);
+}
+
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %                                                                             %
@@ -4529,6 +6287,9 @@ ModifyCache(Image *image, ExceptionInfo *exception)
   CacheInfo
     * restrict cache_info;
 
+  long
+    reference_count;
+
   MagickPassFail
     status;
 
@@ -4538,9 +6299,46 @@ ModifyCache(Image *image, ExceptionInfo *exception)
 
   /*
     Note that this function is normally executed for each and every
-    scanline which is read/updated so it represents constant locking
-    overhead.
+    scanline which is read/updated.  Once the image owns an in-memory
+    cache which matches it there is nothing left to do, so no lock is
+    taken.  A reference count of one is our own reference: another
+    reference can only be added through this image, and cloning an image
+    while it is being modified is not supported, so the count can not
+    grow behind our back.  Other images sharing the cache may release it
+    concurrently, so the count is read atomically; the read-only flag is
+    only set while the cache is shared.  While the cache is not shared,
+    its other members are only changed by the thread updating this image.
   */
+  cache_info=(CacheInfo *) image->cache;
+#if defined(HAVE_OPENMP) && (_OPENMP >= 201107)
+#  pragma omp atomic read
+#endif
+  reference_count=cache_info->reference_count;
+  if ((reference_count == 1) && (!cache_info->read_only) &&
+      (cache_info->type == MemoryCache) &&
+#if defined(HAVE_OPENCL)
+      (cache_info->opencl == (MagickCLCacheInfo) NULL) &&
+#endif
+      (image->taint) &&
+      (image->storage_class == cache_info->storage_class) &&
+      (image->colorspace == cache_info->colorspace) &&
+      (image->rows == cache_info->rows) &&
+      (image->columns == cache_info->columns))
+    {
+      /*
+        The pixels are about to change, the flags are only ever cleared
+        here so threads racing on them store the same value.
+      */
+      if ((image->is_grayscale) || (image->is_monochrome))
+        {
+          LockSemaphoreInfo(image->semaphore);
+          image->is_grayscale=MagickFalse;
+          image->is_monochrome=MagickFalse;
+          UnlockSemaphoreInfo(image->semaphore);
+        }
+      return(status);
+    }
+
   LockSemaphoreInfo(image->semaphore);
   {
     MagickBool
@@ -4767,7 +6565,8 @@ PersistCache(Image *image,const char *filename,
     }
   LockSemaphoreInfo(cache_info->reference_semaphore);
   if ((cache_info->reference_count == 1) &&
-      (cache_info->type != MemoryCache))
+      (cache_info->type != MemoryCache) &&
+      (cache_info->type != CompressedCache))
     {
       /*
         Usurp resident persistent pixel cache.
@@ -5224,7 +7023,9 @@ SyncImagePixelsEx(Image *image,ExceptionInfo *exception)
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 %
 %  GetAuthenticOpenCLBuffer() returns an OpenCL buffer used to execute OpenCL
-%  operations.
+%  operations.  The buffer stays attached to the pixel cache so the results
+%  of consecutive operations remain on the device, the host pixels are only
+%  updated when they are accessed by the CPU (see CopyOpenCLBuffer()).
 %
 %  The format of the GetAuthenticOpenCLBuffer() method is:
 %
@@ -5251,7 +7052,29 @@ MagickPrivate cl_mem GetAuthenticOpenCLBuffer(const Image *image,
   cache_info=(CacheInfo *) image->cache;
   if ((cache_info->type == UndefinedCache) || (cache_info->reference_count > 1))
     {
-      /* SyncImagePixelCache */SyncImagePixelsEx((Image *) image,exception);
+      Image
+        *mutable_image;
+
+      MagickBool
+        is_grayscale,
+        is_monochrome;
+
+      unsigned int
+        taint;
+
+      /*
+        Open (or unshare) the pixel cache.  This does not change the pixels
+        so the attributes reset by ModifyCache() are restored.
+      */
+      mutable_image=(Image *) image;
+      is_grayscale=mutable_image->is_grayscale;
+      is_monochrome=mutable_image->is_monochrome;
+      taint=mutable_image->taint;
+      if (ModifyCache(mutable_image,exception) == MagickFail)
+        return((cl_mem) NULL);
+      mutable_image->is_grayscale=is_grayscale;
+      mutable_image->is_monochrome=is_monochrome;
+      mutable_image->taint=taint;
       cache_info=(CacheInfo *) image->cache;
     }
   if ((cache_info->type != MemoryCache)/*  || (cache_info->mapped != MagickFalse) */)
@@ -60,6 +60,9 @@
 #include "magick/resource.h"
 #include "magick/transform.h"
 #include "magick/utility.h"
+#if defined(HAVE_OPENCL)
+#include "magick/accelerate-private.h"
+#endif
 
 /*
   Define declarations.
@@ -1270,6 +1273,31 @@ AffineEdge(const Image *image,const AffineMatrix *affine,
   return(inverse_edge);
 }
 
+/*
+  Determine the columns of row y which DrawAffineImage() updates.
+*/
+static MagickBool
+AffineSpan(const Image *image,const Image *composite,
+           const AffineMatrix *inverse_affine,const long y,
+           const SegmentInfo *edge,long *start,long *stop)
+{
+  SegmentInfo
+    inverse_edge;
+
+  inverse_edge=AffineEdge(composite,inverse_affine,y,edge);
+  if (inverse_edge.x2 < inverse_edge.x1)
+    return(MagickFalse);
+  if (inverse_edge.x1 < 0)
+    inverse_edge.x1=0.0;
+  if (inverse_edge.x2 > image->columns-1)
+    inverse_edge.x2=image->columns-1;
+  *start=(long) ceil(inverse_edge.x1-0.5);
+  *stop=(long) floor(inverse_edge.x2+0.5);
+  if (*stop < *start)
+    *start=*stop;
+  return(MagickTrue);
+}
+
 static AffineMatrix
 InverseAffineMatrix(const AffineMatrix *affine)
 {
@@ -1380,6 +1408,45 @@ DrawAffineImage(Image *image,const Image *composite,
   y_min=(long) ceil(edge.y1-0.5);
   y_max=(long) floor(edge.y2+0.5);
 
+#if defined(HAVE_OPENCL)
+  if (y_max >= y_min)
+    {
+      long
+        *spans;
+
+      MagickBooleanType
+        accelerated;
+
+      /*
+        The device draws every row at once, so collect the spans first.
+      */
+      spans=MagickAllocateArray(long *,(size_t) (y_max-y_min+1),
+                                2*sizeof(long));
+      if (spans != (long *) NULL)
+        {
+          for (y=y_min; y <= y_max; y++)
+            {
+              long
+                *span = spans+2*(y-y_min);
+
+              if (!AffineSpan(image,composite,&inverse_affine,y,&edge,
+                              span,span+1))
+                {
+                  span[0]=1;
+                  span[1]=0;
+                }
+            }
+          accelerated=AccelerateDrawAffineImage(image,composite,
+                                                &inverse_affine,y_min,
+                                                (unsigned long) (y_max-y_min+1),
+                                                spans,&image->exception);
+          MagickFreeMemory(spans);
+          if (accelerated != MagickFalse)
+            return(MagickPass);
+        }
+    }
+#endif
+
   monitor_active=MagickMonitorActive();
 
 #if defined(HAVE_OPENMP)
@@ -1398,9 +1465,6 @@ DrawAffineImage(Image *image,const Image *composite,
         start,
         stop;
 
-      SegmentInfo
-        inverse_edge;
-
       register PixelPacket
         *q;
 
@@ -1411,19 +1475,9 @@ DrawAffineImage(Image *image,const Image *composite,
       if (thread_status == MagickFail)
         continue;
 
-      inverse_edge=AffineEdge(composite,&inverse_affine,y,&edge);
-      if (inverse_edge.x2 < inverse_edge.x1)
+      if (!AffineSpan(image,composite,&inverse_affine,y,&edge,&start,&stop))
         continue;
-      if (inverse_edge.x1 < 0)
-        inverse_edge.x1=0.0;
-      if (inverse_edge.x2 > image->columns-1)
-        inverse_edge.x2=image->columns-1;
-      start=(long) ceil(inverse_edge.x1-0.5);
-      stop=(long) floor(inverse_edge.x2+0.5);
-      if (stop >= start)
-        x=start;
-      else
-        x=stop;
+      x=start;
       q=GetImagePixelsEx(image,x,y,stop-x+1,1,&image->exception);
       if (q == (PixelPacket *) NULL)
         thread_status=MagickFail;
@@ -53,6 +53,9 @@
 #include "magick/shear.h"
 #include "magick/transform.h"
 #include "magick/utility.h"
+#if defined(HAVE_OPENCL)
+#include "magick/accelerate-private.h"
+#endif
 
 /*
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -1789,6 +1792,11 @@ RotateImage(const Image *image,const double degrees,ExceptionInfo *exception)
   assert(image->signature == MagickSignature);
   assert(exception != (ExceptionInfo *) NULL);
   assert(exception->signature == MagickSignature);
+#if defined(HAVE_OPENCL)
+  rotate_image=AccelerateRotateImage(image,degrees,exception);
+  if (rotate_image != (Image *) NULL)
+    return(rotate_image);
+#endif
   angle = degrees - 360.0*(int)(degrees / 360);
   if(angle < -45.0) angle+=360.0;
 
@@ -0,0 +1,275 @@
+/*
+ *
+ * Check that memory pixel caches which reuse pooled pixels behave like
+ * freshly allocated ones, and that the pool gives its memory back when
+ * a cache needs it.
+ *
+ * Images of alternating sizes (which usually share a pool size class)
+ * are filled, checked and destroyed in turn, so that each reuses the
+ * pixels of its predecessors.  The pooled pixels stay charged to the
+ * memory resource, and the pool hits are logged when the library is
+ * destroyed: there must be pooled pixels and hits, or neither when
+ * MAGICK_CACHE_POOL_LIMIT is zero.  The memory resource limit is then set
+ * to just what a larger image needs, which must still be held in memory.
+ *
+ */
+
+#include <magick/studio.h>
+#include <magick/api.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PixelValue(x,y,k) ((Quantum) (((x)*7+(y)*13+(k)*17) % (MaxRGB+1)))
+
+static unsigned long
+  pool_hits = 0;
+
+/*
+  Pick the pool statistics out of the log.
+*/
+static void RecordPoolStatistics(const ExceptionType type,
+                                 const char *message)
+{
+  const char
+    *p;
+
+  unsigned long
+    hits;
+
+  ARG_NOT_USED(type);
+  p=strstr(message,"pixel cache pool: ");
+  if ((p != (const char *) NULL) &&
+      (sscanf(p+18,"%lu hits",&hits) == 1))
+    pool_hits+=hits;
+}
+
+/*
+  Allocate an image, fill it with a pattern and check that it reads back.
+*/
+static Image *FillImage(const ImageInfo *imageInfo,const unsigned long columns,
+                        const unsigned long rows,const long k,
+                        ExceptionInfo *exception)
+{
+  Image
+    *image;
+
+  long
+    failures = 0,
+    x,
+    y;
+
+  image=AllocateImage(imageInfo);
+  if (image == (Image *) NULL)
+    return (Image *) NULL;
+  image->columns=columns;
+  image->rows=rows;
+  for (y=0; y < (long) image->rows; y++)
+    {
+      PixelPacket
+        *q;
+
+      q=SetImagePixelsEx(image,0,y,image->columns,1,exception);
+      if (q == (PixelPacket *) NULL)
+        break;
+      for (x=0; x < (long) image->columns; x++)
+        {
+          q[x].red=PixelValue(x,y,k);
+          q[x].green=PixelValue(x,y,k+1);
+          q[x].blue=PixelValue(x,y,k+2);
+          q[x].opacity=OpaqueOpacity;
+        }
+      if (!SyncImagePixelsEx(image,exception))
+        break;
+    }
+  if (y != (long) image->rows)
+    failures++;
+  for (y=0; (failures == 0) && (y < (long) image->rows); y++)
+    {
+      const PixelPacket
+        *p;
+
+      p=AcquireImagePixels(image,0,y,image->columns,1,exception);
+      if (p == (const PixelPacket *) NULL)
+        {
+          failures++;
+          break;
+        }
+      for (x=0; x < (long) image->columns; x++)
+        if ((p[x].red != PixelValue(x,y,k)) ||
+            (p[x].green != PixelValue(x,y,k+1)) ||
+            (p[x].blue != PixelValue(x,y,k+2)) ||
+            (p[x].opacity != OpaqueOpacity))
+          failures++;
+    }
+  if (failures != 0)
+    {
+      (void) printf ( "Image %ld (%lux%lu) has %ld wrong pixels\n",
+                      k, columns, rows, failures );
+      DestroyImage( image );
+      return (Image *) NULL;
+    }
+  return image;
+}
+
+int main ( int argc, char **argv )
+{
+  Image
+    *image = (Image *) NULL;
+
+  ImageInfo
+    *imageInfo;
+
+  ExceptionInfo
+    exception;
+
+  int
+    arg = 1,
+    exit_status = 0;
+
+  long
+    k;
+
+  const char
+    *pool_limit;
+
+  MagickBool
+    pool_disabled;
+
+  magick_int64_t
+    base_memory,
+    memory_limit,
+    needed_memory,
+    pooled_memory;
+
+  unsigned long
+    columns = 1024,
+    rows = 768;
+
+  if (LocaleNCompare("cachepool",argv[0],9) == 0)
+    InitializeMagick((char *) NULL);
+  else
+    InitializeMagick(*argv);
+
+  imageInfo=CloneImageInfo(0);
+  GetExceptionInfo( &exception );
+
+  for (arg=1; arg < argc; arg++)
+    {
+      char
+        *option = argv[arg];
+
+      if (*option == '-')
+        {
+          if (LocaleCompare("debug",option+1) == 0)
+            (void) SetLogEventMask(argv[++arg]);
+          else if (LocaleCompare("log",option+1) == 0)
+            (void) SetLogFormat(argv[++arg]);
+          else
+            {
+              (void) printf("Unrecognized option %s\n",option);
+              exit_status = 1;
+              goto program_exit;
+            }
+        }
+      else
+        break;
+    }
+  if (arg == argc-2)
+    {
+      columns=(unsigned long) MagickAtoL(argv[arg]);
+      rows=(unsigned long) MagickAtoL(argv[arg+1]);
+    }
+  else if (arg != argc)
+    {
+      (void) printf ( "Usage: %s [-debug events -log format] [columns rows]\n", argv[0] );
+      exit_status = 1;
+      goto program_exit;
+    }
+  if ((columns < 64) || (rows < 64))
+    {
+      (void) printf ( "Image must be at least 64x64\n" );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  pool_limit=getenv("MAGICK_CACHE_POOL_LIMIT");
+  pool_disabled=((pool_limit != (const char *) NULL) &&
+                 (strtod(pool_limit,(char **) NULL) == 0.0));
+
+  /*
+   * Each image reuses the pixels released by the previous ones
+   */
+  base_memory=GetMagickResource(MemoryResource);
+  for (k=0; k < 8; k++)
+    {
+      image=FillImage(imageInfo,columns-(k % 2)*8,rows,k,&exception);
+      if (image == (Image *) NULL)
+        {
+          CatchException(&exception);
+          exit_status = 1;
+          goto program_exit;
+        }
+      DestroyImage( image );
+      image=(Image *) NULL;
+    }
+  pooled_memory=GetMagickResource(MemoryResource)-base_memory;
+  (void) printf ( "%" MAGICK_INT64_F "d bytes of pooled pixels\n",
+                  pooled_memory );
+  if (pool_disabled ? (pooled_memory != 0) : (pooled_memory <= 0))
+    {
+      (void) printf ( "Expected %s pooled pixels\n",
+                      pool_disabled ? "no" : "some" );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  /*
+   * The pooled pixels must make way for a larger in-memory image
+   */
+  needed_memory=(magick_int64_t) 2*columns*rows*
+    (sizeof(PixelPacket)+sizeof(IndexPacket));
+  memory_limit=GetMagickResourceLimit(MemoryResource);
+  (void) SetMagickResourceLimit(MemoryResource,base_memory+needed_memory);
+  image=FillImage(imageInfo,2*columns,rows,k,&exception);
+  if (image == (Image *) NULL)
+    {
+      CatchException(&exception);
+      exit_status = 1;
+    }
+  else if (GetMagickResource(MemoryResource)-base_memory != needed_memory)
+    {
+      (void) printf ( "Image of %" MAGICK_INT64_F "d bytes was not held in"
+                      " memory (%" MAGICK_INT64_F "d bytes in use)\n",
+                      needed_memory,
+                      GetMagickResource(MemoryResource)-base_memory );
+      exit_status = 1;
+    }
+  (void) SetMagickResourceLimit(MemoryResource,memory_limit);
+
+ program_exit:
+  if (image)
+    DestroyImage( image );
+  DestroyImageInfo( imageInfo );
+  DestroyExceptionInfo( &exception );
+  if (exit_status == 0)
+    {
+      (void) SetLogEventMask("cache");
+      SetLogMethod(RecordPoolStatistics);
+    }
+  DestroyMagick();
+
+  if (exit_status == 0)
+    {
+      (void) printf ( "%lu pool hits\n", pool_hits );
+      if (pool_disabled ? (pool_hits != 0) : (pool_hits == 0))
+        {
+          (void) printf ( "Expected %s pool hits\n",
+                          pool_disabled ? "no" : "some" );
+          exit_status = 1;
+        }
+    }
+
+  return exit_status;
+}
@@ -0,0 +1,194 @@
+/*
+ *
+ * Test that images held in compressed pixel caches give the same results
+ * as images held in memory.
+ *
+ * The input image is enlarged and the operation applied to it while the
+ * memory resource limit is too small for the enlarged images to be held
+ * in memory, so that their pixel caches are compressed (with bands which
+ * do not fit the limit stored in a file, or converted to a disk cache).
+ * The same is then done without the limit, and the results must be
+ * identical.
+ *
+ */
+
+#include <magick/studio.h>
+#include <magick/api.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ScaleFactor 24
+
+static Image *ApplyOperation(const Image *image,const char *operation,
+                             ExceptionInfo *exception)
+{
+  Image
+    *large_image,
+    *result;
+
+  large_image=SampleImage(image,image->columns*ScaleFactor,
+                          image->rows*ScaleFactor,exception);
+  if (large_image == (Image *) NULL)
+    return (Image *) NULL;
+  result=(Image *) NULL;
+  if (LocaleCompare("convolve",operation) == 0)
+    {
+      static const double
+        kernel[] = { -1.0, -1.0, -1.0, -1.0, 9.0, -1.0, -1.0, -1.0, -1.0 };
+
+      result=ConvolveImage(large_image,3,kernel,exception);
+    }
+  else if (LocaleCompare("despeckle",operation) == 0)
+    result=DespeckleImage(large_image,exception);
+  else if (LocaleCompare("flip",operation) == 0)
+    result=FlipImage(large_image,exception);
+  else if (LocaleCompare("resize",operation) == 0)
+    result=ResizeImage(large_image,large_image->columns*3/2,
+                       large_image->rows*2/3,LanczosFilter,1.0,exception);
+  else if (LocaleCompare("rotate",operation) == 0)
+    result=RotateImage(large_image,37.0,exception);
+  else if (LocaleCompare("rotate90",operation) == 0)
+    result=RotateImage(large_image,90.0,exception);
+  else
+    (void) printf ( "Unrecognized operation %s\n", operation );
+  DestroyImage( large_image );
+  return result;
+}
+
+int main ( int argc, char **argv )
+{
+  Image
+    *original = (Image *) NULL,
+    *reference = (Image *) NULL,
+    *result = (Image *) NULL;
+
+  char
+    infile[MaxTextExtent];
+
+  const char
+    *operation;
+
+  int
+    arg = 1,
+    exit_status = 0;
+
+  magick_int64_t
+    memory_limit;
+
+  ImageInfo
+    *imageInfo;
+
+  ExceptionInfo
+    exception;
+
+  if (LocaleNCompare("compresscache",argv[0],13) == 0)
+    InitializeMagick((char *) NULL);
+  else
+    InitializeMagick(*argv);
+
+  imageInfo=CloneImageInfo(0);
+  GetExceptionInfo( &exception );
+
+  for (arg=1; arg < argc; arg++)
+    {
+      char
+        *option = argv[arg];
+
+      if (*option == '-')
+        {
+          if (LocaleCompare("debug",option+1) == 0)
+            (void) SetLogEventMask(argv[++arg]);
+          else if (LocaleCompare("log",option+1) == 0)
+            (void) SetLogFormat(argv[++arg]);
+          else
+            {
+              (void) printf("Unrecognized option %s\n",option);
+              exit_status = 1;
+              goto program_exit;
+            }
+        }
+      else
+        break;
+    }
+  if (arg != argc-2)
+    {
+      (void) printf ( "Usage: %s [-debug events -log format] infile operation\n", argv[0] );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  (void) strncpy(infile, argv[arg], MaxTextExtent );
+  infile[MaxTextExtent-1]='\0';
+  arg++;
+  operation=argv[arg];
+
+  /*
+   * Read original image
+   */
+  (void) strncpy( imageInfo->filename, infile, MaxTextExtent );
+  imageInfo->filename[MaxTextExtent-1]='\0';
+  original = ReadImage ( imageInfo, &exception );
+  if (exception.severity != UndefinedException)
+    CatchException(&exception);
+  if ( original == (Image *)NULL )
+    {
+      (void) printf ( "Failed to read original image %s\n", imageInfo->filename );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  /*
+   * Apply the operation with less memory than the enlarged image needs
+   */
+  memory_limit=GetMagickResourceLimit(MemoryResource);
+  (void) SetMagickResourceLimit(MemoryResource,
+                                GetMagickResource(MemoryResource)+
+                                (magick_int64_t) original->columns*
+                                original->rows*ScaleFactor*ScaleFactor*
+                                (sizeof(PixelPacket)+sizeof(IndexPacket))/8*7);
+  result = ApplyOperation( original, operation, &exception );
+  (void) SetMagickResourceLimit(MemoryResource,memory_limit);
+  if ( result == (Image *)NULL )
+    {
+      CatchException(&exception);
+      (void) printf ( "Failed to %s image with limited memory\n", operation );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  reference = ApplyOperation( original, operation, &exception );
+  if ( reference == (Image *)NULL )
+    {
+      CatchException(&exception);
+      (void) printf ( "Failed to %s image\n", operation );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  /*
+   * Compare with the in-memory result
+   */
+  if ( !IsImagesEqual(result, reference ) ||
+       (result->error.mean_error_per_pixel != 0.0) )
+    {
+      (void) printf( "%s with limited memory differs: mean error %g\n",
+                     operation, result->error.mean_error_per_pixel );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+ program_exit:
+  if (result)
+    DestroyImage( result );
+  if (reference)
+    DestroyImage( reference );
+  if (original)
+    DestroyImageList( original );
+  DestroyImageInfo( imageInfo );
+  DestroyExceptionInfo( &exception );
+  DestroyMagick();
+
+  return exit_status;
+}
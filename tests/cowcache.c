@@ -0,0 +1,340 @@
+/*
+ *
+ * Check that an image and its clones do not see each other's pixel
+ * updates when they started out sharing the pixel cache.
+ *
+ * A large in-memory image is cloned, and the clone of the clone, and a
+ * small region of each image is then updated.  The updates must only be
+ * visible in the image they were made to.  The time taken by the first
+ * update of each clone (which copies the pixel cache) is reported, and so
+ * is the growth of the peak resident memory due to the updates where the
+ * system provides it.
+ *
+ */
+
+#include <magick/studio.h>
+#include <magick/api.h>
+#include <magick/timer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PixelValue(x,y,k) ((Quantum) (((x)*7+(y)*13+(k)) % (MaxRGB+1)))
+
+/*
+  Update a region of the image so that it can be recognized by
+  CheckImage().
+*/
+static MagickPassFail MarkImage(Image *image,const long x,const long y,
+                                const Quantum value,ExceptionInfo *exception)
+{
+  PixelPacket
+    *q;
+
+  long
+    i;
+
+  q=GetImagePixelsEx(image,x,y,16,16,exception);
+  if (q == (PixelPacket *) NULL)
+    return MagickFail;
+  for (i=0; i < 16*16; i++)
+    q[i].opacity=value;
+  return SyncImagePixelsEx(image,exception);
+}
+
+/*
+  Count the pixels which differ from the expected pattern, where the
+  regions at the given offsets have the given opacity.
+*/
+static long CheckImage(const Image *image,const long *marks,
+                       const Quantum *values,const unsigned int nmarks,
+                       ExceptionInfo *exception)
+{
+  long
+    failures = 0,
+    x,
+    y;
+
+  unsigned int
+    i;
+
+  for (y=0; y < (long) image->rows; y++)
+    {
+      const PixelPacket
+        *p;
+
+      p=AcquireImagePixels(image,0,y,image->columns,1,exception);
+      if (p == (const PixelPacket *) NULL)
+        return (long) image->rows;
+      for (x=0; x < (long) image->columns; x++)
+        {
+          Quantum
+            opacity = OpaqueOpacity;
+
+          for (i=0; i < nmarks; i++)
+            if ((x >= marks[i]) && (x < marks[i]+16) &&
+                (y >= marks[i]) && (y < marks[i]+16))
+              opacity=values[i];
+          if ((p[x].red != PixelValue(x,y,0)) ||
+              (p[x].green != PixelValue(x,y,1)) ||
+              (p[x].blue != PixelValue(x,y,2)) ||
+              (p[x].opacity != opacity))
+            failures++;
+        }
+    }
+  return failures;
+}
+
+/*
+  Return the peak resident memory of the process in kilobytes, or -1 if it
+  is not known.
+*/
+static long PeakResidentMemory(void)
+{
+  char
+    line[MaxTextExtent];
+
+  FILE
+    *file;
+
+  long
+    peak = -1;
+
+  file=fopen("/proc/self/status","r");
+  if (file == (FILE *) NULL)
+    return -1;
+  while (fgets(line,sizeof(line),file) != (char *) NULL)
+    if (LocaleNCompare("VmHWM:",line,6) == 0)
+      {
+        peak=MagickAtoL(line+6);
+        break;
+      }
+  (void) fclose(file);
+  return peak;
+}
+
+int main ( int argc, char **argv )
+{
+  Image
+    *clone = (Image *) NULL,
+    *clone_clone = (Image *) NULL,
+    *image = (Image *) NULL;
+
+  ImageInfo
+    *imageInfo;
+
+  ExceptionInfo
+    exception;
+
+  TimerInfo
+    timer;
+
+  int
+    arg = 1,
+    exit_status = 0;
+
+  long
+    failures,
+    marks[3],
+    peak_memory,
+    x,
+    y;
+
+  Quantum
+    values[3];
+
+  unsigned long
+    columns = 1200,
+    rows = 1000;
+
+  if (LocaleNCompare("cowcache",argv[0],8) == 0)
+    InitializeMagick((char *) NULL);
+  else
+    InitializeMagick(*argv);
+
+  imageInfo=CloneImageInfo(0);
+  GetExceptionInfo( &exception );
+
+  for (arg=1; arg < argc; arg++)
+    {
+      char
+        *option = argv[arg];
+
+      if (*option == '-')
+        {
+          if (LocaleCompare("debug",option+1) == 0)
+            (void) SetLogEventMask(argv[++arg]);
+          else if (LocaleCompare("log",option+1) == 0)
+            (void) SetLogFormat(argv[++arg]);
+          else
+            {
+              (void) printf("Unrecognized option %s\n",option);
+              exit_status = 1;
+              goto program_exit;
+            }
+        }
+      else
+        break;
+    }
+  if (arg == argc-2)
+    {
+      columns=(unsigned long) MagickAtoL(argv[arg]);
+      rows=(unsigned long) MagickAtoL(argv[arg+1]);
+    }
+  else if (arg != argc)
+    {
+      (void) printf ( "Usage: %s [-debug events -log format] [columns rows]\n", argv[0] );
+      exit_status = 1;
+      goto program_exit;
+    }
+  if ((columns < 64) || (rows < 64))
+    {
+      (void) printf ( "Image must be at least 64x64\n" );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  image=AllocateImage(imageInfo);
+  if ( image == (Image *) NULL )
+    {
+      (void) printf ( "Failed to allocate image\n" );
+      exit_status = 1;
+      goto program_exit;
+    }
+  image->columns=columns;
+  image->rows=rows;
+  for (y=0; y < (long) image->rows; y++)
+    {
+      PixelPacket
+        *q;
+
+      q=SetImagePixelsEx(image,0,y,image->columns,1,&exception);
+      if (q == (PixelPacket *) NULL)
+        break;
+      for (x=0; x < (long) image->columns; x++)
+        {
+          q[x].red=PixelValue(x,y,0);
+          q[x].green=PixelValue(x,y,1);
+          q[x].blue=PixelValue(x,y,2);
+          q[x].opacity=OpaqueOpacity;
+        }
+      if (!SyncImagePixelsEx(image,&exception))
+        break;
+    }
+  if (y != (long) image->rows)
+    {
+      (void) printf ( "Failed to initialize image\n" );
+      CatchException(&exception);
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  clone=CloneImage(image,0,0,MagickTrue,&exception);
+  if ( clone == (Image *) NULL )
+    {
+      (void) printf ( "Failed to clone image\n" );
+      CatchException(&exception);
+      exit_status = 1;
+      goto program_exit;
+    }
+  clone_clone=CloneImage(clone,0,0,MagickTrue,&exception);
+  if ( clone_clone == (Image *) NULL )
+    {
+      (void) printf ( "Failed to clone clone image\n" );
+      CatchException(&exception);
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  /*
+   * Update each image in turn, the first update of each detaches it from
+   * the shared pixel cache.
+   */
+  marks[0]=0;
+  marks[1]=24;
+  marks[2]=48;
+  values[0]=TransparentOpacity;
+  values[1]=MaxRGB/2;
+  values[2]=MaxRGB/3;
+  peak_memory=PeakResidentMemory();
+  GetTimerInfo(&timer);
+  if (!MarkImage(clone,marks[1],marks[1],values[1],&exception))
+    exit_status = 1;
+  (void) printf ( "first update of clone        %9.3f ms\n",
+                  1.0e3*GetElapsedTime(&timer) );
+  GetTimerInfo(&timer);
+  if (!MarkImage(clone_clone,marks[2],marks[2],values[2],&exception))
+    exit_status = 1;
+  (void) printf ( "first update of clone clone  %9.3f ms\n",
+                  1.0e3*GetElapsedTime(&timer) );
+  if (!MarkImage(image,marks[0],marks[0],values[0],&exception))
+    exit_status = 1;
+  if ((peak_memory >= 0) && (PeakResidentMemory() >= 0))
+    (void) printf ( "peak resident memory grew by %ld KiB\n",
+                    PeakResidentMemory()-peak_memory );
+  if (exit_status != 0)
+    {
+      (void) printf ( "Failed to update images\n" );
+      CatchException(&exception);
+      goto program_exit;
+    }
+
+  failures=CheckImage(image,&marks[0],&values[0],1,&exception);
+  if (failures != 0)
+    {
+      (void) printf ( "%ld pixels of the original image are wrong\n",
+                      failures );
+      exit_status = 1;
+    }
+  failures=CheckImage(clone,&marks[1],&values[1],1,&exception);
+  if (failures != 0)
+    {
+      (void) printf ( "%ld pixels of the clone are wrong\n", failures );
+      exit_status = 1;
+    }
+  failures=CheckImage(clone_clone,&marks[2],&values[2],1,&exception);
+  if (failures != 0)
+    {
+      (void) printf ( "%ld pixels of the clone of the clone are wrong\n",
+                      failures );
+      exit_status = 1;
+    }
+
+  /*
+   * A second round of updates must stay private too.
+   */
+  if (!MarkImage(clone,marks[2],marks[2],values[1],&exception) ||
+      !MarkImage(image,marks[1],marks[1],values[0],&exception))
+    {
+      (void) printf ( "Failed to update images\n" );
+      CatchException(&exception);
+      exit_status = 1;
+      goto program_exit;
+    }
+  values[2]=values[1];
+  failures=CheckImage(clone,&marks[1],&values[1],2,&exception);
+  values[1]=values[0];
+  failures+=CheckImage(image,&marks[0],&values[0],2,&exception);
+  if (failures != 0)
+    {
+      (void) printf ( "%ld pixels are wrong after the second update\n",
+                      failures );
+      exit_status = 1;
+    }
+  if (exception.severity != UndefinedException)
+    CatchException(&exception);
+
+ program_exit:
+  if (clone_clone)
+    DestroyImage( clone_clone );
+  if (clone)
+    DestroyImage( clone );
+  if (image)
+    DestroyImage( image );
+  DestroyImageInfo( imageInfo );
+  DestroyExceptionInfo( &exception );
+  DestroyMagick();
+
+  return exit_status;
+}
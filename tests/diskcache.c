@@ -0,0 +1,221 @@
+/*
+ *
+ * Check the I/O statistics of disk and memory-mapped pixel caches.
+ *
+ * The memory resource limit is set too small for the image to be held in
+ * memory (or in a compressed cache), and the map resource limit too small
+ * (for a disk cache) or large enough (for a memory-mapped cache) to map
+ * it.  The image is then written, read back and destroyed.  The cache statistics are logged when
+ * the cache is destroyed, and the logged byte counts must show that the
+ * pixels were both written and read through the requested kind of cache.
+ *
+ */
+
+#include <magick/studio.h>
+#include <magick/api.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PixelValue(x,y,k) ((Quantum) (((x)*7+(y)*13+(k)*17) % (MaxRGB+1)))
+
+static const char
+  *cache_kind = "disk";
+
+static unsigned long
+  statistics_found = 0;
+
+static magick_uint64_t
+  bytes_read = 0,
+  bytes_written = 0;
+
+/*
+  Pick the statistics of the requested kind of cache out of the log.
+*/
+static void RecordCacheStatistics(const ExceptionType type,
+                                  const char *message)
+{
+  char
+    pattern[MaxTextExtent];
+
+  const char
+    *p;
+
+  unsigned long
+    reads,
+    read_bytes,
+    writes,
+    write_bytes;
+
+  ARG_NOT_USED(type);
+  FormatString(pattern,": %s cache ",cache_kind);
+  p=strstr(message,pattern);
+  if (p == (const char *) NULL)
+    return;
+  if (sscanf(p+strlen(pattern),"%lu reads (%lu bytes,",&reads,
+             &read_bytes) != 2)
+    return;
+  p=strstr(p,"waiting), ");
+  if ((p == (const char *) NULL) ||
+      (sscanf(p+10,"%lu writes (%lu bytes,",&writes,&write_bytes) != 2))
+    return;
+  statistics_found++;
+  bytes_read+=read_bytes;
+  bytes_written+=write_bytes;
+}
+
+int main ( int argc, char **argv )
+{
+  Image
+    *image = (Image *) NULL;
+
+  ImageInfo
+    *imageInfo;
+
+  ExceptionInfo
+    exception;
+
+  int
+    arg = 1,
+    exit_status = 0;
+
+  long
+    failures = 0,
+    x,
+    y;
+
+  if (LocaleNCompare("diskcache",argv[0],9) == 0)
+    InitializeMagick((char *) NULL);
+  else
+    InitializeMagick(*argv);
+
+  imageInfo=CloneImageInfo(0);
+  GetExceptionInfo( &exception );
+
+  for (arg=1; arg < argc; arg++)
+    {
+      char
+        *option = argv[arg];
+
+      if (*option == '-')
+        {
+          if (LocaleCompare("log",option+1) == 0)
+            (void) SetLogFormat(argv[++arg]);
+          else
+            {
+              (void) printf("Unrecognized option %s\n",option);
+              exit_status = 1;
+              goto program_exit;
+            }
+        }
+      else
+        break;
+    }
+  if ((arg != argc-1) ||
+      ((LocaleCompare("disk",argv[arg]) != 0) &&
+       (LocaleCompare("map",argv[arg]) != 0)))
+    {
+      (void) printf ( "Usage: %s [-log format] disk|map\n", argv[0] );
+      exit_status = 1;
+      goto program_exit;
+    }
+  cache_kind=LocaleCompare("disk",argv[arg]) == 0 ? "disk" : "map";
+
+  /* enough for the nexus staging areas but not for the image */
+  (void) SetMagickResourceLimit(MemoryResource,64*1024);
+  (void) SetMagickResourceLimit(MapResource,
+                                LocaleCompare("disk",cache_kind) == 0 ? 1 :
+                                1024*1024*1024);
+  (void) SetLogEventMask("cache");
+  SetLogMethod(RecordCacheStatistics);
+
+  image=AllocateImage(imageInfo);
+  if ( image == (Image *) NULL )
+    {
+      (void) printf ( "Failed to allocate image\n" );
+      exit_status = 1;
+      goto program_exit;
+    }
+  image->columns=640;
+  image->rows=480;
+
+  /*
+   * Write the pixels, then read and check them
+   */
+  for (y=0; y < (long) image->rows; y++)
+    {
+      PixelPacket
+        *q;
+
+      q=SetImagePixelsEx(image,0,y,image->columns,1,&exception);
+      if (q == (PixelPacket *) NULL)
+        {
+          failures++;
+          break;
+        }
+      for (x=0; x < (long) image->columns; x++)
+        {
+          q[x].red=PixelValue(x,y,0);
+          q[x].green=PixelValue(x,y,1);
+          q[x].blue=PixelValue(x,y,2);
+          q[x].opacity=OpaqueOpacity;
+        }
+      if (!SyncImagePixelsEx(image,&exception))
+        failures++;
+    }
+  for (y=0; y < (long) image->rows; y++)
+    {
+      const PixelPacket
+        *p;
+
+      p=AcquireImagePixels(image,0,y,image->columns,1,&exception);
+      if (p == (const PixelPacket *) NULL)
+        {
+          failures++;
+          break;
+        }
+      for (x=0; x < (long) image->columns; x++)
+        if ((p[x].red != PixelValue(x,y,0)) ||
+            (p[x].green != PixelValue(x,y,1)) ||
+            (p[x].blue != PixelValue(x,y,2)))
+          failures++;
+    }
+  if (exception.severity != UndefinedException)
+    CatchException(&exception);
+  DestroyImage(image);
+  image=(Image *) NULL;
+
+  if (failures != 0)
+    {
+      (void) printf ( "%ld pixel cache requests failed or returned wrong pixels\n",
+                      failures );
+      exit_status = 1;
+    }
+  else if (statistics_found == 0)
+    {
+      (void) printf ( "No %s cache statistics were logged\n", cache_kind );
+      exit_status = 1;
+    }
+  else if ((bytes_read == 0) || (bytes_written == 0))
+    {
+      (void) printf ( "The %s cache statistics show %lu bytes read and"
+                      " %lu bytes written\n", cache_kind,
+                      (unsigned long) bytes_read,
+                      (unsigned long) bytes_written );
+      exit_status = 1;
+    }
+  else
+    (void) printf ( "%s cache: %lu bytes read, %lu bytes written\n",
+                    cache_kind, (unsigned long) bytes_read,
+                    (unsigned long) bytes_written );
+
+ program_exit:
+  if (image)
+    DestroyImage( image );
+  DestroyImageInfo( imageInfo );
+  DestroyExceptionInfo( &exception );
+  DestroyMagick();
+
+  return exit_status;
+}
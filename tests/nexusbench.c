@@ -0,0 +1,279 @@
+/*
+ *
+ * Measure the per-call overhead of the pixel cache nexus functions and
+ * check that the pixels written through them read back correctly.
+ *
+ * Each benchmark visits every pixel of an in-memory image, either a row
+ * or a single pixel per call, and reports the average time per call.
+ * Single pixel requests are dominated by the fixed cost of a call.  The
+ * test fails if pixels are wrong, or if updating a pixel of an image which
+ * owns its cache costs more than MaximumUpdateRatio times reading it: the
+ * update should only add the synchronization and the check that the cache
+ * need not be copied.  The fastest rows of the two are compared, since a
+ * single row is rarely interrupted by the other processes of a parallel
+ * test run.
+ *
+ */
+
+#include <magick/studio.h>
+#include <magick/api.h>
+#include <magick/timer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PixelValue(x,y,k) ((Quantum) (((x)*7+(y)*13+(k)) % (MaxRGB+1)))
+#define MaximumUpdateRatio 4.0
+
+static void ReportTime(const char *benchmark,TimerInfo *timer,
+                       const double calls)
+{
+  double
+    elapsed;
+
+  elapsed=GetElapsedTime(timer);
+  (void) printf("%-28s %10.0f calls %9.1f ns/call\n",benchmark,calls,
+                calls > 0.0 ? 1.0e9*elapsed/calls : 0.0);
+}
+
+int main ( int argc, char **argv )
+{
+  Image
+    *image = (Image *) NULL;
+
+  ImageInfo
+    *imageInfo;
+
+  ExceptionInfo
+    exception;
+
+  TimerInfo
+    row_timer,
+    timer;
+
+  double
+    read_time = 0.0,
+    update_time = 0.0;
+
+  int
+    arg = 1,
+    exit_status = 0;
+
+  long
+    failures,
+    x,
+    y;
+
+  unsigned long
+    columns = 512,
+    rows = 512;
+
+  if (LocaleNCompare("nexusbench",argv[0],10) == 0)
+    InitializeMagick((char *) NULL);
+  else
+    InitializeMagick(*argv);
+
+  imageInfo=CloneImageInfo(0);
+  GetExceptionInfo( &exception );
+
+  for (arg=1; arg < argc; arg++)
+    {
+      char
+        *option = argv[arg];
+
+      if (*option == '-')
+        {
+          if (LocaleCompare("debug",option+1) == 0)
+            (void) SetLogEventMask(argv[++arg]);
+          else if (LocaleCompare("log",option+1) == 0)
+            (void) SetLogFormat(argv[++arg]);
+          else
+            {
+              (void) printf("Unrecognized option %s\n",option);
+              exit_status = 1;
+              goto program_exit;
+            }
+        }
+      else
+        break;
+    }
+  if (arg == argc-2)
+    {
+      columns=(unsigned long) MagickAtoL(argv[arg]);
+      rows=(unsigned long) MagickAtoL(argv[arg+1]);
+    }
+  else if (arg != argc)
+    {
+      (void) printf ( "Usage: %s [-debug events -log format] [columns rows]\n", argv[0] );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  image=AllocateImage(imageInfo);
+  if ( image == (Image *) NULL )
+    {
+      (void) printf ( "Failed to allocate image\n" );
+      exit_status = 1;
+      goto program_exit;
+    }
+  image->columns=columns;
+  image->rows=rows;
+
+  /*
+   * Write every row
+   */
+  failures=0;
+  GetTimerInfo(&timer);
+  for (y=0; y < (long) image->rows; y++)
+    {
+      PixelPacket
+        *q;
+
+      q=SetImagePixelsEx(image,0,y,image->columns,1,&exception);
+      if (q == (PixelPacket *) NULL)
+        {
+          failures++;
+          break;
+        }
+      for (x=0; x < (long) image->columns; x++)
+        {
+          q[x].red=PixelValue(x,y,0);
+          q[x].green=PixelValue(x,y,1);
+          q[x].blue=PixelValue(x,y,2);
+          q[x].opacity=OpaqueOpacity;
+        }
+      if (!SyncImagePixelsEx(image,&exception))
+        failures++;
+    }
+  ReportTime("SetImagePixelsEx row",&timer,(double) image->rows);
+
+  /*
+   * Update every pixel, one call per pixel
+   */
+  GetTimerInfo(&timer);
+  for (y=0; y < (long) image->rows; y++)
+    {
+      GetTimerInfo(&row_timer);
+      for (x=0; x < (long) image->columns; x++)
+        {
+          PixelPacket
+            *q;
+
+          q=GetImagePixelsEx(image,x,y,1,1,&exception);
+          if (q == (PixelPacket *) NULL)
+            {
+              failures++;
+              continue;
+            }
+          q->opacity=q->red;
+          if (!SyncImagePixelsEx(image,&exception))
+            failures++;
+        }
+      if ((y == 0) || (GetElapsedTime(&row_timer) < update_time))
+        update_time=GetElapsedTime(&row_timer);
+    }
+  ReportTime("GetImagePixelsEx pixel",&timer,
+             (double) image->columns*image->rows);
+
+  /*
+   * Update every row from all threads
+   */
+  GetTimerInfo(&timer);
+#if defined(HAVE_OPENMP)
+#  pragma omp parallel for schedule(static,1) reduction(+:failures)
+#endif
+  for (y=0; y < (long) image->rows; y++)
+    {
+      PixelPacket
+        *q;
+
+      long
+        i;
+
+      q=GetImagePixelsEx(image,0,y,image->columns,1,&exception);
+      if (q == (PixelPacket *) NULL)
+        {
+          failures++;
+          continue;
+        }
+      for (i=0; i < (long) image->columns; i++)
+        q[i].opacity=(Quantum) (MaxRGB-q[i].opacity);
+      if (!SyncImagePixelsEx(image,&exception))
+        failures++;
+    }
+  ReportTime("GetImagePixelsEx row (omp)",&timer,(double) image->rows);
+
+  /*
+   * Read every pixel, one call per pixel
+   */
+  GetTimerInfo(&timer);
+  for (y=0; y < (long) image->rows; y++)
+    {
+      GetTimerInfo(&row_timer);
+      for (x=0; x < (long) image->columns; x++)
+        {
+          const PixelPacket
+            *p;
+
+          p=AcquireImagePixels(image,x,y,1,1,&exception);
+          if ((p == (const PixelPacket *) NULL) ||
+              (p->red != PixelValue(x,y,0)) ||
+              (p->green != PixelValue(x,y,1)) ||
+              (p->blue != PixelValue(x,y,2)) ||
+              (p->opacity != (Quantum) (MaxRGB-PixelValue(x,y,0))))
+            failures++;
+        }
+      if ((y == 0) || (GetElapsedTime(&row_timer) < read_time))
+        read_time=GetElapsedTime(&row_timer);
+    }
+  ReportTime("AcquireImagePixels pixel",&timer,
+             (double) image->columns*image->rows);
+
+  /*
+   * Read every column (these are staged)
+   */
+  GetTimerInfo(&timer);
+  for (x=0; x < (long) image->columns; x++)
+    {
+      const PixelPacket
+        *p;
+
+      p=AcquireImagePixels(image,x,0,1,image->rows,&exception);
+      if (p == (const PixelPacket *) NULL)
+        {
+          failures++;
+          continue;
+        }
+      for (y=0; y < (long) image->rows; y++)
+        if (p[y].green != PixelValue(x,y,1))
+          failures++;
+    }
+  ReportTime("AcquireImagePixels column",&timer,(double) image->columns);
+
+  if (exception.severity != UndefinedException)
+    CatchException(&exception);
+  if (failures != 0)
+    {
+      (void) printf ( "%ld pixel cache requests failed or returned wrong pixels\n",
+                      failures );
+      exit_status = 1;
+    }
+  if (update_time > MaximumUpdateRatio*read_time)
+    {
+      (void) printf ( "Updating a pixel costs %.1f times reading it"
+                      " (fastest rows took %.1f and %.1f us)\n",
+                      update_time/read_time, 1.0e6*update_time,
+                      1.0e6*read_time );
+      exit_status = 1;
+    }
+
+ program_exit:
+  if (image)
+    DestroyImage( image );
+  DestroyImageInfo( imageInfo );
+  DestroyExceptionInfo( &exception );
+  DestroyMagick();
+
+  return exit_status;
+}
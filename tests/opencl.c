@@ -0,0 +1,745 @@
+/*
+ *
+ * Test the OpenCL acceleration paths against the CPU implementation.
+ *
+ * The input image is first enlarged on the CPU so that it is larger than
+ * the minimum number of pixels which is worth sending to a device.  The
+ * named operation is then applied with OpenCL disabled and again with
+ * OpenCL enabled.  The kernels compute in single precision so the two
+ * results only have to agree within a tolerance.  The kernel profile
+ * records of the devices must show that a kernel ran for the second
+ * result, otherwise both results came from the CPU.  The kernels are
+ * built for the quantum depth of the library, so the test checks that
+ * depth.
+ *
+ * The test exits with status 77, which the test script reports as
+ * skipped, when the library is built without OpenCL or when there is no
+ * OpenCL device.  The -list option prints the names of the operations.
+ *
+ * With the -cpu option the operation must not run a kernel, which checks
+ * that the cost model keeps it on the CPU; -small skips the enlargement.
+ * With -profile the trace which the library writes to the file named by
+ * MAGICK_OCL_PROFILE must be well formed JSON with kernel and transfer
+ * events.
+ *
+ */
+
+#include <magick/studio.h>
+#include <magick/api.h>
+#include <magick/enum_strings.h>
+#if defined(HAVE_OPENCL)
+#include <magick/im_common.h>
+#include <magick/opencl.h>
+#endif
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MinimumDimension 512
+
+typedef Image
+  *(*OperationMethod)(const Image *,const char *,ExceptionInfo *);
+
+static Image *ApplyFilter(const Image *image,const char *filter,
+                          ExceptionInfo *exception)
+{
+  if (LocaleCompare("blur",filter) == 0)
+    return BlurImage(image,0.0,1.5,exception);
+  if (LocaleCompare("convolve",filter) == 0)
+    {
+      static const double
+        kernel[] =
+        {
+          -1.0, -1.0, -1.0, -1.0, -1.0,
+          -1.0,  1.0,  2.0,  1.0, -1.0,
+          -1.0,  2.0, 16.0,  2.0, -1.0,
+          -1.0,  1.0,  2.0,  1.0, -1.0,
+          -1.0, -1.0, -1.0, -1.0, -1.0
+        };
+
+      return ConvolveImage(image,5,kernel,exception);
+    }
+  if (LocaleCompare("despeckle",filter) == 0)
+    return DespeckleImage(image,exception);
+  if (LocaleCompare("edge",filter) == 0)
+    return EdgeImage(image,2.0,exception);
+  if (LocaleCompare("emboss",filter) == 0)
+    return EmbossImage(image,2.0,1.0,exception);
+  if (LocaleCompare("gaussian",filter) == 0)
+    return GaussianBlurImage(image,0.0,1.5,exception);
+  if (LocaleCompare("motionblur",filter) == 0)
+    return MotionBlurImage(image,6.0,3.0,30.0,exception);
+  if (LocaleCompare("unsharp",filter) == 0)
+    return UnsharpMaskImage(image,0.0,1.0,1.0,0.0,exception);
+  if (LocaleCompare("unsharp-wide",filter) == 0)
+    return UnsharpMaskImage(image,0.0,5.0,1.0,0.0,exception);
+  return SharpenImage(image,3.0,1.5,exception);
+}
+
+static Image *ApplyTransform(const Image *image,const char *transform,
+                             ExceptionInfo *exception)
+{
+  if (LocaleCompare("affine",transform) == 0)
+    {
+      AffineMatrix
+        affine;
+
+      affine.sx=0.9;
+      affine.rx=0.25;
+      affine.ry=-0.3;
+      affine.sy=1.1;
+      affine.tx=0.0;
+      affine.ty=0.0;
+      return AffineTransformImage(image,&affine,exception);
+    }
+  return RotateImage(image,MagickAtoF(transform),exception);
+}
+
+/*
+  Composite a partially transparent, flopped copy of the image over its
+  bottom right.
+*/
+static Image *ApplyComposite(const Image *image,const char *compose,
+                             ExceptionInfo *exception)
+{
+  Image
+    *canvas,
+    *change;
+
+  change=FlopImage(image,exception);
+  if (change == (Image *) NULL)
+    return (Image *) NULL;
+  (void) SetImageOpacity(change,MaxRGB/3);
+  canvas=CloneImage(image,0,0,MagickTrue,exception);
+  if ((canvas != (Image *) NULL) &&
+      (CompositeImage(canvas,StringToCompositeOperator(compose),change,
+                      (long) image->columns/4,(long) image->rows/4)
+       == MagickFail))
+    {
+      CopyException(exception,&canvas->exception);
+      DestroyImage(canvas);
+      canvas=(Image *) NULL;
+    }
+  DestroyImage(change);
+  return canvas;
+}
+
+static Image *ApplyEnhance(const Image *image,const char *enhance,
+                           ExceptionInfo *exception)
+{
+  Image
+    *enhanced;
+
+  MagickPassFail
+    status;
+
+  enhanced=CloneImage(image,0,0,MagickTrue,exception);
+  if (enhanced == (Image *) NULL)
+    return (Image *) NULL;
+  if (LocaleCompare("contrast",enhance) == 0)
+    status=ContrastImage(enhanced,MagickTrue);
+  else if (LocaleCompare("dull",enhance) == 0)
+    status=ContrastImage(enhanced,MagickFalse);
+  else if (LocaleCompare("equalize",enhance) == 0)
+    status=EqualizeImage(enhanced);
+  else if (LocaleCompare("grayscale",enhance) == 0)
+    status=TransformColorspace(enhanced,GRAYColorspace);
+  else if (LocaleCompare("modulate",enhance) == 0)
+    status=ModulateImage(enhanced,"110,80,95");
+  else
+    status=NormalizeImage(enhanced);
+  if (status == MagickFail)
+    {
+      CopyException(exception,&enhanced->exception);
+      DestroyImage(enhanced);
+      return (Image *) NULL;
+    }
+  return enhanced;
+}
+
+static Image *ApplyResize(const Image *image,const char *filter,
+                          const double factor,ExceptionInfo *exception)
+{
+  return ResizeImage(image,(unsigned long) (factor*image->columns+0.5),
+                     (unsigned long) (factor*image->rows+0.5),
+                     StringToFilterTypes(filter),1.0,exception);
+}
+
+static Image *ApplyEnlarge(const Image *image,const char *filter,
+                           ExceptionInfo *exception)
+{
+  return ApplyResize(image,filter,1.5,exception);
+}
+
+static Image *ApplyReduce(const Image *image,const char *filter,
+                          ExceptionInfo *exception)
+{
+  return ApplyResize(image,filter,0.5,exception);
+}
+
+static Image *ApplyScale(const Image *image,const char *factor,
+                          ExceptionInfo *exception)
+{
+  return ScaleImage(image,
+                    (unsigned long) (MagickAtoF(factor)*image->columns+0.5),
+                    (unsigned long) (MagickAtoF(factor)*image->rows+0.5),
+                    exception);
+}
+
+static const struct
+{
+  const char
+    *name;
+
+  OperationMethod
+    method;
+
+  const char
+    *argument;
+
+  double
+    mean_error,
+    maximum_error;
+
+  MagickBool
+    interior;           /* only compare the middle of the results */
+} Operations[] =
+{
+  { "blur", ApplyFilter, "blur", 1.0e-3, 0.01 },
+  { "convolve", ApplyFilter, "convolve", 1.0e-3, 0.02 },
+  { "despeckle", ApplyFilter, "despeckle", 1.0e-3, 0.02 },
+  { "edge", ApplyFilter, "edge", 1.0e-3, 0.02 },
+  { "emboss", ApplyFilter, "emboss", 1.0e-3, 0.02 },
+  { "gaussian", ApplyFilter, "gaussian", 1.0e-3, 0.01 },
+  { "motionblur", ApplyFilter, "motionblur", 1.0e-3, 0.02 },
+  { "sharpen", ApplyFilter, "sharpen", 1.0e-3, 0.02 },
+  { "unsharp", ApplyFilter, "unsharp", 1.0e-3, 0.02 },
+  { "unsharp-wide", ApplyFilter, "unsharp-wide", 1.0e-3, 0.02 },
+  { "affine", ApplyTransform, "affine", 1.0e-3, 0.02 },
+  { "deskew", ApplyTransform, "-2.5", 1.0e-3, 0.02, MagickTrue },
+  { "rotate", ApplyTransform, "37", 1.0e-3, 0.02, MagickTrue },
+  { "composite-over", ApplyComposite, "Over", 1.0e-3, 0.02 },
+  { "composite-in", ApplyComposite, "In", 1.0e-3, 0.02 },
+  { "composite-out", ApplyComposite, "Out", 1.0e-3, 0.02 },
+  { "composite-atop", ApplyComposite, "Atop", 1.0e-3, 0.02 },
+  { "composite-xor", ApplyComposite, "Xor", 1.0e-3, 0.02 },
+  { "composite-plus", ApplyComposite, "Plus", 1.0e-3, 0.02 },
+  { "composite-minus", ApplyComposite, "Minus", 1.0e-3, 0.02 },
+  { "composite-add", ApplyComposite, "Add", 1.0e-3, 0.02 },
+  { "composite-subtract", ApplyComposite, "Subtract", 1.0e-3, 0.02 },
+  { "composite-difference", ApplyComposite, "Difference", 1.0e-3, 0.02 },
+  { "composite-multiply", ApplyComposite, "Multiply", 1.0e-3, 0.02 },
+  { "composite-bumpmap", ApplyComposite, "Bumpmap", 1.0e-3, 0.02 },
+  { "composite-copy", ApplyComposite, "Copy", 1.0e-3, 0.02 },
+  { "composite-copyred", ApplyComposite, "CopyRed", 1.0e-3, 0.02 },
+  { "composite-copygreen", ApplyComposite, "CopyGreen", 1.0e-3, 0.02 },
+  { "composite-copyblue", ApplyComposite, "CopyBlue", 1.0e-3, 0.02 },
+  { "composite-copyopacity", ApplyComposite, "CopyOpacity", 1.0e-3, 0.02 },
+  { "composite-clear", ApplyComposite, "Clear", 1.0e-3, 0.02 },
+  { "composite-dissolve", ApplyComposite, "Dissolve", 1.0e-3, 0.02 },
+  { "composite-threshold", ApplyComposite, "Threshold", 1.0e-3, 0.02 },
+  { "composite-darken", ApplyComposite, "Darken", 1.0e-3, 0.02 },
+  { "composite-lighten", ApplyComposite, "Lighten", 1.0e-3, 0.02 },
+  { "composite-screen", ApplyComposite, "Screen", 1.0e-3, 0.02 },
+  { "composite-overlay", ApplyComposite, "Overlay", 1.0e-3, 0.02 },
+  { "composite-divide", ApplyComposite, "Divide", 1.0e-3, 0.02 },
+  { "composite-hardlight", ApplyComposite, "HardLight", 1.0e-3, 0.02 },
+  { "composite-exclusion", ApplyComposite, "Exclusion", 1.0e-3, 0.02 },
+  { "composite-colordodge", ApplyComposite, "ColorDodge", 1.0e-3, 0.02 },
+  { "composite-colorburn", ApplyComposite, "ColorBurn", 1.0e-3, 0.02 },
+  { "composite-softlight", ApplyComposite, "SoftLight", 1.0e-3, 0.02 },
+  { "composite-linearburn", ApplyComposite, "LinearBurn", 1.0e-3, 0.02 },
+  { "composite-lineardodge", ApplyComposite, "LinearDodge", 1.0e-3, 0.02 },
+  { "composite-linearlight", ApplyComposite, "LinearLight", 1.0e-3, 0.02 },
+  { "composite-vividlight", ApplyComposite, "VividLight", 1.0e-3, 0.02 },
+  { "composite-pinlight", ApplyComposite, "PinLight", 1.0e-3, 0.02 },
+  { "composite-hardmix", ApplyComposite, "HardMix", 1.0e-3, 0.02 },
+  { "contrast", ApplyEnhance, "contrast", 1.0e-3, 0.02 },
+  { "dull", ApplyEnhance, "dull", 1.0e-3, 0.02 },
+  { "equalize", ApplyEnhance, "equalize", 1.0e-3, 0.02 },
+  { "grayscale", ApplyEnhance, "grayscale", 1.0e-3, 0.02 },
+  { "modulate", ApplyEnhance, "modulate", 1.0e-3, 0.02 },
+  { "normalize", ApplyEnhance, "normalize", 1.0e-3, 0.02 },
+  { "enlarge-box", ApplyEnlarge, "Box", 1.0e-3, 0.02 },
+  { "enlarge-triangle", ApplyEnlarge, "Triangle", 1.0e-3, 0.02 },
+  { "enlarge-mitchell", ApplyEnlarge, "Mitchell", 1.0e-3, 0.02 },
+  { "enlarge-lanczos", ApplyEnlarge, "Lanczos", 1.0e-3, 0.02 },
+  { "reduce-box", ApplyReduce, "Box", 1.0e-3, 0.02 },
+  { "reduce-triangle", ApplyReduce, "Triangle", 1.0e-3, 0.02 },
+  { "reduce-mitchell", ApplyReduce, "Mitchell", 1.0e-3, 0.02 },
+  { "reduce-lanczos", ApplyReduce, "Lanczos", 1.0e-3, 0.02 },
+  { "scale", ApplyScale, "1.5", 1.0e-3, 0.02 },
+  { "scale-reduce", ApplyScale, "0.5", 1.0e-3, 0.02 }
+};
+
+#if defined(HAVE_OPENCL)
+/*
+  Replace the image with a centered square of the given size.  The device
+  rotates in one pass while the CPU uses three shears, so the anti-aliased
+  edges of the rotated image differ more than the resampled interior.
+*/
+static MagickPassFail CropInterior(Image **image,const unsigned long size,
+                                   ExceptionInfo *exception)
+{
+  Image
+    *interior;
+
+  RectangleInfo
+    geometry;
+
+  geometry.width=size;
+  geometry.height=size;
+  geometry.x=(long) ((*image)->columns-size)/2;
+  geometry.y=(long) ((*image)->rows-size)/2;
+  interior=CropImage(*image,&geometry,exception);
+  if (interior == (Image *) NULL)
+    return MagickFail;
+  DestroyImage(*image);
+  *image=interior;
+  return MagickPass;
+}
+
+/*
+  Count the kernels run by all devices since profiling was enabled.
+*/
+static unsigned long CountKernels(MagickCLDevice *devices,
+                                  const size_t number_devices)
+{
+  const KernelProfileRecord
+    *records;
+
+  size_t
+    i,
+    j,
+    length;
+
+  unsigned long
+    count = 0;
+
+  for (i=0; i < number_devices; i++)
+    {
+      records=GetOpenCLKernelProfileRecords(devices[i],&length);
+      for (j=0; j < length; j++)
+        count+=records[j]->count;
+    }
+  return count;
+}
+
+/*
+  Check the syntax of one JSON value and return the text after it, or NULL
+  if the value is malformed.
+*/
+static const char *SkipJSONSpace(const char *p)
+{
+  while ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r'))
+    p++;
+  return p;
+}
+
+static const char *ParseJSONValue(const char *p,const unsigned int depth)
+{
+  if (depth > 32)
+    return (const char *) NULL;
+  p=SkipJSONSpace(p);
+  if ((*p == '{') || (*p == '['))
+    {
+      const char
+        close = (*p == '{') ? '}' : ']';
+
+      MagickBool
+        object = (*p == '{');
+
+      p=SkipJSONSpace(p+1);
+      if (*p == close)
+        return p+1;
+      for ( ; ; )
+        {
+          if (object)
+            {
+              p=SkipJSONSpace(p);
+              if (*p != '"')
+                return (const char *) NULL;
+              p=ParseJSONValue(p,depth+1);
+              if (p == (const char *) NULL)
+                return (const char *) NULL;
+              p=SkipJSONSpace(p);
+              if (*p++ != ':')
+                return (const char *) NULL;
+            }
+          p=ParseJSONValue(p,depth+1);
+          if (p == (const char *) NULL)
+            return (const char *) NULL;
+          p=SkipJSONSpace(p);
+          if (*p == close)
+            return p+1;
+          if (*p++ != ',')
+            return (const char *) NULL;
+        }
+    }
+  if (*p == '"')
+    {
+      for (p++; *p != '"'; p++)
+        {
+          if ((unsigned char) *p < 0x20)
+            return (const char *) NULL;
+          if ((*p == '\\') && (*++p == '\0'))
+            return (const char *) NULL;
+        }
+      return p+1;
+    }
+  if ((*p == '-') || isdigit((int) ((unsigned char) *p)))
+    {
+      char
+        *end;
+
+      (void) strtod(p,&end);
+      return (end == p) ? (const char *) NULL : end;
+    }
+  if (strncmp(p,"true",4) == 0)
+    return p+4;
+  if (strncmp(p,"false",5) == 0)
+    return p+5;
+  if (strncmp(p,"null",4) == 0)
+    return p+4;
+  return (const char *) NULL;
+}
+
+/*
+  Check that the trace written to MAGICK_OCL_PROFILE is well formed JSON
+  and that it holds kernel and transfer events.  The trace is written when
+  the library is destroyed, so this may only use the C library.
+*/
+static int CheckProfileTrace(const char *filename)
+{
+  char
+    *trace;
+
+  const char
+    *end;
+
+  FILE
+    *file;
+
+  int
+    status = 0;
+
+  long
+    length;
+
+  file=fopen(filename,"rb");
+  if (file == (FILE *) NULL)
+    {
+      (void) printf ( "Failed to open the OpenCL profile %s\n", filename );
+      return 1;
+    }
+  trace=(char *) NULL;
+  if ((fseek(file,0,SEEK_END) == 0) && ((length=ftell(file)) > 0) &&
+      (fseek(file,0,SEEK_SET) == 0))
+    {
+      trace=(char *) malloc((size_t) length+1);
+      if ((trace != (char *) NULL) &&
+          (fread(trace,1,(size_t) length,file) == (size_t) length))
+        trace[length]='\0';
+      else
+        {
+          free(trace);
+          trace=(char *) NULL;
+        }
+    }
+  (void) fclose(file);
+  if (trace == (char *) NULL)
+    {
+      (void) printf ( "Failed to read the OpenCL profile %s\n", filename );
+      return 1;
+    }
+  end=ParseJSONValue(trace,0);
+  if ((end == (const char *) NULL) || (*SkipJSONSpace(end) != '\0') ||
+      (strncmp(SkipJSONSpace(trace),"{\"traceEvents\":[",15) != 0))
+    {
+      (void) printf ( "OpenCL profile %s is not a JSON trace\n", filename );
+      status=1;
+    }
+  else if (strstr(trace,"\"cat\":\"kernel\"") == (char *) NULL)
+    {
+      (void) printf ( "OpenCL profile %s has no kernel events\n", filename );
+      status=1;
+    }
+  else if (strstr(trace,"\"cat\":\"transfer\"") == (char *) NULL)
+    {
+      (void) printf ( "OpenCL profile %s has no transfer events\n", filename );
+      status=1;
+    }
+  free(trace);
+  return status;
+}
+#endif
+
+int main ( int argc, char **argv )
+{
+  Image
+    *accelerated = (Image *) NULL,
+    *original = (Image *) NULL,
+    *reference = (Image *) NULL;
+
+  char
+    infile[MaxTextExtent];
+
+  int
+    arg = 1,
+    exit_status = 0;
+
+  MagickBool
+    check_profile = MagickFalse,
+    expect_cpu = MagickFalse,
+    small = MagickFalse;
+
+  size_t
+    operation;
+
+  unsigned long
+    factor;
+
+  ImageInfo
+    *imageInfo;
+
+  ExceptionInfo
+    exception;
+
+#if defined(HAVE_OPENCL)
+  MagickCLDevice
+    *devices;
+
+  size_t
+    i,
+    number_devices = 0;
+
+  unsigned long
+    kernels;
+#endif
+
+  if (LocaleNCompare("opencl",argv[0],6) == 0)
+    InitializeMagick((char *) NULL);
+  else
+    InitializeMagick(*argv);
+
+  imageInfo=CloneImageInfo(0);
+  GetExceptionInfo( &exception );
+
+  for (arg=1; arg < argc; arg++)
+    {
+      char
+        *option = argv[arg];
+
+      if (*option == '-')
+        {
+          if (LocaleCompare("cpu",option+1) == 0)
+            expect_cpu=MagickTrue;
+          else if (LocaleCompare("debug",option+1) == 0)
+            (void) SetLogEventMask(argv[++arg]);
+          else if (LocaleCompare("list",option+1) == 0)
+            {
+              for (operation=0; operation < ArraySize(Operations); operation++)
+                (void) printf("%s\n",Operations[operation].name);
+              goto program_exit;
+            }
+          else if (LocaleCompare("log",option+1) == 0)
+            (void) SetLogFormat(argv[++arg]);
+          else if (LocaleCompare("profile",option+1) == 0)
+            check_profile=MagickTrue;
+          else if (LocaleCompare("small",option+1) == 0)
+            small=MagickTrue;
+          else
+            {
+              (void) printf("Unrecognized option %s\n",option);
+              exit_status = 1;
+              goto program_exit;
+            }
+        }
+      else
+        break;
+    }
+  if (arg != argc-2)
+    {
+      (void) printf ( "Usage: %s [-cpu -debug events -list -log format -profile -small] infile operation\n", argv[0] );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  (void) strncpy(infile, argv[arg], MaxTextExtent );
+  infile[MaxTextExtent-1]='\0';
+  arg++;
+  for (operation=0; operation < ArraySize(Operations); operation++)
+    if (LocaleCompare(Operations[operation].name,argv[arg]) == 0)
+      break;
+  if (operation == ArraySize(Operations))
+    {
+      (void) printf ( "Unrecognized operation %s\n", argv[arg] );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+#if defined(HAVE_OPENCL)
+  /*
+   * Profile the kernels of every device
+   */
+  (void) SetOpenCLEnabled(MagickTrue);
+  devices=GetOpenCLDevices(&number_devices,&exception);
+  if (number_devices == 0)
+    {
+      (void) printf ( "No OpenCL device is available\n" );
+      exit_status = 77;
+      goto program_exit;
+    }
+  for (i=0; i < number_devices; i++)
+    SetOpenCLKernelProfileEnabled(devices[i],MagickTrue);
+  (void) SetOpenCLEnabled(MagickFalse);
+
+  /*
+   * Read original image and enlarge it on the CPU
+   */
+  (void) strncpy( imageInfo->filename, infile, MaxTextExtent );
+  imageInfo->filename[MaxTextExtent-1]='\0';
+  original = ReadImage ( imageInfo, &exception );
+  if (exception.severity != UndefinedException)
+    CatchException(&exception);
+  if ( original == (Image *)NULL )
+    {
+      (void) printf ( "Failed to read original image %s\n", imageInfo->filename );
+      exit_status = 1;
+      goto program_exit;
+    }
+  factor=(MinimumDimension+Min(original->columns,original->rows)-1)/
+    Min(original->columns,original->rows);
+  if ((factor > 1) && !small)
+    {
+      Image
+        *enlarged;
+
+      enlarged = ResizeImage( original, factor*original->columns,
+                              factor*original->rows, TriangleFilter, 1.0,
+                              &exception );
+      if ( enlarged == (Image *)NULL )
+        {
+          CatchException(&exception);
+          (void) printf ( "Failed to enlarge original image\n" );
+          exit_status = 1;
+          goto program_exit;
+        }
+      DestroyImage( original );
+      original=enlarged;
+    }
+
+  /*
+   * Apply the operation on the CPU
+   */
+  reference = (Operations[operation].method)( original,
+    Operations[operation].argument, &exception );
+  if ( reference == (Image *)NULL )
+    {
+      CatchException(&exception);
+      (void) printf ( "Failed to %s image on the CPU\n",
+                      Operations[operation].name );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  /*
+   * Apply the operation with OpenCL
+   */
+  (void) SetOpenCLEnabled(MagickTrue);
+  kernels=CountKernels(devices,number_devices);
+  accelerated = (Operations[operation].method)( original,
+    Operations[operation].argument, &exception );
+  if ( accelerated == (Image *)NULL )
+    {
+      CatchException(&exception);
+      (void) printf ( "Failed to %s image with OpenCL\n",
+                      Operations[operation].name );
+      exit_status = 1;
+      goto program_exit;
+    }
+  if (expect_cpu)
+    {
+      if (CountKernels(devices,number_devices) != kernels)
+        {
+          (void) printf ( "%s of %lux%lu image ran an OpenCL kernel\n",
+                          Operations[operation].name, original->columns,
+                          original->rows );
+          exit_status = 1;
+          goto program_exit;
+        }
+    }
+  else if (CountKernels(devices,number_devices) == kernels)
+    {
+      (void) printf ( "%s of %lux%lu image did not run an OpenCL kernel\n",
+                      Operations[operation].name, original->columns,
+                      original->rows );
+      exit_status = 1;
+      goto program_exit;
+    }
+
+  /*
+   * Compare the two results, a square of half the smaller dimension lies
+   * well inside of a rotated image
+   */
+  if (Operations[operation].interior &&
+      ((CropInterior(&reference,Min(original->columns,original->rows)/2,
+                     &exception) == MagickFail) ||
+       (CropInterior(&accelerated,Min(original->columns,original->rows)/2,
+                     &exception) == MagickFail)))
+    {
+      CatchException(&exception);
+      (void) printf ( "Failed to crop the %s results\n",
+                      Operations[operation].name );
+      exit_status = 1;
+      goto program_exit;
+    }
+  if ( !IsImagesEqual(accelerated, reference ) &&
+       ((accelerated->error.normalized_mean_error >
+         Operations[operation].mean_error) ||
+        (accelerated->error.normalized_maximum_error >
+         Operations[operation].maximum_error)) )
+    {
+      (void) printf( "Q%d %s differs: mean error %g, maximum error %g\n",
+                     QuantumDepth, Operations[operation].name,
+                     accelerated->error.normalized_mean_error,
+                     accelerated->error.normalized_maximum_error );
+      exit_status = 1;
+    }
+#else
+  (void) check_profile;
+  (void) expect_cpu;
+  (void) factor;
+  (void) small;
+  (void) printf("OpenCL support is not available\n");
+  exit_status = 77;
+#endif
+
+ program_exit:
+  if (accelerated)
+    DestroyImage( accelerated );
+  if (reference)
+    DestroyImage( reference );
+  if (original)
+    DestroyImage( original );
+  DestroyImageInfo( imageInfo );
+  DestroyExceptionInfo( &exception );
+  DestroyMagick();
+
+#if defined(HAVE_OPENCL)
+  if (check_profile && (exit_status == 0))
+    {
+      if (getenv("MAGICK_OCL_PROFILE") == (char *) NULL)
+        {
+          (void) printf ( "MAGICK_OCL_PROFILE is not set\n" );
+          exit_status = 1;
+        }
+      else
+        exit_status=CheckProfileTrace(getenv("MAGICK_OCL_PROFILE"));
+    }
+#endif
+
+  return exit_status;
+}